@@ -0,0 +1,19 @@
+#!/bin/bash
+# Compares the vm's threaded dispatch with its switch fallback, given an
+# lc3 built normally and one built with -DLC3_SWITCH_DISPATCH.
+#   bench/dispatch.sh path/to/lc3 path/to/lc3_switch
+set -e
+
+cd "$(dirname "$0")"
+THREADED=$1
+SWITCH=$2
+
+for script in fib.lc3 arrays.lc3 hashes.lc3; do
+  for build in threaded switch; do
+    if [ "$build" = threaded ]; then lc3=$THREADED; else lc3=$SWITCH; fi
+    start=$(date +%s%N)
+    output=$("$lc3" --engine=vm "$script" | head -1)
+    end=$(date +%s%N)
+    printf "%-14s %-8s %8d ms  %s\n" "$script" "$build" $(((end - start) / 1000000)) "$output"
+  done
+done
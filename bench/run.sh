@@ -0,0 +1,18 @@
+#!/bin/bash
+# Runs every bench script with each engine and prints the wall time.
+#   bench/run.sh [path/to/lc3] [engines...]
+set -e
+
+cd "$(dirname "$0")"
+LC3=${1:-../build/lc3}
+shift || true
+ENGINES=${@:-eval vm closure}
+
+for script in *.lc3; do
+  for engine in $ENGINES; do
+    start=$(date +%s%N)
+    output=$("$LC3" --engine="$engine" "$script" | head -1)
+    end=$(date +%s%N)
+    printf "%-14s %-8s %8d ms  %s\n" "$script" "$engine" $(((end - start) / 1000000)) "$output"
+  done
+done
@@ -0,0 +1,705 @@
+#pragma once
+
+#include "ast.hpp"
+#include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+using namespace ast;
+
+namespace analysis {
+  // return false to skip the children of a node
+  typedef std::function<bool(const Rc<Node> &)> visitor_func;
+
+  // pre-order walk over every node below (and including) node
+  auto walk(const Rc<Node> &node, const visitor_func &visit) -> void {
+    if (node == nullptr || !visit(node)) {
+      return;
+    }
+
+    switch (node->type()) {
+    case NodeType::PROGRAM:
+      for (const auto &stmt : borrow_cast<Program>(node)->statements) {
+        walk(stmt, visit);
+      }
+      break;
+    case NodeType::BLOCKSTATEMENT:
+      for (const auto &stmt : borrow_cast<BlockStatement>(node)->statements) {
+        walk(stmt, visit);
+      }
+      break;
+    case NodeType::EXPRESSIONSTATEMENT:
+      walk(borrow_cast<ExpressionStatement>(node)->expression, visit);
+      break;
+    case NodeType::RETURNSTATEMENT:
+      walk(borrow_cast<ReturnStatement>(node)->value, visit);
+      break;
+    case NodeType::LETSTATEMENT: {
+      auto let = borrow_cast<LetStatement>(node);
+      walk(let->name, visit);
+      walk(let->value, visit);
+      break;
+    }
+    case NodeType::ASSIGNSTATEMENT: {
+      auto assign = borrow_cast<AssignStatement>(node);
+      walk(assign->target, visit);
+      walk(assign->value, visit);
+      break;
+    }
+    case NodeType::WHILESTATEMENT: {
+      auto while_stmt = borrow_cast<WhileStatement>(node);
+      walk(while_stmt->condition, visit);
+      walk(while_stmt->body, visit);
+      break;
+    }
+    case NodeType::FORSTATEMENT: {
+      auto for_stmt = borrow_cast<ForStatement>(node);
+      walk(for_stmt->variable, visit);
+      walk(for_stmt->iterable, visit);
+      walk(for_stmt->body, visit);
+      break;
+    }
+    case NodeType::PREFIXEXPRESSION:
+      walk(borrow_cast<PrefixExpression>(node)->right, visit);
+      break;
+    case NodeType::YIELDEXPRESSION:
+      walk(borrow_cast<YieldExpression>(node)->value, visit);
+      break;
+    case NodeType::INFIXEXPRESSION: {
+      auto infix = borrow_cast<InfixExpression>(node);
+      walk(infix->left, visit);
+      walk(infix->right, visit);
+      break;
+    }
+    case NodeType::IFEXPRESSION: {
+      auto if_expr = borrow_cast<IfExpression>(node);
+      walk(if_expr->condition, visit);
+      walk(if_expr->consequence, visit);
+      walk(if_expr->alternative, visit);
+      break;
+    }
+    case NodeType::FUNCTIONLITERAL: {
+      auto func = borrow_cast<FunctionLiteral>(node);
+      for (const auto &param : func->parameters) {
+        walk(param, visit);
+      }
+      walk(func->body, visit);
+      break;
+    }
+    case NodeType::MACROLITERAL: {
+      auto macro = borrow_cast<MacroLiteral>(node);
+      for (const auto &param : macro->parameters) {
+        walk(param, visit);
+      }
+      walk(macro->body, visit);
+      break;
+    }
+    case NodeType::CALLEXPRESSION: {
+      auto call = borrow_cast<CallExpression>(node);
+      walk(call->function, visit);
+      for (const auto &arg : call->arguments) {
+        walk(arg, visit);
+      }
+      break;
+    }
+    case NodeType::ARRAYLITERAL:
+      for (const auto &elem : borrow_cast<ArrayLiteral>(node)->elements) {
+        walk(elem, visit);
+      }
+      break;
+    case NodeType::INDEXEXPRESSION: {
+      auto index_expr = borrow_cast<IndexExpression>(node);
+      walk(index_expr->left, visit);
+      walk(index_expr->index, visit);
+      break;
+    }
+    case NodeType::HASHLITERAL:
+      for (const auto &pair : borrow_cast<HashLiteral>(node)->pairs) {
+        walk(pair.first, visit);
+        walk(pair.second, visit);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  auto is_quote_call(const Rc<Node> &node) -> bool {
+    return node->type() == NodeType::CALLEXPRESSION &&
+      borrow_cast<CallExpression>(node)->function->token_literal() == "quote";
+  }
+
+  // Only function (and macro) literals keep an environment alive past
+  // the call, unless the literal copies its free variables instead; quote
+  // is treated the same way to stay on the safe side. So does a yield,
+  // the environment of a generator lives as long as the generator.
+  auto may_capture(const Rc<Node> &node) -> bool {
+    bool captures = false;
+    walk(node, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::FUNCTIONLITERAL &&
+            borrow_cast<FunctionLiteral>(n)->closure == Closure::FREE_VARIABLES) {
+          return false;
+        }
+        if (n->type() == NodeType::FUNCTIONLITERAL ||
+            n->type() == NodeType::MACROLITERAL ||
+            n->type() == NodeType::YIELDEXPRESSION ||
+            is_quote_call(n)) {
+          captures = true;
+        }
+        return !captures;
+      });
+    return captures;
+  }
+
+  auto captures_environment(const Rc<BlockStatement> &body) -> bool {
+    if (body->capture == Capture::UNKNOWN) {
+      body->capture = may_capture(body) ? Capture::ENVIRONMENT : Capture::NONE;
+    }
+    return body->capture == Capture::ENVIRONMENT;
+  }
+
+  // a yield of its own (not of a literal in it) makes a function body a
+  // generator
+  auto is_generator(const Rc<BlockStatement> &body) -> bool {
+    if (body->yields == Yields::UNKNOWN) {
+      auto yields = false;
+      walk(body, [&](const Rc<Node> &n) {
+          if (n->type() == NodeType::YIELDEXPRESSION) {
+            yields = true;
+          }
+          return !yields && n->type() != NodeType::FUNCTIONLITERAL && n->type() != NodeType::MACROLITERAL && !is_quote_call(n);
+        });
+      body->yields = yields ? Yields::YIELDS : Yields::NONE;
+    }
+    return body->yields == Yields::YIELDS;
+  }
+
+  auto has_quote_or_macro(const Rc<Node> &node) -> bool {
+    bool found = false;
+    walk(node, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::MACROLITERAL || is_quote_call(n)) {
+          found = true;
+        }
+        return !found;
+      });
+    return found;
+  }
+
+  // Identifiers a function literal reads that it hasn't bound itself by
+  // the time it reads them. Only parameters and lets that are statements
+  // of the body itself are certain to be bound from there on: a read
+  // before such a let, or after one that only runs under an if or in a
+  // loop, may still see the enclosing binding.
+  auto free_variables(FunctionLiteral *func) -> set<string> {
+    set<string> bound = {};
+    set<string> free = {};
+    for (const auto &param : func->parameters) {
+      bound.insert(param->value);
+    }
+
+    auto read = [&](const string &name) {
+      if (bound.count(name) == 0) {
+        free.insert(name);
+      }
+    };
+    visitor_func visit = [&](const Rc<Node> &n) {
+      switch (n->type()) {
+      case NodeType::IDENTIFIER:
+        read(borrow_cast<Identifier>(n)->value);
+        return false;
+      case NodeType::LETSTATEMENT:
+        walk(borrow_cast<LetStatement>(n)->value, visit);
+        return false;
+      case NodeType::FORSTATEMENT: {
+        // the variable is bound for the body only
+        auto for_stmt = borrow_cast<ForStatement>(n);
+        walk(for_stmt->iterable, visit);
+        auto added = bound.insert(for_stmt->variable->value).second;
+        walk(for_stmt->body, visit);
+        if (added) {
+          bound.erase(for_stmt->variable->value);
+        }
+        return false;
+      }
+      case NodeType::FUNCTIONLITERAL:
+        for (const auto &name : free_variables(borrow_cast<FunctionLiteral>(n))) {
+          read(name);
+        }
+        return false;
+      default:
+        return true;
+      }
+    };
+    for (const auto &stmt : func->body->statements) {
+      walk(stmt, visit);
+      if (stmt->type() == NodeType::LETSTATEMENT) {
+        bound.insert(borrow_cast<LetStatement>(stmt)->name->value);
+      }
+    }
+    return free;
+  }
+
+  // names whose value an assignment changes anywhere below node,
+  // function literals and quoted code included
+  auto assigned_names(const Rc<Node> &node) -> set<string> {
+    set<string> names = {};
+    walk(node, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::ASSIGNSTATEMENT) {
+          auto variable = borrow_cast<AssignStatement>(n)->variable();
+          if (variable != nullptr) {
+            names.insert(variable->value);
+          }
+        }
+        return true;
+      });
+    return names;
+  }
+
+  // A function body (or the program, which has no parent) while its
+  // literals are being resolved.
+  struct Scope {
+    const Scope *parent;
+    set<string> parameters;
+    map<string, size_t> lets;          // let statements binding each name
+    map<string, size_t> let_positions; // lets that are statements of the body itself
+    size_t position;                   // the statement being resolved
+    const set<string> *assigned;       // names assigned anywhere in the program
+  };
+
+  // A literal can copy a variable of an enclosing function if its value is
+  // settled by the time the literal is evaluated: a parameter that is never
+  // rebound, or a single let that is an earlier statement of that body.
+  // Nothing assigned is settled, not even by an assignment in another
+  // literal.
+  auto plan_closure(FunctionLiteral *func, const Scope &scope) -> void {
+    func->closure = Closure::ENVIRONMENT;
+    func->captured.clear();
+    if (has_quote_or_macro(func->body)) {
+      return;
+    }
+
+    vector<string> captured = {};
+    for (const auto &name : free_variables(func)) {
+      auto assigned = scope.assigned->count(name) > 0;
+      for (auto s = &scope; s->parent != nullptr; s = s->parent) {
+        auto lets = s->lets.find(name);
+        auto let_count = lets == s->lets.end() ? 0 : lets->second;
+        if (s->parameters.count(name) > 0) {
+          if (let_count > 0 || assigned) {
+            return;
+          }
+          captured.push_back(name);
+          break;
+        }
+        if (let_count > 0) {
+          auto position = s->let_positions.find(name);
+          if (assigned || let_count > 1 || position == s->let_positions.end() || position->second >= s->position) {
+            return;
+          }
+          captured.push_back(name);
+          break;
+        }
+      }
+    }
+
+    func->closure = Closure::FREE_VARIABLES;
+    func->captured = captured;
+  }
+
+  // whether an enclosing function binds name
+  auto binds(const Scope &scope, const string &name) -> bool {
+    for (auto s = &scope; s->parent != nullptr; s = s->parent) {
+      if (s->parameters.count(name) > 0 || s->lets.count(name) > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto resolve_scope(const vector<Rc<Statement>> &statements, Scope &scope) -> void {
+    for (size_t i = 0; i < statements.size(); i++) {
+      walk(statements[i], [&](const Rc<Node> &n) {
+          if (n->type() == NodeType::FUNCTIONLITERAL || n->type() == NodeType::MACROLITERAL || is_quote_call(n)) {
+            return false;
+          }
+          if (n->type() == NodeType::LETSTATEMENT) {
+            auto name = borrow_cast<LetStatement>(n)->name->value;
+            scope.lets[name]++;
+            if (n.get() == statements[i].get()) {
+              scope.let_positions[name] = i;
+            }
+          }
+          // a loop variable is rebound every iteration, it has no position
+          // where its value is settled
+          if (n->type() == NodeType::FORSTATEMENT) {
+            scope.lets[borrow_cast<ForStatement>(n)->variable->value]++;
+          }
+          return true;
+        });
+    }
+
+    for (size_t i = 0; i < statements.size(); i++) {
+      scope.position = i;
+      walk(statements[i], [&](const Rc<Node> &n) {
+          // macros and quoted code are evaluated elsewhere, their literals
+          // stay UNKNOWN and keep the whole environment
+          if (n->type() == NodeType::MACROLITERAL || is_quote_call(n)) {
+            return false;
+          }
+          if (n->type() == NodeType::FUNCTIONLITERAL) {
+            auto func = borrow_cast<FunctionLiteral>(n);
+            plan_closure(func, scope);
+
+            Scope inner = { &scope, {}, {}, {}, 0, scope.assigned };
+            for (const auto &param : func->parameters) {
+              inner.parameters.insert(param->value);
+            }
+            resolve_scope(func->body->statements, inner);
+            return false;
+          }
+          if (n->type() == NodeType::LETSTATEMENT) {
+            auto let = borrow_cast<LetStatement>(n);
+            if (let->value->type() == NodeType::FUNCTIONLITERAL) {
+              borrow_cast<FunctionLiteral>(let->value)->body->name = let->name->value;
+            }
+          }
+          if (n->type() == NodeType::CALLEXPRESSION) {
+            auto call = borrow_cast<CallExpression>(n);
+            call->global_callee = call->function->type() == NodeType::IDENTIFIER &&
+              !binds(scope, borrow_cast<Identifier>(call->function)->value);
+          }
+          return true;
+        });
+    }
+  }
+
+  // plans every function literal of a program evaluated in a root
+  // environment
+  auto resolve_closures(Program *program) -> void {
+    auto assigned = assigned_names(Rc<Node>(program));
+    Scope global = { nullptr, {}, {}, {}, 0, &assigned };
+    resolve_scope(program->statements, global);
+  }
+
+  // a node kind in a shape, infix and prefix nodes with their operator
+  auto shape_kind(const Rc<Node> &node) -> string {
+    if (node == nullptr) {
+      return "";
+    }
+    switch (node->type()) {
+    case NodeType::IDENTIFIER:
+      return "name";
+    case NodeType::INTEGERLITERAL:
+      return "int";
+    case NodeType::STRINGLITERAL:
+      return "string";
+    case NodeType::BOOLEAN:
+      return "bool";
+    case NodeType::PREFIXEXPRESSION:
+      return "prefix " + borrow_cast<PrefixExpression>(node)->prefix_operator;
+    case NodeType::INFIXEXPRESSION:
+      return "infix " + borrow_cast<InfixExpression>(node)->infix_operator;
+    case NodeType::IFEXPRESSION:
+      return "if";
+    case NodeType::FUNCTIONLITERAL:
+      return "fn";
+    case NodeType::MACROLITERAL:
+      return "macro";
+    case NodeType::CALLEXPRESSION:
+      return "call";
+    case NodeType::ARRAYLITERAL:
+      return "array";
+    case NodeType::INDEXEXPRESSION:
+      return "index";
+    case NodeType::HASHLITERAL:
+      return "hash";
+    default:
+      return "statement";
+    }
+  }
+
+  // a node with the kinds of the children that make its shape, nothing
+  // for a node without any
+  auto shape(const Rc<Node> &node) -> string {
+    switch (node->type()) {
+    case NodeType::PREFIXEXPRESSION: {
+      auto prefix = borrow_cast<PrefixExpression>(node);
+      return prefix->prefix_operator + "(" + shape_kind(prefix->right) + ")";
+    }
+    case NodeType::INFIXEXPRESSION: {
+      auto infix = borrow_cast<InfixExpression>(node);
+      return "(" + shape_kind(infix->left) + ") " + infix->infix_operator + " (" + shape_kind(infix->right) + ")";
+    }
+    case NodeType::IFEXPRESSION:
+      return "if (" + shape_kind(borrow_cast<IfExpression>(node)->condition) + ")";
+    case NodeType::INDEXEXPRESSION: {
+      auto index_expr = borrow_cast<IndexExpression>(node);
+      return "(" + shape_kind(index_expr->left) + ")[" + shape_kind(index_expr->index) + "]";
+    }
+    case NodeType::CALLEXPRESSION:
+      return "(" + shape_kind(borrow_cast<CallExpression>(node)->function) + ")(...)";
+    case NodeType::RETURNSTATEMENT:
+      return "return (" + shape_kind(borrow_cast<ReturnStatement>(node)->value) + ")";
+    case NodeType::LETSTATEMENT:
+      return "let = (" + shape_kind(borrow_cast<LetStatement>(node)->value) + ")";
+    default:
+      return "";
+    }
+  }
+
+  // how often each shape occurs below node, the profile analysis::fuse
+  // was picked from
+  auto profile_shapes(const Rc<Node> &node, map<string, size_t> &profile) -> void {
+    walk(node, [&](const Rc<Node> &n) {
+        auto s = shape(n);
+        if (!s.empty()) {
+          profile[s]++;
+        }
+        return true;
+      });
+  }
+
+  auto is_comparison(Operator op) -> bool {
+    return op == Operator::LT || op == Operator::GT || op == Operator::EQ || op == Operator::NOT_EQ;
+  }
+
+  auto is_name(const Rc<Expression> &expr, const string &name) -> bool {
+    return expr->type() == NodeType::IDENTIFIER && borrow_cast<Identifier>(expr)->value == name;
+  }
+
+  // let name = f(name, ...) or let name = name + ..., eval may hand the
+  // old value over instead of keeping it bound (see eval::eval_rebinding)
+  auto rebinds(const string &name, const Rc<Expression> &value) -> bool {
+    if (value->type() == NodeType::CALLEXPRESSION) {
+      const auto &args = borrow_cast<CallExpression>(value)->arguments;
+      return !args.empty() && is_name(args[0], name);
+    }
+    if (value->type() == NodeType::INFIXEXPRESSION) {
+      auto infix = borrow_cast<InfixExpression>(value);
+      return infix->op == Operator::PLUS && is_name(infix->left, name);
+    }
+    return false;
+  }
+
+  // Marks the shapes eval runs as one unit, the most frequent ones of
+  // --profile-shapes over bench/*.lc3 and lib/std.lc3 that have a cheaper
+  // combined form. Marking is purely structural, so it is safe for code
+  // that is only evaluated later, like quoted code.
+  auto fuse(Program *program) -> void {
+    auto compare_branch = [](const Rc<Expression> &condition) {
+      return condition->type() == NodeType::INFIXEXPRESSION &&
+        is_comparison(borrow_cast<InfixExpression>(condition)->op) ? Fused::COMPARE_BRANCH : Fused::NONE;
+    };
+    visitor_func mark = [&](const Rc<Node> &n) {
+        switch (n->type()) {
+        case NodeType::IFEXPRESSION: {
+          auto if_expr = borrow_cast<IfExpression>(n);
+          if_expr->fused = compare_branch(if_expr->condition);
+          break;
+        }
+        case NodeType::WHILESTATEMENT: {
+          auto while_stmt = borrow_cast<WhileStatement>(n);
+          while_stmt->fused = compare_branch(while_stmt->condition);
+          break;
+        }
+        case NodeType::INFIXEXPRESSION: {
+          auto infix = borrow_cast<InfixExpression>(n);
+          if (infix->left->type() == NodeType::IDENTIFIER && infix->right->type() == NodeType::INTEGERLITERAL &&
+              infix->op != Operator::BANG && infix->op != Operator::UNKNOWN) {
+            infix->fused = Fused::NAME_CONSTANT;
+          }
+          break;
+        }
+        case NodeType::INDEXEXPRESSION: {
+          auto index_expr = borrow_cast<IndexExpression>(n);
+          if (index_expr->left->type() == NodeType::IDENTIFIER) {
+            index_expr->fused = Fused::NAME_INDEX;
+          }
+          break;
+        }
+        case NodeType::LETSTATEMENT: {
+          auto let = borrow_cast<LetStatement>(n);
+          let->rebinds = rebinds(let->name->value, let->value);
+          break;
+        }
+        case NodeType::ASSIGNSTATEMENT: {
+          auto assign = borrow_cast<AssignStatement>(n);
+          auto target = assign->target;
+          assign->rebinds = target->type() == NodeType::IDENTIFIER && rebinds(borrow_cast<Identifier>(target)->value, assign->value);
+          break;
+        }
+        default:
+          break;
+        }
+        return true;
+      };
+    for (const auto &stmt : program->statements) {
+      walk(stmt, mark);
+    }
+  }
+
+  // Slots for the parameters and lets of a function body, the frame
+  // layout of the compiled engines. A let is only known to be bound once
+  // its first let that is a statement of the body itself has run, a read
+  // before that has to check the slot and otherwise look the name up.
+  class Locals {
+  public:
+    map<string, uint32_t> slots = {};
+    set<string> parameters = {};
+    map<string, size_t> first_lets = {};
+    size_t count = 0;
+
+    Locals() {};
+
+    Locals(const vector<Rc<Identifier>> &params, BlockStatement *body) {
+      for (size_t i = 0; i < params.size(); i++) {
+        this->slots[params[i]->value] = static_cast<uint32_t>(i);
+        this->parameters.insert(params[i]->value);
+      }
+      this->count = params.size();
+
+      const auto &stmts = body->statements;
+      for (size_t i = 0; i < stmts.size(); i++) {
+        walk(stmts[i], [&](const Rc<Node> &n) {
+            if (n->type() == NodeType::FUNCTIONLITERAL) {
+              return false;
+            }
+            if (n->type() == NodeType::LETSTATEMENT) {
+              const auto &name = borrow_cast<LetStatement>(n)->name->value;
+              if (this->slots.count(name) == 0) {
+                this->slots[name] = static_cast<uint32_t>(this->count++);
+              }
+              if (n.get() == stmts[i].get()) {
+                this->first_lets.emplace(name, i);
+              }
+            }
+            return true;
+          });
+      }
+    }
+
+    auto find(const string &name) -> int64_t {
+      auto slot = this->slots.find(name);
+      return slot == this->slots.end() ? -1 : static_cast<int64_t>(slot->second);
+    }
+
+    // the slot of a local certainly bound while statement position of the
+    // body runs, or -1
+    auto bound(const string &name, size_t position) -> int64_t {
+      auto slot = this->find(name);
+      if (slot < 0 || this->parameters.count(name) > 0) {
+        return slot;
+      }
+      auto first = this->first_lets.find(name);
+      if (first != this->first_lets.end() && first->second < position) {
+        return slot;
+      }
+      return -1;
+    }
+  };
+
+  auto occurrences(const Rc<Node> &node, const string &name) -> size_t {
+    size_t count = 0;
+    walk(node, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::IDENTIFIER && borrow_cast<Identifier>(n)->value == name) {
+          count++;
+        }
+        return true;
+      });
+    return count;
+  }
+
+  // the expressions whose value a call of body returns: what the last
+  // statement and every return statement give, through the branches of an if
+  auto tail_expressions(const Rc<BlockStatement> &body) -> vector<Rc<Expression>> {
+    vector<Rc<Expression>> tails = {};
+    function<void(const Rc<Expression> &)> tail = [&](const Rc<Expression> &expr) {
+      if (expr->type() != NodeType::IFEXPRESSION) {
+        tails.push_back(expr);
+        return;
+      }
+      auto if_expr = borrow_cast<IfExpression>(expr);
+      for (const auto &branch : { if_expr->consequence, if_expr->alternative }) {
+        if (branch != nullptr && !branch->statements.empty() &&
+            branch->statements.back()->type() == NodeType::EXPRESSIONSTATEMENT) {
+          tail(borrow_cast<ExpressionStatement>(branch->statements.back())->expression);
+        }
+      }
+    };
+
+    if (!body->statements.empty() && body->statements.back()->type() == NodeType::EXPRESSIONSTATEMENT) {
+      tail(borrow_cast<ExpressionStatement>(body->statements.back())->expression);
+    }
+    walk(body, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::FUNCTIONLITERAL || n->type() == NodeType::MACROLITERAL || is_quote_call(n)) {
+          return false;
+        }
+        if (n->type() == NodeType::RETURNSTATEMENT) {
+          tail(borrow_cast<ReturnStatement>(n)->value);
+        }
+        return true;
+      });
+    return tails;
+  }
+
+  // Marks the reads of a function's parameters and lets that are the last
+  // thing a call does with them: the only read of the name in a tail
+  // expression. eval moves such a value out of the dying call environment
+  // rather than copying it, so the accumulator of loop(push(acc, n), n - 1)
+  // stays unique. Bodies that may capture their environment are left
+  // alone, as is a node the program reaches twice (macro expansions share
+  // nodes); eval checks it runs a call of the marked body itself.
+  auto mark_last_uses(Program *program) -> void {
+    map<Identifier *, size_t> reached = {};
+    vector<pair<Identifier *, BlockStatement *>> marks = {};
+    visitor_func mark = [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::IDENTIFIER) {
+          auto id = borrow_cast<Identifier>(n);
+          id->last_use = nullptr;
+          reached[id]++;
+        }
+        if (n->type() != NodeType::FUNCTIONLITERAL) {
+          return true;
+        }
+        auto func = borrow_cast<FunctionLiteral>(n);
+        if (captures_environment(func->body)) {
+          return true;
+        }
+        Locals locals(func->parameters, func->body.get());
+        walk(func->body, [&](const Rc<Node> &m) {
+            if (m->type() == NodeType::FORSTATEMENT) {
+              locals.slots.emplace(borrow_cast<ForStatement>(m)->variable->value, 0);
+            }
+            return m->type() != NodeType::FUNCTIONLITERAL;
+          });
+        for (const auto &expr : tail_expressions(func->body)) {
+          walk(expr, [&](const Rc<Node> &m) {
+              if (m->type() == NodeType::FUNCTIONLITERAL || m->type() == NodeType::MACROLITERAL || is_quote_call(m)) {
+                return false;
+              }
+              if (m->type() == NodeType::IDENTIFIER) {
+                auto id = borrow_cast<Identifier>(m);
+                if (locals.find(id->value) >= 0 && occurrences(expr, id->value) == 1) {
+                  marks.push_back(make_pair(id, func->body.get()));
+                }
+              }
+              return true;
+            });
+        }
+        return true;
+      };
+    for (const auto &stmt : program->statements) {
+      walk(stmt, mark);
+    }
+    for (const auto &m : marks) {
+      if (reached[m.first] == 1) {
+        m.first->last_use = m.second;
+      }
+    }
+  }
+}
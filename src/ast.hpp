@@ -1,7 +1,9 @@
 #pragma once
 
 #include "token.hpp"
+#include "rc.hpp"
 #include <memory>
+#include <map>
 #include <vector>
 #include <algorithm>
 #include <range/v3/all.hpp>
@@ -14,6 +16,7 @@
 using namespace std;
 using namespace fmt;
 using namespace ranges;
+using namespace rc;
 
 namespace ast {
   enum class NodeType : size_t {
@@ -36,10 +39,14 @@ namespace ast {
     ARRAYLITERAL,
     INDEXEXPRESSION,
     HASHLITERAL,
-    MACROLITERAL
+    MACROLITERAL,
+    WHILESTATEMENT,
+    FORSTATEMENT,
+    ASSIGNSTATEMENT,
+    YIELDEXPRESSION
   };
 
-  class Node {
+  class Node : public RefCounted {
   public:
     token::Token token;
 
@@ -87,13 +94,13 @@ namespace ast {
     }
   };
 
-  auto flatten_expressions(vector<shared_ptr<Expression>> strs) -> string {
+  auto flatten_expressions(vector<Rc<Expression>> strs) -> string {
     if (strs.size() == 0) {
       return "";
     } else if (strs.size() == 1) {
       return strs[0]->to_string();
     } else {
-      vector<string> literals = strs | view::take(strs.size() - 1) | view::transform([](shared_ptr<Expression> a) {
+      vector<string> literals = strs | view::take(strs.size() - 1) | view::transform([](Rc<Expression> a) {
           auto s = a->to_string();
           s += ",";
           return s;
@@ -105,8 +112,8 @@ namespace ast {
 
   class Program : public Node {
   public:
-    vector<shared_ptr<Statement>> statements = {};
-    explicit Program(const vector<shared_ptr<Statement>> &stms): statements(stms) {};
+    vector<Rc<Statement>> statements = {};
+    explicit Program(const vector<Rc<Statement>> &stms): statements(stms) {};
 
     NodeType type() {
       return NodeType::PROGRAM;
@@ -122,7 +129,7 @@ namespace ast {
 
     string to_string() {
       string s("");
-      std::for_each(statements.cbegin(), statements.cend(), [&](shared_ptr<Statement> stm) {
+      std::for_each(statements.cbegin(), statements.cend(), [&](Rc<Statement> stm) {
           s += stm->to_string();
         });
       return s;
@@ -132,6 +139,13 @@ namespace ast {
   class Identifier : public Expression {
   public:
     string value;
+    // a parameter of the enclosing function as the optimized tier found
+    // it (see tier.hpp): that parameter's node and its slot
+    const Identifier *parameter = nullptr;
+    size_t slot = 0;
+    // the function body this read is the last use of a local in (see
+    // analysis::mark_last_uses)
+    const Node *last_use = nullptr;
 
     Identifier(const token::Token &t, const string &v): Expression(t), value(v) {};
 
@@ -209,15 +223,84 @@ namespace ast {
     }
   };
 
+  // Resolved once, when the parser builds the node, so evaluation never
+  // compares operator strings.
+  enum class Operator : uint8_t {
+    PLUS,
+    MINUS,
+    ASTERISK,
+    SLASH,
+    LT,
+    GT,
+    EQ,
+    NOT_EQ,
+    BANG,
+    UNKNOWN
+  };
+
+  const size_t OPERATORS = static_cast<size_t>(Operator::UNKNOWN) + 1;
+
+  auto resolve_operator(const string &o) -> Operator {
+    static const map<string, Operator> operators = {
+      { token::PLUS, Operator::PLUS },
+      { token::MINUS, Operator::MINUS },
+      { token::ASTERISK, Operator::ASTERISK },
+      { token::SLASH, Operator::SLASH },
+      { token::LT, Operator::LT },
+      { token::GT, Operator::GT },
+      { token::EQ, Operator::EQ },
+      { token::NOT_EQ, Operator::NOT_EQ },
+      { token::BANG, Operator::BANG }
+    };
+    auto op = operators.find(o);
+    return op == operators.end() ? Operator::UNKNOWN : op->second;
+  }
+
+  auto operator_string(Operator op) -> string {
+    static const vector<string> strings = { "+", "-", "*", "/", "<", ">", "==", "!=", "!", "?" };
+    return strings[static_cast<size_t>(op)];
+  }
+
+  // What an infix, index or call node specialized itself to on its first
+  // execution (see eval). A failed guard sends it to the generic path for
+  // good.
+  enum class Quickened : uint8_t {
+    UNSEEN,
+    GENERIC,
+    INTEGERS,          // int op int
+    INTEGER_CONSTANT,  // int op integer literal, the literal isn't evaluated
+    ARRAY_INTEGER,     // array[int]
+    FUNCTION,          // call of a function
+    BUILTIN            // call of a builtin
+  };
+
+  // Shapes eval runs as a single unit, marked by analysis::fuse
+  enum class Fused : uint8_t {
+    NONE,
+    COMPARE_BRANCH,  // if (a < b) and while (a < b), the comparison picks the branch
+    NAME_CONSTANT,   // name op integer literal
+    NAME_INDEX       // name[...]
+  };
+
+  // How far tier.hpp has promoted a function body
+  enum class Tier : uint8_t {
+    WALK,       // evaluated as parsed
+    OPTIMIZED,  // constants folded, parameters resolved to their slots
+    NATIVE      // compiled by the jit
+  };
+
   class PrefixExpression : public Expression {
   public:
     string prefix_operator;
-    shared_ptr<Expression> right;
+    Operator op;
+    // the value the optimized tier folded it to
+    Rc<RefCounted> constant = nullptr;
+    Rc<Expression> right;
 
     PrefixExpression(const token::Token &t,
                      const string &o,
-                     shared_ptr<Expression> r)
-      : Expression(t), prefix_operator(o), right(r) {};
+                     Rc<Expression> r)
+      : Expression(t), prefix_operator(o), op(resolve_operator(o)), right(r) {};
 
     NodeType type() {
       return NodeType::PREFIXEXPRESSION;
@@ -239,15 +322,20 @@ namespace ast {
 
   class InfixExpression : public Expression {
   public:
-    shared_ptr<Expression> left;
+    Rc<Expression> left;
     string infix_operator;
-    shared_ptr<Expression> right;
+    Operator op;
+    // the value the optimized tier folded it to
+    Rc<RefCounted> constant = nullptr;
+    Rc<Expression> right;
+    Quickened quickened = Quickened::UNSEEN;
+    Fused fused = Fused::NONE;
 
     InfixExpression(const token::Token &t,
-                    shared_ptr<Expression> l,
+                    Rc<Expression> l,
                     const string &o,
-                    shared_ptr<Expression> r)
-      : Expression(t), left(l), infix_operator(o), right(r) {};
+                    Rc<Expression> r)
+      : Expression(t), left(l), infix_operator(o), op(resolve_operator(o)), right(r) {};
 
     NodeType type() {
       return NodeType::INFIXEXPRESSION;
@@ -272,12 +360,14 @@ namespace ast {
 
   class LetStatement : public Statement {
   public:
-    shared_ptr<Identifier> name;
-    shared_ptr<Expression> value;
+    Rc<Identifier> name;
+    Rc<Expression> value;
+    // value is a call or + on the old value of name (see analysis::fuse)
+    bool rebinds = false;
 
     LetStatement(const token::Token &t,
-                 shared_ptr<Identifier> n,
-                 shared_ptr<Expression> v)
+                 Rc<Identifier> n,
+                 Rc<Expression> v)
       : Statement(t), name(n), value(v) {};
 
     NodeType type() {
@@ -303,10 +393,10 @@ namespace ast {
 
   class ReturnStatement : public Statement {
   public:
-    shared_ptr<Expression> value;
+    Rc<Expression> value;
 
     ReturnStatement(const token::Token &t,
-                    shared_ptr<Expression> v)
+                    Rc<Expression> v)
       : Statement(t), value(v) {};
 
     NodeType type() {
@@ -329,13 +419,42 @@ namespace ast {
     }
   };
 
+  // Hands a value to whoever consumes the generator the function is the
+  // body of, and waits to be resumed
+  class YieldExpression : public Expression {
+  public:
+    Rc<Expression> value;
+
+    YieldExpression(const token::Token &t,
+                    Rc<Expression> v)
+      : Expression(t), value(v) {};
+
+    NodeType type() {
+      return NodeType::YIELDEXPRESSION;
+    }
+
+    string token_literal() {
+      return this->token.literal;
+    }
+
+    string to_string() {
+      string s("");
+      s += "(";
+      s += this->token_literal();
+      s += " ";
+      s += this->value->to_string();
+      s += ")";
+      return s;
+    }
+  };
+
   // Just a statement wrapper for toplevel expressions
   class ExpressionStatement : public Statement {
   public:
-    shared_ptr<Expression> expression;
+    Rc<Expression> expression;
 
     ExpressionStatement(const token::Token &t,
-                        shared_ptr<Expression> expr)
+                        Rc<Expression> expr)
       : Statement(t), expression(expr) {};
 
     NodeType type() {
@@ -355,12 +474,44 @@ namespace ast {
     }
   };
 
+  // whether evaluating a function body can leave references to its call
+  // environment behind, worked out on first call (see analysis.hpp)
+  enum class Capture : size_t {
+    UNKNOWN,
+    NONE,
+    ENVIRONMENT
+  };
+
+  enum class Yields : uint8_t {
+    UNKNOWN,
+    NONE,
+    YIELDS
+  };
+
   class BlockStatement : public Statement {
   public:
-    vector<shared_ptr<Statement>> statements;
+    vector<Rc<Statement>> statements;
+    Capture capture = Capture::UNKNOWN;
+    // whether a call of the function makes a generator, see
+    // analysis::is_generator
+    Yields yields = Yields::UNKNOWN;
+    // compiled forms of a function body, made on its first call from the
+    // vm (see compiler.hpp) or the closure compiler
+    Rc<RefCounted> code = nullptr;
+    bool uncompilable = false;
+    Rc<RefCounted> callable = nullptr;
+    bool uncallable = false;
+    // calls seen by the eval engine, the tier they promoted the body to
+    // (see tier.hpp) and its native code from the jit
+    uint32_t calls = 0;
+    Tier tier = Tier::WALK;
+    Rc<RefCounted> native = nullptr;
+    bool unjittable = false;
+    // the name a let binds the function to, for traces
+    string name = "";
 
     BlockStatement(const token::Token &t,
-                   const vector<shared_ptr<Statement>> &stms)
+                   const vector<Rc<Statement>> &stms)
       : Statement(t), statements(stms) {};
 
     NodeType type() {
@@ -376,7 +527,7 @@ namespace ast {
         return statements[0]->to_string();
       } else {
         vector<string> strs = statements
-          | view::transform([](shared_ptr<Statement> stmt) {
+          | view::transform([](Rc<Statement> stmt) {
               return "  " + stmt->to_string();
             });
         string s = strs | view::join('\n');
@@ -385,16 +536,79 @@ namespace ast {
     }
   };
 
+  class WhileStatement : public Statement {
+  public:
+    Rc<Expression> condition;
+    Rc<BlockStatement> body;
+    Fused fused = Fused::NONE;
+
+    WhileStatement(const token::Token &t,
+                   Rc<Expression> cond,
+                   Rc<BlockStatement> b)
+      : Statement(t), condition(cond), body(b) {};
+
+    NodeType type() {
+      return NodeType::WHILESTATEMENT;
+    }
+
+    string token_literal() {
+      return this->token.literal;
+    }
+
+    string to_string() {
+      string s("");
+      s += "while";
+      s += this->condition->to_string();
+      s += " ";
+      s += this->body->to_string();
+      return s;
+    }
+  };
+
+  // for (variable in iterable) { body }
+  class ForStatement : public Statement {
+  public:
+    Rc<Identifier> variable;
+    Rc<Expression> iterable;
+    Rc<BlockStatement> body;
+
+    ForStatement(const token::Token &t,
+                 Rc<Identifier> v,
+                 Rc<Expression> it,
+                 Rc<BlockStatement> b)
+      : Statement(t), variable(v), iterable(it), body(b) {};
+
+    NodeType type() {
+      return NodeType::FORSTATEMENT;
+    }
+
+    string token_literal() {
+      return this->token.literal;
+    }
+
+    string to_string() {
+      string s("");
+      s += "for(";
+      s += this->variable->to_string();
+      s += " in ";
+      s += this->iterable->to_string();
+      s += ") ";
+      s += this->body->to_string();
+      return s;
+    }
+  };
+
   class IfExpression : public Expression {
   public:
-    shared_ptr<Expression> condition;
-    shared_ptr<BlockStatement> consequence;
-    shared_ptr<BlockStatement> alternative;
+    Rc<Expression> condition;
+    Rc<BlockStatement> consequence;
+    Rc<BlockStatement> alternative;
+    Fused fused = Fused::NONE;
 
     IfExpression(const token::Token &t,
-                 shared_ptr<Expression> cond,
-                 shared_ptr<BlockStatement> cons,
-                 shared_ptr<BlockStatement> alt)
+                 Rc<Expression> cond,
+                 Rc<BlockStatement> cons,
+                 Rc<BlockStatement> alt)
       : Expression(t),
         condition(cond),
         consequence(cons),
@@ -422,14 +636,26 @@ namespace ast {
     }
   };
 
+  // what a function literal closes over, worked out per program (see
+  // analysis.hpp)
+  enum class Closure : size_t {
+    UNKNOWN,
+    ENVIRONMENT,
+    FREE_VARIABLES
+  };
+
   class FunctionLiteral : public Expression {
   public:
-    vector<shared_ptr<Identifier>> parameters;
-    shared_ptr<BlockStatement> body;
+    vector<Rc<Identifier>> parameters;
+    Rc<BlockStatement> body;
+    Closure closure = Closure::UNKNOWN;
+    // for FREE_VARIABLES: the ones bound in enclosing functions, the rest
+    // are globals
+    vector<string> captured = {};
 
     FunctionLiteral(const token::Token &t,
-                    const vector<shared_ptr<Identifier>> &ps,
-                    shared_ptr<BlockStatement> b)
+                    const vector<Rc<Identifier>> &ps,
+                    Rc<BlockStatement> b)
       : Expression(t), parameters(ps), body(b) {};
 
     NodeType type() {
@@ -444,7 +670,7 @@ namespace ast {
       string s("");
 
       string literal = flatten_expressions(parameters
-                                           | view::transform([](shared_ptr<Identifier> a) {
+                                           | view::transform([](Rc<Identifier> a) {
                                                return static_pointer_cast<Expression>(a);
                                              }));
 
@@ -460,12 +686,24 @@ namespace ast {
 
   class CallExpression : public Expression {
   public:
-    shared_ptr<Expression> function;
-    vector<shared_ptr<Expression>> arguments;
+    Rc<Expression> function;
+    vector<Rc<Expression>> arguments;
+    Quickened quickened = Quickened::UNSEEN;
+    // set by analysis::resolve_closures when the callee is a name that no
+    // enclosing function binds, it can only resolve in the root environment
+    bool global_callee = false;
+    // eval's inline cache of a global callee: what it resolved to while
+    // the root environment cached_root was at cached_version, and the
+    // frame it needs
+    const RefCounted *cached_root = nullptr;
+    uint64_t cached_version = 0;
+    RefCounted *cached_callee = nullptr;
+    bool cached_on_stack = false;
+    size_t cached_slots = 0;
 
     CallExpression(const token::Token &t,
-                   shared_ptr<Expression> f,
-                   const vector<shared_ptr<Expression>> &args)
+                   Rc<Expression> f,
+                   const vector<Rc<Expression>> &args)
       : Expression(t), function(f), arguments(args) {};
 
     NodeType type() {
@@ -491,10 +729,10 @@ namespace ast {
 
   class ArrayLiteral : public Expression {
   public:
-    vector<shared_ptr<Expression>> elements;
+    vector<Rc<Expression>> elements;
 
     ArrayLiteral(const token::Token &t,
-                 const vector<shared_ptr<Expression>> &elems)
+                 const vector<Rc<Expression>> &elems)
       : Expression(t), elements(elems) {};
 
     NodeType type() {
@@ -519,12 +757,14 @@ namespace ast {
 
   class IndexExpression : public Expression {
   public:
-    shared_ptr<Expression> left;
-    shared_ptr<Expression> index;
+    Rc<Expression> left;
+    Rc<Expression> index;
+    Quickened quickened = Quickened::UNSEEN;
+    Fused fused = Fused::NONE;
 
     IndexExpression(const token::Token &t,
-                    shared_ptr<Expression> l,
-                    shared_ptr<Expression> i)
+                    Rc<Expression> l,
+                    Rc<Expression> i)
       : Expression(t), left(l), index(i) {};
 
     NodeType type() {
@@ -547,12 +787,55 @@ namespace ast {
     }
   };
 
+  // x = value, or a[i] = value and h[k] = value for a target that indexes
+  // a name
+  class AssignStatement : public Statement {
+  public:
+    Rc<Expression> target;
+    Rc<Expression> value;
+    // as in LetStatement
+    bool rebinds = false;
+
+    AssignStatement(const token::Token &t,
+                    Rc<Expression> tgt,
+                    Rc<Expression> v)
+      : Statement(t), target(tgt), value(v) {};
+
+    NodeType type() {
+      return NodeType::ASSIGNSTATEMENT;
+    }
+
+    // the variable whose value changes, the name the target indexes
+    auto variable() -> Identifier * {
+      auto target = this->target.get();
+      while (target->type() == NodeType::INDEXEXPRESSION) {
+        target = static_cast<IndexExpression *>(target)->left.get();
+      }
+      return target->type() == NodeType::IDENTIFIER ? static_cast<Identifier *>(target) : nullptr;
+    }
+
+    string token_literal() {
+      return this->token.literal;
+    }
+
+    string to_string() {
+      string s("");
+      s += this->target->to_string();
+      s += " = ";
+      if (this->value != nullptr) {
+        s += this->value->to_string();
+      }
+      s += ";";
+      return s;
+    }
+  };
+
   class HashLiteral : public Expression {
   public:
-    map<shared_ptr<Expression>, shared_ptr<Expression>> pairs;
+    map<Rc<Expression>, Rc<Expression>> pairs;
 
     HashLiteral(const token::Token &t,
-                const map<shared_ptr<Expression>, shared_ptr<Expression>> &ps)
+                const map<Rc<Expression>, Rc<Expression>> &ps)
       : Expression(t), pairs(ps) {};
 
     NodeType type() {
@@ -567,7 +850,7 @@ namespace ast {
       string s("");
 
       vector<string> literals = pairs
-        | view::transform([](pair<shared_ptr<Expression>, shared_ptr<Expression>> const &p) {
+        | view::transform([](pair<Rc<Expression>, Rc<Expression>> const &p) {
             return p.first->to_string() + ":" + p.second->to_string();
           });
       string literal = literals | view::join(',');
@@ -581,12 +864,12 @@ namespace ast {
 
   class MacroLiteral : public Expression {
   public:
-    vector<shared_ptr<Identifier>> parameters;
-    shared_ptr<BlockStatement> body;
+    vector<Rc<Identifier>> parameters;
+    Rc<BlockStatement> body;
 
     MacroLiteral(const token::Token &t,
-                 const vector<shared_ptr<Identifier>> &ps,
-                 shared_ptr<BlockStatement> b)
+                 const vector<Rc<Identifier>> &ps,
+                 Rc<BlockStatement> b)
       : Expression(t), parameters(ps), body(b) {};
 
     NodeType type() {
@@ -599,7 +882,7 @@ namespace ast {
 
     string to_string() {
       string literal = flatten_expressions(parameters
-                                           | view::transform([](shared_ptr<Identifier> a) {
+                                           | view::transform([](Rc<Identifier> a) {
                                                return static_pointer_cast<Expression>(a);
                                              }));
       return format("{0}({1}) {2}", this->token_literal(), literal, this->body->to_string());
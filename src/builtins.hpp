@@ -1,10 +1,15 @@
 #pragma once
 
 #include "object.hpp"
+#include "simd.hpp"
 #include <map>
 #include <string>
+#include <memory>
 #include <vector>
+#include <iterator>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 #ifndef FORMAT_HEADER
 #define FORMAT_HEADER
 #include <fmt/format.h>
@@ -18,115 +23,822 @@ using namespace ranges;
 using namespace object;
 
 namespace builtins {
-  auto len_func(vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
+  // Calls of one function from a higher order builtin, set up once for
+  // all of them by the engine that runs the program.
+  class Callback {
+  public:
+    virtual ~Callback() {};
+    // the arguments are taken over
+    virtual auto call(Rc<Object> *args, size_t count) -> Rc<Object> = 0;
+  };
+
+  // a builtin passed where a function is expected
+  class BuiltinCallback : public Callback {
+    Rc<Builtin> builtin;
+    vector<Rc<Object>> args = {};
+
+  public:
+    explicit BuiltinCallback(const Rc<Builtin> &b): builtin(b) {};
+
+    auto call(Rc<Object> *args, size_t count) -> Rc<Object> {
+      this->args.assign(make_move_iterator(args), make_move_iterator(args + count));
+      return this->builtin->func(this->args);
+    }
+  };
+
+  // callbacks of func taking count arguments each, nullptr if func isn't
+  // a function
+  typedef unique_ptr<Callback> (*CallbackFactory)(const Rc<Object> &func, size_t count);
+}
+
+namespace eval {
+  auto callback_for(const Rc<Object> &func, size_t count) -> unique_ptr<builtins::Callback>;
+}
+
+namespace builtins {
+  // the runtime of a compiled program installs its own
+  CallbackFactory callback = eval::callback_for;
+
+  auto truthy(const Rc<Object> &obj) -> bool {
+    if (obj->type() == BOOLEAN_OBJ) {
+      return static_pointer_cast<object::Boolean>(obj)->value;
+    }
+    return obj->type() != NULL_OBJ;
+  }
+
+  // what the function gives for one element, the null of an empty body
+  // included
+  auto call(Callback *f, Rc<Object> *args, size_t count) -> Rc<Object> {
+    auto value = f->call(args, count);
+    return value == nullptr ? make_rc<Null>() : value;
+  }
+
+  auto is_iterable(const Rc<Object> &obj) -> bool {
+    return obj->type() == ARRAY_OBJ || obj->type() == SEQUENCE_OBJ || obj->type() == GENERATOR_OBJ;
+  }
+
+  // The elements of an array or generator, see elements. A generator is
+  // resumed for one element at a time and left where it is when the
+  // iteration stops.
+  template <typename Sink>
+  auto source_elements(const Rc<Object> &obj, Sink sink) -> Rc<Object> {
+    if (obj->type() == ARRAY_OBJ) {
+      auto arr = static_cast<Array *>(obj.get());
+      for (size_t i = 0; i < arr->size(); i++) {
+        auto stop = sink(arr->at(i));
+        if (stop != nullptr) {
+          return stop;
+        }
+      }
+      return nullptr;
+    }
+    if (obj->type() == GENERATOR_OBJ) {
+      auto generator = static_cast<Generator *>(obj.get());
+      Rc<Object> value;
+      while (generator->next(value)) {
+        auto stop = sink(value);
+        if (stop != nullptr) {
+          return stop;
+        }
+      }
+      return value;
+    }
+    return nullptr;
+  }
+
+  // Gives sink every element of an array, sequence or generator in order,
+  // until it returns what stops the iteration rather than nullptr. A
+  // sequence takes each element through all of its stages before it
+  // produces the next, and stops early once a take has had its count.
+  // What stopped it (an error of a function in the pipeline included) is
+  // returned.
+  template <typename Sink>
+  auto elements(const Rc<Object> &obj, Sink sink) -> Rc<Object> {
+    if (obj->type() != SEQUENCE_OBJ) {
+      return source_elements(obj, sink);
+    }
+
+    auto seq = static_cast<Sequence *>(obj.get());
+    const auto &stages = seq->stages;
+    vector<unique_ptr<Callback>> callbacks(stages.size());
+    vector<size_t> taken(stages.size(), 0);
+    auto done = false;
+    for (size_t k = 0; k < stages.size(); k++) {
+      if (stages[k].stage == Stage::TAKE) {
+        done = done || stages[k].count == 0;
+      } else {
+        callbacks[k] = callback(stages[k].func, 1);
+      }
+    }
+
+    auto produce = [&](Rc<Object> value) -> Rc<Object> {
+      for (size_t k = 0; k < stages.size(); k++) {
+        if (stages[k].stage == Stage::MAP) {
+          value = call(callbacks[k].get(), &value, 1);
+          if (value->type() == ERROR_OBJ) {
+            return value;
+          }
+        } else if (stages[k].stage == Stage::FILTER) {
+          Rc<Object> arg = value;
+          auto keep = call(callbacks[k].get(), &arg, 1);
+          if (keep->type() == ERROR_OBJ) {
+            return keep;
+          }
+          if (!truthy(keep)) {
+            return nullptr;
+          }
+        } else if (++taken[k] == stages[k].count) {
+          done = true;
+        }
+      }
+      return sink(value);
+    };
+
+    Rc<Object> stop = nullptr;
+    if (seq->source != nullptr && !done) {
+      // the sequence itself stops its source once a take is done
+      stop = source_elements(seq->source, [&](const Rc<Object> &element) -> Rc<Object> {
+          auto stop = produce(element);
+          return stop == nullptr && done ? obj : stop;
+        });
+      if (stop.get() == obj.get()) {
+        stop = nullptr;
+      }
+    } else if (seq->source == nullptr) {
+      auto n = seq->range_length();
+      for (int64_t i = 0; i < n && !done && stop == nullptr; i++) {
+        stop = produce(make_rc<Integer>(static_cast<int>(seq->start + i * seq->step)));
+      }
+    }
+    // frames are released in the reverse order of their reservation
+    while (!callbacks.empty()) {
+      callbacks.pop_back();
+    }
+    return stop;
+  }
+
+  auto len_func(const vector<Rc<Object>> &args) -> Rc<Object> {
     if (args.size() != 1) {
       string msg = format("wrong number of arguments. got={0}, want=1", args.size());
-      return make_shared<Error>(msg);
+      return make_rc<Error>(msg);
     }
 
-    shared_ptr<Object> o = args[0];
+    Rc<Object> o = args[0];
     if (o->type() == ARRAY_OBJ) {
-      shared_ptr<Array> arr = static_pointer_cast<Array>(o);
-      return make_shared<Integer>(arr->elements.size());
+      Rc<Array> arr = static_pointer_cast<Array>(o);
+      return make_rc<Integer>(arr->size());
     } else if (o->type() == STRING_OBJ) {
-      shared_ptr<String> str = static_pointer_cast<String>(o);
-      return make_shared<Integer>(str->value.size());
+      Rc<String> str = static_pointer_cast<String>(o);
+      return make_rc<Integer>(str->value.size());
+    } else if (o->type() == SEQUENCE_OBJ || o->type() == GENERATOR_OBJ) {
+      if (o->type() == SEQUENCE_OBJ) {
+        auto seq = borrow_cast<Sequence>(o);
+        if (seq->source == nullptr && seq->stages.empty()) {
+          return make_rc<Integer>(static_cast<int>(seq->range_length()));
+        }
+      }
+      size_t count = 0;
+      auto error = elements(o, [&](const Rc<Object> &) -> Rc<Object> {
+          count++;
+          return nullptr;
+        });
+      return error != nullptr ? error : make_rc<Integer>(count);
     } else {
-      return make_shared<Error>(format("argument to `len` not supported, got {0}", o->type()));
+      return make_rc<Error>(format("argument to `len` not supported, got {0}", type_name(o->type())));
     }
   }
 
-  auto puts_func(vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
-    std::for_each(args.cbegin(), args.cend(), [](shared_ptr<Object> o) {
+  auto puts_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    std::for_each(args.cbegin(), args.cend(), [](const Rc<Object> &o) {
         cout << o->inspect() << endl;
       });
 
-    return make_shared<Null>();
+    return make_rc<Null>();
   }
 
-  auto first_func(vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
+  auto first_func(const vector<Rc<Object>> &args) -> Rc<Object> {
     if (args.size() != 1) {
       string msg = format("wrong number of arguments. got={0}, want=1", args.size());
-      return make_shared<Error>(msg);
+      return make_rc<Error>(msg);
     }
 
-    shared_ptr<Object> o = args[0];
+    Rc<Object> o = args[0];
     if (o->type() != ARRAY_OBJ) {
-      return make_shared<Error>(format("argument to `first` must be ARRAY, got {0}", o->type()));
+      return make_rc<Error>(format("argument to `first` must be ARRAY, got {0}", type_name(o->type())));
     }
 
-    shared_ptr<Array> arr = static_pointer_cast<Array>(o);
-    if (arr->elements.size() > 0) {
-      return arr->elements[0];
+    Rc<Array> arr = static_pointer_cast<Array>(o);
+    if (!arr->empty()) {
+      return arr->at(0);
     } else {
-      return make_shared<Null>();
+      return make_rc<Null>();
     }
   }
 
-  auto last_func(vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
+  auto last_func(const vector<Rc<Object>> &args) -> Rc<Object> {
     if (args.size() != 1) {
       string msg = format("wrong number of arguments. got={0}, want=1", args.size());
-      return make_shared<Error>(msg);
+      return make_rc<Error>(msg);
     }
 
-    shared_ptr<Object> o = args[0];
+    Rc<Object> o = args[0];
     if (o->type() != ARRAY_OBJ) {
-      return make_shared<Error>(format("argument to `last` must be ARRAY, got {0}", o->type()));
+      return make_rc<Error>(format("argument to `last` must be ARRAY, got {0}", type_name(o->type())));
     }
 
-    shared_ptr<Array> arr = static_pointer_cast<Array>(o);
-    auto length = arr->elements.size();
+    Rc<Array> arr = static_pointer_cast<Array>(o);
+    auto length = arr->size();
     if (length > 0) {
-      return arr->elements[length - 1];
+      return arr->at(length - 1);
     } else {
-      return make_shared<Null>();
+      return make_rc<Null>();
     }
   }
 
-  auto rest_func(vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
+  auto rest_func(const vector<Rc<Object>> &args) -> Rc<Object> {
     if (args.size() != 1) {
       string msg = format("wrong number of arguments. got={0}, want=1", args.size());
-      return make_shared<Error>(msg);
+      return make_rc<Error>(msg);
     }
 
-    shared_ptr<Object> o = args[0];
+    // nobody else sees a unique array shrink
+    auto in_place = is_unique(args[0]);
+    Rc<Object> o = args[0];
     if (o->type() != ARRAY_OBJ) {
-      return make_shared<Error>(format("argument to `rest` must be ARRAY, got {0}", o->type()));
+      return make_rc<Error>(format("argument to `rest` must be ARRAY, got {0}", type_name(o->type())));
     }
 
-    shared_ptr<Array> arr = static_pointer_cast<Array>(o);
-    auto length = arr->elements.size();
-    if (length > 0) {
-      vector<shared_ptr<Object>> rest = arr->elements | view::tail;
-      return make_shared<Array>(rest);
+    Rc<Array> arr = static_pointer_cast<Array>(o);
+    if (arr->empty()) {
+      return make_rc<Null>();
+    }
+    auto rest = in_place ? arr : make_rc<Array>(*arr);
+    if (rest->is_unboxed()) {
+      auto &values = rest->values();
+      values.erase(values.begin());
     } else {
-      return make_shared<Null>();
+      auto &elements = rest->elements();
+      elements.erase(elements.begin());
     }
+    return rest;
   }
 
-  auto push_func(vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
+  auto push_func(const vector<Rc<Object>> &args) -> Rc<Object> {
     if (args.size() != 2) {
       string msg = format("wrong number of arguments. got={0}, want=2", args.size());
-      return make_shared<Error>(msg);
+      return make_rc<Error>(msg);
     }
 
-    shared_ptr<Object> o = args[0];
+    // nobody else sees a unique array grow
+    auto in_place = is_unique(args[0]);
+    Rc<Object> o = args[0];
     if (o->type() != ARRAY_OBJ) {
-      return make_shared<Error>(format("argument to `push` must be ARRAY, got {0}", o->type()));
+      return make_rc<Error>(format("argument to `push` must be ARRAY, got {0}", type_name(o->type())));
+    }
+
+    Rc<Array> arr = static_pointer_cast<Array>(o);
+    if (in_place) {
+      arr->push(outlives_region(arr.get()) ? promote(args[1]) : args[1]);
+      return arr;
     }
+    auto pushed = make_rc<Array>(*arr);
+    pushed->push(args[1]);
+    return pushed;
+  }
+
+  // The callback of map(arr, f) and the like, nullptr with error set if
+  // the arguments don't fit. f is the last argument.
+  auto iteration(const string &name, const vector<Rc<Object>> &args, size_t want, size_t arity,
+                 Rc<Object> &error) -> unique_ptr<Callback> {
+    if (args.size() != want) {
+      error = make_rc<Error>(format("wrong number of arguments. got={0}, want={1}", args.size(), want));
+      return nullptr;
+    }
+    if (!is_iterable(args[0])) {
+      error = make_rc<Error>(format("argument to `{0}` must be ARRAY, got {1}", name, type_name(args[0]->type())));
+      return nullptr;
+    }
+    auto f = callback(args.back(), arity);
+    if (f == nullptr) {
+      error = make_rc<Error>(format("argument to `{0}` must be FUNCTION, got {1}", name, type_name(args.back()->type())));
+    }
+    return f;
+  }
+
+  auto map_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    Rc<Object> error;
+    auto f = iteration("map", args, 2, 1, error);
+    if (f == nullptr) {
+      return error;
+    }
+
+    auto mapped = make_rc<Array>(vector<int>());
+    error = elements(args[0], [&](const Rc<Object> &element) -> Rc<Object> {
+        Rc<Object> arg = element;
+        auto value = call(f.get(), &arg, 1);
+        if (value->type() == ERROR_OBJ) {
+          return value;
+        }
+        mapped->push(std::move(value));
+        return nullptr;
+      });
+    return error != nullptr ? error : mapped;
+  }
+
+  auto filter_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    Rc<Object> error;
+    auto f = iteration("filter", args, 2, 1, error);
+    if (f == nullptr) {
+      return error;
+    }
+
+    auto kept = make_rc<Array>(vector<int>());
+    error = elements(args[0], [&](const Rc<Object> &element) -> Rc<Object> {
+        Rc<Object> arg = element;
+        auto keep = call(f.get(), &arg, 1);
+        if (keep->type() == ERROR_OBJ) {
+          return keep;
+        }
+        if (truthy(keep)) {
+          kept->push(element);
+        }
+        return nullptr;
+      });
+    return error != nullptr ? error : kept;
+  }
+
+  // reduce(arr, initial, f) folds from the left with f(acc, element). The
+  // accumulator is handed to f, so one it pushes onto stays unique.
+  auto reduce_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    Rc<Object> error;
+    auto f = iteration("reduce", args, 3, 2, error);
+    if (f == nullptr) {
+      return error;
+    }
+
+    auto acc = args[1];
+    error = elements(args[0], [&](const Rc<Object> &element) -> Rc<Object> {
+        Rc<Object> pair[2] = { std::move(acc), element };
+        acc = call(f.get(), pair, 2);
+        return acc->type() == ERROR_OBJ ? acc : nullptr;
+      });
+    return error != nullptr ? error : acc;
+  }
+
+  auto each_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    Rc<Object> error;
+    auto f = iteration("each", args, 2, 1, error);
+    if (f == nullptr) {
+      return error;
+    }
+
+    error = elements(args[0], [&](const Rc<Object> &element) -> Rc<Object> {
+        Rc<Object> arg = element;
+        auto value = call(f.get(), &arg, 1);
+        return value->type() == ERROR_OBJ ? value : nullptr;
+      });
+    return error != nullptr ? error : make_rc<Null>();
+  }
+
+  auto integer_argument(const string &name, const Rc<Object> &arg, Rc<Object> &error) -> int64_t {
+    if (arg->type() != INTEGER_OBJ) {
+      error = make_rc<Error>(format("argument to `{0}` must be INTEGER, got {1}", name, type_name(arg->type())));
+      return 0;
+    }
+    return static_pointer_cast<Integer>(arg)->value;
+  }
+
+  // range(start, end) or range(start, end, step), up to but not including end
+  auto range_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 2 && args.size() != 3) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=2 or 3", args.size()));
+    }
+
+    Rc<Object> error = nullptr;
+    auto start = integer_argument("range", args[0], error);
+    auto end = integer_argument("range", args[1], error);
+    auto step = args.size() == 3 ? integer_argument("range", args[2], error) : 1;
+    if (error != nullptr) {
+      return error;
+    }
+    if (step == 0) {
+      return make_rc<Error>("range step must not be 0");
+    }
+    return make_rc<Sequence>(nullptr, start, end, step);
+  }
+
+  // an array or generator becomes a sequence when a stage is added to it
+  auto sequence(const Rc<Object> &obj) -> Rc<Sequence> {
+    if (obj->type() == SEQUENCE_OBJ) {
+      return static_pointer_cast<Sequence>(obj);
+    }
+    return make_rc<Sequence>(obj, 0, 0, 1);
+  }
+
+  auto stage_func(const string &name, Stage stage, const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 2) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=2", args.size()));
+    }
+    if (!is_iterable(args[0])) {
+      return make_rc<Error>(format("argument to `{0}` must be ARRAY, got {1}", name, type_name(args[0]->type())));
+    }
+
+    if (stage == Stage::TAKE) {
+      Rc<Object> error = nullptr;
+      auto count = integer_argument(name, args[1], error);
+      if (error != nullptr) {
+        return error;
+      }
+      return sequence(args[0])->then({ stage, nullptr, static_cast<size_t>(std::max(count, static_cast<int64_t>(0))) });
+    }
+    if (args[1]->type() != FUNCTION_OBJ && args[1]->type() != BUILTIN_OBJ) {
+      return make_rc<Error>(format("argument to `{0}` must be FUNCTION, got {1}", name, type_name(args[1]->type())));
+    }
+    return sequence(args[0])->then({ stage, args[1], 0 });
+  }
+
+  auto lmap_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return stage_func("lmap", Stage::MAP, args);
+  }
+
+  auto lfilter_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return stage_func("lfilter", Stage::FILTER, args);
+  }
+
+  auto take_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return stage_func("take", Stage::TAKE, args);
+  }
+
+  // the elements of a sequence, computed
+  auto array_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 1) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    if (!is_iterable(args[0])) {
+      return make_rc<Error>(format("argument to `array` must be ARRAY, got {0}", type_name(args[0]->type())));
+    }
+    if (args[0]->type() == ARRAY_OBJ) {
+      return args[0];
+    }
+
+    auto computed = make_rc<Array>(vector<int>());
+    auto error = elements(args[0], [&](const Rc<Object> &element) -> Rc<Object> {
+        computed->push(element);
+        return nullptr;
+      });
+    return error != nullptr ? error : computed;
+  }
+
+  // Sorts integers with an lsd radix sort on the bytes of their values,
+  // the sign bit flipped so the negatives come first. A byte every value
+  // shares costs no pass.
+  auto radix_sort(vector<int> &elements) -> void {
+    auto digit = [](int value, int shift) {
+      auto bits = static_cast<uint32_t>(value) ^ 0x80000000u;
+      return (bits >> shift) & 0xFF;
+    };
+    vector<int> buffer(elements.size());
+    for (int shift = 0; shift < 32; shift += 8) {
+      size_t starts[257] = { 0 };
+      for (auto element : elements) {
+        starts[digit(element, shift) + 1]++;
+      }
+      if (*std::max_element(starts + 1, starts + 257) == elements.size()) {
+        continue;
+      }
+      for (size_t d = 1; d < 257; d++) {
+        starts[d] += starts[d - 1];
+      }
+      for (auto element : elements) {
+        buffer[starts[digit(element, shift)]++] = element;
+      }
+      elements.swap(buffer);
+    }
+  }
+
+  // arrays this long have their strings sorted by up to sort_threads
+  // threads
+  const size_t PARALLEL_SORT_MIN = 1 << 15;
+  size_t sort_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // Sorts begin..end with the halves of the first depth splits sorted on
+  // threads of their own, then merged. Only less runs on the threads, it
+  // must not touch a reference count.
+  template <typename Iterator, typename Less>
+  auto parallel_merge_sort(Iterator begin, Iterator end, Less less, size_t depth) -> void {
+    if (depth == 0 || static_cast<size_t>(end - begin) < PARALLEL_SORT_MIN) {
+      std::stable_sort(begin, end, less);
+      return;
+    }
+    auto middle = begin + (end - begin) / 2;
+    std::thread left([=]() {
+        parallel_merge_sort(begin, middle, less, depth - 1);
+      });
+    parallel_merge_sort(middle, end, less, depth - 1);
+    left.join();
+    std::inplace_merge(begin, middle, end, less);
+  }
+
+  auto sort_strings(vector<Rc<Object>> &elements) -> void {
+    // the threads see plain pointers, the references stay where they are
+    vector<String *> strings = {};
+    for (const auto &element : elements) {
+      strings.push_back(static_cast<String *>(element.get()));
+    }
+    size_t depth = 0;
+    for (auto threads = sort_threads; threads > 1; threads /= 2) {
+      depth++;
+    }
+    parallel_merge_sort(strings.begin(), strings.end(), [](const String *a, const String *b) {
+        return a->value < b->value;
+      }, depth);
+
+    vector<Rc<Object>> sorted = {};
+    sorted.reserve(strings.size());
+    for (auto str : strings) {
+      sorted.push_back(Rc<Object>(str));
+    }
+    elements.swap(sorted);
+  }
+
+  // A stable bottom up merge sort on what before says. Once it gives an
+  // error the remaining merges just copy, so no element is lost.
+  auto merge_sort(vector<Rc<Object>> &elements, Callback *before, Rc<Object> &error) -> void {
+    auto goes_first = [&](const Rc<Object> &a, const Rc<Object> &b) {
+      if (error != nullptr) {
+        return false;
+      }
+      Rc<Object> pair[2] = { a, b };
+      auto result = call(before, pair, 2);
+      if (result->type() == ERROR_OBJ) {
+        error = result;
+        return false;
+      }
+      return truthy(result);
+    };
+
+    auto n = elements.size();
+    vector<Rc<Object>> buffer(n);
+    for (size_t width = 1; width < n; width *= 2) {
+      for (size_t low = 0; low < n; low += 2 * width) {
+        auto middle = std::min(low + width, n);
+        auto high = std::min(low + 2 * width, n);
+        auto i = low;
+        auto j = middle;
+        auto k = low;
+        while (i < middle && j < high) {
+          buffer[k++] = goes_first(elements[j], elements[i]) ? std::move(elements[j++]) : std::move(elements[i++]);
+        }
+        while (i < middle) {
+          buffer[k++] = std::move(elements[i++]);
+        }
+        while (j < high) {
+          buffer[k++] = std::move(elements[j++]);
+        }
+      }
+      elements.swap(buffer);
+    }
+  }
+
+  // sort(arr) puts integers or strings in ascending order, sort(arr, f)
+  // puts a before b where f(a, b) is true. Either is stable.
+  auto sort_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 1 && args.size() != 2) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=1 or 2", args.size()));
+    }
+    // nobody else sees a unique array reordered
+    auto in_place = is_unique(args[0]);
+    if (args[0]->type() != ARRAY_OBJ) {
+      return make_rc<Error>(format("argument to `sort` must be ARRAY, got {0}", type_name(args[0]->type())));
+    }
+
+    auto arr = static_pointer_cast<Array>(args[0]);
+    unique_ptr<Callback> before = nullptr;
+    if (args.size() == 2) {
+      before = callback(args[1], 2);
+      if (before == nullptr) {
+        return make_rc<Error>(format("argument to `sort` must be FUNCTION, got {0}", type_name(args[1]->type())));
+      }
+    } else if (!arr->is_unboxed() && !arr->empty()) {
+      const auto &elements = arr->elements();
+      auto type = elements[0]->type();
+      if (type != INTEGER_OBJ && type != STRING_OBJ) {
+        return make_rc<Error>(format("can't sort {0} without a function to order it", type_name(type)));
+      }
+      for (const auto &element : elements) {
+        if (element->type() != type) {
+          return make_rc<Error>(format("can't sort {0} and {1} without a function to order them",
+                                       type_name(type), type_name(element->type())));
+        }
+      }
+    }
+
+    if (before != nullptr) {
+      Rc<Object> error = nullptr;
+      if (in_place && !arr->is_unboxed()) {
+        merge_sort(arr->elements(), before.get(), error);
+        return error != nullptr ? error : arr;
+      }
+      // integers are boxed one at a time for f
+      vector<Rc<Object>> elements = {};
+      elements.reserve(arr->size());
+      for (size_t i = 0; i < arr->size(); i++) {
+        elements.push_back(arr->at(i));
+      }
+      merge_sort(elements, before.get(), error);
+      if (error != nullptr) {
+        return error;
+      }
+      if (!in_place) {
+        return make_rc<Array>(elements);
+      }
+      auto &values = arr->values();
+      for (size_t i = 0; i < elements.size(); i++) {
+        values[i] = static_cast<Integer *>(elements[i].get())->value;
+      }
+      return arr;
+    }
+
+    // integers boxed once by now are sorted unboxed again, a copy is
+    // made unboxed from the start
+    auto sorted = arr;
+    if (in_place) {
+      arr->unbox();
+    } else {
+      sorted = arr->is_unboxed() ? make_rc<Array>(*arr) : make_rc<Array>(arr->elements());
+    }
+    if (sorted->is_unboxed()) {
+      radix_sort(sorted->values());
+    } else {
+      sort_strings(sorted->elements());
+    }
+    return sorted;
+  }
+
+  // An array argument as unboxed integers: the array itself, or an
+  // unboxed copy of a boxed one that holds nothing else. nullptr with error
+  // set if it isn't an array of integers.
+  auto integer_array(const string &name, const Rc<Object> &arg, Rc<Object> &error) -> Rc<Array> {
+    if (arg->type() != ARRAY_OBJ) {
+      error = make_rc<Error>(format("argument to `{0}` must be ARRAY, got {1}", name, type_name(arg->type())));
+      return nullptr;
+    }
+    auto arr = static_pointer_cast<Array>(arg);
+    if (arr->is_unboxed()) {
+      return arr;
+    }
+    for (const auto &element : arr->elements()) {
+      if (element->type() != INTEGER_OBJ) {
+        error = make_rc<Error>(format("argument to `{0}` must only hold INTEGER, got {1}", name,
+                                      type_name(element->type())));
+        return nullptr;
+      }
+    }
+    return make_rc<Array>(arr->elements());
+  }
+
+  // the two integer arrays of equal length of name(a, b)
+  auto integer_arrays(const string &name, const vector<Rc<Object>> &args, Rc<Array> &a, Rc<Array> &b,
+                      Rc<Object> &error) -> bool {
+    if (args.size() != 2) {
+      error = make_rc<Error>(format("wrong number of arguments. got={0}, want=2", args.size()));
+      return false;
+    }
+    a = integer_array(name, args[0], error);
+    b = a != nullptr ? integer_array(name, args[1], error) : nullptr;
+    if (b == nullptr) {
+      return false;
+    }
+    if (a->size() != b->size()) {
+      error = make_rc<Error>(format("arguments to `{0}` must have the same length, got {1} and {2}", name,
+                                    a->size(), b->size()));
+      return false;
+    }
+    return true;
+  }
+
+  auto sum_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 1) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    Rc<Object> error;
+    auto arr = integer_array("sum", args[0], error);
+    if (arr == nullptr) {
+      return error;
+    }
+    return make_rc<Integer>(simd::sum(arr->values().data(), arr->size()));
+  }
+
+  // min(arr) or max(arr), null for an empty array
+  auto bound(const string &name, const vector<Rc<Object>> &args, int (*kernel)(const int *, size_t)) -> Rc<Object> {
+    if (args.size() != 1) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    Rc<Object> error;
+    auto arr = integer_array(name, args[0], error);
+    if (arr == nullptr) {
+      return error;
+    }
+    if (arr->empty()) {
+      return make_rc<Null>();
+    }
+    return make_rc<Integer>(kernel(arr->values().data(), arr->size()));
+  }
+
+  auto min_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return bound("min", args, simd::min);
+  }
+
+  auto max_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return bound("max", args, simd::max);
+  }
+
+  auto dot_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    Rc<Array> a, b;
+    Rc<Object> error;
+    if (!integer_arrays("dot", args, a, b, error)) {
+      return error;
+    }
+    return make_rc<Integer>(simd::dot(a->values().data(), b->values().data(), a->size()));
+  }
+
+  // count_eq(arr, x) counts the elements equal to x
+  auto count_eq_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 2) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=2", args.size()));
+    }
+    Rc<Object> error;
+    auto arr = integer_array("count_eq", args[0], error);
+    if (arr == nullptr) {
+      return error;
+    }
+    auto x = integer_argument("count_eq", args[1], error);
+    if (error != nullptr) {
+      return error;
+    }
+    return make_rc<Integer>(static_cast<int>(simd::count_eq(arr->values().data(), arr->size(), static_cast<int>(x))));
+  }
+
+  // the running totals of arr, a new array
+  auto prefix_sum_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (args.size() != 1) {
+      return make_rc<Error>(format("wrong number of arguments. got={0}, want=1", args.size()));
+    }
+    Rc<Object> error;
+    auto arr = integer_array("prefix_sum", args[0], error);
+    if (arr == nullptr) {
+      return error;
+    }
+    auto sums = make_rc<Array>(vector<int>(arr->size()));
+    simd::prefix_sum(arr->values().data(), sums->values().data(), arr->size());
+    return sums;
+  }
+
+  // add(a, b) or mul(a, b), element by element into a new array
+  auto elementwise(const string &name, const vector<Rc<Object>> &args,
+                   void (*kernel)(const int *, const int *, int *, size_t)) -> Rc<Object> {
+    Rc<Array> a, b;
+    Rc<Object> error;
+    if (!integer_arrays(name, args, a, b, error)) {
+      return error;
+    }
+    auto result = make_rc<Array>(vector<int>(a->size()));
+    kernel(a->values().data(), b->values().data(), result->values().data(), a->size());
+    return result;
+  }
+
+  auto add_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return elementwise("add", args, simd::add);
+  }
 
-    shared_ptr<Array> arr = static_pointer_cast<Array>(o);
-    auto elements = arr->elements;
-    elements.push_back(args[1]);
-    return make_shared<Array>(elements);
+  auto mul_func(const vector<Rc<Object>> &args) -> Rc<Object> {
+    return elementwise("mul", args, simd::mul);
   }
 
-  map<string, shared_ptr<Builtin>> builtins = {
-    { "len", make_shared<Builtin>(len_func) },
-    { "puts", make_shared<Builtin>(puts_func) },
-    { "first", make_shared<Builtin>(first_func) },
-    { "last", make_shared<Builtin>(last_func) },
-    { "rest", make_shared<Builtin>(rest_func) },
-    { "push", make_shared<Builtin>(push_func) }
+  map<string, Rc<Builtin>> builtins = {
+    { "len", make_rc<Builtin>(len_func) },
+    { "puts", make_rc<Builtin>(puts_func) },
+    { "first", make_rc<Builtin>(first_func) },
+    { "last", make_rc<Builtin>(last_func) },
+    { "rest", make_rc<Builtin>(rest_func, true) },
+    { "push", make_rc<Builtin>(push_func, true) },
+    { "map", make_rc<Builtin>(map_func) },
+    { "filter", make_rc<Builtin>(filter_func) },
+    { "reduce", make_rc<Builtin>(reduce_func) },
+    { "each", make_rc<Builtin>(each_func) },
+    { "range", make_rc<Builtin>(range_func) },
+    { "lmap", make_rc<Builtin>(lmap_func) },
+    { "lfilter", make_rc<Builtin>(lfilter_func) },
+    { "take", make_rc<Builtin>(take_func) },
+    { "array", make_rc<Builtin>(array_func) },
+    { "sort", make_rc<Builtin>(sort_func) },
+    { "sum", make_rc<Builtin>(sum_func) },
+    { "min", make_rc<Builtin>(min_func) },
+    { "max", make_rc<Builtin>(max_func) },
+    { "dot", make_rc<Builtin>(dot_func) },
+    { "count_eq", make_rc<Builtin>(count_eq_func) },
+    { "prefix_sum", make_rc<Builtin>(prefix_sum_func) },
+    { "add", make_rc<Builtin>(add_func) },
+    { "mul", make_rc<Builtin>(mul_func) }
   };
 }
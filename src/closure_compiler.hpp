@@ -0,0 +1,555 @@
+#pragma once
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "eval.hpp"
+#include "analysis.hpp"
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+using namespace ast;
+using namespace object;
+
+namespace closurecompiler {
+  // anything a function body can't be compiled with, calls of it are left
+  // to eval
+  class Unsupported : public std::runtime_error {
+  public:
+    explicit Unsupported(const string &what): std::runtime_error(what) {};
+  };
+
+  struct Frame {
+    // parameters and lets laid out by analysis::Locals, nullptr at the top
+    // level where every variable lives in env
+    Rc<Object> *slots;
+    Environment *env;
+    // set by a return statement, stops the enclosing blocks
+    bool returning;
+  };
+
+  // every node is compiled once into one of these, with its operator,
+  // literal or variable slot already bound
+  typedef std::function<Rc<Object>(Frame &)> Callable;
+
+  class Body : public RefCounted {
+  public:
+    Callable run;
+    size_t parameters;
+    size_t slots;
+  };
+
+  auto compiled(object::Function *func) -> Body *;
+
+  auto call_function(const Rc<Object> &callee, const vector<Callable> &args, Frame &frame) -> Rc<Object> {
+    if (eval::is_error(callee)) {
+      return callee;
+    }
+
+    if (callee->type() == FUNCTION_OBJ) {
+      auto func = borrow_cast<object::Function>(callee);
+      auto body = compiled(func);
+      if (body != nullptr) {
+        // the slots come from the evaluator's argument stack
+        auto slots = eval::frames.reserve(body->slots);
+        if (slots.begin != nullptr) {
+          for (size_t i = 0; i < args.size(); i++) {
+            auto value = args[i](frame);
+            if (eval::is_error(value)) {
+              eval::frames.release(slots);
+              return value;
+            }
+            if (i < body->parameters) {
+              slots.begin[i] = std::move(value);
+            }
+          }
+
+          Frame callee_frame = { slots.begin, func->env.get(), false };
+          auto result = body->run(callee_frame);
+          eval::frames.release(slots);
+          return result;
+        }
+      }
+    }
+
+    vector<Rc<Object>> values = {};
+    for (const auto &arg : args) {
+      auto value = arg(frame);
+      if (eval::is_error(value)) {
+        return value;
+      }
+      values.push_back(std::move(value));
+    }
+    return eval::apply_function(callee, std::move(values));
+  }
+
+  auto integer_result(int value) -> Rc<Object> {
+    return make_rc<Integer>(value);
+  }
+
+  auto integer_result(bool value) -> Rc<Object> {
+    return eval::trans_boolean_object(value);
+  }
+
+  template <typename Op>
+  auto integer_infix(Callable left, Callable right, Operator infix_operator, Op op) -> Callable {
+    return [left, right, infix_operator, op](Frame &f) -> Rc<Object> {
+      auto l = left(f);
+      if (eval::is_error(l)) {
+        return l;
+      }
+      auto r = right(f);
+      if (eval::is_error(r)) {
+        return r;
+      }
+
+      if (l->type() == INTEGER_OBJ && r->type() == INTEGER_OBJ) {
+        return integer_result(op(borrow_cast<Integer>(l)->value, borrow_cast<Integer>(r)->value));
+      }
+      return eval::eval_infix_expression(infix_operator, l, r);
+    };
+  }
+
+  // the right operand is an integer literal
+  template <typename Op>
+  auto integer_infix_constant(Callable left, const Rc<Object> &right, Operator infix_operator, Op op) -> Callable {
+    auto k = borrow_cast<Integer>(right)->value;
+    return [left, right, k, infix_operator, op](Frame &f) -> Rc<Object> {
+      auto l = left(f);
+      if (eval::is_error(l)) {
+        return l;
+      }
+
+      if (l->type() == INTEGER_OBJ) {
+        return integer_result(op(borrow_cast<Integer>(l)->value, k));
+      }
+      return eval::eval_infix_expression(infix_operator, l, right);
+    };
+  }
+
+  template <typename Make>
+  auto with_operator(Operator infix_operator, Make make) -> Callable {
+    switch (infix_operator) {
+    case Operator::PLUS:
+      return make(std::plus<int>());
+    case Operator::MINUS:
+      return make(std::minus<int>());
+    case Operator::ASTERISK:
+      return make(std::multiplies<int>());
+    case Operator::SLASH:
+      return make(std::divides<int>());
+    case Operator::LT:
+      return make(std::less<int>());
+    case Operator::GT:
+      return make(std::greater<int>());
+    case Operator::EQ:
+      return make(std::equal_to<int>());
+    case Operator::NOT_EQ:
+      return make(std::not_equal_to<int>());
+    default:
+      return nullptr;
+    }
+  }
+
+  // Compiles a top level statement or a function body. The top level can
+  // always fall back to eval for a node since its variables live in an
+  // environment, a function body can't.
+  class Compiler {
+  private:
+    bool top_level;
+    analysis::Locals locals;
+    // the statement of the body being compiled
+    size_t position = 0;
+
+    explicit Compiler(bool t): top_level(t) {};
+
+    auto identifier(Identifier *id) -> Callable {
+      auto name = id->value;
+      auto slot = this->locals.find(name);
+      if (slot < 0) {
+        return [name](Frame &f) -> Rc<Object> {
+          return eval::lookup(name, f.env);
+        };
+      }
+
+      auto bound = this->locals.bound(name, this->position);
+      if (bound >= 0) {
+        return [bound](Frame &f) -> Rc<Object> {
+          return f.slots[bound];
+        };
+      }
+      return [slot, name](Frame &f) -> Rc<Object> {
+        const auto &value = f.slots[slot];
+        return value != nullptr ? value : eval::lookup(name, f.env);
+      };
+    }
+
+    auto infix(InfixExpression *infix) -> Callable {
+      auto left = this->expression(infix->left);
+      auto infix_operator = infix->op;
+
+      Callable callable;
+      if (infix->right->type() == NodeType::INTEGERLITERAL) {
+        Rc<Object> right = make_rc<Integer>(borrow_cast<IntegerLiteral>(infix->right)->value);
+        callable = with_operator(infix_operator, [&](auto op) {
+            return integer_infix_constant(left, right, infix_operator, op);
+          });
+      } else {
+        auto right = this->expression(infix->right);
+        callable = with_operator(infix_operator, [&](auto op) {
+            return integer_infix(left, right, infix_operator, op);
+          });
+      }
+      if (callable == nullptr) {
+        throw Unsupported(format("infix operator {0}", operator_string(infix_operator)));
+      }
+      return callable;
+    }
+
+    auto prefix(PrefixExpression *prefix) -> Callable {
+      auto right = this->expression(prefix->right);
+      if (prefix->op == Operator::MINUS) {
+        return [right](Frame &f) -> Rc<Object> {
+          auto value = right(f);
+          if (eval::is_error(value)) {
+            return value;
+          }
+          if (value->type() == INTEGER_OBJ) {
+            return make_rc<Integer>(-borrow_cast<Integer>(value)->value);
+          }
+          return eval::eval_minus_prefix_operator_expression(value);
+        };
+      } else if (prefix->op == Operator::BANG) {
+        return [right](Frame &f) -> Rc<Object> {
+          auto value = right(f);
+          if (eval::is_error(value)) {
+            return value;
+          }
+          return eval::eval_bang_operator_expression(value);
+        };
+      }
+      throw Unsupported(format("prefix operator {0}", prefix->prefix_operator));
+    }
+
+    auto if_expression(IfExpression *if_expr) -> Callable {
+      auto condition = this->expression(if_expr->condition);
+      auto consequence = this->block(if_expr->consequence.get());
+      Callable alternative = nullptr;
+      if (if_expr->alternative != nullptr) {
+        alternative = this->block(if_expr->alternative.get());
+      }
+
+      return [condition, consequence, alternative](Frame &f) -> Rc<Object> {
+        auto value = condition(f);
+        if (eval::is_error(value)) {
+          return value;
+        }
+        if (eval::is_truthy(value)) {
+          return consequence(f);
+        } else if (alternative != nullptr) {
+          return alternative(f);
+        } else {
+          return eval::NULLOBJ;
+        }
+      };
+    }
+
+    auto function_literal(FunctionLiteral *func) -> Callable {
+      if (this->top_level) {
+        return [func](Frame &f) -> Rc<Object> {
+          Rc<Environment> env(f.env);
+          if (func->closure == Closure::FREE_VARIABLES) {
+            env = eval::closure_environment(func, env);
+          }
+          return make_rc<object::Function>(func->parameters, func->body, env);
+        };
+      }
+
+      // a literal that shares the frame's environment needs one
+      if (func->closure != Closure::FREE_VARIABLES) {
+        throw Unsupported("closure over the whole environment");
+      }
+      vector<pair<string, int64_t>> captured = {};
+      for (const auto &name : func->captured) {
+        captured.push_back(make_pair(name, this->locals.bound(name, this->position)));
+      }
+
+      return [func, captured](Frame &f) -> Rc<Object> {
+        auto root = f.env;
+        while (root->outer != nullptr) {
+          root = root->outer.get();
+        }
+        if (captured.empty()) {
+          return make_rc<object::Function>(func->parameters, func->body, Rc<Environment>(root));
+        }
+
+        auto env = new_enclosed_environment(Rc<Environment>(root));
+        for (const auto &c : captured) {
+          env->store[c.first] = c.second >= 0 ? f.slots[c.second] : f.env->get(c.first);
+        }
+        return make_rc<object::Function>(func->parameters, func->body, env);
+      };
+    }
+
+    auto call(CallExpression *call) -> Callable {
+      if (call->function->token_literal() == "quote") {
+        if (!this->top_level) {
+          throw Unsupported("quote");
+        }
+        auto quoted = call->arguments[0];
+        return [quoted](Frame &f) -> Rc<Object> {
+          return eval::quote(quoted, Rc<Environment>(f.env));
+        };
+      }
+
+      auto function = this->expression(call->function);
+      auto args = this->expressions(call->arguments);
+      return [function, args](Frame &f) -> Rc<Object> {
+        return call_function(function(f), args, f);
+      };
+    }
+
+    auto hash_literal(HashLiteral *hash_expr) -> Callable {
+      vector<pair<Callable, Callable>> pairs = {};
+      for (const auto &pair : hash_expr->pairs) {
+        pairs.push_back(make_pair(this->expression(pair.first), this->expression(pair.second)));
+      }
+
+      return [pairs](Frame &f) -> Rc<Object> {
+        map<HashKey, HashPair> result = {};
+        for (const auto &pair : pairs) {
+          auto key = pair.first(f);
+          if (eval::is_error(key)) {
+            return key;
+          }
+          if (!is_hashable(key)) {
+            return make_rc<Error>(format("unusable as hash key_obj: {0}", type_name(key->type())));
+          }
+          auto value = pair.second(f);
+          if (eval::is_error(value)) {
+            return value;
+          }
+          result[dynamic_cast<Hashable *>(key.get())->hash_key()] = make_pair(key, value);
+        }
+        return make_rc<Hash>(result);
+      };
+    }
+
+    auto expressions(const vector<Rc<Expression>> &exprs) -> vector<Callable> {
+      vector<Callable> result = {};
+      for (const auto &expr : exprs) {
+        result.push_back(this->expression(expr));
+      }
+      return result;
+    }
+
+    auto constant(const Rc<Object> &obj) -> Callable {
+      return [obj](Frame &) -> Rc<Object> {
+        return obj;
+      };
+    }
+
+    // left to eval, only possible where the variables live in env
+    auto fallback(const Rc<Node> &node) -> Callable {
+      if (!this->top_level) {
+        throw Unsupported(node->to_string());
+      }
+      return [node](Frame &f) -> Rc<Object> {
+        auto result = eval::eval(node, Rc<Environment>(f.env));
+        // a return inside a loop
+        if (result != nullptr && result->type() == RETURN_VALUE_OBJ) {
+          f.returning = true;
+          return borrow_cast<ReturnValue>(result)->value;
+        }
+        return result;
+      };
+    }
+
+    auto expression(const Rc<Expression> &expr) -> Callable {
+      switch (expr->type()) {
+      case NodeType::INTEGERLITERAL:
+        return this->constant(make_rc<Integer>(borrow_cast<IntegerLiteral>(expr)->value));
+      case NodeType::STRINGLITERAL:
+        return this->constant(make_rc<String>(borrow_cast<StringLiteral>(expr)->value));
+      case NodeType::BOOLEAN:
+        return this->constant(eval::trans_boolean_object(borrow_cast<ast::Boolean>(expr)->value));
+      case NodeType::IDENTIFIER:
+        return this->identifier(borrow_cast<Identifier>(expr));
+      case NodeType::PREFIXEXPRESSION:
+        return this->prefix(borrow_cast<PrefixExpression>(expr));
+      case NodeType::INFIXEXPRESSION:
+        return this->infix(borrow_cast<InfixExpression>(expr));
+      case NodeType::IFEXPRESSION:
+        return this->if_expression(borrow_cast<IfExpression>(expr));
+      case NodeType::FUNCTIONLITERAL:
+        return this->function_literal(borrow_cast<FunctionLiteral>(expr));
+      case NodeType::CALLEXPRESSION:
+        return this->call(borrow_cast<CallExpression>(expr));
+      case NodeType::ARRAYLITERAL: {
+        auto elements = this->expressions(borrow_cast<ArrayLiteral>(expr)->elements);
+        return [elements](Frame &f) -> Rc<Object> {
+          vector<Rc<Object>> values = {};
+          for (const auto &elem : elements) {
+            auto value = elem(f);
+            if (eval::is_error(value)) {
+              return value;
+            }
+            values.push_back(std::move(value));
+          }
+          return make_rc<Array>(values);
+        };
+      }
+      case NodeType::INDEXEXPRESSION: {
+        auto index_expr = borrow_cast<IndexExpression>(expr);
+        auto left = this->expression(index_expr->left);
+        auto index = this->expression(index_expr->index);
+        return [left, index](Frame &f) -> Rc<Object> {
+          auto l = left(f);
+          if (eval::is_error(l)) {
+            return l;
+          }
+          auto i = index(f);
+          if (eval::is_error(i)) {
+            return i;
+          }
+          return eval::eval_index_expression(l, i);
+        };
+      }
+      case NodeType::HASHLITERAL:
+        return this->hash_literal(borrow_cast<HashLiteral>(expr));
+      default:
+        return this->fallback(expr);
+      }
+    }
+
+    auto statement(const Rc<Statement> &stmt) -> Callable {
+      switch (stmt->type()) {
+      case NodeType::EXPRESSIONSTATEMENT:
+        return this->expression(borrow_cast<ExpressionStatement>(stmt)->expression);
+      case NodeType::LETSTATEMENT: {
+        auto let = borrow_cast<LetStatement>(stmt);
+        auto value = this->expression(let->value);
+        if (this->top_level) {
+          auto name = let->name->value;
+          return [name, value](Frame &f) -> Rc<Object> {
+            auto v = value(f);
+            if (eval::is_error(v)) {
+              return v;
+            }
+            return f.env->set(name, v);
+          };
+        }
+
+        auto slot = this->locals.find(let->name->value);
+        return [slot, value](Frame &f) -> Rc<Object> {
+          auto v = value(f);
+          if (eval::is_error(v)) {
+            return v;
+          }
+          return f.slots[slot] = v;
+        };
+      }
+      case NodeType::RETURNSTATEMENT: {
+        auto value = this->expression(borrow_cast<ReturnStatement>(stmt)->value);
+        return [value](Frame &f) -> Rc<Object> {
+          auto v = value(f);
+          if (!eval::is_error(v)) {
+            f.returning = true;
+          }
+          return v;
+        };
+      }
+      default:
+        return this->fallback(stmt);
+      }
+    }
+
+    // runs statements until one returns or fails, a block's value is the
+    // last one's
+    static auto sequence(const vector<Callable> &stmts) -> Callable {
+      if (stmts.size() == 1) {
+        return stmts[0];
+      }
+      return [stmts](Frame &f) -> Rc<Object> {
+        Rc<Object> result;
+        for (const auto &stmt : stmts) {
+          result = stmt(f);
+          if (f.returning || eval::is_error(result)) {
+            return result;
+          }
+        }
+        return result;
+      };
+    }
+
+    auto block(BlockStatement *block) -> Callable {
+      vector<Callable> stmts = {};
+      for (const auto &stmt : block->statements) {
+        stmts.push_back(this->statement(stmt));
+      }
+      return sequence(stmts);
+    }
+
+  public:
+    static auto compile_statement(const Rc<Statement> &stmt) -> Callable {
+      Compiler c(true);
+      return c.statement(stmt);
+    }
+
+    // nullptr if calls of the function have to be left to eval
+    static auto compile_function(const vector<Rc<Identifier>> &params, BlockStatement *body) -> Rc<Body> {
+      try {
+        Compiler c(false);
+        c.locals = analysis::Locals(params, body);
+
+        vector<Callable> compiled = {};
+        const auto &stmts = body->statements;
+        for (size_t i = 0; i < stmts.size(); i++) {
+          c.position = i;
+          compiled.push_back(c.statement(stmts[i]));
+        }
+
+        auto result = make_rc<Body>();
+        result->run = sequence(compiled);
+        result->parameters = params.size();
+        result->slots = c.locals.count;
+        return result;
+      } catch (Unsupported &) {
+        return nullptr;
+      }
+    }
+  };
+
+  auto compiled(object::Function *func) -> Body * {
+    auto body = func->body.get();
+    if (body->callable == nullptr && !body->uncallable) {
+      auto b = Compiler::compile_function(func->parameters, body);
+      if (b == nullptr) {
+        body->uncallable = true;
+      } else {
+        body->callable = b;
+      }
+    }
+    return static_cast<Body *>(body->callable.get());
+  }
+
+  // Same contract as eval::eval_program.
+  auto run(Program *program, const Rc<Environment> &env) -> Rc<Object> {
+    Rc<Object> result;
+
+    analysis::resolve_closures(program);
+
+    for (const auto &stmt : program->statements) {
+      Frame frame = { nullptr, env.get(), false };
+      result = Compiler::compile_statement(stmt)(frame);
+      if (frame.returning || eval::is_error(result)) {
+        return result;
+      }
+    }
+
+    return result;
+  }
+}
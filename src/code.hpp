@@ -0,0 +1,123 @@
+#pragma once
+
+#include "ast.hpp"
+#include "object.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+#ifndef FORMAT_HEADER
+#define FORMAT_HEADER
+#include <fmt/format.h>
+#include <fmt/format.cc>
+#endif
+
+using namespace std;
+using namespace ast;
+using namespace fmt;
+using namespace object;
+
+namespace code {
+  // Three address instructions over the registers of a frame. a is the
+  // destination unless noted, K[n] is constant n and N[n] name n.
+  enum class Opcode : uint8_t {
+    LOAD_CONST,     // a = K[b]
+    LOAD_NULL,      // a = null
+    LOAD_NIL,       // a = nothing, the value of an empty block
+    MOVE,           // a = b
+    GET_NAME,       // a = N[b] looked up in the environment
+    GET_LOCAL,      // a = b, or N[c] looked up while b is still unbound
+    SET_NAME,       // N[b] = a in the environment
+    ADD,            // a = b op c
+    SUB,
+    MUL,
+    DIV,
+    LT,
+    GT,
+    EQ,
+    NE,
+    ADD_K,          // a = b op K[c]
+    SUB_K,
+    MUL_K,
+    DIV_K,
+    LT_K,
+    GT_K,
+    EQ_K,
+    NE_K,
+    NEG,            // a = -b
+    NOT,            // a = !b
+    JUMP,           // continue at a
+    JUMP_IF_FALSE,  // continue at b unless a is truthy
+    CALL,           // a = b(b + 1, ..., b + c)
+    RETURN,         // return a to the caller
+    END,            // a is the value of a top level statement
+    ARRAY,          // a = [b, ..., b + c - 1]
+    HASH_KEY,       // fail unless a is hashable
+    HASH,           // a = {b: b + 1, ...} with c pairs
+    INDEX,          // a = b[c]
+    CLOSURE         // a = function literal b of the code
+  };
+
+  const size_t OPCODES = static_cast<size_t>(Opcode::CLOSURE) + 1;
+
+  auto opcode_name(Opcode op) -> string {
+    static const vector<string> names = {
+      "LOAD_CONST", "LOAD_NULL", "LOAD_NIL", "MOVE", "GET_NAME", "GET_LOCAL", "SET_NAME",
+      "ADD", "SUB", "MUL", "DIV", "LT", "GT", "EQ", "NE",
+      "ADD_K", "SUB_K", "MUL_K", "DIV_K", "LT_K", "GT_K", "EQ_K", "NE_K",
+      "NEG", "NOT", "JUMP", "JUMP_IF_FALSE", "CALL", "RETURN", "END",
+      "ARRAY", "HASH_KEY", "HASH", "INDEX", "CLOSURE"
+    };
+    return names[static_cast<size_t>(op)];
+  }
+
+  // the source operator of ADD .. NE and ADD_K .. NE_K
+  auto infix_operator(Opcode op) -> Operator {
+    static const vector<Operator> operators = {
+      Operator::PLUS, Operator::MINUS, Operator::ASTERISK, Operator::SLASH,
+      Operator::LT, Operator::GT, Operator::EQ, Operator::NOT_EQ
+    };
+    auto n = static_cast<size_t>(op);
+    auto first = static_cast<size_t>(n >= static_cast<size_t>(Opcode::ADD_K) ? Opcode::ADD_K : Opcode::ADD);
+    return operators[n - first];
+  }
+
+  // Eight bytes, so a cache line holds eight instructions. Code that
+  // needs an operand past MAX_OPERAND is left to eval by the compiler.
+  struct Instruction {
+    Opcode op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+  };
+
+  const uint32_t MAX_OPERAND = 0xffff;
+
+  // A function literal instantiated by CLOSURE. At the top level it closes
+  // over the whole environment, in a function body it copies its captured
+  // variables (see analysis::plan_closure), from a register or by name.
+  struct ClosureInfo {
+    FunctionLiteral *literal;
+    bool whole_environment;
+    vector<string> names;
+    vector<int64_t> registers;  // -1 for a name to look up
+  };
+
+  class Code : public RefCounted {
+  public:
+    vector<Instruction> instructions = {};
+    vector<Rc<Object>> constants = {};
+    vector<string> names = {};
+    vector<ClosureInfo> closures = {};
+    size_t parameters = 0;
+    size_t registers = 0;
+
+    string to_string() {
+      string s("");
+      for (size_t i = 0; i < this->instructions.size(); i++) {
+        const auto &in = this->instructions[i];
+        s += format("{0:04} {1} {2} {3} {4}\n", i, opcode_name(in.op), in.a, in.b, in.c);
+      }
+      return s;
+    }
+  };
+}
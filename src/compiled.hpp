@@ -0,0 +1,119 @@
+#pragma once
+
+#include "object.hpp"
+#include "builtins.hpp"
+#include "eval.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <iostream>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+using namespace object;
+using namespace eval;
+
+// What a program made by `lc3 compile` (see transpiler.hpp) links
+// against: the objects, builtins and operators of the interpreter, plus
+// functions whose bodies are C++.
+namespace compiled {
+  typedef std::function<Rc<Object>(const vector<Rc<Object>> &args)> Entry;
+
+  // an lc3 function compiled to C++, inspected as its source
+  class CompiledFunction : public Object {
+  public:
+    size_t arity;
+    string source;
+    Entry entry;
+
+    CompiledFunction(size_t a, const string &s, const Entry &e)
+      : arity(a), source(s), entry(e) {};
+
+    ObjectType type() {
+      return FUNCTION_OBJ;
+    }
+
+    string inspect() {
+      return this->source;
+    }
+  };
+
+  // a variable that function literals close over
+  class Cell : public RefCounted {
+  public:
+    Rc<Object> value = nullptr;
+  };
+
+  auto arg(const vector<Rc<Object>> &args, size_t i) -> Rc<Object> {
+    return i < args.size() ? args[i] : nullptr;
+  }
+
+  auto is_integer(const Rc<Object> &obj) -> bool {
+    return obj != nullptr && obj->type() == INTEGER_OBJ;
+  }
+
+  auto unbound(const string &name) -> Rc<Object> {
+    return make_rc<Error>(format("identifier not found: {0}", name));
+  }
+
+  auto builtin(const string &name) -> Rc<Object> {
+    return builtins::builtins[name];
+  }
+
+  auto call(const Rc<Object> &callee, const vector<Rc<Object>> &args) -> Rc<Object> {
+    if (callee->type() == FUNCTION_OBJ) {
+      return static_cast<CompiledFunction *>(callee.get())->entry(args);
+    } else if (callee->type() == BUILTIN_OBJ) {
+      return borrow_cast<Builtin>(callee)->func(args);
+    }
+    return make_rc<Error>(format("not a function: {0}", type_name(callee->type())));
+  }
+
+  // calls of a compiled function from a builtin, through one argument
+  // vector
+  class EntryCallback : public builtins::Callback {
+    Rc<Object> callee;
+    vector<Rc<Object>> args = {};
+
+  public:
+    explicit EntryCallback(const Rc<Object> &f): callee(f) {};
+
+    auto call(Rc<Object> *args, size_t count) -> Rc<Object> {
+      this->args.assign(make_move_iterator(args), make_move_iterator(args + count));
+      return static_cast<CompiledFunction *>(this->callee.get())->entry(this->args);
+    }
+  };
+
+  auto callback_for(const Rc<Object> &func, size_t) -> unique_ptr<builtins::Callback> {
+    if (func->type() == FUNCTION_OBJ) {
+      return unique_ptr<builtins::Callback>(new EntryCallback(func));
+    } else if (func->type() == BUILTIN_OBJ) {
+      return unique_ptr<builtins::Callback>(new builtins::BuiltinCallback(static_pointer_cast<Builtin>(func)));
+    }
+    return nullptr;
+  }
+
+  auto hash_pair(map<HashKey, HashPair> &pairs, const Rc<Object> &key, const Rc<Object> &value) -> void {
+    pairs[dynamic_cast<Hashable *>(key.get())->hash_key()] = make_pair(key, value);
+  }
+
+  auto unusable_hash_key(const Rc<Object> &key) -> Rc<Object> {
+    return make_rc<Error>(format("unusable as hash key_obj: {0}", type_name(key->type())));
+  }
+
+  // prints what the program evaluates to, as the interpreter does
+  auto run(Rc<Object> (*program)()) -> int {
+    builtins::callback = callback_for;
+    try {
+      auto evaluated = program();
+      if (evaluated != nullptr) {
+        cout << evaluated->inspect() << endl;
+      }
+    } catch (std::runtime_error &e) {
+      cout << "runtime error: " << e.what () << endl;
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "code.hpp"
+#include "eval.hpp"
+#include "analysis.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+using namespace ast;
+using namespace object;
+using namespace code;
+
+namespace compiler {
+  // anything the register code doesn't cover, the statement or function
+  // is left to eval
+  class Unsupported : public std::runtime_error {
+  public:
+    explicit Unsupported(const string &what): std::runtime_error(what) {};
+  };
+
+  auto infix_opcode(Operator infix_operator, bool constant) -> Opcode {
+    Opcode op;
+    switch (infix_operator) {
+    case Operator::PLUS: op = Opcode::ADD; break;
+    case Operator::MINUS: op = Opcode::SUB; break;
+    case Operator::ASTERISK: op = Opcode::MUL; break;
+    case Operator::SLASH: op = Opcode::DIV; break;
+    case Operator::LT: op = Opcode::LT; break;
+    case Operator::GT: op = Opcode::GT; break;
+    case Operator::EQ: op = Opcode::EQ; break;
+    case Operator::NOT_EQ: op = Opcode::NE; break;
+    default:
+      throw Unsupported(format("infix operator {0}", operator_string(infix_operator)));
+    }
+
+    auto n = static_cast<size_t>(op);
+    if (constant) {
+      n += static_cast<size_t>(Opcode::ADD_K) - static_cast<size_t>(Opcode::ADD);
+    }
+    return static_cast<Opcode>(n);
+  }
+
+  // whether evaluating node may rebind a local of the function it is in
+  auto has_let(const Rc<Node> &node) -> bool {
+    bool found = false;
+    analysis::walk(node, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::LETSTATEMENT) {
+          found = true;
+        }
+        return !found && n->type() != NodeType::FUNCTIONLITERAL;
+      });
+    return found;
+  }
+
+  // Compiles a top level statement or a function body to register code.
+  // Parameters and lets of a function body get a register each, the rest
+  // of the frame are temporaries allocated like a stack. At the top level
+  // every variable lives in the environment.
+  class Compiler {
+  private:
+    Rc<Code> code;
+    bool top_level;
+    analysis::Locals locals;
+    // the statement of the body being compiled
+    size_t position = 0;
+    uint32_t next = 0;
+
+    explicit Compiler(bool t): code(make_rc<Code>()), top_level(t) {};
+
+    auto emit(Opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) -> size_t {
+      if (a > MAX_OPERAND || b > MAX_OPERAND || c > MAX_OPERAND) {
+        throw Unsupported(format("operand of {0} out of range", opcode_name(op)));
+      }
+      this->code->instructions.push_back({ op, static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c) });
+      return this->code->instructions.size() - 1;
+    }
+
+    // a jump target
+    auto here() -> uint16_t {
+      auto n = this->code->instructions.size();
+      if (n > MAX_OPERAND) {
+        throw Unsupported("jump out of range");
+      }
+      return static_cast<uint16_t>(n);
+    }
+
+    auto temp() -> uint32_t {
+      auto r = this->next++;
+      if (this->next > this->code->registers) {
+        this->code->registers = this->next;
+      }
+      return r;
+    }
+
+    auto constant(const Rc<Object> &obj) -> uint32_t {
+      this->code->constants.push_back(obj);
+      return static_cast<uint32_t>(this->code->constants.size() - 1);
+    }
+
+    auto name(const string &n) -> uint32_t {
+      auto &names = this->code->names;
+      for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == n) {
+          return static_cast<uint32_t>(i);
+        }
+      }
+      names.push_back(n);
+      return static_cast<uint32_t>(names.size() - 1);
+    }
+
+    // the register of a local that is certainly bound at this point, or -1
+    auto bound_local(const string &n) -> int64_t {
+      return this->locals.bound(n, this->position);
+    }
+
+    // a register holding the value of expr, the local itself if it can be
+    auto operand(const Rc<Expression> &expr) -> uint32_t {
+      if (expr->type() == NodeType::IDENTIFIER) {
+        auto local = this->bound_local(borrow_cast<Identifier>(expr)->value);
+        if (local >= 0) {
+          return static_cast<uint32_t>(local);
+        }
+      }
+      return this->in_temp(expr);
+    }
+
+    auto in_temp(const Rc<Expression> &expr) -> uint32_t {
+      auto t = this->temp();
+      this->expression(expr, t);
+      return t;
+    }
+
+    auto identifier(Identifier *id, uint32_t dest) -> void {
+      auto local = this->locals.find(id->value);
+      if (local < 0) {
+        this->emit(Opcode::GET_NAME, dest, this->name(id->value));
+        return;
+      }
+
+      auto bound = this->bound_local(id->value);
+      if (bound < 0) {
+        this->emit(Opcode::GET_LOCAL, dest, static_cast<uint32_t>(local), this->name(id->value));
+      } else if (static_cast<uint32_t>(bound) != dest) {
+        this->emit(Opcode::MOVE, dest, static_cast<uint32_t>(bound));
+      }
+    }
+
+    auto function_literal(FunctionLiteral *func, uint32_t dest) -> void {
+      ClosureInfo info = { func, this->top_level, {}, {} };
+      if (!this->top_level) {
+        // a literal that shares the frame's environment needs one
+        if (func->closure != Closure::FREE_VARIABLES) {
+          throw Unsupported("closure over the whole environment");
+        }
+        for (const auto &captured : func->captured) {
+          info.names.push_back(captured);
+          info.registers.push_back(this->bound_local(captured));
+        }
+      }
+
+      this->code->closures.push_back(info);
+      this->emit(Opcode::CLOSURE, dest, static_cast<uint32_t>(this->code->closures.size() - 1));
+    }
+
+    auto expression(const Rc<Expression> &expr, uint32_t dest) -> void {
+      auto mark = this->next;
+
+      switch (expr->type()) {
+      case NodeType::INTEGERLITERAL:
+        this->emit(Opcode::LOAD_CONST, dest, this->constant(make_rc<Integer>(borrow_cast<IntegerLiteral>(expr)->value)));
+        break;
+      case NodeType::STRINGLITERAL:
+        this->emit(Opcode::LOAD_CONST, dest, this->constant(make_rc<String>(borrow_cast<StringLiteral>(expr)->value)));
+        break;
+      case NodeType::BOOLEAN:
+        this->emit(Opcode::LOAD_CONST, dest, this->constant(eval::trans_boolean_object(borrow_cast<ast::Boolean>(expr)->value)));
+        break;
+      case NodeType::IDENTIFIER:
+        this->identifier(borrow_cast<Identifier>(expr), dest);
+        break;
+      case NodeType::PREFIXEXPRESSION: {
+        auto prefix = borrow_cast<PrefixExpression>(expr);
+        Opcode op;
+        if (prefix->op == Operator::MINUS) {
+          op = Opcode::NEG;
+        } else if (prefix->op == Operator::BANG) {
+          op = Opcode::NOT;
+        } else {
+          throw Unsupported(format("prefix operator {0}", prefix->prefix_operator));
+        }
+        auto right = this->operand(prefix->right);
+        this->emit(op, dest, right);
+        break;
+      }
+      case NodeType::INFIXEXPRESSION: {
+        auto infix = borrow_cast<InfixExpression>(expr);
+        // a let in the right operand must not change what the left one read
+        auto left = has_let(infix->right) ? this->in_temp(infix->left) : this->operand(infix->left);
+        if (infix->right->type() == NodeType::INTEGERLITERAL) {
+          auto k = this->constant(make_rc<Integer>(borrow_cast<IntegerLiteral>(infix->right)->value));
+          this->emit(infix_opcode(infix->op, true), dest, left, k);
+        } else {
+          // the result register is free until the instruction itself
+          // unless the left operand sits in it
+          uint32_t right = dest;
+          if (left == dest) {
+            right = this->operand(infix->right);
+          } else if (infix->right->type() == NodeType::IDENTIFIER && this->bound_local(borrow_cast<Identifier>(infix->right)->value) >= 0) {
+            right = this->operand(infix->right);
+          } else {
+            this->expression(infix->right, dest);
+          }
+          this->emit(infix_opcode(infix->op, false), dest, left, right);
+        }
+        break;
+      }
+      case NodeType::IFEXPRESSION: {
+        auto if_expr = borrow_cast<IfExpression>(expr);
+        auto condition = this->operand(if_expr->condition);
+        auto to_alternative = this->emit(Opcode::JUMP_IF_FALSE, condition);
+        this->next = mark;
+        this->block(if_expr->consequence.get(), dest);
+        auto to_end = this->emit(Opcode::JUMP);
+        this->code->instructions[to_alternative].b = this->here();
+        if (if_expr->alternative != nullptr) {
+          this->block(if_expr->alternative.get(), dest);
+        } else {
+          this->emit(Opcode::LOAD_NULL, dest);
+        }
+        this->code->instructions[to_end].a = this->here();
+        break;
+      }
+      case NodeType::FUNCTIONLITERAL:
+        this->function_literal(borrow_cast<FunctionLiteral>(expr), dest);
+        break;
+      case NodeType::CALLEXPRESSION: {
+        auto call = borrow_cast<CallExpression>(expr);
+        if (analysis::is_quote_call(expr)) {
+          throw Unsupported("quote");
+        }
+        auto callee = this->in_temp(call->function);
+        for (const auto &arg : call->arguments) {
+          this->in_temp(arg);
+        }
+        this->emit(Opcode::CALL, dest, callee, static_cast<uint32_t>(call->arguments.size()));
+        break;
+      }
+      case NodeType::ARRAYLITERAL: {
+        const auto &elements = borrow_cast<ArrayLiteral>(expr)->elements;
+        auto first = this->next;
+        for (const auto &elem : elements) {
+          this->in_temp(elem);
+        }
+        this->emit(Opcode::ARRAY, dest, first, static_cast<uint32_t>(elements.size()));
+        break;
+      }
+      case NodeType::INDEXEXPRESSION: {
+        auto index_expr = borrow_cast<IndexExpression>(expr);
+        auto left = has_let(index_expr->index) ? this->in_temp(index_expr->left) : this->operand(index_expr->left);
+        auto index = this->operand(index_expr->index);
+        this->emit(Opcode::INDEX, dest, left, index);
+        break;
+      }
+      case NodeType::HASHLITERAL: {
+        const auto &pairs = borrow_cast<HashLiteral>(expr)->pairs;
+        auto first = this->next;
+        for (const auto &pair : pairs) {
+          auto key = this->in_temp(pair.first);
+          this->emit(Opcode::HASH_KEY, key);
+          this->in_temp(pair.second);
+        }
+        this->emit(Opcode::HASH, dest, first, static_cast<uint32_t>(pairs.size()));
+        break;
+      }
+      default:
+        throw Unsupported(expr->to_string());
+      }
+
+      this->next = mark;
+    }
+
+    // want is false when nobody uses the value of the statement
+    auto statement(const Rc<Statement> &stmt, uint32_t dest, bool want) -> void {
+      auto mark = this->next;
+
+      switch (stmt->type()) {
+      case NodeType::EXPRESSIONSTATEMENT: {
+        auto expr = borrow_cast<ExpressionStatement>(stmt)->expression;
+        if (want) {
+          this->expression(expr, dest);
+        } else {
+          this->in_temp(expr);
+        }
+        break;
+      }
+      case NodeType::LETSTATEMENT: {
+        auto let = borrow_cast<LetStatement>(stmt);
+        if (this->top_level) {
+          auto value = this->in_temp(let->value);
+          this->emit(Opcode::SET_NAME, value, this->name(let->name->value));
+          if (want) {
+            this->emit(Opcode::MOVE, dest, value);
+          }
+        } else {
+          auto local = static_cast<uint32_t>(this->locals.find(let->name->value));
+          this->expression(let->value, local);
+          if (want && local != dest) {
+            this->emit(Opcode::MOVE, dest, local);
+          }
+        }
+        break;
+      }
+      case NodeType::RETURNSTATEMENT:
+        this->emit(Opcode::RETURN, this->operand(borrow_cast<ReturnStatement>(stmt)->value));
+        break;
+      default:
+        throw Unsupported(stmt->to_string());
+      }
+
+      this->next = mark;
+    }
+
+    auto block(BlockStatement *block, uint32_t dest) -> void {
+      const auto &stmts = block->statements;
+      if (stmts.empty()) {
+        this->emit(Opcode::LOAD_NIL, dest);
+      }
+      for (size_t i = 0; i < stmts.size(); i++) {
+        this->statement(stmts[i], dest, i + 1 == stmts.size());
+      }
+    }
+
+    auto declare_locals(const vector<Rc<Identifier>> &params, BlockStatement *body) -> void {
+      this->locals = analysis::Locals(params, body);
+      this->code->parameters = params.size();
+      this->next = static_cast<uint32_t>(this->locals.count);
+      this->code->registers = this->locals.count;
+    }
+
+  public:
+    // nullptr if the statement has to be left to eval
+    static auto compile_statement(const Rc<Statement> &stmt) -> Rc<Code> {
+      try {
+        Compiler c(true);
+        auto result = c.temp();
+        c.statement(stmt, result, true);
+        c.emit(Opcode::END, result);
+        return c.code;
+      } catch (Unsupported &) {
+        return nullptr;
+      }
+    }
+
+    // nullptr if calls of the function have to be left to eval
+    static auto compile_function(const vector<Rc<Identifier>> &params, BlockStatement *body) -> Rc<Code> {
+      try {
+        Compiler c(false);
+        c.declare_locals(params, body);
+        auto result = c.temp();
+        const auto &stmts = body->statements;
+        if (stmts.empty()) {
+          c.emit(Opcode::LOAD_NIL, result);
+        }
+        for (size_t i = 0; i < stmts.size(); i++) {
+          c.position = i;
+          c.statement(stmts[i], result, i + 1 == stmts.size());
+        }
+        c.emit(Opcode::RETURN, result);
+        return c.code;
+      } catch (Unsupported &) {
+        return nullptr;
+      }
+    }
+  };
+}
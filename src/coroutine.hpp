@@ -0,0 +1,201 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <exception>
+#include <functional>
+#if defined(__x86_64__) && defined(__linux__)
+#define COROUTINE_X86_64
+#else
+#include <ucontext.h>
+#endif
+
+using namespace std;
+
+#ifdef COROUTINE_X86_64
+// Saves the callee saved registers (and the sse and x87 control words) on
+// the current stack, stores the stack pointer in *save and carries on
+// from the stack restore points to. swapcontext does the same but also
+// makes two syscalls for the signal mask, every time.
+extern "C" void lc3_coroutine_switch(void **save, void *restore);
+asm(R"(
+    .text
+    .weak lc3_coroutine_switch
+    .type lc3_coroutine_switch, @function
+lc3_coroutine_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size lc3_coroutine_switch, .-lc3_coroutine_switch
+)");
+#endif
+
+// Stackful coroutines. The body runs on a stack of its own, so it can
+// suspend anywhere in the recursive evaluation of a function and resume
+// there, which a C++14 evaluator has no other way to do.
+namespace coroutine {
+  // As deep as the main thread's stack may grow (8MB where that has no
+  // limit), reserved up front: pages are only backed once they are
+  // touched.
+  auto stack_size() -> size_t {
+    const size_t fallback = 8 * 1024 * 1024;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur < fallback) {
+      return fallback;
+    }
+    return limit.rlim_cur;
+  }
+
+  const size_t STACK_SIZE = stack_size();
+
+  // what a body must have left of its stack to make another call
+  const size_t STACK_MARGIN = 256 * 1024;
+
+  class Coroutine {
+  private:
+#ifdef COROUTINE_X86_64
+    void *context = nullptr;
+    void *caller = nullptr;
+#else
+    ucontext_t context;
+    ucontext_t caller;
+#endif
+    char *stack = nullptr;
+    std::function<void()> body;
+    bool started = false;
+    bool finished = false;
+    std::exception_ptr failure = nullptr;
+
+    // the entry point only gets a stack, the coroutine being started is
+    // handed over here instead
+    static Coroutine *&starting() {
+      static Coroutine *c = nullptr;
+      return c;
+    }
+
+    static void trampoline() {
+      auto self = starting();
+      try {
+        self->body();
+      } catch (...) {
+        self->failure = std::current_exception();
+      }
+      self->finished = true;
+      // there is nothing to return to, the stack must not be fallen off
+      self->suspend();
+    }
+
+    auto start() -> void {
+      this->stack = static_cast<char *>(mmap(nullptr, STACK_SIZE, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+      if (this->stack == MAP_FAILED) {
+        this->stack = nullptr;
+        throw std::bad_alloc();
+      }
+      // the lowest page stops an overflow instead of corrupting memory
+      mprotect(this->stack, getpagesize(), PROT_NONE);
+#ifdef COROUTINE_X86_64
+      // what lc3_coroutine_switch pops: the control words, six registers
+      // and trampoline to return to, with an empty slot above it where
+      // trampoline's own return address would be (so the stack is aligned
+      // as on any call)
+      auto top = reinterpret_cast<uint64_t *>(this->stack + STACK_SIZE);
+      auto frame = top - 9;
+      frame[0] = 0x037F00001F80;  // the default x87 and sse control words
+      for (size_t i = 1; i < 7; i++) {
+        frame[i] = 0;
+      }
+      frame[7] = reinterpret_cast<uint64_t>(&trampoline);
+      frame[8] = 0;
+      this->context = frame;
+#else
+      getcontext(&this->context);
+      this->context.uc_stack.ss_sp = this->stack;
+      this->context.uc_stack.ss_size = STACK_SIZE;
+      this->context.uc_link = nullptr;
+      makecontext(&this->context, trampoline, 0);
+#endif
+      this->started = true;
+      starting() = this;
+    }
+
+  public:
+    explicit Coroutine(const std::function<void()> &b): body(b) {};
+
+    Coroutine(const Coroutine &) = delete;
+    Coroutine &operator=(const Coroutine &) = delete;
+
+    ~Coroutine() {
+      if (this->stack != nullptr) {
+        munmap(this->stack, STACK_SIZE);
+      }
+    }
+
+    // Runs the body until it suspends or returns. An exception the body
+    // throws comes out here, on the caller's stack.
+    auto resume() -> void {
+      if (this->finished) {
+        return;
+      }
+      if (!this->started) {
+        this->start();
+      }
+#ifdef COROUTINE_X86_64
+      lc3_coroutine_switch(&this->caller, this->context);
+#else
+      swapcontext(&this->caller, &this->context);
+#endif
+      if (this->failure != nullptr) {
+        auto failure = this->failure;
+        this->failure = nullptr;
+        std::rethrow_exception(failure);
+      }
+    }
+
+    // back to whoever resumed, from inside the body
+    auto suspend() -> void {
+#ifdef COROUTINE_X86_64
+      lc3_coroutine_switch(&this->context, this->caller);
+#else
+      swapcontext(&this->context, &this->caller);
+#endif
+    }
+
+    // bytes of stack below the caller's frame, from inside the body
+    auto stack_left() -> size_t {
+      char here;
+      return static_cast<size_t>(&here - this->stack) - getpagesize();
+    }
+
+    // suspended in the middle of the body
+    auto suspended() -> bool {
+      return this->started && !this->finished;
+    }
+
+    auto done() -> bool {
+      return this->finished;
+    }
+  };
+}
@@ -5,9 +5,12 @@
 #include "builtins.hpp"
 #include "quote_unquote.hpp"
 #include "modify.hpp"
+#include "analysis.hpp"
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <memory>
+#include <functional>
 #ifndef FORMAT_HEADER
 #define FORMAT_HEADER
 #include <fmt/format.h>
@@ -21,22 +24,28 @@ using namespace object;
 using namespace modify;
 using namespace quoteunquote;
 
+namespace tier {
+  auto call(object::Function *func, const Rc<Object> *args, size_t count, Rc<Object> &result) -> bool;
+}
+
 namespace eval {
-  shared_ptr<Object> NULLOBJ = make_shared<Null>();
-  shared_ptr<Object> TRUEOBJ = make_shared<object::Boolean>(true);
-  shared_ptr<Object> FALSEOBJ = make_shared<object::Boolean>(false);
+  Rc<Object> NULLOBJ = make_rc<Null>();
+  Rc<Object> TRUEOBJ = make_rc<object::Boolean>(true);
+  Rc<Object> FALSEOBJ = make_rc<object::Boolean>(false);
+
+  auto eval(const Rc<Node> &node, const Rc<Environment> &env) -> Rc<Object>;
 
-  auto eval(shared_ptr<Node> node, shared_ptr<Environment> env) -> shared_ptr<Object>;
+  auto quote(const Rc<Node> &node, const Rc<Environment> &env) -> Rc<Object>;
 
-  auto quote(shared_ptr<Node> node, shared_ptr<Environment> env) -> shared_ptr<Object>;
+  auto eval_rebinding(const string &name, const Rc<Expression> &value, const Rc<Environment> &env) -> Rc<Object>;
 
-  auto eval_unquote_calls(shared_ptr<Node> quoted, shared_ptr<Environment> env) -> shared_ptr<Node> {
-    return modify::modify(quoted, [&](shared_ptr<Node> node) -> shared_ptr<Node> {
+  auto eval_unquote_calls(const Rc<Node> &quoted, const Rc<Environment> &env) -> Rc<Node> {
+    return modify::modify(quoted, [&](const Rc<Node> &node) -> Rc<Node> {
         if (!is_unquote_call(node)) {
           return node;
         }
 
-        auto call = static_pointer_cast<CallExpression>(node);
+        auto call = borrow_cast<CallExpression>(node);
         if (call->arguments.size() != 1) {
           return node;
         }
@@ -46,21 +55,59 @@ namespace eval {
       });
   }
 
-  auto quote(shared_ptr<Node> node, shared_ptr<Environment> env) -> shared_ptr<Object> {
+  auto quote(const Rc<Node> &node, const Rc<Environment> &env) -> Rc<Object> {
     auto new_node = eval_unquote_calls(node, env);
-    return make_shared<Quote>(new_node);
+    return make_rc<Quote>(new_node);
   }
 
-  auto eval_program(shared_ptr<Program> program, shared_ptr<Environment> env) -> shared_ptr<Object> {
-    shared_ptr<Object> result;
+  auto statement_region() -> region::Region & {
+    // leaked, retired chunks may be released during static destruction
+    static auto r = new region::Region();
+    return *r;
+  }
 
-    auto stmts = program->statements;
-    for (const auto &stmt : stmts) {
+  // Evaluates a top level statement with its temporaries allocated in the
+  // statement region. Only the value the program may hand back (the last
+  // statement, a return or an error) is promoted, bindings made by let
+  // were already promoted by Environment::set.
+  auto eval_statement_in_region(const Rc<Statement> &stmt, const Rc<Environment> &env, bool is_last) -> Rc<Object> {
+    Rc<Object> result;
+    {
+      region::Scope scope(&statement_region());
       result = eval(stmt, env);
+      if (result != nullptr) {
+        auto rt = result->type();
+        if (is_last || rt == RETURN_VALUE_OBJ || rt == ERROR_OBJ) {
+          result = promote(result);
+        } else {
+          result = nullptr;
+        }
+      }
+    }
+    statement_region().reset();
+    return result;
+  }
+
+  auto eval_program(Program *program, const Rc<Environment> &env) -> Rc<Object> {
+    Rc<Object> result;
+
+    analysis::resolve_closures(program);
+    analysis::fuse(program);
+    analysis::mark_last_uses(program);
+
+    const auto &stmts = program->statements;
+    for (size_t i = 0; i < stmts.size(); i++) {
+      const auto &stmt = stmts[i];
+      result = nullptr;
+      if (region::per_statement && region::current == nullptr) {
+        result = eval_statement_in_region(stmt, env, i + 1 == stmts.size());
+      } else {
+        result = eval(stmt, env);
+      }
 
       if (result != nullptr) {
         if (result->type() == RETURN_VALUE_OBJ) {
-          return static_pointer_cast<ReturnValue>(result)->value;
+          return borrow_cast<ReturnValue>(result)->value;
         } else if (result->type() == ERROR_OBJ) {
           return result;
         }
@@ -70,11 +117,13 @@ namespace eval {
     return result;
   }
 
-  auto eval_block_statement(shared_ptr<BlockStatement> block, shared_ptr<Environment> env) {
-    shared_ptr<Object> result;
+  auto eval_block_statement(BlockStatement *block, const Rc<Environment> &env) {
+    Rc<Object> result;
 
-    auto stmts = block->statements;
+    const auto &stmts = block->statements;
     for (const auto &stmt : stmts) {
+      // the previous value mustn't keep a variable's value from being unique
+      result = nullptr;
       result = eval(stmt, env);
 
       if (result != nullptr) {
@@ -88,7 +137,7 @@ namespace eval {
     return result;
   }
 
-  auto is_error(shared_ptr<Object> o) -> bool {
+  auto is_error(const Rc<Object> &o) -> bool {
     if (o != nullptr) {
       return o->type() == ERROR_OBJ;
     } else {
@@ -96,9 +145,9 @@ namespace eval {
     }
   }
 
-  auto is_truthy(shared_ptr<Object> obj) -> bool {
+  auto is_truthy(const Rc<Object> &obj) -> bool {
     if (obj->type() == BOOLEAN_OBJ) {
-      return static_pointer_cast<object::Boolean>(obj)->value;
+      return borrow_cast<object::Boolean>(obj)->value;
     } else if (obj->type() == NULL_OBJ) {
       return false;
     } else {
@@ -106,13 +155,13 @@ namespace eval {
     }
   }
 
-  auto trans_boolean_object(bool input) -> shared_ptr<Object> {
+  auto trans_boolean_object(bool input) -> Rc<Object> {
     return input ? TRUEOBJ : FALSEOBJ;
   }
 
-  auto eval_bang_operator_expression(shared_ptr<Object> right) -> shared_ptr<Object> {
+  auto eval_bang_operator_expression(const Rc<Object> &right) -> Rc<Object> {
     if (right->type() == BOOLEAN_OBJ) {
-      shared_ptr<object::Boolean> bo = static_pointer_cast<object::Boolean>(right);
+      auto bo = borrow_cast<object::Boolean>(right);
       if (bo->value) {
         return FALSEOBJ;
       } else {
@@ -125,89 +174,218 @@ namespace eval {
     }
   }
 
-  auto eval_minus_prefix_operator_expression(shared_ptr<Object> right) -> shared_ptr<Object> {
+  auto eval_minus_prefix_operator_expression(const Rc<Object> &right) -> Rc<Object> {
     if (right->type() != INTEGER_OBJ) {
-      return make_shared<Error>(format("unknown operator: -{0}", right->type()));
+      return make_rc<Error>(format("unknown operator: -{0}", type_name(right->type())));
     } else {
-      auto val = static_pointer_cast<Integer>(right)->value;
-      return make_shared<Integer>(-val);
+      auto val = borrow_cast<Integer>(right)->value;
+      return make_rc<Integer>(-val);
     }
   }
 
-  auto eval_prefix_expression(string prefix_operator, shared_ptr<Object> right) -> shared_ptr<Object> {
-    if (prefix_operator == "!") {
+  auto eval_prefix_expression(Operator op, const Rc<Object> &right) -> Rc<Object> {
+    switch (op) {
+    case Operator::BANG:
       return eval_bang_operator_expression(right);
-    } else if (prefix_operator == "-") {
+    case Operator::MINUS:
       return eval_minus_prefix_operator_expression(right);
-    } else {
-      return make_shared<Error>(format("unknown prefix_operator: {0}{1}", prefix_operator, right->type()));
-    }
-  }
-
-  auto eval_integer_infix_expression(string infix_operator,
-                                     shared_ptr<Object> left,
-                                     shared_ptr<Object> right) -> shared_ptr<Object> {
-    auto left_int = static_pointer_cast<Integer>(left)->value;
-    auto right_int = static_pointer_cast<Integer>(right)->value;
-
-    if (infix_operator == "+") {
-      return make_shared<Integer>(left_int + right_int);
-    } else if (infix_operator == "-") {
-      return make_shared<Integer>(left_int - right_int);
-    } else if (infix_operator == "*") {
-      return make_shared<Integer>(left_int * right_int);
-    } else if (infix_operator == "/") {
-      return make_shared<Integer>(left_int / right_int);
-    } else if (infix_operator == "<") {
-      return trans_boolean_object(left_int < right_int);
-    } else if (infix_operator == ">") {
-      return trans_boolean_object(left_int > right_int);
-    } else if (infix_operator == "==") {
-      return trans_boolean_object(left_int == right_int);
-    } else if (infix_operator == "!=") {
-      return trans_boolean_object(left_int != right_int);
-    } else {
-      return make_shared<Error>(format("unknown operator: {0} {1} {2}", left->type(), infix_operator, right->type()));
+    default:
+      return make_rc<Error>(format("unknown prefix_operator: {0}{1}", operator_string(op), type_name(right->type())));
     }
   }
 
-  auto eval_string_infix_expression(string infix_operator,
-                                    shared_ptr<Object> left,
-                                    shared_ptr<Object> right) -> shared_ptr<Object> {
-    if (infix_operator == "+") {
-      auto left_str = static_pointer_cast<String>(left)->value;
-      auto right_str = static_pointer_cast<String>(right)->value;
-      return make_shared<String>(left_str + right_str);
-    } else {
-      return make_shared<Error>(format("unknown operator: {0} {1} {2}", left->type(), infix_operator, right->type()));
+  typedef Rc<Object> (*InfixHandler)(Operator op, const Rc<Object> &left, const Rc<Object> &right);
+
+  template <typename Op>
+  auto integer_arithmetic(Operator, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return make_rc<Integer>(Op()(borrow_cast<Integer>(left)->value, borrow_cast<Integer>(right)->value));
+  }
+
+  template <typename Op>
+  auto integer_comparison(Operator, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return trans_boolean_object(Op()(borrow_cast<Integer>(left)->value, borrow_cast<Integer>(right)->value));
+  }
+
+  auto string_concatenation(Operator, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return make_rc<String>(borrow_cast<String>(left)->value + borrow_cast<String>(right)->value);
+  }
+
+  // arrays and hashes compare by value, see object::operator==
+  auto equal(Operator, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return trans_boolean_object(object::operator==(left, right));
+  }
+
+  auto not_equal(Operator, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return trans_boolean_object(object::operator!=(left, right));
+  }
+
+  auto type_mismatch(Operator op, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return make_rc<Error>(format("type mismatch: {0} {1} {2}", type_name(left->type()), operator_string(op), type_name(right->type())));
+  }
+
+  auto unknown_operator(Operator op, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+    return make_rc<Error>(format("unknown operator: {0} {1} {2}", type_name(left->type()), operator_string(op), type_name(right->type())));
+  }
+
+  // Infix handlers indexed by the types of both operands and the operator.
+  // Integers and strings get their own rows, any other pair compares by
+  // value or fails.
+  struct InfixTable {
+    InfixHandler handlers[OBJECT_TYPES][OBJECT_TYPES][OPERATORS];
+
+    InfixTable() {
+      for (size_t l = 0; l < OBJECT_TYPES; l++) {
+        for (size_t r = 0; r < OBJECT_TYPES; r++) {
+          for (size_t o = 0; o < OPERATORS; o++) {
+            auto op = static_cast<Operator>(o);
+            if (op == Operator::EQ) {
+              this->handlers[l][r][o] = equal;
+            } else if (op == Operator::NOT_EQ) {
+              this->handlers[l][r][o] = not_equal;
+            } else if (l != r) {
+              this->handlers[l][r][o] = type_mismatch;
+            } else {
+              this->handlers[l][r][o] = unknown_operator;
+            }
+          }
+        }
+      }
+
+      auto integers = this->handlers[static_cast<size_t>(INTEGER_OBJ)][static_cast<size_t>(INTEGER_OBJ)];
+      integers[static_cast<size_t>(Operator::PLUS)] = integer_arithmetic<std::plus<int>>;
+      integers[static_cast<size_t>(Operator::MINUS)] = integer_arithmetic<std::minus<int>>;
+      integers[static_cast<size_t>(Operator::ASTERISK)] = integer_arithmetic<std::multiplies<int>>;
+      integers[static_cast<size_t>(Operator::SLASH)] = integer_arithmetic<std::divides<int>>;
+      integers[static_cast<size_t>(Operator::LT)] = integer_comparison<std::less<int>>;
+      integers[static_cast<size_t>(Operator::GT)] = integer_comparison<std::greater<int>>;
+      integers[static_cast<size_t>(Operator::EQ)] = integer_comparison<std::equal_to<int>>;
+      integers[static_cast<size_t>(Operator::NOT_EQ)] = integer_comparison<std::not_equal_to<int>>;
+
+      // strings only concatenate, they don't even compare
+      auto strings = this->handlers[static_cast<size_t>(STRING_OBJ)][static_cast<size_t>(STRING_OBJ)];
+      for (size_t o = 0; o < OPERATORS; o++) {
+        strings[o] = unknown_operator;
+      }
+      strings[static_cast<size_t>(Operator::PLUS)] = string_concatenation;
+    }
+  };
+
+  const InfixTable infix_table;
+
+  auto eval_infix_expression(Operator op,
+                             const Rc<Object> &left,
+                             const Rc<Object> &right) -> Rc<Object> {
+    auto handler = infix_table.handlers[static_cast<size_t>(left->type())][static_cast<size_t>(right->type())][static_cast<size_t>(op)];
+    return handler(op, left, right);
+  }
+
+  auto lookup(const string &name, Environment *env) -> Rc<Object> {
+    auto val = env->get(name);
+    if (val != nullptr) {
+      return val;
     }
+
+    auto builtin = builtins::builtins[name];
+    if (builtin != nullptr) {
+      return builtin;
+    }
+
+    return make_rc<Error>(format("identifier not found: {0}", name));
   }
 
-  auto eval_infix_expression(string infix_operator,
-                             shared_ptr<Object> left,
-                             shared_ptr<Object> right) -> shared_ptr<Object> {
+  auto eval_identifier(Identifier *id_expr, const Rc<Environment> &env) -> Rc<Object> {
+    // a parameter the optimized tier resolved, while env is its frame
+    if (id_expr->parameter != nullptr) {
+      auto names = env->slot_names;
+      if (names != nullptr && id_expr->slot < names->size() && (*names)[id_expr->slot].get() == id_expr->parameter) {
+        if (id_expr->last_use != nullptr && env->body == id_expr->last_use) {
+          return std::move(env->slots[id_expr->slot]);
+        }
+        return env->slots[id_expr->slot];
+      }
+    }
+    // nothing reads it after this in the call, it's handed over
+    if (id_expr->last_use != nullptr && env->body == id_expr->last_use) {
+      auto local = env->local(id_expr->value);
+      if (local != nullptr && *local != nullptr) {
+        return std::move(*local);
+      }
+    }
+    return lookup(id_expr->value, env.get());
+  }
+
+  auto compare_integers(Operator op, int left, int right) -> bool {
+    switch (op) {
+    case Operator::LT:
+      return left < right;
+    case Operator::GT:
+      return left > right;
+    case Operator::EQ:
+      return left == right;
+    default:
+      return left != right;
+    }
+  }
+
+  // a name is looked up without going through eval
+  auto eval_operand(const Rc<Expression> &expr, const Rc<Environment> &env) -> Rc<Object> {
+    if (expr->type() == NodeType::IDENTIFIER) {
+      return eval_identifier(borrow_cast<Identifier>(expr), env);
+    }
+    return eval(expr, env);
+  }
+
+  // The condition of a fused compare-and-branch: integers pick the branch
+  // without a Boolean in between, an integer literal on the right isn't
+  // evaluated. error is set when an operand or the comparison fails.
+  auto eval_comparison(InfixExpression *cond, const Rc<Environment> &env, Rc<Object> &error) -> bool {
+    auto left = eval_operand(cond->left, env);
+    if (is_error(left)) {
+      error = left;
+      return false;
+    }
+    if (left->type() == INTEGER_OBJ && cond->right->type() == NodeType::INTEGERLITERAL) {
+      return compare_integers(cond->op, borrow_cast<Integer>(left)->value, borrow_cast<IntegerLiteral>(cond->right)->value);
+    }
+
+    auto right = eval_operand(cond->right, env);
+    if (is_error(right)) {
+      error = right;
+      return false;
+    }
     if (left->type() == INTEGER_OBJ && right->type() == INTEGER_OBJ) {
-      return eval_integer_infix_expression(infix_operator, left, right);
-    } else if (left->type() == STRING_OBJ && right->type() == STRING_OBJ) {
-      return eval_string_infix_expression(infix_operator, left, right);
-    } else if (infix_operator == "==") {
-      return trans_boolean_object(left == right);
-    } else if (infix_operator == "!=") {
-      return trans_boolean_object(left != right);
-    } else if (left->type() != right->type()) {
-      return make_shared<Error>(format("type mismatch: {0} {1} {2}", left->type(), infix_operator, right->type()));
-    } else {
-      return make_shared<Error>(format("unknown operator: {0} {1} {2}", left->type(), infix_operator, right->type()));
+      return compare_integers(cond->op, borrow_cast<Integer>(left)->value, borrow_cast<Integer>(right)->value);
+    }
+    auto result = eval_infix_expression(cond->op, left, right);
+    if (is_error(result)) {
+      error = result;
+      return false;
+    }
+    return is_truthy(result);
+  }
+
+  // whether the condition of an if or a while holds, error is set when
+  // evaluating it fails
+  auto eval_condition(const Rc<Expression> &condition, Fused fused, const Rc<Environment> &env, Rc<Object> &error) -> bool {
+    if (fused == Fused::COMPARE_BRANCH) {
+      return eval_comparison(borrow_cast<InfixExpression>(condition), env, error);
     }
+    auto evaluated = eval(condition, env);
+    if (is_error(evaluated)) {
+      error = evaluated;
+      return false;
+    }
+    return is_truthy(evaluated);
   }
 
-  auto eval_if_expression(shared_ptr<IfExpression> if_expr, shared_ptr<Environment> env) -> shared_ptr<Object> {
-    auto condition = eval(if_expr->condition, env);
-    if (is_error(condition)) {
-      return condition;
+  auto eval_if_expression(IfExpression *if_expr, const Rc<Environment> &env) -> Rc<Object> {
+    Rc<Object> error = nullptr;
+    auto taken = eval_condition(if_expr->condition, if_expr->fused, env, error);
+    if (error != nullptr) {
+      return error;
     }
 
-    if (is_truthy(condition)) {
+    if (taken) {
       return eval(if_expr->consequence, env);
     } else if (if_expr->alternative != nullptr) {
       return eval(if_expr->alternative, env);
@@ -216,77 +394,301 @@ namespace eval {
     }
   }
 
-  auto eval_identifier(shared_ptr<Identifier> id_expr, shared_ptr<Environment> env) -> shared_ptr<Object> {
-    auto val = env->get(id_expr->value);
-    if (val != nullptr) {
-      return val;
+  // A loop may reset the statement region between iterations when it runs
+  // in the heap environment of a top level statement: what outlives an
+  // iteration was promoted when it was bound (see Environment::set), and
+  // a chunk something else still lives in is retired, not reused.
+  auto recycles_region(Environment *env) -> bool {
+    return region::current == &statement_region() && !region::owns(env);
+  }
+
+  // Runs a loop body once in the loop's own environment, false when the
+  // loop stops with result, a return or an error.
+  auto eval_iteration(BlockStatement *body, const Rc<Environment> &env, bool recycle, Rc<Object> &result) -> bool {
+    {
+      auto evaluated = eval_block_statement(body, env);
+      if (evaluated != nullptr) {
+        auto rt = evaluated->type();
+        if (rt == RETURN_VALUE_OBJ || rt == ERROR_OBJ) {
+          result = evaluated;
+          return false;
+        }
+      }
+    }
+    if (recycle) {
+      statement_region().reset();
     }
+    return true;
+  }
 
-    auto builtin = builtins::builtins[id_expr->value];
-    if (builtin != nullptr) {
-      return builtin;
+  // Loops bind in the environment they run in, lets in the body rebind
+  // the same names each iteration. Unlike recursion an iteration costs no
+  // environment, argument vector or return value.
+  auto eval_while_statement(WhileStatement *while_stmt, const Rc<Environment> &env) -> Rc<Object> {
+    auto recycle = recycles_region(env.get());
+    Rc<Object> result = nullptr;
+    while (true) {
+      auto holds = eval_condition(while_stmt->condition, while_stmt->fused, env, result);
+      if (result != nullptr) {
+        return result;
+      }
+      if (!holds) {
+        return NULLOBJ;
+      }
+      if (!eval_iteration(while_stmt->body.get(), env, recycle, result)) {
+        return result;
+      }
+    }
+  }
+
+  // arrays are iterated by element, hashes by key
+  auto eval_for_statement(ForStatement *for_stmt, const Rc<Environment> &env) -> Rc<Object> {
+    auto iterable = eval(for_stmt->iterable, env);
+    if (is_error(iterable)) {
+      return iterable;
+    }
+
+    auto recycle = recycles_region(env.get());
+    const auto &name = for_stmt->variable->value;
+    Rc<Object> result = nullptr;
+    if (iterable->type() == SEQUENCE_OBJ || iterable->type() == GENERATOR_OBJ) {
+      // computed one element at a time
+      auto stop = builtins::elements(iterable, [&](const Rc<Object> &element) -> Rc<Object> {
+          env->set(name, element);
+          return eval_iteration(for_stmt->body.get(), env, recycle, result) ? nullptr : result;
+        });
+      return stop != nullptr ? stop : NULLOBJ;
+    }
+
+    if (iterable->type() == HASH_OBJ) {
+      vector<Rc<Object>> keys = {};
+      for (const auto &pair : borrow_cast<Hash>(iterable)->pairs) {
+        keys.push_back(pair.second.first);
+      }
+      iterable = make_rc<Array>(keys);
+    } else if (iterable->type() != ARRAY_OBJ) {
+      return make_rc<Error>(format("not iterable: {0}", type_name(iterable->type())));
     }
 
-    return make_shared<Error>(format("identifier not found: {0}", id_expr->value));
+    auto arr = borrow_cast<Array>(iterable);
+    for (size_t i = 0; i < arr->size(); i++) {
+      env->set(name, arr->at(i));
+      if (!eval_iteration(for_stmt->body.get(), env, recycle, result)) {
+        return result;
+      }
+    }
+    return NULLOBJ;
   }
 
-  auto eval_expressions(vector<shared_ptr<Expression>> exprs, shared_ptr<Environment> env) {
-    vector<shared_ptr<Object>> result = {};
+  auto eval_expressions(const vector<Rc<Expression>> &exprs, const Rc<Environment> &env) {
+    vector<Rc<Object>> result = {};
     for (size_t i = 0; i < exprs.size(); i++) {
       auto evaluated = eval(exprs[i], env);
       if (is_error(evaluated)) {
-        return vector<shared_ptr<Object>>({ evaluated });
+        return vector<Rc<Object>>({ evaluated });
       }
       result.push_back(evaluated);
     }
     return result;
   }
 
-  auto extend_function_env(shared_ptr<object::Function> func, vector<shared_ptr<Object>> args) -> shared_ptr<Environment> {
+  FrameStack frames;
+
+  // the arguments are moved into the environment
+  auto extend_function_env(object::Function *func, vector<Rc<Object>> &args) -> Rc<Environment> {
     auto env = new_enclosed_environment(func->env);
+    env->body = func->body.get();
     for (size_t i = 0; i < func->parameters.size(); i++) {
-      env->set(func->parameters[i]->value, args[i]);
+      // a missing argument is left unbound, as in a frame's slots
+      env->set(func->parameters[i]->value, i < args.size() ? std::move(args[i]) : nullptr);
     }
 
     return env;
   }
 
-  auto unwrap_return_value(shared_ptr<Object> obj) -> shared_ptr<Object> {
+  // inside a region the environment is a bump allocation already
+  auto on_frame_stack(object::Function *func) -> bool {
+    return region::current == nullptr && !analysis::captures_environment(func->body);
+  }
+
+  auto unwrap_return_value(const Rc<Object> &obj) -> Rc<Object> {
     if (obj->type() == RETURN_VALUE_OBJ) {
-      return static_pointer_cast<ReturnValue>(obj)->value;
+      return borrow_cast<ReturnValue>(obj)->value;
     } else {
       return obj;
     }
   }
 
-  auto apply_function(shared_ptr<Object> obj, vector<shared_ptr<Object>> args) -> shared_ptr<Object> {
+  // copies of just the captured variables on top of the root (global)
+  // environment, instead of the whole defining chain
+  auto closure_environment(FunctionLiteral *func, const Rc<Environment> &env) -> Rc<Environment> {
+    auto root = env.get();
+    while (root->outer != nullptr) {
+      root = root->outer.get();
+    }
+
+    if (func->captured.empty()) {
+      return Rc<Environment>(root);
+    }
+    auto closure = new_enclosed_environment(Rc<Environment>(root));
+    for (const auto &name : func->captured) {
+      closure->store[name] = env->get(name);
+    }
+    return closure;
+  }
+
+  auto apply_on_stack(object::Function *func, const FrameStack::Slots &slots) -> Rc<Object> {
+    Rc<Object> evaluated;
+    {
+      auto env = frames.push(func, slots);
+      evaluated = unwrap_return_value(eval(func->body, env));
+    }
+    frames.pop(slots);
+    return evaluated;
+  }
+
+  // A call of a function with yield in its body. Nothing of the body runs
+  // yet, it runs up to the next yield whenever the generator is asked for
+  // a value. The generator and what it runs with outlive any region.
+  auto make_generator(const Rc<Object> &obj, vector<Rc<Object>> &args) -> Rc<Object> {
+    auto callee = promote(obj);
+    for (auto &arg : args) {
+      arg = promote(arg);
+    }
+    region::Scope heap(nullptr);
+    auto env = extend_function_env(borrow_cast<object::Function>(callee), args);
+    auto generator = make_rc<Generator>(&frames);
+    generator->start([callee, env]() {
+        return eval(borrow_cast<object::Function>(callee)->body, env);
+      });
+    return generator;
+  }
+
+  auto eval_yield_expression(YieldExpression *yield_expr, const Rc<Environment> &env) -> Rc<Object> {
+    auto generator = Generator::running();
+    if (generator == nullptr) {
+      return make_rc<Error>("yield outside a generator");
+    }
+    auto value = eval(yield_expr->value, env);
+    if (is_error(value)) {
+      return value;
+    }
+    if (!generator->yield(value)) {
+      // unwinds the body of a generator nobody holds anymore
+      return make_rc<Error>("generator closed");
+    }
+    return NULLOBJ;
+  }
+
+  // A generator body runs on a stack of its own (see coroutine.hpp), a
+  // call that would overflow it fails instead
+  auto stack_overflow() -> Rc<Object> {
+    auto generator = Generator::running();
+    if (generator != nullptr && !generator->has_stack_left()) {
+      return make_rc<Error>("stack overflow in generator");
+    }
+    return nullptr;
+  }
+
+  // args is taken over, so a value handed over stays unique in the call
+  auto apply_function(const Rc<Object> &obj, vector<Rc<Object>> args) -> Rc<Object> {
     if (obj->type() == FUNCTION_OBJ) {
-      auto func = static_pointer_cast<object::Function>(obj);
+      auto overflow = stack_overflow();
+      if (overflow != nullptr) {
+        return overflow;
+      }
+      auto func = borrow_cast<object::Function>(obj);
+      if (analysis::is_generator(func->body)) {
+        return make_generator(obj, args);
+      }
+      Rc<Object> result;
+      if (tier::call(func, args.data(), args.size(), result)) {
+        return result;
+      }
+      if (on_frame_stack(func)) {
+        auto slots = frames.reserve(std::max(args.size(), func->parameters.size()));
+        if (slots.begin != nullptr) {
+          for (size_t i = 0; i < args.size(); i++) {
+            slots.begin[i] = std::move(args[i]);
+          }
+          return apply_on_stack(func, slots);
+        }
+      }
       auto extended_env = extend_function_env(func, args);
-      auto evaluated = eval(func->body, extended_env);
-      return unwrap_return_value(evaluated);
+      return unwrap_return_value(eval(func->body, extended_env));
     } else if (obj->type() == BUILTIN_OBJ) {
-      auto builtin = static_pointer_cast<Builtin>(obj);
+      auto builtin = borrow_cast<Builtin>(obj);
       return builtin->func(args);
     } else {
-      return make_shared<Error>(format("not a function: {0}", obj->type()));
+      return make_rc<Error>(format("not a function: {0}", type_name(obj->type())));
     }
   }
 
-  auto eval_array_index_expression(shared_ptr<Array> arr, shared_ptr<Integer> index) -> shared_ptr<Object> {
-    auto max = static_cast<int>(arr->elements.size() - 1);
+  // Calls of a function from a builtin in one frame: its slots are
+  // reserved once and refilled for every call, no vector in between.
+  class FrameCallback : public builtins::Callback {
+    Rc<Object> callee;
+    object::Function *func;
+    FrameStack::Slots slots;
+
+  public:
+    FrameCallback(const Rc<Object> &f, size_t count)
+      : callee(f), func(borrow_cast<object::Function>(f)),
+        slots(on_frame_stack(func) ? frames.reserve(std::max(count, func->parameters.size())) : FrameStack::Slots{ nullptr, 0, 0, 0 }) {};
+
+    ~FrameCallback() {
+      if (this->slots.begin != nullptr) {
+        frames.release(this->slots);
+      }
+    }
+
+    auto call(Rc<Object> *args, size_t count) -> Rc<Object> {
+      Rc<Object> result;
+      if (tier::call(this->func, args, count, result)) {
+        return result;
+      }
+      if (this->slots.begin == nullptr) {
+        return apply_function(this->callee, vector<Rc<Object>>(make_move_iterator(args), make_move_iterator(args + count)));
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        this->slots.begin[i] = std::move(args[i]);
+      }
+      {
+        auto env = frames.push(this->func, this->slots);
+        result = unwrap_return_value(eval(this->func->body, env));
+      }
+      frames.leave();
+      for (size_t i = 0; i < this->slots.count; i++) {
+        this->slots.begin[i] = nullptr;
+      }
+      return result;
+    }
+  };
+
+  auto callback_for(const Rc<Object> &func, size_t count) -> unique_ptr<builtins::Callback> {
+    if (func->type() == FUNCTION_OBJ) {
+      return unique_ptr<builtins::Callback>(new FrameCallback(func, count));
+    } else if (func->type() == BUILTIN_OBJ) {
+      return unique_ptr<builtins::Callback>(new builtins::BuiltinCallback(static_pointer_cast<Builtin>(func)));
+    }
+    return nullptr;
+  }
+
+  auto eval_array_index_expression(Array *arr, Integer *index) -> Rc<Object> {
+    auto max = static_cast<int>(arr->size() - 1);
     auto idx = index->value;
     if (idx < 0 || idx > max) {
       return NULLOBJ;
     }
 
-    return arr->elements[idx];
+    return arr->at(idx);
   }
 
-  auto eval_hash_index_expression(shared_ptr<Hash> hash, shared_ptr<Object> index) -> shared_ptr<Object> {
+  auto eval_hash_index_expression(Hash *hash, const Rc<Object> &index) -> Rc<Object> {
     if (is_hashable(index)) {
-      auto pairs = hash->pairs;
-      auto key = dynamic_pointer_cast<Hashable>(index)->hash_key();
+      const auto &pairs = hash->pairs;
+      auto key = dynamic_cast<Hashable *>(index.get())->hash_key();
       auto result = pairs.find(key);
       if (result != pairs.end()) {
         return result->second.second;
@@ -294,22 +696,22 @@ namespace eval {
         return NULLOBJ;
       }
     } else {
-      return make_shared<Error>(format("unusable as hash key: {0}", index->type()));
+      return make_rc<Error>(format("unusable as hash key: {0}", type_name(index->type())));
     }
   }
 
-  auto eval_index_expression(shared_ptr<Object> left, shared_ptr<Object> index) -> shared_ptr<Object> {
+  auto eval_index_expression(const Rc<Object> &left, const Rc<Object> &index) -> Rc<Object> {
     if (left->type() == ARRAY_OBJ && index->type() == INTEGER_OBJ) {
-      return eval_array_index_expression(static_pointer_cast<Array>(left),
-                                         static_pointer_cast<Integer>(index));
+      return eval_array_index_expression(borrow_cast<Array>(left),
+                                         borrow_cast<Integer>(index));
     } else if (left->type() == HASH_OBJ) {
-      return eval_hash_index_expression(static_pointer_cast<Hash>(left), index);
+      return eval_hash_index_expression(borrow_cast<Hash>(left), index);
     } else {
-      return make_shared<Error>(format("index operator not supported: {0}", left->type()));
+      return make_rc<Error>(format("index operator not supported: {0}", type_name(left->type())));
     }
   }
 
-  auto eval_hash_literal(shared_ptr<HashLiteral> hash_expr, shared_ptr<Environment> env) -> shared_ptr<Object> {
+  auto eval_hash_literal(HashLiteral *hash_expr, const Rc<Environment> &env) -> Rc<Object> {
     map<HashKey, HashPair> pairs = {};
     for (auto iter = hash_expr->pairs.begin(); iter != hash_expr->pairs.end(); iter++) {
       auto key_obj = eval(iter->first, env);
@@ -318,7 +720,7 @@ namespace eval {
       }
 
       if (!is_hashable(key_obj)) {
-        return make_shared<Error>(format("unusable as hash key_obj: {0}", key_obj->type()));
+        return make_rc<Error>(format("unusable as hash key_obj: {0}", type_name(key_obj->type())));
       }
 
       auto value_obj = eval(iter->second, env);
@@ -326,120 +728,458 @@ namespace eval {
         return value_obj;
       }
 
-      auto hashed = dynamic_pointer_cast<Hashable>(key_obj)->hash_key();
+      auto hashed = dynamic_cast<Hashable *>(key_obj.get())->hash_key();
       pairs[hashed] = make_pair(key_obj, value_obj);
     }
-    return make_shared<Hash>(pairs);
+    return make_rc<Hash>(pairs);
 }
 
-  auto eval(shared_ptr<Node> node, shared_ptr<Environment> env) -> shared_ptr<Object> {
+  // Makes the array or hash a place holds its own before it is changed in
+  // place: one someone else references too is copied (allocated next to
+  // its holder) and the place rebound to the copy.
+  auto make_unique(Rc<Object> &place, bool heap) -> void {
+    if (is_unique(place)) {
+      return;
+    }
+    region::Scope scope(heap ? nullptr : region::current);
+    if (place->type() == ARRAY_OBJ) {
+      place = make_rc<Array>(*borrow_cast<Array>(place));
+    } else {
+      place = make_rc<Hash>(borrow_cast<Hash>(place)->pairs);
+    }
+  }
+
+  // Rebinds a variable where it is bound (let binds in the current
+  // environment), or stores into an element of the array or hash it
+  // holds, so an array of n elements is built in O(n) by appending at
+  // a[len(a)]. Arrays and hashes are values: what is changed in place is
+  // only ever referenced by the target, others keep the value they had.
+  auto eval_assign_statement(AssignStatement *assign, const Rc<Environment> &env) -> Rc<Object> {
+    auto variable = assign->variable();
+    if (variable == nullptr) {
+      return make_rc<Error>(format("cannot assign to {0}", assign->target->to_string()));
+    }
+
+    // every index first, user code may change what the places point into
+    vector<Rc<Object>> indexes = {};
+    for (auto target = assign->target.get(); target->type() == NodeType::INDEXEXPRESSION;
+         target = static_cast<IndexExpression *>(target)->left.get()) {
+      auto index = eval(static_cast<IndexExpression *>(target)->index, env);
+      if (is_error(index)) {
+        return index;
+      }
+      indexes.push_back(index);
+    }
+    std::reverse(indexes.begin(), indexes.end());
+
+    auto value = assign->rebinds ? eval_rebinding(variable->value, assign->value, env) : eval(assign->value, env);
+    if (is_error(value)) {
+      return value;
+    }
+
+    Environment *owner = nullptr;
+    auto place = env->binding(variable->value, owner);
+    if (place == nullptr) {
+      return make_rc<Error>(format("identifier not found: {0}", variable->value));
+    }
+    if (indexes.empty()) {
+      return owner->set(variable->value, value);
+    }
+
+    // what a level other than the last indexes must be there already, and
+    // be indexable itself
+    auto descends_into = [](const Rc<Object> &element) -> Rc<Object> {
+      if (element->type() != ARRAY_OBJ && element->type() != HASH_OBJ) {
+        return make_rc<Error>(format("index operator not supported: {0}", type_name(element->type())));
+      }
+      return nullptr;
+    };
+
+    auto heap = outlives_region(owner);
+    for (const auto &index : indexes) {
+      auto last = &index == &indexes.back();
+      auto type = (*place)->type();
+      if (type == ARRAY_OBJ && index->type() == INTEGER_OBJ) {
+        // one past the end appends
+        auto idx = borrow_cast<Integer>(index)->value;
+        auto size = borrow_cast<Array>(*place)->size();
+        if (idx < 0 || static_cast<size_t>(idx) > size || (!last && static_cast<size_t>(idx) == size)) {
+          return make_rc<Error>(format("index out of range: {0}", idx));
+        }
+        if (!last) {
+          auto error = descends_into(borrow_cast<Array>(*place)->at(idx));
+          if (error != nullptr) {
+            return error;
+          }
+        }
+        make_unique(*place, heap);
+        heap = outlives_region(place->get());
+        auto arr = borrow_cast<Array>(*place);
+        if (arr->is_unboxed() && last && value->type() == INTEGER_OBJ) {
+          // stays unboxed
+          auto &values = arr->values();
+          auto v = borrow_cast<Integer>(value)->value;
+          if (static_cast<size_t>(idx) == values.size()) {
+            values.push_back(v);
+          } else {
+            values[idx] = v;
+          }
+          return value;
+        }
+        auto &elements = arr->elements();
+        if (static_cast<size_t>(idx) == elements.size()) {
+          elements.push_back(nullptr);
+        }
+        place = &elements[idx];
+      } else if (type == HASH_OBJ) {
+        if (!is_hashable(index)) {
+          return make_rc<Error>(format("unusable as hash key: {0}", type_name(index->type())));
+        }
+        auto key = dynamic_cast<Hashable *>(index.get())->hash_key();
+        if (!last) {
+          auto &pairs = borrow_cast<Hash>(*place)->pairs;
+          auto found = pairs.find(key);
+          if (found == pairs.end()) {
+            return make_rc<Error>(format("key not found: {0}", index->inspect()));
+          }
+          auto error = descends_into(found->second.second);
+          if (error != nullptr) {
+            return error;
+          }
+        }
+        make_unique(*place, heap);
+        heap = outlives_region(place->get());
+        auto &pair = borrow_cast<Hash>(*place)->pairs[key];
+        if (pair.first == nullptr) {
+          pair.first = heap ? promote(index) : index;
+        }
+        place = &pair.second;
+      } else {
+        return make_rc<Error>(format("index operator not supported: {0}", type_name(type)));
+      }
+    }
+    *place = heap ? promote(value) : value;
+    return value;
+  }
+
+  auto integer_infix(Operator op, int left, int right) -> Rc<Object> {
+    switch (op) {
+    case Operator::PLUS:
+      return make_rc<Integer>(left + right);
+    case Operator::MINUS:
+      return make_rc<Integer>(left - right);
+    case Operator::ASTERISK:
+      return make_rc<Integer>(left * right);
+    case Operator::SLASH:
+      return make_rc<Integer>(left / right);
+    case Operator::LT:
+      return trans_boolean_object(left < right);
+    case Operator::GT:
+      return trans_boolean_object(left > right);
+    case Operator::EQ:
+      return trans_boolean_object(left == right);
+    default:
+      return trans_boolean_object(left != right);
+    }
+  }
+
+  auto quicken_infix(InfixExpression *infix, const Rc<Object> &left, const Rc<Object> &right) -> Quickened {
+    if (left->type() != INTEGER_OBJ || right->type() != INTEGER_OBJ ||
+        infix->op == Operator::BANG || infix->op == Operator::UNKNOWN) {
+      return Quickened::GENERIC;
+    }
+    return infix->right->type() == NodeType::INTEGERLITERAL ? Quickened::INTEGER_CONSTANT : Quickened::INTEGERS;
+  }
+
+  // Drops env's own binding of name while it holds value, leaving value
+  // unique for an update in place; the binding is given back the result.
+  auto release(Environment *env, const string &name, const Rc<Object> &value) -> Rc<Object> * {
+    auto local = env->local(name);
+    if (local == nullptr || local->get() != value.get()) {
+      return nullptr;
+    }
+    *local = nullptr;
+    return local;
+  }
+
+  // string + string appends to the left string when nobody else sees it
+  auto concatenate(const Rc<Object> &left, const Rc<Object> &right, const Rc<Environment> &env, const string *rebinding) -> Rc<Object> {
+    auto local = rebinding != nullptr ? release(env.get(), *rebinding, left) : nullptr;
+    Rc<Object> result;
+    if (is_unique(left)) {
+      borrow_cast<String>(left)->value += borrow_cast<String>(right)->value;
+      result = left;
+    } else {
+      result = string_concatenation(Operator::PLUS, left, right);
+    }
+    if (local != nullptr) {
+      *local = result;
+    }
+    return result;
+  }
+
+  auto eval_infix_node(InfixExpression *infix, const Rc<Environment> &env, const string *rebinding = nullptr) -> Rc<Object> {
+    // fused name op integer literal
+    if (infix->fused == Fused::NAME_CONSTANT) {
+      auto left = eval_identifier(borrow_cast<Identifier>(infix->left), env);
+      if (left->type() == INTEGER_OBJ) {
+        return integer_infix(infix->op, borrow_cast<Integer>(left)->value, borrow_cast<IntegerLiteral>(infix->right)->value);
+      }
+      if (is_error(left)) {
+        return left;
+      }
+      return eval_infix_expression(infix->op, left, eval(infix->right, env));
+    }
+    if (infix->constant != nullptr) {
+      return Rc<Object>(static_cast<Object *>(infix->constant.get()));
+    }
+
+    auto left = eval(infix->left, env);
+    if (is_error(left)) {
+      return left;
+    }
+
+    if (infix->quickened == Quickened::INTEGER_CONSTANT) {
+      if (left->type() == INTEGER_OBJ) {
+        return integer_infix(infix->op, borrow_cast<Integer>(left)->value, borrow_cast<IntegerLiteral>(infix->right)->value);
+      }
+      infix->quickened = Quickened::GENERIC;
+    }
+
+    auto right = eval(infix->right, env);
+    if (is_error(right)) {
+      return right;
+    }
+
+    if (infix->quickened == Quickened::INTEGERS) {
+      if (left->type() == INTEGER_OBJ && right->type() == INTEGER_OBJ) {
+        return integer_infix(infix->op, borrow_cast<Integer>(left)->value, borrow_cast<Integer>(right)->value);
+      }
+      infix->quickened = Quickened::GENERIC;
+    } else if (infix->quickened == Quickened::UNSEEN) {
+      infix->quickened = quicken_infix(infix, left, right);
+    }
+    if (infix->op == Operator::PLUS && left->type() == STRING_OBJ && right->type() == STRING_OBJ) {
+      return concatenate(left, right, env, rebinding);
+    }
+    return eval_infix_expression(infix->op, left, right);
+  }
+
+  auto eval_index_node(IndexExpression *index_expr, const Rc<Environment> &env) -> Rc<Object> {
+    // fused name[...]
+    auto left_obj = index_expr->fused == Fused::NAME_INDEX ? eval_operand(index_expr->left, env) : eval(index_expr->left, env);
+    if (is_error(left_obj)) {
+      return left_obj;
+    }
+    auto index_obj = eval_operand(index_expr->index, env);
+    if (is_error(index_obj)) {
+      return index_obj;
+    }
+
+    auto array_integer = left_obj->type() == ARRAY_OBJ && index_obj->type() == INTEGER_OBJ;
+    if (index_expr->quickened == Quickened::ARRAY_INTEGER) {
+      if (array_integer) {
+        return eval_array_index_expression(borrow_cast<Array>(left_obj), borrow_cast<Integer>(index_obj));
+      }
+      index_expr->quickened = Quickened::GENERIC;
+    } else if (index_expr->quickened == Quickened::UNSEEN) {
+      index_expr->quickened = array_integer ? Quickened::ARRAY_INTEGER : Quickened::GENERIC;
+    }
+    return eval_index_expression(left_obj, index_obj);
+  }
+
+  // A global callee comes from the call site's cache while the root
+  // environment is unchanged, otherwise it is looked up and cached again.
+  auto global_callee(CallExpression *call_expr, Environment *env) -> Rc<Object> {
+    auto root = env;
+    while (root->outer != nullptr) {
+      root = root->outer.get();
+    }
+    // the root's store (or the builtins) still holds the cached callee
+    if (call_expr->cached_root == root && call_expr->cached_version == root->version) {
+      return Rc<Object>(static_cast<Object *>(call_expr->cached_callee));
+    }
+
+    auto callee = lookup(borrow_cast<Identifier>(call_expr->function)->value, env);
+    if (is_error(callee)) {
+      call_expr->cached_root = nullptr;
+      return callee;
+    }
+    call_expr->cached_root = root;
+    call_expr->cached_version = root->version;
+    call_expr->cached_callee = callee.get();
+    if (callee->type() == FUNCTION_OBJ) {
+      auto func = borrow_cast<object::Function>(callee);
+      call_expr->cached_on_stack = !analysis::captures_environment(func->body);
+      call_expr->cached_slots = std::max(call_expr->arguments.size(), func->parameters.size());
+    }
+    return callee;
+  }
+
+  auto eval_call_expression(CallExpression *call_expr, const Rc<Environment> &env, const string *rebinding = nullptr) -> Rc<Object> {
+    // a call quickens only once it has been seen not to be a quote
+    if (call_expr->quickened == Quickened::UNSEEN && call_expr->function->token_literal() == "quote") {
+      return quote(call_expr->arguments[0], env);
+    }
+    auto overflow = stack_overflow();
+    if (overflow != nullptr) {
+      return overflow;
+    }
+
+    auto func_obj = call_expr->global_callee ? global_callee(call_expr, env.get()) : eval(call_expr->function, env);
+    if (is_error(func_obj)) {
+      return func_obj;
+    }
+
+    auto type = func_obj->type();
+    if (call_expr->quickened == Quickened::FUNCTION && type != FUNCTION_OBJ) {
+      call_expr->quickened = Quickened::GENERIC;
+    } else if (call_expr->quickened == Quickened::BUILTIN && type != BUILTIN_OBJ) {
+      call_expr->quickened = Quickened::GENERIC;
+    } else if (call_expr->quickened == Quickened::UNSEEN) {
+      call_expr->quickened = type == FUNCTION_OBJ ? Quickened::FUNCTION
+        : type == BUILTIN_OBJ ? Quickened::BUILTIN : Quickened::GENERIC;
+    }
+
+    // arguments of a call on the frame stack are evaluated straight
+    // into its slots, no vector in between
+    auto cached = call_expr->global_callee && call_expr->cached_callee == func_obj.get();
+    if (call_expr->quickened == Quickened::FUNCTION &&
+        (cached ? region::current == nullptr && call_expr->cached_on_stack : on_frame_stack(borrow_cast<object::Function>(func_obj)))) {
+      auto func = borrow_cast<object::Function>(func_obj);
+      auto &exprs = call_expr->arguments;
+      auto slots = frames.reserve(cached ? call_expr->cached_slots : std::max(exprs.size(), func->parameters.size()));
+      if (slots.begin != nullptr) {
+        for (size_t i = 0; i < exprs.size(); i++) {
+          auto evaluated = eval(exprs[i], env);
+          if (is_error(evaluated)) {
+            frames.release(slots);
+            return evaluated;
+          }
+          slots.begin[i] = std::move(evaluated);
+        }
+        Rc<Object> result;
+        if (tier::call(func, slots.begin, exprs.size(), result)) {
+          frames.release(slots);
+          return result;
+        }
+        return apply_on_stack(func, slots);
+      }
+    }
+
+    auto args = eval_expressions(call_expr->arguments, env);
+    if (args.size() == 1 && is_error(args[0])) {
+      return args[0];
+    }
+
+    if (call_expr->quickened == Quickened::BUILTIN) {
+      auto builtin = borrow_cast<Builtin>(func_obj);
+      auto local = rebinding != nullptr && builtin->in_place ? release(env.get(), *rebinding, args[0]) : nullptr;
+      if (local == nullptr) {
+        return builtin->func(args);
+      }
+      auto result = builtin->func(args);
+      *local = is_error(result) ? args[0] : result;
+      return result;
+    }
+    return apply_function(func_obj, std::move(args));
+  }
+
+  // The value of let name = f(name, ...) or name + ...: the old value of
+  // name is handed over to an in place builtin or + when env binds name
+  // itself, as it is rebound right after anyway.
+  auto eval_rebinding(const string &name, const Rc<Expression> &value, const Rc<Environment> &env) -> Rc<Object> {
+    if (value->type() == NodeType::CALLEXPRESSION) {
+      return eval_call_expression(borrow_cast<CallExpression>(value), env, &name);
+    }
+    return eval_infix_node(borrow_cast<InfixExpression>(value), env, &name);
+  }
+
+  auto eval(const Rc<Node> &node, const Rc<Environment> &env) -> Rc<Object> {
     switch (node->type()) {
     case NodeType::PROGRAM:
-      return eval_program(static_pointer_cast<Program>(node), env);
+      return eval_program(borrow_cast<Program>(node), env);
     case NodeType::BLOCKSTATEMENT:
-      return eval_block_statement(static_pointer_cast<BlockStatement>(node), env);
+      return eval_block_statement(borrow_cast<BlockStatement>(node), env);
     case NodeType::EXPRESSIONSTATEMENT:
-      return eval(static_pointer_cast<ExpressionStatement>(node)->expression, env);
+      return eval(borrow_cast<ExpressionStatement>(node)->expression, env);
     case NodeType::RETURNSTATEMENT: {
-      auto val = eval(static_pointer_cast<ReturnStatement>(node)->value, env);
+      auto val = eval(borrow_cast<ReturnStatement>(node)->value, env);
       if (is_error(val)) {
         return val;
       } else {
-        return make_shared<ReturnValue>(val);
+        return make_rc<ReturnValue>(val);
       }
     }
     case NodeType::LETSTATEMENT: {
-      auto let = static_pointer_cast<LetStatement>(node);
-      auto val = eval(let->value, env);
+      auto let = borrow_cast<LetStatement>(node);
+      auto val = let->rebinds ? eval_rebinding(let->name->value, let->value, env) : eval(let->value, env);
       if (is_error(val)) {
         return val;
       } else {
         return env->set(let->name->value, val);
       }
     }
+    case NodeType::ASSIGNSTATEMENT:
+      return eval_assign_statement(borrow_cast<AssignStatement>(node), env);
+    case NodeType::WHILESTATEMENT:
+      return eval_while_statement(borrow_cast<WhileStatement>(node), env);
+    case NodeType::FORSTATEMENT:
+      return eval_for_statement(borrow_cast<ForStatement>(node), env);
     case NodeType::INTEGERLITERAL: {
-      return make_shared<Integer>(static_pointer_cast<IntegerLiteral>(node)->value);
+      return make_rc<Integer>(borrow_cast<IntegerLiteral>(node)->value);
     }
     case NodeType::STRINGLITERAL:
-      return make_shared<String>(static_pointer_cast<StringLiteral>(node)->value);
+      return make_rc<String>(borrow_cast<StringLiteral>(node)->value);
     case NodeType::BOOLEAN:
-      return trans_boolean_object(static_pointer_cast<ast::Boolean>(node)->value);
+      return trans_boolean_object(borrow_cast<ast::Boolean>(node)->value);
     case NodeType::PREFIXEXPRESSION: {
-      auto prefix = static_pointer_cast<PrefixExpression>(node);
+      auto prefix = borrow_cast<PrefixExpression>(node);
+      if (prefix->constant != nullptr) {
+        return Rc<Object>(static_cast<Object *>(prefix->constant.get()));
+      }
       auto right = eval(prefix->right, env);
       if (is_error(right)) {
         return right;
       } else {
-        return eval_prefix_expression(prefix->prefix_operator, right);
+        return eval_prefix_expression(prefix->op, right);
       }
     }
-    case NodeType::INFIXEXPRESSION: {
-      auto infix = static_pointer_cast<InfixExpression>(node);
-      auto left = eval(infix->left, env);
-      if (is_error(left)) {
-        return left;
-      }
-      auto right = eval(infix->right, env);
-      if (is_error(right)) {
-        return right;
-      }
-
-      return eval_infix_expression(infix->infix_operator, left, right);
-    }
+    case NodeType::INFIXEXPRESSION:
+      return eval_infix_node(borrow_cast<InfixExpression>(node), env);
     case NodeType::IFEXPRESSION:
-      return eval_if_expression(static_pointer_cast<IfExpression>(node), env);
+      return eval_if_expression(borrow_cast<IfExpression>(node), env);
     case NodeType::IDENTIFIER:
-      return eval_identifier(static_pointer_cast<Identifier>(node), env);
+      return eval_identifier(borrow_cast<Identifier>(node), env);
+    case NodeType::YIELDEXPRESSION:
+      return eval_yield_expression(borrow_cast<YieldExpression>(node), env);
     case NodeType::FUNCTIONLITERAL: {
-      auto func_expr = static_pointer_cast<FunctionLiteral>(node);
-      auto params = func_expr->parameters;
-      auto body = func_expr->body;
-      // closure here, save the current context
-      return make_shared<object::Function>(params, body, env);
-    }
-    case NodeType::CALLEXPRESSION: {
-      auto call_expr = static_pointer_cast<CallExpression>(node);
-
-      if (call_expr->function->token_literal() == "quote") {
-        return quote(call_expr->arguments[0], env);
-      }
-
-      auto func_obj = eval(call_expr->function, env);
-      if (is_error(func_obj)) {
-        return func_obj;
+      auto func_expr = borrow_cast<FunctionLiteral>(node);
+      if (func_expr->closure == Closure::FREE_VARIABLES) {
+        return make_rc<object::Function>(func_expr->parameters, func_expr->body, closure_environment(func_expr, env));
       }
-
-      auto args = eval_expressions(call_expr->arguments, env);
-      if (args.size() == 1 && is_error(args[0])) {
-        return args[0];
-      }
-
-      return apply_function(func_obj, args);
+      // closure here, save the current context
+      return make_rc<object::Function>(func_expr->parameters, func_expr->body, env);
     }
+    case NodeType::CALLEXPRESSION:
+      return eval_call_expression(borrow_cast<CallExpression>(node), env);
     case NodeType::ARRAYLITERAL: {
-      auto arr_expr = static_pointer_cast<ArrayLiteral>(node);
+      auto arr_expr = borrow_cast<ArrayLiteral>(node);
       auto elements = eval_expressions(arr_expr->elements, env);
       if (elements.size() == 1 && is_error(elements[0])) {
         return elements[0];
       }
-      return make_shared<Array>(elements);
-    }
-    case NodeType::INDEXEXPRESSION: {
-      auto index_expr = static_pointer_cast<IndexExpression>(node);
-      auto left_obj = eval(index_expr->left, env);
-      if (is_error(left_obj)) {
-        return left_obj;
-      }
-      auto index_obj = eval(index_expr->index, env);
-      if (is_error(index_obj)) {
-        return index_obj;
-      }
-      return eval_index_expression(left_obj, index_obj);
+      return make_rc<Array>(elements);
     }
+    case NodeType::INDEXEXPRESSION:
+      return eval_index_node(borrow_cast<IndexExpression>(node), env);
     case NodeType::HASHLITERAL:
-      return eval_hash_literal(static_pointer_cast<HashLiteral>(node), env);
+      return eval_hash_literal(borrow_cast<HashLiteral>(node), env);
     default:
       return nullptr;
     }
   }
 }
+
+#include "jit.hpp"
+#include "tier.hpp"
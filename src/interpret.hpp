@@ -10,7 +10,11 @@
 #include "parser.hpp"
 #include "object.hpp"
 #include "eval.hpp"
+#include "vm.hpp"
+#include "closure_compiler.hpp"
 #include "macro_expansion.hpp"
+#include "pool.hpp"
+#include "transpiler.hpp"
 
 using namespace std;
 using namespace ast;
@@ -21,6 +25,27 @@ using namespace eval;
 using namespace macroexpansion;
 
 namespace interpret {
+  enum class Engine {
+    EVAL,     // walks the ast
+    VM,       // register code, see vm.hpp
+    CLOSURE   // a tree of pre-bound callables, see closure_compiler.hpp
+  };
+
+  Engine engine = Engine::EVAL;
+
+  auto parse_engine(const string &name, Engine &result) -> bool {
+    if (name == "eval") {
+      result = Engine::EVAL;
+    } else if (name == "vm") {
+      result = Engine::VM;
+    } else if (name == "closure") {
+      result = Engine::CLOSURE;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
   auto check_parser_errors(shared_ptr<Parser> p) -> bool {
     auto errors = p->get_errors();
     if (errors.size() == 0) {
@@ -34,10 +59,10 @@ namespace interpret {
     return true;
   }
 
-  auto interp(const string &input, shared_ptr<Environment> env, shared_ptr<Environment> macro_env) -> void {
+  auto interp(const string &input, Rc<Environment> env, Rc<Environment> macro_env) -> void {
     shared_ptr<Lexer> l = Lexer::new_lexer(input);
     shared_ptr<Parser> p = Parser::new_parser(l);
-    shared_ptr<Program> program = p->parse_program();
+    Rc<Program> program = p->parse_program();
     if (check_parser_errors(p)) {
       return;
     }
@@ -45,7 +70,18 @@ namespace interpret {
     try {
       define_macros(program, macro_env);
       auto expanded = expand_macros(program, macro_env);
-      auto evaluated = eval::eval(expanded, env);
+      Rc<Object> evaluated;
+      switch (engine) {
+      case Engine::VM:
+        evaluated = vm::run(borrow_cast<Program>(expanded), env);
+        break;
+      case Engine::CLOSURE:
+        evaluated = closurecompiler::run(borrow_cast<Program>(expanded), env);
+        break;
+      default:
+        evaluated = eval::eval(expanded, env);
+        break;
+      }
       if (evaluated != nullptr) {
         cout << evaluated->inspect() << endl;
       }
@@ -54,15 +90,79 @@ namespace interpret {
     }
   }
 
-  auto load(const string &path, shared_ptr<Environment> env, shared_ptr<Environment> macro_env) -> void {
+  auto load(const string &path, Rc<Environment> env, Rc<Environment> macro_env) -> void {
     ifstream in(path);
     string input((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
     interp(input, env, macro_env);
   }
 
   auto run(const string &path) -> void {
-    auto env = make_shared<Environment>();
-    auto macro_env = make_shared<Environment>();
+    auto env = make_rc<Environment>();
+    auto macro_env = make_rc<Environment>();
     load(path, env, macro_env);
   }
+
+  // writes the C++ translation of the script at path to output, see
+  // transpiler.hpp
+  auto compile(const string &path, const string &output) -> bool {
+    ifstream in(path);
+    if (!in) {
+      cout << "cannot read " << path << endl;
+      return false;
+    }
+    string input((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    shared_ptr<Parser> p = Parser::new_parser(Lexer::new_lexer(input));
+    Rc<Program> program = p->parse_program();
+    if (check_parser_errors(p)) {
+      return false;
+    }
+
+    string code;
+    try {
+      auto macro_env = make_rc<Environment>();
+      define_macros(program, macro_env);
+      auto expanded = expand_macros(program, macro_env);
+      code = transpiler::transpile(borrow_cast<Program>(expanded), path);
+    } catch (transpiler::Unsupported &e) {
+      cout << "cannot compile: " << e.what() << endl;
+      return false;
+    }
+
+    ofstream out(output);
+    out << code;
+    return static_cast<bool>(out);
+  }
+
+  // the shapes of the given scripts after macro expansion, most frequent
+  // first
+  auto print_shape_profile(const vector<string> &paths) -> void {
+    map<string, size_t> profile = {};
+    auto macro_env = make_rc<Environment>();
+    for (const auto &path : paths) {
+      ifstream in(path);
+      string input((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+      shared_ptr<Parser> p = Parser::new_parser(Lexer::new_lexer(input));
+      Rc<Program> program = p->parse_program();
+      if (check_parser_errors(p)) {
+        continue;
+      }
+      define_macros(program, macro_env);
+      analysis::profile_shapes(expand_macros(program, macro_env), profile);
+    }
+
+    vector<pair<string, size_t>> shapes(profile.begin(), profile.end());
+    std::stable_sort(shapes.begin(), shapes.end(), [](const pair<string, size_t> &a, const pair<string, size_t> &b) {
+        return a.second > b.second;
+      });
+    for (const auto &s : shapes) {
+      cout << format("{0:>6}  {1}", s.second, s.first) << endl;
+    }
+  }
+
+  auto print_pool_stats() -> void {
+    cout << format("{0:<14}{1:>6}{2:>8}{3:>10}{4:>14}{5:>14}{6:>10}", "pool", "size", "slabs", "capacity", "allocations", "frees", "live") << endl;
+    for (const auto &s : pool::stats()) {
+      cout << format("{0:<14}{1:>6}{2:>8}{3:>10}{4:>14}{5:>14}{6:>10}", s.name, s.object_size, s.slabs, s.capacity, s.allocations, s.frees, s.live()) << endl;
+    }
+  }
 }
@@ -0,0 +1,513 @@
+#pragma once
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "eval.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define JIT_X86_64
+#endif
+#ifndef FORMAT_HEADER
+#define FORMAT_HEADER
+#include <fmt/format.h>
+#include <fmt/format.cc>
+#endif
+
+using namespace std;
+using namespace ast;
+using namespace fmt;
+using namespace object;
+
+// A baseline jit for the eval engine, the top tier of tier.hpp. A hot
+// function's body is translated, one template per node, to x86-64. Only
+// pure integer code is covered: parameters and lets of the body, integer
+// literals, arithmetic, comparisons, if, return and calls of global
+// names. Since that code has no side effects, a native call that runs
+// into anything else (a callee that isn't compiled, an argument that
+// isn't an integer) gives up as a whole and eval runs the function again.
+namespace jit {
+  bool enabled = true;
+
+  // what native code returns when it gives up, no int32 sign extends to it
+  const int64_t BAILOUT = INT64_MIN;
+
+  // native code of a function body: args holds one int32 per 8 bytes, env
+  // is the function's environment for resolving callees
+  typedef int64_t (*Entry)(const int64_t *args, Environment *env);
+
+  class Unsupported : public std::runtime_error {
+  public:
+    explicit Unsupported(const string &what): std::runtime_error(what) {};
+  };
+
+  class Native : public RefCounted {
+  public:
+    Entry entry = nullptr;
+    void *memory = nullptr;
+    size_t size = 0;
+
+    ~Native() {
+#ifdef JIT_X86_64
+      if (this->memory != nullptr) {
+        munmap(this->memory, this->size);
+      }
+#endif
+    }
+  };
+
+  size_t compiled_functions = 0;
+  size_t bailouts = 0;
+
+  auto native(object::Function *func) -> Native *;
+
+  // Calls of global names from native code come through here: the callee
+  // is resolved with the call site's cache, compiled if it hasn't been yet
+  // and entered directly.
+  int64_t call_global(CallExpression *site, Environment *env, const int64_t *args) {
+    auto callee = eval::global_callee(site, env);
+    if (callee->type() != FUNCTION_OBJ) {
+      return BAILOUT;
+    }
+    auto func = borrow_cast<object::Function>(callee);
+    if (func->parameters.size() != site->arguments.size()) {
+      return BAILOUT;
+    }
+    auto code = native(func);
+    if (code == nullptr) {
+      return BAILOUT;
+    }
+    return code->entry(args, func->env.get());
+  }
+
+  enum class Type {
+    INT,
+    BOOL,
+    UNIT,   // nothing the rest of the code may use
+    NEVER   // control left through a return
+  };
+
+  // the handful of x86-64 instructions the templates are made of
+  class Assembler {
+  public:
+    vector<uint8_t> bytes = {};
+
+    auto emit(std::initializer_list<uint8_t> bs) -> void {
+      this->bytes.insert(this->bytes.end(), bs);
+    }
+
+    auto imm32(int32_t v) -> void {
+      uint8_t b[4];
+      memcpy(b, &v, 4);
+      this->bytes.insert(this->bytes.end(), b, b + 4);
+    }
+
+    auto imm64(uint64_t v) -> void {
+      uint8_t b[8];
+      memcpy(b, &v, 8);
+      this->bytes.insert(this->bytes.end(), b, b + 8);
+    }
+
+    // a rel32 to be patched, returns its offset
+    auto jump(std::initializer_list<uint8_t> op) -> size_t {
+      this->emit(op);
+      this->imm32(0);
+      return this->bytes.size() - 4;
+    }
+
+    auto patch(size_t at, size_t target) -> void {
+      auto rel = static_cast<int32_t>(target - (at + 4));
+      memcpy(&this->bytes[at], &rel, 4);
+    }
+
+    auto here() -> size_t {
+      return this->bytes.size();
+    }
+  };
+
+  class Compiler {
+  private:
+    Assembler a;
+    map<string, int32_t> parameters = {};
+    map<string, int32_t> lets = {};
+    size_t let_count = 0;
+    // 8 byte pushes since the frame was set up, for aligning calls
+    size_t depth = 0;
+    vector<size_t> to_success = {};
+    vector<size_t> to_bailout = {};
+
+    auto push() -> void {
+      this->a.emit({ 0x50 });                                 // push rax
+      this->depth++;
+    }
+
+    auto local(int32_t slot) -> int32_t {
+      return -24 - 8 * slot;
+    }
+
+    auto identifier(Identifier *id) -> Type {
+      auto param = this->parameters.find(id->value);
+      if (param != this->parameters.end()) {
+        this->a.emit({ 0x8b, 0x83 });                         // mov eax, [rbx + disp32]
+        this->a.imm32(8 * param->second);
+        return Type::INT;
+      }
+      auto let = this->lets.find(id->value);
+      if (let != this->lets.end()) {
+        this->a.emit({ 0x8b, 0x85 });                         // mov eax, [rbp + disp32]
+        this->a.imm32(this->local(let->second));
+        return Type::INT;
+      }
+      throw Unsupported(format("name {0}", id->value));
+    }
+
+    // left in eax, right in ecx
+    auto operands(InfixExpression *infix) -> pair<Type, Type> {
+      auto left = this->expression(infix->left);
+      if (infix->right->type() == NodeType::INTEGERLITERAL) {
+        this->a.emit({ 0xb9 });                               // mov ecx, imm32
+        this->a.imm32(borrow_cast<IntegerLiteral>(infix->right)->value);
+        return make_pair(left, Type::INT);
+      }
+      this->push();
+      auto right = this->expression(infix->right);
+      this->a.emit({ 0x89, 0xc1 });                           // mov ecx, eax
+      this->a.emit({ 0x58 });                                 // pop rax
+      this->depth--;
+      return make_pair(left, right);
+    }
+
+    auto infix(InfixExpression *infix) -> Type {
+      auto types = this->operands(infix);
+      auto ints = types.first == Type::INT && types.second == Type::INT;
+      auto bools = types.first == Type::BOOL && types.second == Type::BOOL;
+      switch (infix->op) {
+      case Operator::PLUS:
+      case Operator::MINUS:
+      case Operator::ASTERISK:
+      case Operator::SLASH:
+        if (!ints) {
+          break;
+        }
+        if (infix->op == Operator::PLUS) {
+          this->a.emit({ 0x01, 0xc8 });                       // add eax, ecx
+        } else if (infix->op == Operator::MINUS) {
+          this->a.emit({ 0x29, 0xc8 });                       // sub eax, ecx
+        } else if (infix->op == Operator::ASTERISK) {
+          this->a.emit({ 0x0f, 0xaf, 0xc1 });                 // imul eax, ecx
+        } else {
+          this->a.emit({ 0x99, 0xf7, 0xf9 });                 // cdq; idiv ecx
+        }
+        return Type::INT;
+      case Operator::LT:
+      case Operator::GT:
+      case Operator::EQ:
+      case Operator::NOT_EQ: {
+        if (!ints && !(bools && (infix->op == Operator::EQ || infix->op == Operator::NOT_EQ))) {
+          break;
+        }
+        uint8_t setcc = infix->op == Operator::LT ? 0x9c : infix->op == Operator::GT ? 0x9f : infix->op == Operator::EQ ? 0x94 : 0x95;
+        this->a.emit({ 0x39, 0xc8 });                         // cmp eax, ecx
+        this->a.emit({ 0x0f, setcc, 0xc0 });                  // setcc al
+        this->a.emit({ 0x0f, 0xb6, 0xc0 });                   // movzx eax, al
+        return Type::BOOL;
+      }
+      default:
+        break;
+      }
+      throw Unsupported(format("operator {0}", infix->infix_operator));
+    }
+
+    auto prefix(PrefixExpression *prefix) -> Type {
+      auto right = this->expression(prefix->right);
+      if (prefix->op == Operator::MINUS && right == Type::INT) {
+        this->a.emit({ 0xf7, 0xd8 });                         // neg eax
+        return Type::INT;
+      }
+      if (prefix->op == Operator::BANG && right == Type::BOOL) {
+        this->a.emit({ 0x83, 0xf0, 0x01 });                   // xor eax, 1
+        return Type::BOOL;
+      }
+      if (prefix->op == Operator::BANG && right == Type::INT) {
+        this->a.emit({ 0x31, 0xc0 });                         // xor eax, eax
+        return Type::BOOL;
+      }
+      throw Unsupported(format("operator {0}", prefix->prefix_operator));
+    }
+
+    auto call(CallExpression *call) -> Type {
+      if (!call->global_callee) {
+        throw Unsupported("callee");
+      }
+      const auto &args = call->arguments;
+      auto pad = (this->depth + args.size()) % 2;
+      if (pad != 0) {
+        this->a.emit({ 0x48, 0x83, 0xec, 0x08 });             // sub rsp, 8
+        this->depth++;
+      }
+      // pushed last first, so args[0] ends up at rsp
+      for (size_t i = args.size(); i > 0; i--) {
+        if (this->expression(args[i - 1]) != Type::INT) {
+          throw Unsupported("argument");
+        }
+        this->push();
+      }
+      this->a.emit({ 0x48, 0xbf });                           // mov rdi, site
+      this->a.imm64(reinterpret_cast<uint64_t>(call));
+      this->a.emit({ 0x4c, 0x89, 0xe6 });                     // mov rsi, r12
+      this->a.emit({ 0x48, 0x89, 0xe2 });                     // mov rdx, rsp
+      this->a.emit({ 0x48, 0xb8 });                           // mov rax, call_global
+      this->a.imm64(reinterpret_cast<uint64_t>(&call_global));
+      this->a.emit({ 0xff, 0xd0 });                           // call rax
+      auto popped = args.size() + pad;
+      if (popped > 0) {
+        this->a.emit({ 0x48, 0x81, 0xc4 });                   // add rsp, imm32
+        this->a.imm32(static_cast<int32_t>(8 * popped));
+        this->depth -= popped;
+      }
+      this->a.emit({ 0x48, 0xb9 });                           // mov rcx, BAILOUT
+      this->a.imm64(static_cast<uint64_t>(BAILOUT));
+      this->a.emit({ 0x48, 0x39, 0xc8 });                     // cmp rax, rcx
+      this->to_bailout.push_back(this->a.jump({ 0x0f, 0x84 })); // je bailout
+      return Type::INT;
+    }
+
+    auto if_expression(IfExpression *if_expr, bool want) -> Type {
+      if (this->expression(if_expr->condition) != Type::BOOL) {
+        throw Unsupported("condition");
+      }
+      this->a.emit({ 0x85, 0xc0 });                           // test eax, eax
+      auto to_alternative = this->a.jump({ 0x0f, 0x84 });     // jz alternative
+      auto consequence = this->block(if_expr->consequence.get(), want);
+      auto to_end = this->a.jump({ 0xe9 });                   // jmp end
+      this->a.patch(to_alternative, this->a.here());
+      auto alternative = Type::UNIT;
+      if (if_expr->alternative != nullptr) {
+        alternative = this->block(if_expr->alternative.get(), want);
+      } else if (want) {
+        throw Unsupported("if without else");
+      }
+      this->a.patch(to_end, this->a.here());
+
+      if (consequence == Type::NEVER || consequence == alternative) {
+        return alternative;
+      }
+      if (alternative == Type::NEVER) {
+        return consequence;
+      }
+      if (want) {
+        throw Unsupported("branches of different types");
+      }
+      return Type::UNIT;
+    }
+
+    auto expression(const Rc<Expression> &expr) -> Type {
+      switch (expr->type()) {
+      case NodeType::INTEGERLITERAL:
+        this->a.emit({ 0xb8 });                               // mov eax, imm32
+        this->a.imm32(borrow_cast<IntegerLiteral>(expr)->value);
+        return Type::INT;
+      case NodeType::BOOLEAN:
+        this->a.emit({ 0xb8 });                               // mov eax, imm32
+        this->a.imm32(borrow_cast<ast::Boolean>(expr)->value ? 1 : 0);
+        return Type::BOOL;
+      case NodeType::IDENTIFIER:
+        return this->identifier(borrow_cast<Identifier>(expr));
+      case NodeType::INFIXEXPRESSION:
+        return this->infix(borrow_cast<InfixExpression>(expr));
+      case NodeType::PREFIXEXPRESSION:
+        return this->prefix(borrow_cast<PrefixExpression>(expr));
+      case NodeType::CALLEXPRESSION:
+        return this->call(borrow_cast<CallExpression>(expr));
+      case NodeType::IFEXPRESSION:
+        return this->if_expression(borrow_cast<IfExpression>(expr), true);
+      default:
+        throw Unsupported("expression");
+      }
+    }
+
+    auto statement(const Rc<Statement> &stmt, bool want, bool top) -> Type {
+      switch (stmt->type()) {
+      case NodeType::EXPRESSIONSTATEMENT: {
+        auto expr = borrow_cast<ExpressionStatement>(stmt)->expression;
+        if (expr->type() == NodeType::IFEXPRESSION) {
+          return this->if_expression(borrow_cast<IfExpression>(expr), want);
+        }
+        return this->expression(expr);
+      }
+      case NodeType::RETURNSTATEMENT:
+        if (this->expression(borrow_cast<ReturnStatement>(stmt)->value) != Type::INT) {
+          throw Unsupported("return value");
+        }
+        this->to_success.push_back(this->a.jump({ 0xe9 }));  // jmp success
+        return Type::NEVER;
+      case NodeType::LETSTATEMENT: {
+        // only the body's own statements, each name once
+        auto let = borrow_cast<LetStatement>(stmt);
+        auto name = let->name->value;
+        // eval gives a let no value
+        if (!top || want || this->parameters.count(name) > 0 || this->lets.count(name) > 0) {
+          throw Unsupported("let");
+        }
+        if (this->expression(let->value) != Type::INT) {
+          throw Unsupported("let value");
+        }
+        auto slot = static_cast<int32_t>(this->lets.size());
+        if (static_cast<size_t>(slot) >= this->let_count) {
+          throw Unsupported("let");
+        }
+        this->a.emit({ 0x89, 0x85 });                         // mov [rbp + disp32], eax
+        this->a.imm32(this->local(slot));
+        this->lets[name] = slot;
+        return Type::UNIT;
+      }
+      default:
+        throw Unsupported("statement");
+      }
+    }
+
+    auto block(BlockStatement *block, bool want, bool top = false) -> Type {
+      const auto &stmts = block->statements;
+      if (stmts.empty() && want) {
+        throw Unsupported("empty block");
+      }
+      auto type = Type::UNIT;
+      for (size_t i = 0; i < stmts.size(); i++) {
+        type = this->statement(stmts[i], want && i + 1 == stmts.size(), top);
+        if (type == Type::NEVER) {
+          // the rest is never run
+          return type;
+        }
+      }
+      return type;
+    }
+
+  public:
+    static auto compile(object::Function *func) -> Rc<Native> {
+#ifdef JIT_X86_64
+      try {
+        Compiler c;
+        auto body = func->body.get();
+        if (func->parameters.size() > 64) {
+          throw Unsupported("parameters");
+        }
+        for (size_t i = 0; i < func->parameters.size(); i++) {
+          c.parameters[func->parameters[i]->value] = static_cast<int32_t>(i);
+        }
+        for (const auto &stmt : body->statements) {
+          if (stmt->type() == NodeType::LETSTATEMENT) {
+            c.let_count++;
+          }
+        }
+
+        auto &a = c.a;
+        a.emit({ 0x55 });                                     // push rbp
+        a.emit({ 0x48, 0x89, 0xe5 });                         // mov rbp, rsp
+        a.emit({ 0x53 });                                     // push rbx
+        a.emit({ 0x41, 0x54 });                               // push r12
+        a.emit({ 0x48, 0x89, 0xfb });                         // mov rbx, rdi
+        a.emit({ 0x49, 0x89, 0xf4 });                         // mov r12, rsi
+        // lets, rounded up to keep rsp 16 byte aligned
+        auto frame = 8 * (c.let_count + c.let_count % 2);
+        if (frame > 0) {
+          a.emit({ 0x48, 0x81, 0xec });                       // sub rsp, imm32
+          a.imm32(static_cast<int32_t>(frame));
+        }
+
+        auto type = c.block(body, true, true);
+        if (type != Type::INT && type != Type::NEVER) {
+          throw Unsupported("result");
+        }
+
+        auto success = a.here();
+        a.emit({ 0x48, 0x63, 0xc0 });                         // movsxd rax, eax
+        auto epilogue_jump = a.jump({ 0xe9 });
+        auto bailout = a.here();
+        a.emit({ 0x48, 0xb8 });                               // mov rax, BAILOUT
+        a.imm64(static_cast<uint64_t>(BAILOUT));
+        auto epilogue = a.here();
+        a.emit({ 0x48, 0x8d, 0x65, 0xf0 });                   // lea rsp, [rbp - 16]
+        a.emit({ 0x41, 0x5c });                               // pop r12
+        a.emit({ 0x5b });                                     // pop rbx
+        a.emit({ 0x5d });                                     // pop rbp
+        a.emit({ 0xc3 });                                     // ret
+        a.patch(epilogue_jump, epilogue);
+        for (auto at : c.to_success) {
+          a.patch(at, success);
+        }
+        for (auto at : c.to_bailout) {
+          a.patch(at, bailout);
+        }
+
+        // written while writable, executable once done
+        auto page = static_cast<size_t>(4096);
+        auto size = (a.bytes.size() + page - 1) / page * page;
+        auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+          return nullptr;
+        }
+        memcpy(memory, a.bytes.data(), a.bytes.size());
+        auto code = make_rc<Native>();
+        code->memory = memory;
+        code->size = size;
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+          return nullptr;
+        }
+        code->entry = reinterpret_cast<Entry>(memory);
+        compiled_functions++;
+        return code;
+      } catch (Unsupported &) {
+        return nullptr;
+      }
+#else
+      return nullptr;
+#endif
+    }
+  };
+
+  // the native code of func, compiled on first use, nullptr if eval has
+  // to run it
+  auto native(object::Function *func) -> Native * {
+    auto body = func->body.get();
+    if (body->native == nullptr && !body->unjittable) {
+      auto code = Compiler::compile(func);
+      if (code == nullptr) {
+        body->unjittable = true;
+      } else {
+        body->native = code;
+      }
+    }
+    return body->unjittable ? nullptr : static_cast<Native *>(body->native.get());
+  }
+
+  // Runs a call of a compiled func natively. false leaves the call to
+  // eval: an argument isn't an integer, or the native code gave up, which
+  // also retires it.
+  auto run(object::Function *func, const Rc<Object> *args, size_t count, Rc<Object> &result) -> bool {
+    auto body = func->body.get();
+    auto code = native(func);
+    if (code == nullptr || count != func->parameters.size()) {
+      return false;
+    }
+    int64_t values[64];
+    for (size_t i = 0; i < count; i++) {
+      if (args[i] == nullptr || args[i]->type() != INTEGER_OBJ) {
+        return false;
+      }
+      values[i] = borrow_cast<Integer>(args[i])->value;
+    }
+    auto value = code->entry(values, func->env.get());
+    if (value == BAILOUT) {
+      bailouts++;
+      body->unjittable = true;
+      return false;
+    }
+    result = make_rc<Integer>(static_cast<int>(value));
+    return true;
+  }
+}
@@ -16,7 +16,7 @@ using namespace modify;
 using namespace eval;
 
 namespace macroexpansion {
-  auto is_macro_definition(shared_ptr<Node> node) -> bool {
+  auto is_macro_definition(Rc<Node> node) -> bool {
     if (node->type() != NodeType::LETSTATEMENT) {
       return false;
     }
@@ -30,7 +30,7 @@ namespace macroexpansion {
     return true;
   }
 
-  auto is_macro_call(shared_ptr<CallExpression> expr, shared_ptr<Environment> env) -> shared_ptr<Macro> {
+  auto is_macro_call(Rc<CallExpression> expr, Rc<Environment> env) -> Rc<Macro> {
     if (expr->function->type() != NodeType::IDENTIFIER) {
       return nullptr;
     }
@@ -47,21 +47,21 @@ namespace macroexpansion {
     return static_pointer_cast<Macro>(obj);
   }
 
-  auto add_macro(shared_ptr<Statement> stmt, shared_ptr<Environment> env) -> void {
+  auto add_macro(Rc<Statement> stmt, Rc<Environment> env) -> void {
     auto let = static_pointer_cast<LetStatement>(stmt);
     auto macro = static_pointer_cast<MacroLiteral>(let->value);
 
-    auto macro_obj = make_shared<Macro>(macro->parameters, macro->body, env);
+    auto macro_obj = make_rc<Macro>(macro->parameters, macro->body, env);
     env->set(let->name->value, macro_obj);
   }
 
-  auto quote_args(shared_ptr<CallExpression> expr) -> vector<shared_ptr<Quote>> {
-    return expr->arguments | view::transform([](shared_ptr<Expression> arg) {
-        return make_shared<Quote>(arg);
+  auto quote_args(Rc<CallExpression> expr) -> vector<Rc<Quote>> {
+    return expr->arguments | view::transform([](Rc<Expression> arg) {
+        return make_rc<Quote>(arg);
       });
   }
 
-  auto extend_macro_env(shared_ptr<Macro> macro, vector<shared_ptr<Quote>> args) -> shared_ptr<Environment> {
+  auto extend_macro_env(Rc<Macro> macro, vector<Rc<Quote>> args) -> Rc<Environment> {
     auto extended = new_enclosed_environment(macro->env);
 
     for (size_t i = 0; i < macro->parameters.size(); i++) {
@@ -71,10 +71,10 @@ namespace macroexpansion {
     return extended;
   }
 
-  auto define_macros(shared_ptr<Program> program, shared_ptr<Environment> env) -> void {
-    vector<shared_ptr<Statement>> new_statements = {};
+  auto define_macros(Rc<Program> program, Rc<Environment> env) -> void {
+    vector<Rc<Statement>> new_statements = {};
     auto stmts = program->statements;
-    std::for_each(stmts.cbegin(), stmts.cend(), [&](shared_ptr<Statement> stmt) {
+    std::for_each(stmts.cbegin(), stmts.cend(), [&](Rc<Statement> stmt) {
         if (is_macro_definition(stmt)) {
           add_macro(stmt, env);
         } else {
@@ -84,8 +84,8 @@ namespace macroexpansion {
     program->statements = new_statements;
   }
 
-  auto expand_macros(shared_ptr<Node> program, shared_ptr<Environment> env) -> shared_ptr<Node> {
-    return modify::modify(program, [&](shared_ptr<Node> node) -> shared_ptr<Node> {
+  auto expand_macros(Rc<Node> program, Rc<Environment> env) -> Rc<Node> {
+    return modify::modify(program, [&](Rc<Node> node) -> Rc<Node> {
         if (node->type() != NodeType::CALLEXPRESSION) {
           return node;
         }
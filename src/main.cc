@@ -1,19 +1,63 @@
 #include "repl.hpp"
 #include "interpret.hpp"
 #include <string>
+#include <cstdlib>
+#include <vector>
 
 using namespace std;
 
 int main(int argc, char** argv) {
-  if (argc == 2) {
-    string arg(argv[1]);
-    if (arg == "repl") {
-      repl::start();
+  bool show_pool_stats = false;
+  bool profile_shapes = false;
+  vector<string> args = {};
+  for (int i = 1; i < argc; i++) {
+    string arg(argv[i]);
+    if (arg == "--pool-stats") {
+      show_pool_stats = true;
+    } else if (arg == "--profile-shapes") {
+      profile_shapes = true;
+    } else if (arg == "--no-jit") {
+      jit::enabled = false;
+    } else if (arg == "--tier-log") {
+      tier::log = &cerr;
+    } else if (arg.compare(0, 16, "--tier-optimize=") == 0) {
+      tier::optimize_after = static_cast<uint32_t>(strtoul(arg.c_str() + 16, nullptr, 10));
+    } else if (arg.compare(0, 14, "--tier-native=") == 0) {
+      tier::native_after = static_cast<uint32_t>(strtoul(arg.c_str() + 14, nullptr, 10));
+    } else if (arg == "--region") {
+      region::per_statement = true;
+    } else if (arg.compare(0, 9, "--engine=") == 0) {
+      if (!interpret::parse_engine(arg.substr(9), interpret::engine)) {
+        cout << "unknown engine: " << arg.substr(9) << endl;
+        return 1;
+      }
     } else {
-      interpret::run(arg);
+      args.push_back(arg);
     }
+  }
+
+  // lc3 compile script.lc3 [-o script.cc]
+  if (args.size() >= 2 && args[0] == "compile") {
+    auto output = args[1].substr(0, args[1].rfind('.')) + ".cc";
+    if (args.size() == 4 && args[2] == "-o") {
+      output = args[3];
+    } else if (args.size() != 2) {
+      cout << "usage: lc3 compile script.lc3 [-o script.cc]" << endl;
+      return 1;
+    }
+    return interpret::compile(args[1], output) ? 0 : 1;
+  }
+
+  if (profile_shapes) {
+    interpret::print_shape_profile(args);
+  } else if (args.size() == 1 && args[0] != "repl") {
+    interpret::run(args[0]);
   } else {
     repl::start();
   }
+
+  if (show_pool_stats) {
+    interpret::print_pool_stats();
+  }
   return 0;
 }
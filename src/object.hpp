@@ -1,8 +1,12 @@
 #pragma once
 
 #include "ast.hpp"
+#include "rc.hpp"
+#include "pool.hpp"
+#include "coroutine.hpp"
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <utility>
@@ -20,6 +24,7 @@ using namespace std;
 using namespace ast;
 using namespace fmt;
 using namespace ranges;
+using namespace rc;
 
 namespace object {
   auto flatten_strings(vector<string> strs) -> string {
@@ -37,34 +42,103 @@ namespace object {
     }
   }
 
-  typedef string ObjectType;
+  // a tag small enough to index the operator tables of eval
+  enum class ObjectType : uint8_t {
+    NULL_OBJ,
+    ERROR_OBJ,
+    INTEGER_OBJ,
+    BOOLEAN_OBJ,
+    STRING_OBJ,
+    RETURN_VALUE_OBJ,
+    FUNCTION_OBJ,
+    BUILTIN_OBJ,
+    ARRAY_OBJ,
+    HASH_OBJ,
+    QUOTE_OBJ,
+    MACRO_OBJ,
+    SEQUENCE_OBJ,
+    GENERATOR_OBJ
+  };
+
+  const size_t OBJECT_TYPES = static_cast<size_t>(ObjectType::GENERATOR_OBJ) + 1;
+
   typedef string HashKey;
 
-  const ObjectType NULL_OBJ  = "NULL";
-  const ObjectType ERROR_OBJ = "ERROR";
-  const ObjectType INTEGER_OBJ = "INTEGER";
-  const ObjectType BOOLEAN_OBJ = "BOOLEAN";
-  const ObjectType STRING_OBJ  = "STRING";
-  const ObjectType RETURN_VALUE_OBJ = "RETURN_VALUE";
-  const ObjectType FUNCTION_OBJ = "FUNCTION";
-  const ObjectType BUILTIN_OBJ  = "BUILTIN";
-  const ObjectType ARRAY_OBJ = "ARRAY";
-  const ObjectType HASH_OBJ  = "HASH";
-  const ObjectType QUOTE_OBJ = "QUOTE";
-  const ObjectType MACRO_OBJ = "MACRO";
-
-  class Object {
+  const ObjectType NULL_OBJ  = ObjectType::NULL_OBJ;
+  const ObjectType ERROR_OBJ = ObjectType::ERROR_OBJ;
+  const ObjectType INTEGER_OBJ = ObjectType::INTEGER_OBJ;
+  const ObjectType BOOLEAN_OBJ = ObjectType::BOOLEAN_OBJ;
+  const ObjectType STRING_OBJ  = ObjectType::STRING_OBJ;
+  const ObjectType RETURN_VALUE_OBJ = ObjectType::RETURN_VALUE_OBJ;
+  const ObjectType FUNCTION_OBJ = ObjectType::FUNCTION_OBJ;
+  const ObjectType BUILTIN_OBJ  = ObjectType::BUILTIN_OBJ;
+  const ObjectType ARRAY_OBJ = ObjectType::ARRAY_OBJ;
+  const ObjectType HASH_OBJ  = ObjectType::HASH_OBJ;
+  const ObjectType QUOTE_OBJ = ObjectType::QUOTE_OBJ;
+  const ObjectType MACRO_OBJ = ObjectType::MACRO_OBJ;
+  const ObjectType SEQUENCE_OBJ = ObjectType::SEQUENCE_OBJ;
+  const ObjectType GENERATOR_OBJ = ObjectType::GENERATOR_OBJ;
+
+  // the name of a type in error messages and hash keys
+  auto type_name(ObjectType type) -> string {
+    static const vector<string> names = {
+      "NULL", "ERROR", "INTEGER", "BOOLEAN", "STRING", "RETURN_VALUE",
+      "FUNCTION", "BUILTIN", "ARRAY", "HASH", "QUOTE", "MACRO", "SEQUENCE",
+      "GENERATOR"
+    };
+    return names[static_cast<size_t>(type)];
+  }
+
+  class Object : public RefCounted {
   public:
     virtual ObjectType type() = 0;
     virtual string inspect() = 0;
   };
 
-  class Environment {
+  auto promote(const Rc<Object> &obj) -> Rc<Object>;
+
+  class Environment : public RefCounted, public pool::Pooled<Environment> {
   public:
-    map<string, shared_ptr<Object>> store = {};
-    shared_ptr<Environment> outer = nullptr;
+    map<string, Rc<Object>> store = {};
+    Rc<Environment> outer = nullptr;
+    // the parameters of a call on the frame stack are bound to a slice of
+    // its argument slots rather than to the store
+    const vector<Rc<Identifier>> *slot_names = nullptr;
+    Rc<Object> *slots = nullptr;
+    // the function body this is the environment of a call of
+    const BlockStatement *body = nullptr;
+    // changes whenever the store is set. Versions are never reused, not
+    // even by a recycled environment, so a cache keyed on the pointer and
+    // the version can't be fooled.
+    uint64_t version = next_version();
+
+    static string pool_name() {
+      return "ENVIRONMENT";
+    }
+
+    static auto next_version() -> uint64_t {
+      static uint64_t versions = 0;
+      return ++versions;
+    }
+
+    auto find_slot(const string &name) -> Rc<Object> * {
+      if (this->slots != nullptr) {
+        const auto &names = *this->slot_names;
+        for (size_t i = 0; i < names.size(); i++) {
+          if (names[i]->value == name) {
+            return &this->slots[i];
+          }
+        }
+      }
+      return nullptr;
+    }
+
+    Rc<Object> get(const string &name) {
+      auto slot = this->find_slot(name);
+      if (slot != nullptr) {
+        return *slot;
+      }
 
-    shared_ptr<Object> get(string name) {
       auto result = this->store.find(name);
       if (result == this->store.end() && this->outer != nullptr) {
         return this->outer->get(name);
@@ -73,26 +147,79 @@ namespace object {
       }
     }
 
-    shared_ptr<Object> set(string name, shared_ptr<Object> value) {
+    // name's binding in this environment itself, nullptr if it has none
+    auto local(const string &name) -> Rc<Object> * {
+      auto slot = this->find_slot(name);
+      if (slot != nullptr) {
+        return slot;
+      }
+      auto found = this->store.find(name);
+      return found == this->store.end() ? nullptr : &found->second;
+    }
+
+    // where name is bound, here or further out, and the environment
+    // binding it; nullptr if it isn't bound
+    auto binding(const string &name, Environment *&owner) -> Rc<Object> * {
+      for (auto env = this; env != nullptr; env = env->outer.get()) {
+        auto slot = env->find_slot(name);
+        if (slot != nullptr) {
+          owner = env;
+          return slot;
+        }
+        auto found = env->store.find(name);
+        if (found != env->store.end()) {
+          owner = env;
+          return found->second == nullptr ? nullptr : &found->second;
+        }
+      }
+      return nullptr;
+    }
+
+    Rc<Object> set(const string &name, const Rc<Object> &value) {
+      // an environment that outlives the statement region must not end up
+      // pointing into it
+      if (region::current != nullptr && !region::owns(this)) {
+        this->version = next_version();
+        return this->store[name] = promote(value);
+      }
+
+      auto slot = this->find_slot(name);
+      if (slot != nullptr) {
+        return *slot = value;
+      }
+      this->version = next_version();
       this->store[name] = value;
       return value;
     }
+
+    // move slot bindings into the store, for a frame that has to outlive
+    // its slots
+    auto detach_slots() -> void {
+      if (this->slots != nullptr) {
+        const auto &names = *this->slot_names;
+        for (size_t i = 0; i < names.size(); i++) {
+          this->store[names[i]->value] = this->slots[i];
+        }
+      }
+      this->slot_names = nullptr;
+      this->slots = nullptr;
+    }
   };
 
-  shared_ptr<Environment> new_enclosed_environment(shared_ptr<Environment> outer) {
-    shared_ptr<Environment> env = make_shared<Environment>();
+  Rc<Environment> new_enclosed_environment(const Rc<Environment> &outer) {
+    Rc<Environment> env = make_rc<Environment>();
     env->outer = outer;
     return env;
   }
 
-  typedef function<shared_ptr<Object>(vector<shared_ptr<Object>> args)> BuiltinFunction;
+  typedef function<Rc<Object>(const vector<Rc<Object>> &args)> BuiltinFunction;
 
   class Hashable {
   public:
     virtual HashKey hash_key() = 0;
   };
 
-  class Integer : public Object, public Hashable {
+  class Integer : public Object, public Hashable, public pool::Pooled<Integer> {
   public:
     int value;
 
@@ -102,6 +229,10 @@ namespace object {
       return INTEGER_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(INTEGER_OBJ);
+    }
+
     string inspect() {
       stringstream ss;
       ss << this->value;
@@ -110,14 +241,14 @@ namespace object {
 
     HashKey hash_key() {
       stringstream ss;
-      ss << this->type();
+      ss << type_name(this->type());
       ss << "-";
       ss << this->value;
       return ss.str();
     }
   };
 
-  class Boolean : public Object, public Hashable {
+  class Boolean : public Object, public Hashable, public pool::Pooled<Boolean> {
   public:
     bool value;
 
@@ -127,6 +258,10 @@ namespace object {
       return BOOLEAN_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(BOOLEAN_OBJ);
+    }
+
     string inspect() {
       stringstream ss;
       ss << this->value;
@@ -135,7 +270,7 @@ namespace object {
 
     HashKey hash_key() {
       stringstream ss;
-      ss << this->type();
+      ss << type_name(this->type());
       ss << "-";
       ss << (this->value ? 1 : 0);
       return ss.str();
@@ -153,16 +288,20 @@ namespace object {
     }
   };
 
-  class ReturnValue : public Object {
+  class ReturnValue : public Object, public pool::Pooled<ReturnValue> {
   public:
-    shared_ptr<Object> value;
+    Rc<Object> value;
 
-    explicit ReturnValue(shared_ptr<Object> v): value(v) {};
+    explicit ReturnValue(Rc<Object> v): value(v) {};
 
     ObjectType type() {
       return RETURN_VALUE_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(RETURN_VALUE_OBJ);
+    }
+
     string inspect() {
       return this->value->inspect();
     }
@@ -183,25 +322,29 @@ namespace object {
     }
   };
 
-  class Function : public Object {
+  class Function : public Object, public pool::Pooled<Function> {
   public:
-    vector<shared_ptr<Identifier>> parameters;
-    shared_ptr<BlockStatement> body;
-    shared_ptr<Environment> env;
+    vector<Rc<Identifier>> parameters;
+    Rc<BlockStatement> body;
+    Rc<Environment> env;
 
-    Function(const vector<shared_ptr<Identifier>> &ps,
-             shared_ptr<BlockStatement> b,
-             shared_ptr<Environment> e)
+    Function(const vector<Rc<Identifier>> &ps,
+             Rc<BlockStatement> b,
+             Rc<Environment> e)
       : parameters(ps), body(b), env(e) {};
 
     ObjectType type() {
       return FUNCTION_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(FUNCTION_OBJ);
+    }
+
     string inspect() {
       string s("");
 
-      string params = flatten_strings(parameters | view::transform([](shared_ptr<Identifier> o) { return o->to_string(); }));
+      string params = flatten_strings(parameters | view::transform([](Rc<Identifier> o) { return o->to_string(); }));
 
       s += "fn(";
       s += params;
@@ -213,7 +356,160 @@ namespace object {
     }
   };
 
-  class String : public Object, public Hashable {
+  // Call frames for functions whose environment can't be captured (see
+  // analysis::captures_environment), owned by the evaluator. Environments
+  // sit in fixed size segments and are reused by call depth, parameters
+  // are bound to a slice of one contiguous argument stack, so such a call
+  // allocates neither an environment nor a map node.
+  class FrameStack {
+  public:
+    struct Slots {
+      Rc<Object> *begin;
+      size_t count;
+      // where the argument stack was before this reservation
+      size_t segment;
+      size_t top;
+    };
+
+  private:
+    static const size_t SEGMENT_FRAMES = 256;
+    static const size_t SEGMENT_SLOTS = 4096;
+
+    vector<Environment *> envs = {};
+    Environment *segment = nullptr;
+    size_t carved = SEGMENT_FRAMES;
+
+    vector<Rc<Object> *> slot_segments = {};
+    size_t slot_segment = 0;
+    size_t slot_top = 0;
+
+    // segments are never given back, an environment that escaped keeps
+    // living where it is
+    auto carve() -> Environment * {
+      if (this->carved == SEGMENT_FRAMES) {
+        this->segment = static_cast<Environment *>(::operator new(SEGMENT_FRAMES * sizeof(Environment)));
+        this->carved = 0;
+      }
+      auto env = ::new (this->segment + this->carved++) Environment();
+      pin(env);
+      return env;
+    }
+
+  public:
+    size_t depth = 0;
+    size_t calls = 0;
+    size_t escaped = 0;
+
+    FrameStack() {};
+    FrameStack(const FrameStack &) = delete;
+    FrameStack &operator=(const FrameStack &) = delete;
+
+    // Gives its segments back once no call is on it. Environments that
+    // escaped keep living in theirs, so those stay.
+    ~FrameStack() {
+      if (this->depth != 0) {
+        return;
+      }
+      for (auto segment : this->slot_segments) {
+        delete[] segment;
+      }
+      if (this->escaped != 0) {
+        return;
+      }
+      // without an escape envs is every environment carved, in order
+      for (auto env : this->envs) {
+        env->~Environment();
+      }
+      for (size_t i = 0; i < this->envs.size(); i += SEGMENT_FRAMES) {
+        ::operator delete(this->envs[i]);
+      }
+    }
+
+    // the calls of one coroutine go on a stack of their own
+    auto swap(FrameStack &other) -> void {
+      std::swap(this->envs, other.envs);
+      std::swap(this->segment, other.segment);
+      std::swap(this->carved, other.carved);
+      std::swap(this->slot_segments, other.slot_segments);
+      std::swap(this->slot_segment, other.slot_segment);
+      std::swap(this->slot_top, other.slot_top);
+      std::swap(this->depth, other.depth);
+      std::swap(this->calls, other.calls);
+      std::swap(this->escaped, other.escaped);
+    }
+
+    // n argument slots on top of the stack, begin is nullptr if they can't
+    // be contiguous
+    auto reserve(size_t n) -> Slots {
+      Slots slots = { nullptr, n, this->slot_segment, this->slot_top };
+      if (n > SEGMENT_SLOTS) {
+        return slots;
+      }
+
+      if (this->slot_segments.empty() || this->slot_top + n > SEGMENT_SLOTS) {
+        if (!this->slot_segments.empty()) {
+          this->slot_segment++;
+        }
+        if (this->slot_segment == this->slot_segments.size()) {
+          this->slot_segments.push_back(new Rc<Object>[SEGMENT_SLOTS]);
+        }
+        this->slot_top = 0;
+      }
+
+      slots.begin = this->slot_segments[this->slot_segment] + this->slot_top;
+      this->slot_top += n;
+      return slots;
+    }
+
+    auto release(const Slots &slots) -> void {
+      if (slots.begin != nullptr) {
+        for (size_t i = 0; i < slots.count; i++) {
+          slots.begin[i] = nullptr;
+        }
+      }
+      this->slot_segment = slots.segment;
+      this->slot_top = slots.top;
+    }
+
+    auto push(Function *func, const Slots &slots) -> Rc<Environment> {
+      if (this->depth == this->envs.size()) {
+        this->envs.push_back(this->carve());
+      }
+
+      auto env = this->envs[this->depth++];
+      env->outer = func->env;
+      env->slot_names = &func->parameters;
+      env->slots = slots.begin;
+      env->body = func->body.get();
+      this->calls++;
+      return Rc<Environment>(env);
+    }
+
+    // the environment of the innermost call is gone, its slots stay
+    // reserved for the next call
+    auto leave() -> void {
+      auto env = this->envs[--this->depth];
+      if (references(env) != 1) {
+        // still referenced after all, cut it loose from the slots
+        env->detach_slots();
+        this->envs[this->depth] = this->carve();
+        this->escaped++;
+      } else {
+        env->store.clear();
+        env->outer = nullptr;
+        env->slot_names = nullptr;
+        env->slots = nullptr;
+        env->body = nullptr;
+      }
+    }
+
+    auto pop(const Slots &slots) -> void {
+      this->leave();
+      this->release(slots);
+    }
+  };
+
+  class String : public Object, public Hashable, public pool::Pooled<String> {
   public:
     string value;
 
@@ -223,6 +519,10 @@ namespace object {
       return STRING_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(STRING_OBJ);
+    }
+
     string inspect() {
       return this->value;
     }
@@ -231,7 +531,7 @@ namespace object {
       size_t value_hash = hash<string>{}(this->value);
 
       stringstream ss;
-      ss << this->type();
+      ss << type_name(this->type());
       ss << "-";
       ss << value_hash;
       return ss.str();
@@ -241,8 +541,12 @@ namespace object {
   class Builtin : public Object {
   public:
     BuiltinFunction func;
+    // reuses its first argument when that is unique (see is_unique), so
+    // eval hands over a variable the call rebinds. It must not call back
+    // into lc3 code, which could read the variable meanwhile.
+    bool in_place;
 
-    explicit Builtin(const BuiltinFunction &f): func(f) {};
+    explicit Builtin(const BuiltinFunction &f, bool i = false): func(f), in_place(i) {};
 
     ObjectType type() {
       return BUILTIN_OBJ;
@@ -253,19 +557,112 @@ namespace object {
     }
   };
 
-  class Array : public Object {
+  // An array of integers only keeps them unboxed, in one contiguous
+  // buffer, instead of an object each. The first element of another type
+  // boxes them all and the array stays generic until unbox.
+  class Array : public Object, public pool::Pooled<Array> {
+  private:
+    vector<Rc<Object>> boxed = {};
+    vector<int> ints = {};
+    bool unboxed = true;
+
+    auto box() -> void {
+      if (!this->unboxed) {
+        return;
+      }
+      this->boxed.reserve(this->ints.size());
+      for (auto value : this->ints) {
+        this->boxed.push_back(make_rc<Integer>(value));
+      }
+      this->ints = vector<int>();
+      this->unboxed = false;
+    }
+
   public:
-    vector<shared_ptr<Object>> elements;
+    explicit Array(const vector<Rc<Object>> &es) {
+      for (const auto &e : es) {
+        if (e == nullptr || e->type() != INTEGER_OBJ) {
+          this->boxed = es;
+          this->unboxed = false;
+          return;
+        }
+      }
+      this->ints.reserve(es.size());
+      for (const auto &e : es) {
+        this->ints.push_back(static_cast<Integer *>(e.get())->value);
+      }
+    };
 
-    explicit Array(const vector<shared_ptr<Object>> &es): elements(es) {};
+    explicit Array(vector<int> vs): ints(std::move(vs)) {};
 
     ObjectType type() {
       return ARRAY_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(ARRAY_OBJ);
+    }
+
+    auto size() const -> size_t {
+      return this->unboxed ? this->ints.size() : this->boxed.size();
+    }
+
+    auto empty() const -> bool {
+      return this->size() == 0;
+    }
+
+    // an unboxed integer is boxed on the way out
+    auto at(size_t i) const -> Rc<Object> {
+      return this->unboxed ? make_rc<Integer>(this->ints[i]) : this->boxed[i];
+    }
+
+    auto push(const Rc<Object> &obj) -> void {
+      if (this->unboxed && obj->type() == INTEGER_OBJ) {
+        this->ints.push_back(static_cast<Integer *>(obj.get())->value);
+      } else {
+        this->elements().push_back(obj);
+      }
+    }
+
+    auto is_unboxed() const -> bool {
+      return this->unboxed;
+    }
+
+    // the integers, only while is_unboxed
+    auto values() -> vector<int> & {
+      return this->ints;
+    }
+
+    // back to the unboxed form, false if anything but integers is left
+    auto unbox() -> bool {
+      if (this->unboxed) {
+        return true;
+      }
+      for (const auto &e : this->boxed) {
+        if (e->type() != INTEGER_OBJ) {
+          return false;
+        }
+      }
+      this->ints.reserve(this->boxed.size());
+      for (const auto &e : this->boxed) {
+        this->ints.push_back(static_cast<Integer *>(e.get())->value);
+      }
+      this->boxed = vector<Rc<Object>>();
+      this->unboxed = true;
+      return true;
+    }
+
+    // the generic form, until unbox
+    auto elements() -> vector<Rc<Object>> & {
+      this->box();
+      return this->boxed;
+    }
+
     string inspect() {
       string s("");
-      string elems = flatten_strings(elements | view::transform([](shared_ptr<Object> o) { return o->inspect(); }));
+      string elems = this->unboxed
+        ? flatten_strings(this->ints | view::transform([](int v) { return std::to_string(v); }))
+        : flatten_strings(this->boxed | view::transform([](Rc<Object> o) { return o->inspect(); }));
 
       s += "[";
       s += elems;
@@ -275,9 +672,160 @@ namespace object {
     }
   };
 
-  typedef pair<shared_ptr<Object>, shared_ptr<Object>> HashPair;
+  enum class Stage : uint8_t {
+    MAP,
+    FILTER,
+    TAKE
+  };
+
+  struct SequenceStage {
+    Stage stage;
+    // of MAP and FILTER
+    Rc<Object> func;
+    // of TAKE
+    size_t count;
+  };
 
-  class Hash : public Object {
+  // A sequence computed only as it is consumed: the integers of a range,
+  // or the elements of an array or generator, through maps, filters and takes that run
+  // in one pass with no array in between (see builtins::elements).
+  // Adding a stage makes a new sequence, a sequence never changes.
+  class Sequence : public Object {
+  public:
+    // an array or a generator, nullptr for the range
+    Rc<Object> source;
+    int64_t start;
+    int64_t end;
+    int64_t step;
+    vector<SequenceStage> stages = {};
+
+    Sequence(const Rc<Object> &src, int64_t b, int64_t e, int64_t s)
+      : source(src), start(b), end(e), step(s) {};
+
+    // a sequence with one more stage
+    auto then(const SequenceStage &stage) -> Rc<Object> {
+      auto seq = make_rc<Sequence>(this->source, this->start, this->end, this->step);
+      seq->stages = this->stages;
+      seq->stages.push_back(stage);
+      return seq;
+    }
+
+    // the number of integers in the range
+    auto range_length() -> int64_t {
+      auto n = this->step > 0 ? (this->end - this->start + this->step - 1) / this->step
+        : (this->start - this->end - this->step - 1) / -this->step;
+      return std::max(n, static_cast<int64_t>(0));
+    }
+
+    ObjectType type() {
+      return SEQUENCE_OBJ;
+    }
+
+    string inspect() {
+      return "sequence";
+    }
+  };
+
+  // What a call of a function with yield in its body gives (see
+  // eval::make_generator). The body runs on a coroutine, from one yield to
+  // the next each time a value is asked for, with calls of its own on a
+  // frame stack of its own: a yield may come while the arguments of a
+  // call are being put on it.
+  class Generator : public Object {
+  private:
+    // the evaluator's frame stack, swapped with frames while the body runs
+    FrameStack *shared;
+    FrameStack frames;
+    unique_ptr<coroutine::Coroutine> coroutine = nullptr;
+    // what the body yielded last, or the error it stopped with
+    Rc<Object> value = nullptr;
+    bool active = false;
+
+    auto resume() -> void {
+      this->active = true;
+      auto outer = running();
+      running() = this;
+      this->shared->swap(this->frames);
+      {
+        // nothing the body allocates may be reset under it between
+        // resumes
+        region::Scope heap(nullptr);
+        this->coroutine->resume();
+      }
+      this->shared->swap(this->frames);
+      running() = outer;
+      this->active = false;
+    }
+
+  public:
+    // set to unwind a body suspended for good, its yield gives an error
+    bool closing = false;
+
+    explicit Generator(FrameStack *s): shared(s) {};
+
+    ~Generator() {
+      if (this->coroutine != nullptr && this->coroutine->suspended()) {
+        this->closing = true;
+        this->resume();
+      }
+    }
+
+    // the generator whose body is running, nullptr outside of one
+    static auto running() -> Generator *& {
+      static Generator *g = nullptr;
+      return g;
+    }
+
+    // body gives the error it stopped with, or anything else when it ran
+    // to the end
+    auto start(const std::function<Rc<Object>()> &body) -> void {
+      this->coroutine.reset(new coroutine::Coroutine([this, body]() {
+            auto result = body();
+            this->value = result != nullptr && result->type() == ERROR_OBJ ? result : nullptr;
+          }));
+    }
+
+    // from inside the body, whether it may go another call deeper
+    auto has_stack_left() -> bool {
+      return this->coroutine->stack_left() >= coroutine::STACK_MARGIN;
+    }
+
+    // from inside the body, false when the generator is being closed
+    auto yield(const Rc<Object> &v) -> bool {
+      if (this->closing) {
+        return false;
+      }
+      this->value = v;
+      this->coroutine->suspend();
+      return !this->closing;
+    }
+
+    // The next value in out, false once the body is done: out is then the
+    // error it stopped with or nullptr.
+    auto next(Rc<Object> &out) -> bool {
+      if (this->active) {
+        out = make_rc<Error>("generator is already running");
+        return false;
+      }
+      if (!this->coroutine->done()) {
+        this->resume();
+      }
+      out = std::move(this->value);
+      return !this->coroutine->done();
+    }
+
+    ObjectType type() {
+      return GENERATOR_OBJ;
+    }
+
+    string inspect() {
+      return "generator";
+    }
+  };
+
+  typedef pair<Rc<Object>, Rc<Object>> HashPair;
+
+  class Hash : public Object, public pool::Pooled<Hash> {
   public:
     map<HashKey, HashPair> pairs;
 
@@ -287,6 +835,10 @@ namespace object {
       return HASH_OBJ;
     }
 
+    static string pool_name() {
+      return type_name(HASH_OBJ);
+    }
+
     string inspect() {
       string s("");
       vector<string> pairs_strs = pairs | view::transform([](pair<HashKey, HashPair> p) {
@@ -307,11 +859,11 @@ namespace object {
 
   class Quote : public Object {
   public:
-    shared_ptr<Node> node;
+    Rc<Node> node;
 
-    explicit Quote(shared_ptr<Node> n): node(n) {};
+    explicit Quote(Rc<Node> n): node(n) {};
 
-    string type() {
+    ObjectType type() {
       return QUOTE_OBJ;
     }
 
@@ -322,26 +874,26 @@ namespace object {
 
   class Macro : public Object {
   public:
-    vector<shared_ptr<Identifier>> parameters;
-    shared_ptr<BlockStatement> body;
-    shared_ptr<Environment> env;
+    vector<Rc<Identifier>> parameters;
+    Rc<BlockStatement> body;
+    Rc<Environment> env;
 
-    Macro(const vector<shared_ptr<Identifier>> &ps,
-          shared_ptr<BlockStatement> b,
-          shared_ptr<Environment> e)
+    Macro(const vector<Rc<Identifier>> &ps,
+          Rc<BlockStatement> b,
+          Rc<Environment> e)
       : parameters(ps), body(b), env(e) {};
 
-    string type() {
+    ObjectType type() {
       return MACRO_OBJ;
     }
 
     string inspect() {
-      string params = flatten_strings(parameters | view::transform([](shared_ptr<Identifier> o) { return o->to_string(); }));
+      string params = flatten_strings(parameters | view::transform([](Rc<Identifier> o) { return o->to_string(); }));
       return format("macro({0}) {\n{1}\n}", params, this->body->to_string());
     }
   };
 
-  bool operator==(shared_ptr<Object> obj1, shared_ptr<Object> obj2) {
+  bool operator==(const Rc<Object> &obj1, const Rc<Object> &obj2) {
     if (obj1 == nullptr && obj2 == nullptr) {
       return true;
     } else if (obj1->type() != obj2->type() || obj1 == nullptr || obj2 == nullptr) {
@@ -356,11 +908,14 @@ namespace object {
       } else if (obj1->type() == RETURN_VALUE_OBJ) {
         return static_pointer_cast<ReturnValue>(obj1)->value == static_pointer_cast<ReturnValue>(obj2)->value;
       } else if (obj1->type() == ARRAY_OBJ) {
-        auto elems1 = static_pointer_cast<Array>(obj1)->elements;
-        auto elems2 = static_pointer_cast<Array>(obj2)->elements;
-        if (elems1.size() == elems2.size()) {
-          for (size_t i = 0; i < elems1.size(); i++) {
-            if (!(elems1[i] == elems2[i])) {
+        auto arr1 = borrow_cast<Array>(obj1);
+        auto arr2 = borrow_cast<Array>(obj2);
+        if (arr1->is_unboxed() && arr2->is_unboxed()) {
+          return arr1->values() == arr2->values();
+        }
+        if (arr1->size() == arr2->size()) {
+          for (size_t i = 0; i < arr1->size(); i++) {
+            if (!(arr1->at(i) == arr2->at(i))) {
               return false;
             }
           }
@@ -369,8 +924,8 @@ namespace object {
           return false;
         }
       } else if (obj1->type() == HASH_OBJ) {
-        auto pairs1 = static_pointer_cast<Hash>(obj1)->pairs;
-        auto pairs2 = static_pointer_cast<Hash>(obj2)->pairs;
+        auto &pairs1 = borrow_cast<Hash>(obj1)->pairs;
+        auto &pairs2 = borrow_cast<Hash>(obj2)->pairs;
         if (pairs1.size() == pairs2.size()) {
           for (auto entry1 = pairs1.begin(),
                     entry2 = pairs2.begin();
@@ -398,14 +953,126 @@ namespace object {
     }
   }
 
-  bool operator!=(shared_ptr<Object> obj1, shared_ptr<Object> obj2) {
+  bool operator!=(const Rc<Object> &obj1, const Rc<Object> &obj2) {
     return !(obj1 == obj2);
   }
 
-  bool is_hashable(shared_ptr<Object> obj) {
+  bool is_hashable(const Rc<Object> &obj) {
     return
       obj->type() == INTEGER_OBJ ||
       obj->type() == BOOLEAN_OBJ ||
       obj->type() == STRING_OBJ;
   }
+
+  typedef map<const void *, Rc<RefCounted>> Promoted;
+
+  auto promote(const Rc<Object> &obj, Promoted &promoted) -> Rc<Object>;
+
+  auto promote(const Rc<Environment> &env, Promoted &promoted) -> Rc<Environment> {
+    if (env == nullptr || !region::owns(env.get())) {
+      return env;
+    }
+
+    auto seen = promoted.find(env.get());
+    if (seen != promoted.end()) {
+      return static_pointer_cast<Environment>(seen->second);
+    }
+
+    auto copy = make_rc<Environment>();
+    promoted[env.get()] = copy;
+    for (const auto &binding : env->store) {
+      copy->store[binding.first] = promote(binding.second, promoted);
+    }
+    if (env->slots != nullptr) {
+      for (size_t i = 0; i < env->slot_names->size(); i++) {
+        copy->store[(*env->slot_names)[i]->value] = promote(env->slots[i], promoted);
+      }
+    }
+    copy->outer = promote(env->outer, promoted);
+    return copy;
+  }
+
+  // Copies whatever part of obj lives in the statement region onto the
+  // heap. Heap objects never point into the region (environments promote
+  // on set), so the walk stops at the first heap object.
+  auto promote(const Rc<Object> &obj, Promoted &promoted) -> Rc<Object> {
+    if (obj == nullptr || !region::owns(obj.get())) {
+      return obj;
+    }
+
+    auto seen = promoted.find(obj.get());
+    if (seen != promoted.end()) {
+      return static_pointer_cast<Object>(seen->second);
+    }
+
+    Rc<Object> copy;
+    auto type = obj->type();
+    if (type == INTEGER_OBJ) {
+      copy = make_rc<Integer>(borrow_cast<Integer>(obj)->value);
+    } else if (type == BOOLEAN_OBJ) {
+      copy = make_rc<Boolean>(borrow_cast<Boolean>(obj)->value);
+    } else if (type == STRING_OBJ) {
+      copy = make_rc<String>(borrow_cast<String>(obj)->value);
+    } else if (type == RETURN_VALUE_OBJ) {
+      copy = make_rc<ReturnValue>(promote(borrow_cast<ReturnValue>(obj)->value, promoted));
+    } else if (type == ARRAY_OBJ) {
+      auto source = borrow_cast<Array>(obj);
+      if (source->is_unboxed()) {
+        copy = make_rc<Array>(source->values());
+      } else {
+        auto arr = make_rc<Array>(vector<Rc<Object>>());
+        promoted[obj.get()] = arr;
+        auto &elements = arr->elements();
+        for (const auto &elem : source->elements()) {
+          elements.push_back(promote(elem, promoted));
+        }
+        copy = arr;
+      }
+    } else if (type == HASH_OBJ) {
+      auto hash = make_rc<Hash>(map<HashKey, HashPair>());
+      promoted[obj.get()] = hash;
+      for (const auto &p : borrow_cast<Hash>(obj)->pairs) {
+        hash->pairs[p.first] = make_pair(promote(p.second.first, promoted), promote(p.second.second, promoted));
+      }
+      copy = hash;
+    } else if (type == SEQUENCE_OBJ) {
+      auto seq = borrow_cast<Sequence>(obj);
+      auto promoted_seq = make_rc<Sequence>(promote(seq->source, promoted), seq->start, seq->end, seq->step);
+      for (const auto &stage : seq->stages) {
+        promoted_seq->stages.push_back({ stage.stage, promote(stage.func, promoted), stage.count });
+      }
+      copy = promoted_seq;
+    } else if (type == FUNCTION_OBJ) {
+      // registered before its environment, which usually holds it
+      auto func = borrow_cast<Function>(obj);
+      auto fn = make_rc<Function>(func->parameters, func->body, nullptr);
+      promoted[obj.get()] = fn;
+      fn->env = promote(func->env, promoted);
+      copy = fn;
+    } else {
+      return obj;
+    }
+
+    promoted[obj.get()] = copy;
+    return copy;
+  }
+
+  auto promote(const Rc<Object> &obj) -> Rc<Object> {
+    region::Scope heap(nullptr);
+    Promoted promoted = {};
+    return promote(obj, promoted);
+  }
+
+  // whether something holding a value outlives the statement region, so
+  // what it is given has to be promoted
+  auto outlives_region(const void *holder) -> bool {
+    return region::current != nullptr && !region::owns(holder);
+  }
+
+  // Whether obj is referenced from nowhere but the caller's Rc, so it can
+  // be changed in place without anyone seeing: a temporary, or a value
+  // eval handed over from a variable it is done with.
+  auto is_unique(const Rc<Object> &obj) -> bool {
+    return references(obj.get()) == 1;
+  }
 }
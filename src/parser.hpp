@@ -13,8 +13,8 @@ using namespace std;
 using namespace std::placeholders;
 
 namespace parser {
-  typedef std::function<shared_ptr<ast::Expression>()> prefix_parse_fn;
-  typedef std::function<shared_ptr<ast::Expression>(shared_ptr<ast::Expression>)> infix_parse_fn;
+  typedef std::function<Rc<ast::Expression>()> prefix_parse_fn;
+  typedef std::function<Rc<ast::Expression>(Rc<ast::Expression>)> infix_parse_fn;
 
   enum class Precedence : size_t {
       LOWEST
@@ -65,29 +65,33 @@ namespace parser {
     auto peek_precedence() -> Precedence;
     auto current_precedence() -> Precedence;
 
-    auto parse_program() -> shared_ptr<ast::Program>;
-    auto parse_statement() -> shared_ptr<ast::Statement>;
-    auto parse_let_statement() -> shared_ptr<ast::LetStatement>;
-    auto parse_return_statement() -> shared_ptr<ast::ReturnStatement>;
-    auto parse_expression_statement() -> shared_ptr<ast::ExpressionStatement>;
-    auto parse_expression(Precedence prec) -> shared_ptr<ast::Expression>;
-    auto parse_identifier() -> shared_ptr<ast::Expression>;
-    auto parse_integer_literal() -> shared_ptr<ast::Expression>;
-    auto parse_string_literal() -> shared_ptr<ast::Expression>;
-    auto parse_prefix_expression() -> shared_ptr<ast::Expression>;
-    auto parse_infix_expression(shared_ptr<ast::Expression> left) -> shared_ptr<ast::Expression>;
-    auto parse_boolean() -> shared_ptr<ast::Expression>;
-    auto parse_grouped_expression() -> shared_ptr<ast::Expression>;
-    auto parse_if_expression() -> shared_ptr<ast::Expression>;
-    auto parse_block_statement() -> shared_ptr<ast::BlockStatement>;
-    auto parse_function_literal() -> shared_ptr<ast::Expression>;
-    auto parse_macro_literal() -> shared_ptr<ast::Expression>;
-    auto parse_function_parameters() -> vector<shared_ptr<ast::Identifier>>;
-    auto parse_call_expression(shared_ptr<ast::Expression> func) -> shared_ptr<ast::Expression>;
-    auto parse_expression_list(token::TokenType end) -> vector<shared_ptr<ast::Expression>>;
-    auto parse_array_literal() -> shared_ptr<ast::Expression>;
-    auto parse_index_expression(shared_ptr<ast::Expression> left) -> shared_ptr<ast::Expression>;
-    auto parse_hash_literal() -> shared_ptr<ast::Expression>;
+    auto parse_program() -> Rc<ast::Program>;
+    auto parse_statement() -> Rc<ast::Statement>;
+    auto parse_let_statement() -> Rc<ast::LetStatement>;
+    auto parse_return_statement() -> Rc<ast::ReturnStatement>;
+    auto parse_expression_statement() -> Rc<ast::Statement>;
+    auto parse_assign_statement(Rc<ast::Expression> target) -> Rc<ast::AssignStatement>;
+    auto parse_while_statement() -> Rc<ast::WhileStatement>;
+    auto parse_for_statement() -> Rc<ast::ForStatement>;
+    auto parse_expression(Precedence prec) -> Rc<ast::Expression>;
+    auto parse_identifier() -> Rc<ast::Expression>;
+    auto parse_integer_literal() -> Rc<ast::Expression>;
+    auto parse_string_literal() -> Rc<ast::Expression>;
+    auto parse_prefix_expression() -> Rc<ast::Expression>;
+    auto parse_yield_expression() -> Rc<ast::Expression>;
+    auto parse_infix_expression(Rc<ast::Expression> left) -> Rc<ast::Expression>;
+    auto parse_boolean() -> Rc<ast::Expression>;
+    auto parse_grouped_expression() -> Rc<ast::Expression>;
+    auto parse_if_expression() -> Rc<ast::Expression>;
+    auto parse_block_statement() -> Rc<ast::BlockStatement>;
+    auto parse_function_literal() -> Rc<ast::Expression>;
+    auto parse_macro_literal() -> Rc<ast::Expression>;
+    auto parse_function_parameters() -> vector<Rc<ast::Identifier>>;
+    auto parse_call_expression(Rc<ast::Expression> func) -> Rc<ast::Expression>;
+    auto parse_expression_list(token::TokenType end) -> vector<Rc<ast::Expression>>;
+    auto parse_array_literal() -> Rc<ast::Expression>;
+    auto parse_index_expression(Rc<ast::Expression> left) -> Rc<ast::Expression>;
+    auto parse_hash_literal() -> Rc<ast::Expression>;
 
     auto register_prefix(const token::TokenType &tt, prefix_parse_fn f) -> void;
     auto register_infix(const token::TokenType &tt, infix_parse_fn f) -> void;
@@ -111,6 +115,7 @@ namespace parser {
     this->register_prefix(token::MACRO, std::bind(&Parser::parse_macro_literal, this));
     this->register_prefix(token::LBRACKET, std::bind(&Parser::parse_array_literal, this));
     this->register_prefix(token::LBRACE, std::bind(&Parser::parse_hash_literal, this));
+    this->register_prefix(token::YIELD, std::bind(&Parser::parse_yield_expression, this));
 
     this->infix_parse_fns = {};
     this->register_infix(token::PLUS, std::bind(&Parser::parse_infix_expression, this, _1));
@@ -201,8 +206,8 @@ namespace parser {
     return precedences[this->current_token.type];
   }
 
-  auto Parser::parse_program() -> shared_ptr<ast::Program> {
-    vector<shared_ptr<ast::Statement>> statements = {};
+  auto Parser::parse_program() -> Rc<ast::Program> {
+    vector<Rc<ast::Statement>> statements = {};
     while(!this->current_token_is(token::EOFT)) {
       auto stmt = this->parse_statement();
       if (stmt != nullptr) {
@@ -210,28 +215,32 @@ namespace parser {
       }
       this->next_token();
     }
-    return make_shared<ast::Program>(statements);
+    return make_rc<ast::Program>(statements);
   }
 
-  auto Parser::parse_statement() -> shared_ptr<ast::Statement> {
+  auto Parser::parse_statement() -> Rc<ast::Statement> {
     auto tt = this->current_token.type;
     if (tt == token::LET) {
       return this->parse_let_statement();
     } else if (tt == token::RETURN) {
       return this->parse_return_statement();
+    } else if (tt == token::WHILE) {
+      return this->parse_while_statement();
+    } else if (tt == token::FOR) {
+      return this->parse_for_statement();
     } else {
       return this->parse_expression_statement();
     }
   }
 
-  auto Parser::parse_let_statement() -> shared_ptr<ast::LetStatement> {
+  auto Parser::parse_let_statement() -> Rc<ast::LetStatement> {
     auto current_token = this->current_token;
 
     if (!this->expect_peek(token::IDENT)) {
       return nullptr;
     }
 
-    auto name = make_shared<ast::Identifier>(this->current_token, this->current_token.literal);
+    auto name = make_rc<ast::Identifier>(this->current_token, this->current_token.literal);
 
     if (!this->expect_peek(token::ASSIGN)) {
       return nullptr;
@@ -244,10 +253,10 @@ namespace parser {
       this->next_token();
     }
 
-    return make_shared<ast::LetStatement>(current_token, name, value);
+    return make_rc<ast::LetStatement>(current_token, name, value);
   }
 
-  auto Parser::parse_return_statement() -> shared_ptr<ast::ReturnStatement> {
+  auto Parser::parse_return_statement() -> Rc<ast::ReturnStatement> {
     auto current_token = this->current_token;
     this->next_token();
     auto value = this->parse_expression(Precedence::LOWEST);
@@ -256,21 +265,116 @@ namespace parser {
       this->next_token();
     }
 
-    return make_shared<ast::ReturnStatement>(current_token, value);
+    return make_rc<ast::ReturnStatement>(current_token, value);
   }
 
-  auto Parser::parse_expression_statement() -> shared_ptr<ast::ExpressionStatement> {
+  auto Parser::parse_expression_statement() -> Rc<ast::Statement> {
     auto current_token = this->current_token;
     auto expr = this->parse_expression(Precedence::LOWEST);
 
+    if (this->peek_token_is(token::ASSIGN)) {
+      return this->parse_assign_statement(expr);
+    }
+
     if (this->peek_token_is(token::SEMICOLON)) {
       this->next_token();
     }
 
-    return make_shared<ast::ExpressionStatement>(current_token, expr);
+    return make_rc<ast::ExpressionStatement>(current_token, expr);
   }
 
-  auto Parser::parse_expression(Precedence prec) -> shared_ptr<ast::Expression> {
+  auto Parser::parse_assign_statement(Rc<ast::Expression> target) -> Rc<ast::AssignStatement> {
+    this->next_token();
+    auto current_token = this->current_token;
+
+    if (target == nullptr) {
+      return nullptr;
+    }
+    if (target->type() != ast::NodeType::IDENTIFIER && target->type() != ast::NodeType::INDEXEXPRESSION) {
+      string msg("");
+      msg += "cannot assign to ";
+      msg += target->to_string();
+      this->errors.push_back(msg);
+      return nullptr;
+    }
+
+    this->next_token();
+    auto value = this->parse_expression(Precedence::LOWEST);
+
+    if (this->peek_token_is(token::SEMICOLON)) {
+      this->next_token();
+    }
+
+    return make_rc<ast::AssignStatement>(current_token, target, value);
+  }
+
+  auto Parser::parse_while_statement() -> Rc<ast::WhileStatement> {
+    auto current_token = this->current_token;
+
+    if (!this->expect_peek(token::LPAREN)) {
+      return nullptr;
+    }
+
+    this->next_token();
+
+    auto condition = this->parse_expression(Precedence::LOWEST);
+
+    if (!this->expect_peek(token::RPAREN)) {
+      return nullptr;
+    }
+
+    if (!this->expect_peek(token::LBRACE)) {
+      return nullptr;
+    }
+
+    auto body = this->parse_block_statement();
+
+    if (this->peek_token_is(token::SEMICOLON)) {
+      this->next_token();
+    }
+
+    return make_rc<ast::WhileStatement>(current_token, condition, body);
+  }
+
+  auto Parser::parse_for_statement() -> Rc<ast::ForStatement> {
+    auto current_token = this->current_token;
+
+    if (!this->expect_peek(token::LPAREN)) {
+      return nullptr;
+    }
+
+    if (!this->expect_peek(token::IDENT)) {
+      return nullptr;
+    }
+
+    auto variable = make_rc<ast::Identifier>(this->current_token, this->current_token.literal);
+
+    if (!this->expect_peek(token::IN)) {
+      return nullptr;
+    }
+
+    this->next_token();
+
+    auto iterable = this->parse_expression(Precedence::LOWEST);
+
+    if (!this->expect_peek(token::RPAREN)) {
+      return nullptr;
+    }
+
+    if (!this->expect_peek(token::LBRACE)) {
+      return nullptr;
+    }
+
+    auto body = this->parse_block_statement();
+
+    if (this->peek_token_is(token::SEMICOLON)) {
+      this->next_token();
+    }
+
+    return make_rc<ast::ForStatement>(current_token, variable, iterable, body);
+  }
+
+  auto Parser::parse_expression(Precedence prec) -> Rc<ast::Expression> {
     auto prefix_fn = this->prefix_parse_fns[this->current_token.type];
     if (prefix_fn == nullptr) {
       this->no_prefix_parse_fn_error(this->current_token.type);
@@ -292,11 +396,11 @@ namespace parser {
     return left_expr;
   }
 
-  auto Parser::parse_identifier() -> shared_ptr<ast::Expression> {
-    return make_shared<ast::Identifier>(this->current_token, this->current_token.literal);
+  auto Parser::parse_identifier() -> Rc<ast::Expression> {
+    return make_rc<ast::Identifier>(this->current_token, this->current_token.literal);
   }
 
-  auto Parser::parse_integer_literal() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_integer_literal() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
 
     int value;
@@ -311,37 +415,50 @@ namespace parser {
       return nullptr;
     }
 
-    return make_shared<ast::IntegerLiteral>(current_token, value);
+    return make_rc<ast::IntegerLiteral>(current_token, value);
   }
 
-  auto Parser::parse_string_literal() -> shared_ptr<ast::Expression> {
-    return make_shared<ast::StringLiteral>(this->current_token, this->current_token.literal);
+  auto Parser::parse_string_literal() -> Rc<ast::Expression> {
+    return make_rc<ast::StringLiteral>(this->current_token, this->current_token.literal);
   }
 
-  auto Parser::parse_prefix_expression() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_prefix_expression() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
 
     this->next_token();
     auto right = this->parse_expression(Precedence::PREFIX);
 
-    return make_shared<ast::PrefixExpression>(current_token, current_token.literal, right);
+    return make_rc<ast::PrefixExpression>(current_token, current_token.literal, right);
+  }
+
+  // yield takes everything up to the end of the expression, like return
+  auto Parser::parse_yield_expression() -> Rc<ast::Expression> {
+    auto current_token = this->current_token;
+
+    this->next_token();
+    auto value = this->parse_expression(Precedence::LOWEST);
+    if (value == nullptr) {
+      return nullptr;
+    }
+
+    return make_rc<ast::YieldExpression>(current_token, value);
   }
 
-  auto Parser::parse_infix_expression(shared_ptr<ast::Expression> left) -> shared_ptr<ast::Expression> {
+  auto Parser::parse_infix_expression(Rc<ast::Expression> left) -> Rc<ast::Expression> {
     auto current_token = this->current_token;
 
     auto prec = this->current_precedence();
     this->next_token();
     auto right = this->parse_expression(prec);
 
-    return make_shared<ast::InfixExpression>(current_token, left, current_token.literal, right);
+    return make_rc<ast::InfixExpression>(current_token, left, current_token.literal, right);
   }
 
-  auto Parser::parse_boolean() -> shared_ptr<ast::Expression> {
-    return make_shared<ast::Boolean>(this->current_token, this->current_token_is(token::TRUET));
+  auto Parser::parse_boolean() -> Rc<ast::Expression> {
+    return make_rc<ast::Boolean>(this->current_token, this->current_token_is(token::TRUET));
   }
 
-  auto Parser::parse_grouped_expression() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_grouped_expression() -> Rc<ast::Expression> {
     this->next_token();
 
     auto expr = this->parse_expression(Precedence::LOWEST);
@@ -353,7 +470,7 @@ namespace parser {
     return expr;
   }
 
-  auto Parser::parse_if_expression() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_if_expression() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
 
     if (!this->expect_peek(token::LPAREN)) {
@@ -373,7 +490,7 @@ namespace parser {
     }
 
     auto consequence = this->parse_block_statement();
-    shared_ptr<ast::BlockStatement> alternative = nullptr;
+    Rc<ast::BlockStatement> alternative = nullptr;
 
     if (this->peek_token_is(token::ELSE)) {
       this->next_token();
@@ -385,13 +502,13 @@ namespace parser {
       alternative = this->parse_block_statement();
     }
 
-    return make_shared<ast::IfExpression>(current_token, condition, consequence, alternative);
+    return make_rc<ast::IfExpression>(current_token, condition, consequence, alternative);
   }
 
-  auto Parser::parse_block_statement() -> shared_ptr<ast::BlockStatement> {
+  auto Parser::parse_block_statement() -> Rc<ast::BlockStatement> {
     auto current_token = this->current_token;
 
-    vector<shared_ptr<ast::Statement>> statements = {};
+    vector<Rc<ast::Statement>> statements = {};
     this->next_token();
 
     while (!this->current_token_is(token::RBRACE) && !this->current_token_is(token::EOFT)) {
@@ -402,10 +519,10 @@ namespace parser {
       this->next_token();
     }
 
-    return make_shared<ast::BlockStatement>(current_token, statements);
+    return make_rc<ast::BlockStatement>(current_token, statements);
   }
 
-  auto Parser::parse_function_literal() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_function_literal() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
 
     if (!this->expect_peek(token::LPAREN)) {
@@ -420,11 +537,11 @@ namespace parser {
 
     auto body = this->parse_block_statement();
 
-    return make_shared<ast::FunctionLiteral>(current_token, parameters, body);
+    return make_rc<ast::FunctionLiteral>(current_token, parameters, body);
   }
 
   // pretty much like the parse_function_literal
-  auto Parser::parse_macro_literal() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_macro_literal() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
 
     if (!this->expect_peek(token::LPAREN)) {
@@ -439,11 +556,11 @@ namespace parser {
 
     auto body = this->parse_block_statement();
 
-    return make_shared<ast::MacroLiteral>(current_token, parameters, body);
+    return make_rc<ast::MacroLiteral>(current_token, parameters, body);
   }
 
-  auto Parser::parse_function_parameters() -> vector<shared_ptr<ast::Identifier>> {
-    vector<shared_ptr<ast::Identifier>> identifiers = {};
+  auto Parser::parse_function_parameters() -> vector<Rc<ast::Identifier>> {
+    vector<Rc<ast::Identifier>> identifiers = {};
 
     if (this->peek_token_is(token::RPAREN)) {
       this->next_token();
@@ -452,13 +569,13 @@ namespace parser {
 
     this->next_token();
 
-    auto ident = make_shared<ast::Identifier>(this->current_token, this->current_token.literal);
+    auto ident = make_rc<ast::Identifier>(this->current_token, this->current_token.literal);
     identifiers.push_back(ident);
 
     while (this->peek_token_is(token::COMMA)) {
       this->next_token();
       this->next_token();
-      auto ident = make_shared<ast::Identifier>(this->current_token, this->current_token.literal);
+      auto ident = make_rc<ast::Identifier>(this->current_token, this->current_token.literal);
       identifiers.push_back(ident);
     }
 
@@ -469,14 +586,14 @@ namespace parser {
     return identifiers;
   }
 
-  auto Parser::parse_call_expression(shared_ptr<ast::Expression> func) -> shared_ptr<ast::Expression> {
+  auto Parser::parse_call_expression(Rc<ast::Expression> func) -> Rc<ast::Expression> {
     auto current_token = this->current_token;
     auto arguments = this->parse_expression_list(token::RPAREN);
-    return make_shared<ast::CallExpression>(current_token, func, arguments);
+    return make_rc<ast::CallExpression>(current_token, func, arguments);
   }
 
-  auto Parser::parse_expression_list(token::TokenType end) -> vector<shared_ptr<ast::Expression>> {
-    vector<shared_ptr<ast::Expression>> list = {};
+  auto Parser::parse_expression_list(token::TokenType end) -> vector<Rc<ast::Expression>> {
+    vector<Rc<ast::Expression>> list = {};
 
     if (this->peek_token_is(end)) {
       this->next_token();
@@ -499,13 +616,13 @@ namespace parser {
     return list;
   }
 
-  auto Parser::parse_array_literal() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_array_literal() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
     auto elements = this->parse_expression_list(token::RBRACKET);
-    return make_shared<ast::ArrayLiteral>(current_token, elements);
+    return make_rc<ast::ArrayLiteral>(current_token, elements);
   }
 
-  auto Parser::parse_index_expression(shared_ptr<ast::Expression> left) -> shared_ptr<ast::Expression> {
+  auto Parser::parse_index_expression(Rc<ast::Expression> left) -> Rc<ast::Expression> {
     auto current_token = this->current_token;
     this->next_token();
     auto index = this->parse_expression(Precedence::LOWEST);
@@ -514,12 +631,12 @@ namespace parser {
       return nullptr;
     }
 
-    return make_shared<ast::IndexExpression>(current_token, left, index);
+    return make_rc<ast::IndexExpression>(current_token, left, index);
   }
 
-  auto Parser::parse_hash_literal() -> shared_ptr<ast::Expression> {
+  auto Parser::parse_hash_literal() -> Rc<ast::Expression> {
     auto current_token = this->current_token;
-    map<shared_ptr<ast::Expression>, shared_ptr<ast::Expression>> pairs = {};
+    map<Rc<ast::Expression>, Rc<ast::Expression>> pairs = {};
 
     while (!this->peek_token_is(token::RBRACE)) {
       this->next_token();
@@ -543,6 +660,6 @@ namespace parser {
       return nullptr;
     }
 
-    return make_shared<ast::HashLiteral>(current_token, pairs);
+    return make_rc<ast::HashLiteral>(current_token, pairs);
   }
 }
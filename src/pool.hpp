@@ -0,0 +1,255 @@
+#pragma once
+
+#include <new>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include "region.hpp"
+
+using namespace std;
+
+namespace pool {
+  struct PoolStats {
+    string name;
+    size_t object_size;
+    size_t slabs;       // slabs carved so far, they are never given back
+    size_t capacity;    // blocks those slabs hold
+    size_t allocations;
+    size_t frees;
+
+    auto live() const -> size_t {
+      return this->allocations - this->frees;
+    }
+  };
+
+  constexpr auto round_up(size_t n, size_t align) -> size_t {
+    return (n + align - 1) / align * align;
+  }
+
+  class PoolBase {
+  public:
+    virtual PoolStats stats() = 0;
+  };
+
+  // pools are leaked on purpose: objects held by globals are released
+  // during static destruction and must still find their pool
+  auto registry() -> vector<PoolBase *> & {
+    static auto pools = new vector<PoolBase *>();
+    return *pools;
+  }
+
+  auto registry_lock() -> mutex & {
+    static auto lock = new mutex();
+    return *lock;
+  }
+
+  // Fixed size block pool for one object type. Blocks are carved out of
+  // 16KB slabs so objects of the same type sit next to each other, freed
+  // blocks go on an intrusive free list. Each thread keeps a small cache of
+  // free blocks and only takes the depot lock to move a batch in or out.
+  template <typename T>
+  class Pool : public PoolBase {
+  private:
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    // trivially destructible so it stays usable after the flusher below
+    // is gone (globals released at exit still come through here)
+    struct Cache {
+      FreeBlock *head;
+      size_t count;
+      size_t allocations;
+      size_t frees;
+      bool registered;
+      bool dead;
+    };
+
+    struct CacheFlusher {
+      ~CacheFlusher() {
+        auto &cache = Pool::local();
+        Pool::instance().flush(cache, cache.count);
+        cache.dead = true;
+      }
+    };
+
+    static constexpr size_t BLOCK_SIZE = round_up(sizeof(T) < sizeof(FreeBlock) ? sizeof(FreeBlock) : sizeof(T), alignof(T));
+    static constexpr size_t SLAB_SIZE = 16 * 1024;
+    static constexpr size_t BLOCKS_PER_SLAB = SLAB_SIZE / BLOCK_SIZE > 0 ? SLAB_SIZE / BLOCK_SIZE : 1;
+    static constexpr size_t BATCH = 64;
+
+    mutex lock;
+    FreeBlock *depot = nullptr;
+    vector<void *> slabs = {};
+    size_t allocations = 0;
+    size_t frees = 0;
+
+    static auto local() -> Cache & {
+      static thread_local Cache cache = { nullptr, 0, 0, 0, false, false };
+      return cache;
+    }
+
+    auto carve_slab() -> void {
+      auto slab = static_cast<char *>(::operator new(BLOCKS_PER_SLAB * BLOCK_SIZE));
+      this->slabs.push_back(slab);
+      for (size_t i = BLOCKS_PER_SLAB; i > 0; i--) {
+        auto block = reinterpret_cast<FreeBlock *>(slab + (i - 1) * BLOCK_SIZE);
+        block->next = this->depot;
+        this->depot = block;
+      }
+    }
+
+    // callers hold the lock
+    auto take_one() -> FreeBlock * {
+      if (this->depot == nullptr) {
+        this->carve_slab();
+      }
+      auto block = this->depot;
+      this->depot = block->next;
+      return block;
+    }
+
+    auto flush(Cache &cache, size_t n) -> void {
+      lock_guard<mutex> guard(this->lock);
+      for (size_t i = 0; i < n && cache.head != nullptr; i++) {
+        auto block = cache.head;
+        cache.head = block->next;
+        cache.count--;
+        block->next = this->depot;
+        this->depot = block;
+      }
+      this->allocations += cache.allocations;
+      this->frees += cache.frees;
+      cache.allocations = 0;
+      cache.frees = 0;
+    }
+
+    auto refill(Cache &cache) -> void {
+      if (!cache.registered) {
+        static thread_local CacheFlusher flusher;
+        (void) flusher;
+        cache.registered = true;
+      }
+      lock_guard<mutex> guard(this->lock);
+      for (size_t i = 0; i < BATCH; i++) {
+        auto block = this->take_one();
+        block->next = cache.head;
+        cache.head = block;
+        cache.count++;
+      }
+    }
+
+  public:
+    static auto instance() -> Pool & {
+      static auto pool = [] {
+        auto p = new Pool();
+        lock_guard<mutex> guard(registry_lock());
+        registry().push_back(p);
+        return p;
+      }();
+      return *pool;
+    }
+
+    static auto allocate(size_t size) -> void * {
+      if (size != sizeof(T)) {
+        return ::operator new(size);
+      }
+
+      auto &cache = local();
+      if (cache.dead) {
+        auto &pool = instance();
+        lock_guard<mutex> guard(pool.lock);
+        pool.allocations++;
+        return pool.take_one();
+      }
+
+      if (cache.head == nullptr) {
+        instance().refill(cache);
+      }
+      auto block = cache.head;
+      cache.head = block->next;
+      cache.count--;
+      cache.allocations++;
+      return block;
+    }
+
+    static auto deallocate(void *p, size_t size) -> void {
+      if (size != sizeof(T)) {
+        ::operator delete(p);
+        return;
+      }
+
+      auto block = static_cast<FreeBlock *>(p);
+      auto &cache = local();
+      if (cache.dead) {
+        auto &pool = instance();
+        lock_guard<mutex> guard(pool.lock);
+        block->next = pool.depot;
+        pool.depot = block;
+        pool.frees++;
+        return;
+      }
+
+      block->next = cache.head;
+      cache.head = block;
+      cache.count++;
+      cache.frees++;
+      if (cache.count > 2 * BATCH) {
+        instance().flush(cache, BATCH);
+      }
+    }
+
+    // exact for the calling thread, other threads report what they have
+    // handed back to the depot so far
+    PoolStats stats() {
+      auto &cache = local();
+      lock_guard<mutex> guard(this->lock);
+      return {
+        T::pool_name(),
+        BLOCK_SIZE,
+        this->slabs.size(),
+        this->slabs.size() * BLOCKS_PER_SLAB,
+        this->allocations + cache.allocations,
+        this->frees + cache.frees
+      };
+    }
+  };
+
+  // Mixed into a class to route its new/delete through Pool<T>, or
+  // through the current region while one is active. Only objects of
+  // exactly that type use the pool, a bigger subclass falls back to the
+  // global allocator.
+  template <typename T>
+  class Pooled {
+  public:
+    static void *operator new(size_t size) {
+      if (region::fits(size)) {
+        return region::current->allocate(size);
+      }
+      return Pool<T>::allocate(size);
+    }
+
+    static void operator delete(void *p, size_t size) {
+      if (region::owns(p)) {
+        region::release(p);
+        return;
+      }
+      Pool<T>::deallocate(p, size);
+    }
+  };
+
+  auto stats() -> vector<PoolStats> {
+    vector<PoolBase *> pools;
+    {
+      lock_guard<mutex> guard(registry_lock());
+      pools = registry();
+    }
+
+    vector<PoolStats> result = {};
+    for (auto p : pools) {
+      result.push_back(p->stats());
+    }
+    return result;
+  }
+}
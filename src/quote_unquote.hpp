@@ -17,11 +17,11 @@ using namespace token;
 using namespace object;
 
 namespace quoteunquote {
-  auto convert_object_to_node(shared_ptr<Object> obj) -> shared_ptr<Node> {
+  auto convert_object_to_node(Rc<Object> obj) -> Rc<Node> {
     if (obj->type() == INTEGER_OBJ) {
       auto int_obj = static_pointer_cast<Integer>(obj);
       Token t = { INT, format("{}", int_obj->value) };
-      return make_shared<IntegerLiteral>(t, int_obj->value);
+      return make_rc<IntegerLiteral>(t, int_obj->value);
     } else if (obj->type() == BOOLEAN_OBJ) {
       auto bool_obj = static_pointer_cast<object::Boolean>(obj);
       Token t;
@@ -30,7 +30,7 @@ namespace quoteunquote {
       } else {
         t = { FALSET, "false" };
       }
-      return make_shared<ast::Boolean>(t, bool_obj->value);
+      return make_rc<ast::Boolean>(t, bool_obj->value);
     } else if (obj->type() == QUOTE_OBJ) {
       return static_pointer_cast<Quote>(obj)->node;
     } else {
@@ -38,7 +38,7 @@ namespace quoteunquote {
     }
   }
 
-  auto is_unquote_call(shared_ptr<Node> node) -> bool {
+  auto is_unquote_call(Rc<Node> node) -> bool {
     if (node->type() != NodeType::CALLEXPRESSION) {
       return false;
     }
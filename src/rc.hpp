@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <functional>
+
+using namespace std;
+
+namespace rc {
+  // Base class for everything the runtime hands around through Rc<T>
+  // (AST nodes, objects and environments). The count lives inside the
+  // object and is a plain integer: the interpreter is single threaded, so
+  // unlike shared_ptr we never pay for atomic updates or a control block.
+  class RefCounted {
+  private:
+    mutable size_t ref_count = 0;
+
+    template <typename T> friend class Rc;
+    friend auto pin(const RefCounted *obj) -> void;
+    friend auto references(const RefCounted *obj) -> size_t;
+
+  public:
+    RefCounted() {};
+    // a copy is a brand new object, it doesn't inherit the references
+    RefCounted(const RefCounted &) {};
+    RefCounted &operator=(const RefCounted &) { return *this; };
+    virtual ~RefCounted() {};
+  };
+
+  // For objects whose storage belongs to something other than Rc (say an
+  // evaluator stack): the extra reference is never released, so Rc will
+  // never try to delete them.
+  auto pin(const RefCounted *obj) -> void {
+    obj->ref_count++;
+  }
+
+  auto references(const RefCounted *obj) -> size_t {
+    return obj->ref_count;
+  }
+
+  template <typename T>
+  class Rc {
+  private:
+    T *ptr;
+
+    template <typename U> friend class Rc;
+
+    auto retain() const -> void {
+      if (this->ptr != nullptr) {
+        static_cast<const RefCounted *>(this->ptr)->ref_count++;
+      }
+    }
+
+    auto release() -> void {
+      if (this->ptr != nullptr) {
+        // nothing is read through ptr once it may have been deleted
+        auto count = --static_cast<const RefCounted *>(this->ptr)->ref_count;
+        if (count == 0) {
+          delete this->ptr;
+        }
+      }
+      this->ptr = nullptr;
+    }
+
+  public:
+    Rc(): ptr(nullptr) {};
+    Rc(nullptr_t): ptr(nullptr) {};
+    // the count is intrusive, so adopting a raw pointer that is already
+    // owned somewhere else is safe (it just adds one more reference)
+    explicit Rc(T *p): ptr(p) { this->retain(); };
+    Rc(const Rc &other): ptr(other.ptr) { this->retain(); };
+    Rc(Rc &&other) noexcept : ptr(other.ptr) { other.ptr = nullptr; };
+
+    template <typename U, typename = typename enable_if<is_convertible<U *, T *>::value>::type>
+    Rc(const Rc<U> &other): ptr(other.ptr) { this->retain(); };
+
+    template <typename U, typename = typename enable_if<is_convertible<U *, T *>::value>::type>
+    Rc(Rc<U> &&other) noexcept : ptr(other.ptr) { other.ptr = nullptr; };
+
+    ~Rc() { this->release(); };
+
+    Rc &operator=(const Rc &other) {
+      other.retain();
+      this->release();
+      this->ptr = other.ptr;
+      return *this;
+    }
+
+    Rc &operator=(Rc &&other) noexcept {
+      if (this != &other) {
+        this->release();
+        this->ptr = other.ptr;
+        other.ptr = nullptr;
+      }
+      return *this;
+    }
+
+    Rc &operator=(nullptr_t) {
+      this->release();
+      return *this;
+    }
+
+    T *get() const {
+      return this->ptr;
+    }
+
+    T *operator->() const {
+      return this->ptr;
+    }
+
+    T &operator*() const {
+      return *this->ptr;
+    }
+
+    explicit operator bool() const {
+      return this->ptr != nullptr;
+    }
+
+    size_t use_count() const {
+      return this->ptr == nullptr ? 0 : static_cast<const RefCounted *>(this->ptr)->ref_count;
+    }
+
+    void reset() {
+      this->release();
+    }
+  };
+
+  template <typename T, typename... Args>
+  auto make_rc(Args&&... args) -> Rc<T> {
+    return Rc<T>(new T(std::forward<Args>(args)...));
+  }
+
+  // found through ADL, so call sites read the same as with shared_ptr
+  template <typename T, typename U>
+  auto static_pointer_cast(const Rc<U> &p) -> Rc<T> {
+    return Rc<T>(static_cast<T *>(p.get()));
+  }
+
+  template <typename T, typename U>
+  auto dynamic_pointer_cast(const Rc<U> &p) -> Rc<T> {
+    return Rc<T>(dynamic_cast<T *>(p.get()));
+  }
+
+  // cast without touching the count, the caller must keep p alive
+  template <typename T, typename U>
+  auto borrow_cast(const Rc<U> &p) -> T * {
+    return static_cast<T *>(p.get());
+  }
+
+  template <typename T>
+  bool operator==(const Rc<T> &p, nullptr_t) {
+    return p.get() == nullptr;
+  }
+
+  template <typename T>
+  bool operator==(nullptr_t, const Rc<T> &p) {
+    return p.get() == nullptr;
+  }
+
+  template <typename T>
+  bool operator!=(const Rc<T> &p, nullptr_t) {
+    return p.get() != nullptr;
+  }
+
+  template <typename T>
+  bool operator!=(nullptr_t, const Rc<T> &p) {
+    return p.get() != nullptr;
+  }
+
+  // identity order, used by the ast maps keyed on nodes
+  template <typename T, typename U>
+  bool operator<(const Rc<T> &a, const Rc<U> &b) {
+    return std::less<const void *>()(a.get(), b.get());
+  }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <unordered_set>
+
+using namespace std;
+
+namespace region {
+  const size_t CHUNK_SIZE = 64 * 1024;
+  const size_t ALIGN = 16;
+
+  // Lives at the start of every chunk. Chunks are CHUNK_SIZE aligned, so
+  // the header of any block is found by masking its address.
+  struct Chunk {
+    size_t live;
+    bool retired;
+  };
+
+  const size_t HEADER_SIZE = (sizeof(Chunk) + ALIGN - 1) / ALIGN * ALIGN;
+
+  // every chunk that still holds memory, current or retired
+  unordered_set<uintptr_t> chunks = {};
+
+  auto chunk_of(const void *p) -> Chunk * {
+    return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(p) & ~(CHUNK_SIZE - 1));
+  }
+
+  auto owns(const void *p) -> bool {
+    return !chunks.empty() && chunks.count(reinterpret_cast<uintptr_t>(chunk_of(p))) > 0;
+  }
+
+  auto free_chunk(Chunk *chunk) -> void {
+    chunks.erase(reinterpret_cast<uintptr_t>(chunk));
+    free(chunk);
+  }
+
+  // a block allocated from a region died, its memory comes back on reset
+  auto release(void *p) -> void {
+    auto chunk = chunk_of(p);
+    chunk->live--;
+    if (chunk->retired && chunk->live == 0) {
+      free_chunk(chunk);
+    }
+  }
+
+  // Bump allocator whose memory is reclaimed all at once by reset().
+  // Objects are still reference counted and destroyed one by one (that is
+  // what releases their strings and vectors), dying just doesn't give the
+  // block back. A chunk that still has live blocks at reset is retired
+  // rather than reused and freed once its last block dies, so something
+  // that escaped without being promoted costs memory, never correctness.
+  class Region {
+  private:
+    vector<Chunk *> used = {};
+    vector<Chunk *> spare = {};
+    char *cursor = nullptr;
+    char *limit = nullptr;
+
+    auto next_chunk() -> void {
+      Chunk *chunk;
+      if (!this->spare.empty()) {
+        chunk = this->spare.back();
+        this->spare.pop_back();
+      } else {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, CHUNK_SIZE, CHUNK_SIZE) != 0) {
+          throw bad_alloc();
+        }
+        chunk = static_cast<Chunk *>(memory);
+        chunks.insert(reinterpret_cast<uintptr_t>(chunk));
+      }
+      chunk->live = 0;
+      chunk->retired = false;
+      this->used.push_back(chunk);
+      this->cursor = reinterpret_cast<char *>(chunk) + HEADER_SIZE;
+      this->limit = reinterpret_cast<char *>(chunk) + CHUNK_SIZE;
+    }
+
+  public:
+    size_t resets = 0;
+    size_t retired = 0;
+
+    ~Region() {
+      this->reset();
+      for (auto chunk : this->spare) {
+        free_chunk(chunk);
+      }
+    }
+
+    auto allocate(size_t size) -> void * {
+      size = (size + ALIGN - 1) / ALIGN * ALIGN;
+      if (this->cursor == nullptr || this->cursor + size > this->limit) {
+        this->next_chunk();
+      }
+      auto block = this->cursor;
+      this->cursor += size;
+      this->used.back()->live++;
+      return block;
+    }
+
+    auto live() -> size_t {
+      size_t n = 0;
+      for (auto chunk : this->used) {
+        n += chunk->live;
+      }
+      return n;
+    }
+
+    auto reset() -> void {
+      for (auto chunk : this->used) {
+        if (chunk->live == 0) {
+          this->spare.push_back(chunk);
+        } else {
+          chunk->retired = true;
+          this->retired++;
+        }
+      }
+      this->used.clear();
+      this->cursor = nullptr;
+      this->limit = nullptr;
+      this->resets++;
+    }
+  };
+
+  // the region pooled objects are carved from, nullptr means the heap
+  thread_local Region *current = nullptr;
+
+  // Set per run: evaluate each top level statement in its own region.
+  bool per_statement = false;
+
+  // allocates into r (or the heap for nullptr) until the end of the scope
+  class Scope {
+  private:
+    Region *previous;
+
+  public:
+    explicit Scope(Region *r): previous(current) {
+      current = r;
+    }
+
+    ~Scope() {
+      current = this->previous;
+    }
+  };
+
+  // only small blocks are worth a region, anything else stays on the heap
+  auto fits(size_t size) -> bool {
+    return current != nullptr && size <= (CHUNK_SIZE - HEADER_SIZE) / 4;
+  }
+}
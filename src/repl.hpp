@@ -15,8 +15,8 @@ namespace repl {
     cout << "lc3 Version 0.1" << endl;
     cout << "Press Ctrl+c to Exit\n" << endl;
 
-    auto env = make_shared<Environment>();
-    auto macro_env = make_shared<Environment>();
+    auto env = make_rc<Environment>();
+    auto macro_env = make_rc<Environment>();
 
     load("./lib/std.lc3", env, macro_env);
 
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SIMD_X86_64
+#define SIMD_AVX2 __attribute__((target("avx2")))
+#define SIMD_SSE4 __attribute__((target("sse4.1")))
+#endif
+
+using namespace std;
+
+// Kernels over the int buffer of an unboxed array (see object::Array), in
+// avx2 or sse4.1 where the cpu running them has it and plain loops
+// otherwise. Arithmetic wraps around, as Integer's does in practice.
+namespace simd {
+  enum class Level {
+    SCALAR,
+    SSE4,
+    AVX2
+  };
+
+  auto detect() -> Level {
+#ifdef SIMD_X86_64
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return Level::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+      return Level::SSE4;
+    }
+#endif
+    return Level::SCALAR;
+  }
+
+  // what the kernels run on, never above what detect gives
+  Level level = detect();
+
+  auto wrapping_add(int a, int b) -> int {
+    return static_cast<int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+  }
+
+  auto wrapping_mul(int a, int b) -> int {
+    return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+  }
+
+  // the scalar kernels also finish what is left over after the last
+  // whole vector
+
+  auto sum_scalar(const int *v, size_t n, int acc) -> int {
+    for (size_t i = 0; i < n; i++) {
+      acc = wrapping_add(acc, v[i]);
+    }
+    return acc;
+  }
+
+  auto min_scalar(const int *v, size_t n, int acc) -> int {
+    for (size_t i = 0; i < n; i++) {
+      acc = v[i] < acc ? v[i] : acc;
+    }
+    return acc;
+  }
+
+  auto max_scalar(const int *v, size_t n, int acc) -> int {
+    for (size_t i = 0; i < n; i++) {
+      acc = v[i] > acc ? v[i] : acc;
+    }
+    return acc;
+  }
+
+  auto dot_scalar(const int *a, const int *b, size_t n, int acc) -> int {
+    for (size_t i = 0; i < n; i++) {
+      acc = wrapping_add(acc, wrapping_mul(a[i], b[i]));
+    }
+    return acc;
+  }
+
+  auto count_eq_scalar(const int *v, size_t n, int x) -> size_t {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+      count += v[i] == x;
+    }
+    return count;
+  }
+
+  auto prefix_sum_scalar(const int *v, int *out, size_t n, int acc) -> void {
+    for (size_t i = 0; i < n; i++) {
+      acc = wrapping_add(acc, v[i]);
+      out[i] = acc;
+    }
+  }
+
+  auto add_scalar(const int *a, const int *b, int *out, size_t n) -> void {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = wrapping_add(a[i], b[i]);
+    }
+  }
+
+  auto mul_scalar(const int *a, const int *b, int *out, size_t n) -> void {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = wrapping_mul(a[i], b[i]);
+    }
+  }
+
+#ifdef SIMD_X86_64
+  SIMD_AVX2 auto load8(const int *p) -> __m256i {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+
+  SIMD_AVX2 auto store8(int *p, __m256i x) -> void {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), x);
+  }
+
+  SIMD_SSE4 auto load4(const int *p) -> __m128i {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  }
+
+  SIMD_SSE4 auto store4(int *p, __m128i x) -> void {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), x);
+  }
+
+  SIMD_AVX2 auto sum_avx2(const int *v, size_t n) -> int {
+    auto acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      acc = _mm256_add_epi32(acc, load8(v + i));
+    }
+    int lanes[8];
+    store8(lanes, acc);
+    return sum_scalar(v + i, n - i, sum_scalar(lanes, 8, 0));
+  }
+
+  SIMD_SSE4 auto sum_sse4(const int *v, size_t n) -> int {
+    auto acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      acc = _mm_add_epi32(acc, load4(v + i));
+    }
+    int lanes[4];
+    store4(lanes, acc);
+    return sum_scalar(v + i, n - i, sum_scalar(lanes, 4, 0));
+  }
+
+  SIMD_AVX2 auto min_avx2(const int *v, size_t n) -> int {
+    if (n < 8) {
+      return min_scalar(v + 1, n - 1, v[0]);
+    }
+    auto acc = load8(v);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+      acc = _mm256_min_epi32(acc, load8(v + i));
+    }
+    int lanes[8];
+    store8(lanes, acc);
+    return min_scalar(v + i, n - i, min_scalar(lanes + 1, 7, lanes[0]));
+  }
+
+  SIMD_SSE4 auto min_sse4(const int *v, size_t n) -> int {
+    if (n < 4) {
+      return min_scalar(v + 1, n - 1, v[0]);
+    }
+    auto acc = load4(v);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+      acc = _mm_min_epi32(acc, load4(v + i));
+    }
+    int lanes[4];
+    store4(lanes, acc);
+    return min_scalar(v + i, n - i, min_scalar(lanes + 1, 3, lanes[0]));
+  }
+
+  SIMD_AVX2 auto max_avx2(const int *v, size_t n) -> int {
+    if (n < 8) {
+      return max_scalar(v + 1, n - 1, v[0]);
+    }
+    auto acc = load8(v);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+      acc = _mm256_max_epi32(acc, load8(v + i));
+    }
+    int lanes[8];
+    store8(lanes, acc);
+    return max_scalar(v + i, n - i, max_scalar(lanes + 1, 7, lanes[0]));
+  }
+
+  SIMD_SSE4 auto max_sse4(const int *v, size_t n) -> int {
+    if (n < 4) {
+      return max_scalar(v + 1, n - 1, v[0]);
+    }
+    auto acc = load4(v);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+      acc = _mm_max_epi32(acc, load4(v + i));
+    }
+    int lanes[4];
+    store4(lanes, acc);
+    return max_scalar(v + i, n - i, max_scalar(lanes + 1, 3, lanes[0]));
+  }
+
+  SIMD_AVX2 auto dot_avx2(const int *a, const int *b, size_t n) -> int {
+    auto acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(load8(a + i), load8(b + i)));
+    }
+    int lanes[8];
+    store8(lanes, acc);
+    return dot_scalar(a + i, b + i, n - i, sum_scalar(lanes, 8, 0));
+  }
+
+  SIMD_SSE4 auto dot_sse4(const int *a, const int *b, size_t n) -> int {
+    auto acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      acc = _mm_add_epi32(acc, _mm_mullo_epi32(load4(a + i), load4(b + i)));
+    }
+    int lanes[4];
+    store4(lanes, acc);
+    return dot_scalar(a + i, b + i, n - i, sum_scalar(lanes, 4, 0));
+  }
+
+  // a lane that compares equal is -1, subtracted it counts one
+  SIMD_AVX2 auto count_eq_avx2(const int *v, size_t n, int x) -> size_t {
+    auto xs = _mm256_set1_epi32(x);
+    auto acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(load8(v + i), xs));
+    }
+    uint32_t lanes[8];
+    store8(reinterpret_cast<int *>(lanes), acc);
+    size_t count = count_eq_scalar(v + i, n - i, x);
+    for (auto lane : lanes) {
+      count += lane;
+    }
+    return count;
+  }
+
+  SIMD_SSE4 auto count_eq_sse4(const int *v, size_t n, int x) -> size_t {
+    auto xs = _mm_set1_epi32(x);
+    auto acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(load4(v + i), xs));
+    }
+    uint32_t lanes[4];
+    store4(reinterpret_cast<int *>(lanes), acc);
+    size_t count = count_eq_scalar(v + i, n - i, x);
+    for (auto lane : lanes) {
+      count += lane;
+    }
+    return count;
+  }
+
+  // Four at a time: each lane adds the lanes below it in two shifts, then
+  // the total so far, which is broadcast from the last lane for the next
+  // four. A scan across 256 bit registers needs lane crossing permutes and
+  // is no faster, so avx2 runs this one too.
+  SIMD_SSE4 auto prefix_sum_sse4(const int *v, int *out, size_t n) -> void {
+    auto carry = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      auto x = load4(v + i);
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi32(x, carry);
+      store4(out + i, x);
+      carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    prefix_sum_scalar(v + i, out + i, n - i, _mm_cvtsi128_si32(carry));
+  }
+
+  SIMD_AVX2 auto add_avx2(const int *a, const int *b, int *out, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      store8(out + i, _mm256_add_epi32(load8(a + i), load8(b + i)));
+    }
+    add_scalar(a + i, b + i, out + i, n - i);
+  }
+
+  SIMD_SSE4 auto add_sse4(const int *a, const int *b, int *out, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      store4(out + i, _mm_add_epi32(load4(a + i), load4(b + i)));
+    }
+    add_scalar(a + i, b + i, out + i, n - i);
+  }
+
+  SIMD_AVX2 auto mul_avx2(const int *a, const int *b, int *out, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      store8(out + i, _mm256_mullo_epi32(load8(a + i), load8(b + i)));
+    }
+    mul_scalar(a + i, b + i, out + i, n - i);
+  }
+
+  SIMD_SSE4 auto mul_sse4(const int *a, const int *b, int *out, size_t n) -> void {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      store4(out + i, _mm_mullo_epi32(load4(a + i), load4(b + i)));
+    }
+    mul_scalar(a + i, b + i, out + i, n - i);
+  }
+#endif
+
+  auto sum(const int *v, size_t n) -> int {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      return sum_avx2(v, n);
+    } else if (level == Level::SSE4) {
+      return sum_sse4(v, n);
+    }
+#endif
+    return sum_scalar(v, n, 0);
+  }
+
+  // of n > 0 values
+  auto min(const int *v, size_t n) -> int {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      return min_avx2(v, n);
+    } else if (level == Level::SSE4) {
+      return min_sse4(v, n);
+    }
+#endif
+    return min_scalar(v + 1, n - 1, v[0]);
+  }
+
+  // of n > 0 values
+  auto max(const int *v, size_t n) -> int {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      return max_avx2(v, n);
+    } else if (level == Level::SSE4) {
+      return max_sse4(v, n);
+    }
+#endif
+    return max_scalar(v + 1, n - 1, v[0]);
+  }
+
+  auto dot(const int *a, const int *b, size_t n) -> int {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      return dot_avx2(a, b, n);
+    } else if (level == Level::SSE4) {
+      return dot_sse4(a, b, n);
+    }
+#endif
+    return dot_scalar(a, b, n, 0);
+  }
+
+  auto count_eq(const int *v, size_t n, int x) -> size_t {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      return count_eq_avx2(v, n, x);
+    } else if (level == Level::SSE4) {
+      return count_eq_sse4(v, n, x);
+    }
+#endif
+    return count_eq_scalar(v, n, x);
+  }
+
+  auto prefix_sum(const int *v, int *out, size_t n) -> void {
+#ifdef SIMD_X86_64
+    if (level != Level::SCALAR) {
+      prefix_sum_sse4(v, out, n);
+      return;
+    }
+#endif
+    prefix_sum_scalar(v, out, n, 0);
+  }
+
+  auto add(const int *a, const int *b, int *out, size_t n) -> void {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      add_avx2(a, b, out, n);
+      return;
+    } else if (level == Level::SSE4) {
+      add_sse4(a, b, out, n);
+      return;
+    }
+#endif
+    add_scalar(a, b, out, n);
+  }
+
+  auto mul(const int *a, const int *b, int *out, size_t n) -> void {
+#ifdef SIMD_X86_64
+    if (level == Level::AVX2) {
+      mul_avx2(a, b, out, n);
+      return;
+    } else if (level == Level::SSE4) {
+      mul_sse4(a, b, out, n);
+      return;
+    }
+#endif
+    mul_scalar(a, b, out, n);
+  }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "region.hpp"
+#include "analysis.hpp"
+#include "eval.hpp"
+#include "jit.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+using namespace ast;
+using namespace object;
+
+// Promotes the function bodies the eval engine calls through tiers as
+// they get hot, counting calls per function literal:
+//   * WALK, the ast as parsed. Cold code (setup run once, most of
+//     lib/std.lc3) never leaves it and costs nothing extra to start
+//   * OPTIMIZED after optimize_after calls: operators on constants are
+//     folded and parameters are resolved to their frame slots
+//   * NATIVE after native_after calls, when the jit can compile the body
+namespace tier {
+  uint32_t optimize_after = 10;
+  uint32_t native_after = 100;
+  // where promotions are traced, nullptr for none
+  ostream *log = nullptr;
+
+  auto label(BlockStatement *body, object::Function *func) -> string {
+    if (!body->name.empty()) {
+      return body->name;
+    }
+    vector<string> params = {};
+    for (const auto &param : func->parameters) {
+      params.push_back(param->value);
+    }
+    return "fn(" + flatten_strings(params) + ")";
+  }
+
+  auto trace(object::Function *func, const string &what) -> void {
+    if (log != nullptr) {
+      auto body = func->body.get();
+      *log << "tier: " << label(body, func) << " " << what << " after " << body->calls << " calls" << endl;
+    }
+  }
+
+  // the value an operand folds to, nullptr if it isn't constant
+  auto constant(const Rc<Expression> &expr) -> Rc<Object> {
+    switch (expr->type()) {
+    case NodeType::INTEGERLITERAL:
+      return make_rc<Integer>(borrow_cast<IntegerLiteral>(expr)->value);
+    case NodeType::STRINGLITERAL:
+      return make_rc<String>(borrow_cast<StringLiteral>(expr)->value);
+    case NodeType::BOOLEAN:
+      return eval::trans_boolean_object(borrow_cast<ast::Boolean>(expr)->value);
+    case NodeType::PREFIXEXPRESSION:
+      return Rc<Object>(static_cast<Object *>(borrow_cast<PrefixExpression>(expr)->constant.get()));
+    case NodeType::INFIXEXPRESSION:
+      return Rc<Object>(static_cast<Object *>(borrow_cast<InfixExpression>(expr)->constant.get()));
+    default:
+      return nullptr;
+    }
+  }
+
+  // Folds operators whose operands are constant, innermost first. Errors
+  // (and a division by zero) are left to happen when the code runs.
+  auto fold(const Rc<Node> &node) -> void {
+    analysis::walk(node, [](const Rc<Node> &n) {
+        if (n->type() == NodeType::FUNCTIONLITERAL || n->type() == NodeType::MACROLITERAL || analysis::is_quote_call(n)) {
+          return false;
+        }
+        if (n->type() == NodeType::PREFIXEXPRESSION) {
+          auto prefix = borrow_cast<PrefixExpression>(n);
+          fold(prefix->right);
+          auto right = constant(prefix->right);
+          if (right != nullptr) {
+            auto folded = eval::eval_prefix_expression(prefix->op, right);
+            if (!eval::is_error(folded)) {
+              prefix->constant = folded;
+            }
+          }
+          return false;
+        }
+        if (n->type() == NodeType::INFIXEXPRESSION) {
+          auto infix = borrow_cast<InfixExpression>(n);
+          fold(infix->left);
+          fold(infix->right);
+          auto left = constant(infix->left);
+          auto right = constant(infix->right);
+          if (left == nullptr || right == nullptr) {
+            return false;
+          }
+          if (infix->op == Operator::SLASH && right->type() == INTEGER_OBJ && borrow_cast<Integer>(right)->value == 0) {
+            return false;
+          }
+          auto folded = eval::eval_infix_expression(infix->op, left, right);
+          if (!eval::is_error(folded)) {
+            infix->constant = folded;
+          }
+          return false;
+        }
+        return true;
+      });
+  }
+
+  // names of the body's parameters, not of the literals in it
+  auto resolve_parameters(object::Function *func) -> void {
+    const auto &params = func->parameters;
+    analysis::walk(func->body, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::FUNCTIONLITERAL || n->type() == NodeType::MACROLITERAL || analysis::is_quote_call(n)) {
+          return false;
+        }
+        if (n->type() == NodeType::IDENTIFIER) {
+          auto id = borrow_cast<Identifier>(n);
+          for (size_t i = 0; i < params.size(); i++) {
+            if (params[i]->value == id->value) {
+              id->parameter = params[i].get();
+              id->slot = i;
+            }
+          }
+        }
+        return true;
+      });
+  }
+
+  auto optimize(object::Function *func) -> void {
+    // folded constants outlive any statement region
+    region::Scope heap(nullptr);
+    fold(func->body);
+    resolve_parameters(func);
+    func->body->tier = Tier::OPTIMIZED;
+    trace(func, "optimized");
+  }
+
+  // Counts a call of func and runs it in native code if it has got that
+  // far. false leaves the call to eval.
+  auto call(object::Function *func, const Rc<Object> *args, size_t count, Rc<Object> &result) -> bool {
+    auto body = func->body.get();
+    if (body->tier == Tier::NATIVE) {
+      if (jit::run(func, args, count, result)) {
+        return true;
+      }
+      if (body->unjittable) {
+        body->tier = Tier::OPTIMIZED;
+        trace(func, "left native code");
+      }
+      return false;
+    }
+
+    if (body->unjittable && body->tier == Tier::OPTIMIZED) {
+      // as far as it goes
+      return false;
+    }
+    body->calls++;
+    if (body->tier == Tier::WALK) {
+      if (body->calls < optimize_after) {
+        return false;
+      }
+      optimize(func);
+    }
+    if (body->calls < native_after || !jit::enabled) {
+      return false;
+    }
+    if (jit::native(func) == nullptr) {
+      trace(func, "can't be compiled, stays optimized");
+      return false;
+    }
+    body->tier = Tier::NATIVE;
+    trace(func, "compiled to native code");
+    return jit::run(func, args, count, result);
+  }
+}
@@ -55,6 +55,10 @@ namespace token {
   const TokenType ELSE = "ELSE";
   const TokenType RETURN = "RETURN";
   const TokenType MACRO = "MACRO";
+  const TokenType WHILE = "WHILE";
+  const TokenType FOR = "FOR";
+  const TokenType IN = "IN";
+  const TokenType YIELD = "YIELD";
 
   map<TokenLiteral, TokenType> token_type = {
     { "fn", FUNCTION },
@@ -64,7 +68,11 @@ namespace token {
     { "if", IF },
     { "else", ELSE },
     { "return", RETURN },
-    { "macro", MACRO }
+    { "macro", MACRO },
+    { "while", WHILE },
+    { "for", FOR },
+    { "in", IN },
+    { "yield", YIELD }
   };
 
   auto lookup_indent_type(TokenLiteral ident) -> TokenType {
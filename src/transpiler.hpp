@@ -0,0 +1,943 @@
+#pragma once
+
+#include "ast.hpp"
+#include "analysis.hpp"
+#include "builtins.hpp"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdio>
+#include <stdexcept>
+#ifndef FORMAT_HEADER
+#define FORMAT_HEADER
+#include <fmt/format.h>
+#include <fmt/format.cc>
+#endif
+
+using namespace std;
+using namespace ast;
+using namespace fmt;
+
+// Ahead of time translation of a (macro expanded) program to C++ that
+// links against the runtime in compiled.hpp. Values stay boxed objects,
+// except that:
+//   * a function bound once by a top level let is a C++ function and is
+//     called directly by name
+//   * such a function whose body is pure integer code (the subset the
+//     jit covers) also gets an int version, which the boxed one enters
+//     when all of its arguments are integers
+// Names bound by a function literal live in C++ locals, or in cells when
+// an inner literal closes over them. Top level names are C++ globals.
+namespace transpiler {
+  class Unsupported : public std::runtime_error {
+  public:
+    explicit Unsupported(const string &what): std::runtime_error(what) {};
+  };
+
+  enum class Type {
+    INT,
+    BOOL,
+    UNIT,   // nothing the rest of the code may use
+    NEVER   // control left through a return
+  };
+
+  auto escape(const string &s) -> string {
+    string escaped = "\"";
+    for (auto ch : s) {
+      if (ch == '"' || ch == '\\') {
+        escaped += '\\';
+        escaped += ch;
+      } else if (ch == '\n') {
+        escaped += "\\n";
+      } else if (static_cast<unsigned char>(ch) < 0x20) {
+        char octal[8];
+        snprintf(octal, sizeof(octal), "\\%03o", static_cast<unsigned char>(ch));
+        escaped += octal;
+      } else {
+        escaped += ch;
+      }
+    }
+    return escaped + "\"";
+  }
+
+  auto joined(const vector<string> &strs, const string &separator) -> string {
+    string s = "";
+    for (size_t i = 0; i < strs.size(); i++) {
+      s += (i == 0 ? "" : separator) + strs[i];
+    }
+    return s;
+  }
+
+  // how the interpreter inspects a function
+  auto function_source(FunctionLiteral *func) -> string {
+    vector<string> params = {};
+    for (const auto &param : func->parameters) {
+      params.push_back(param->to_string());
+    }
+    return "fn(" + joined(params, ", ") + ") {\n" + func->body->to_string() + "\n}";
+  }
+
+  auto operator_name(Operator op) -> string {
+    switch (op) {
+    case Operator::PLUS:
+      return "Operator::PLUS";
+    case Operator::MINUS:
+      return "Operator::MINUS";
+    case Operator::ASTERISK:
+      return "Operator::ASTERISK";
+    case Operator::SLASH:
+      return "Operator::SLASH";
+    case Operator::LT:
+      return "Operator::LT";
+    case Operator::GT:
+      return "Operator::GT";
+    case Operator::EQ:
+      return "Operator::EQ";
+    case Operator::NOT_EQ:
+      return "Operator::NOT_EQ";
+    case Operator::BANG:
+      return "Operator::BANG";
+    default:
+      return "Operator::UNKNOWN";
+    }
+  }
+
+  // a function body, or the program, while it is emitted
+  struct Scope {
+    const Scope *parent;
+    size_t depth;                // 0 for the program
+    set<string> parameters;
+    set<string> lets;            // names its let statements bind
+    set<string> cells;           // names inner literals close over
+    set<string> bound;           // names certainly bound at this point
+  };
+
+  // names bound by lets of body, not of the literals in it
+  auto let_names(const Rc<Node> &body) -> set<string> {
+    set<string> names = {};
+    analysis::walk(body, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::FUNCTIONLITERAL || n->type() == NodeType::MACROLITERAL) {
+          return false;
+        }
+        if (n->type() == NodeType::LETSTATEMENT) {
+          names.insert(borrow_cast<LetStatement>(n)->name->value);
+        }
+        return true;
+      });
+    return names;
+  }
+
+  // free variables of the literals directly in body
+  auto closed_over(const Rc<Node> &body) -> set<string> {
+    set<string> names = {};
+    analysis::walk(body, [&](const Rc<Node> &n) {
+        if (n->type() == NodeType::FUNCTIONLITERAL) {
+          for (const auto &name : analysis::free_variables(borrow_cast<FunctionLiteral>(n))) {
+            names.insert(name);
+          }
+          return false;
+        }
+        return true;
+      });
+    return names;
+  }
+
+  class Transpiler {
+  private:
+    vector<string> *out = nullptr;
+    size_t indent = 0;
+    size_t temps = 0;
+
+    vector<string> constants = {};
+    map<int, string> integers = {};
+    map<string, string> strings = {};
+    set<string> builtin_names = {};
+    set<string> builtins_used = {};
+
+    set<string> globals = {};
+    // top level names bound once, to a function literal
+    map<string, FunctionLiteral *> known = {};
+    // the known functions with an int version
+    set<string> integral = {};
+    // the int versions each int version calls
+    map<string, set<string>> integral_calls = {};
+
+    // state of the int version being emitted
+    map<string, string> int_locals = {};
+    set<string> *int_callees = nullptr;
+
+    auto line(const string &s) -> void {
+      this->out->push_back(string(2 * this->indent, ' ') + s);
+    }
+
+    auto temp() -> string {
+      return format("t{0}", this->temps++);
+    }
+
+    auto check(const string &value) -> void {
+      this->line(format("if (is_error({0})) {{ return {0}; }}", value));
+    }
+
+    auto integer_constant(int value) -> string {
+      auto found = this->integers.find(value);
+      if (found != this->integers.end()) {
+        return found->second;
+      }
+      auto name = format("k{0}", this->integers.size() + this->strings.size());
+      this->constants.push_back(format("Rc<Object> {0} = make_rc<Integer>({1});", name, value));
+      return this->integers[value] = name;
+    }
+
+    auto string_constant(const string &value) -> string {
+      auto found = this->strings.find(value);
+      if (found != this->strings.end()) {
+        return found->second;
+      }
+      auto name = format("k{0}", this->integers.size() + this->strings.size());
+      this->constants.push_back(format("Rc<Object> {0} = make_rc<String>({1});", name, escape(value)));
+      return this->strings[value] = name;
+    }
+
+    static auto variable(const Scope *scope, const string &name) -> string {
+      if (scope->cells.count(name) > 0) {
+        return format("c{0}_{1}->value", scope->depth, name);
+      }
+      return "v_" + name;
+    }
+
+    // A name resolves like the interpreter's environment chain: a let
+    // that hasn't run yet leaves it to the enclosing scopes, then to the
+    // top level and the builtins. What a later let may rebind is read
+    // into a temporary.
+    auto identifier(const Scope *scope, const string &name) -> string {
+      vector<string> candidates = {};
+      for (auto s = scope; s != nullptr; s = s->parent) {
+        auto certain = s == scope && s->bound.count(name) > 0;
+        if (s->depth == 0) {
+          if (this->globals.count(name) > 0) {
+            candidates.push_back("g_" + name);
+            if (certain) {
+              return this->first_bound(name, candidates, true);
+            }
+          }
+          break;
+        }
+        auto parameter = s->parameters.count(name) > 0;
+        if (parameter || s->lets.count(name) > 0) {
+          candidates.push_back(variable(s, name));
+          if (parameter && s->lets.count(name) == 0 && candidates.size() == 1) {
+            return candidates[0];
+          }
+          if (certain || parameter) {
+            return this->first_bound(name, candidates, true);
+          }
+        }
+      }
+      auto is_builtin = this->builtin_names.count(name) > 0;
+      if (is_builtin) {
+        this->builtins_used.insert(name);
+        candidates.push_back(format("b_{0}", name));
+        if (candidates.size() == 1) {
+          return candidates[0];
+        }
+      }
+      return this->first_bound(name, candidates, is_builtin);
+    }
+
+    auto first_bound(const string &name, const vector<string> &candidates, bool certain) -> string {
+      auto value = this->temp();
+      this->line(format("Rc<Object> {0} = {1};", value, candidates.empty() ? "nullptr" : candidates[0]));
+      for (size_t i = 1; i < candidates.size(); i++) {
+        this->line(format("if ({0} == nullptr) {{ {0} = {1}; }}", value, candidates[i]));
+      }
+      if (!certain) {
+        this->line(format("if ({0} == nullptr) {{ return unbound({1}); }}", value, escape(name)));
+      }
+      return value;
+    }
+
+    // a name that no function literal around scope binds
+    auto is_known(const Scope *scope, const string &name) -> bool {
+      for (const Scope *s = scope; s->depth > 0; s = s->parent) {
+        if (s->parameters.count(name) > 0 || s->lets.count(name) > 0) {
+          return false;
+        }
+      }
+      return this->known.count(name) > 0;
+    }
+
+    auto call(Scope *scope, CallExpression *call) -> string {
+      if (call->function->token_literal() == "quote") {
+        throw Unsupported("quote");
+      }
+
+      const auto &exprs = call->arguments;
+      if (call->function->type() == NodeType::IDENTIFIER) {
+        auto name = borrow_cast<Identifier>(call->function)->value;
+        if (this->is_known(scope, name) && this->known[name]->parameters.size() == exprs.size()) {
+          if (!(scope->depth == 0 && scope->bound.count(name) > 0)) {
+            this->line(format("if (g_{0} == nullptr) {{ return unbound({1}); }}", name, escape(name)));
+          }
+          vector<string> args = {};
+          for (const auto &expr : exprs) {
+            args.push_back(this->expression(scope, expr));
+          }
+          auto value = this->temp();
+          this->line(format("auto {0} = f_{1}({2});", value, name, joined(args, ", ")));
+          this->check(value);
+          return value;
+        }
+      }
+
+      auto callee = this->expression(scope, call->function);
+      vector<string> args = {};
+      for (const auto &expr : exprs) {
+        args.push_back(this->expression(scope, expr));
+      }
+      auto value = this->temp();
+      this->line(format("auto {0} = call({1}, {{{2}}});", value, callee, joined(args, ", ")));
+      this->check(value);
+      return value;
+    }
+
+    // the value of a block and whether it returns
+    auto block(Scope *scope, const vector<Rc<Statement>> &stmts) -> pair<string, bool> {
+      string value = "nullptr";
+      for (const auto &stmt : stmts) {
+        auto result = this->statement(scope, stmt);
+        if (result.second) {
+          return result;
+        }
+        value = result.first;
+      }
+      return make_pair(value, false);
+    }
+
+    auto if_expression(Scope *scope, IfExpression *if_expr) -> string {
+      auto condition = this->expression(scope, if_expr->condition);
+      auto value = this->temp();
+      this->line(format("Rc<Object> {0};", value));
+      this->line(format("if (is_truthy({0})) {{", condition));
+
+      // lets in a branch may not have run after it
+      auto bound = scope->bound;
+      this->indent++;
+      auto consequence = this->block(scope, if_expr->consequence->statements);
+      if (!consequence.second) {
+        this->line(format("{0} = {1};", value, consequence.first));
+      }
+      scope->bound = bound;
+      this->indent--;
+      this->line("} else {");
+      this->indent++;
+      if (if_expr->alternative != nullptr) {
+        auto alternative = this->block(scope, if_expr->alternative->statements);
+        if (!alternative.second) {
+          this->line(format("{0} = {1};", value, alternative.first));
+        }
+        scope->bound = bound;
+      } else {
+        this->line(format("{0} = NULLOBJ;", value));
+      }
+      this->indent--;
+      this->line("}");
+      return value;
+    }
+
+    auto function_literal(Scope *scope, FunctionLiteral *func) -> string {
+      // the cells of every scope around that the literal may read
+      auto free = analysis::free_variables(func);
+      vector<string> captures = {};
+      for (const Scope *s = scope; s->depth > 0; s = s->parent) {
+        for (const auto &name : s->cells) {
+          if (free.count(name) > 0) {
+            captures.push_back(format("c{0}_{1}", s->depth, name));
+          }
+        }
+      }
+
+      auto value = this->temp();
+      this->line(format("auto {0} = make_rc<CompiledFunction>({1}, {2}, [{3}](const vector<Rc<Object>> &args) -> Rc<Object> {{",
+                        value, func->parameters.size(), escape(function_source(func)), joined(captures, ", ")));
+      this->indent++;
+      Scope inner = { scope, scope->depth + 1, {}, {}, {}, {} };
+      vector<string> params = {};
+      for (size_t i = 0; i < func->parameters.size(); i++) {
+        params.push_back(format("arg(args, {0})", i));
+      }
+      this->body(&inner, func, params);
+      this->indent--;
+      this->line("});");
+      return value;
+    }
+
+    // binds the parameters to the given values and emits the body
+    auto body(Scope *scope, FunctionLiteral *func, const vector<string> &params) -> void {
+      for (const auto &param : func->parameters) {
+        scope->parameters.insert(param->value);
+      }
+      scope->lets = let_names(func->body);
+      auto closed = closed_over(func->body);
+      for (const auto &name : closed) {
+        if (scope->parameters.count(name) > 0 || scope->lets.count(name) > 0) {
+          scope->cells.insert(name);
+        }
+      }
+
+      set<string> declared = {};
+      for (size_t i = 0; i < func->parameters.size(); i++) {
+        auto name = func->parameters[i]->value;
+        if (scope->cells.count(name) > 0) {
+          this->line(format("auto c{0}_{1} = make_rc<Cell>();", scope->depth, name));
+          this->line(format("c{0}_{1}->value = {2};", scope->depth, name, params[i]));
+        } else {
+          this->line(format("Rc<Object> v_{0} = {1};", name, params[i]));
+        }
+        declared.insert(name);
+      }
+      for (const auto &name : scope->lets) {
+        if (declared.count(name) > 0) {
+          continue;
+        }
+        if (scope->cells.count(name) > 0) {
+          this->line(format("auto c{0}_{1} = make_rc<Cell>();", scope->depth, name));
+        } else {
+          this->line(format("Rc<Object> v_{0};", name));
+        }
+      }
+
+      auto result = this->block(scope, func->body->statements);
+      if (!result.second) {
+        this->line(format("return {0};", result.first));
+      }
+    }
+
+    auto statement(Scope *scope, const Rc<Statement> &stmt) -> pair<string, bool> {
+      switch (stmt->type()) {
+      case NodeType::EXPRESSIONSTATEMENT:
+        return make_pair(this->expression(scope, borrow_cast<ExpressionStatement>(stmt)->expression), false);
+      case NodeType::RETURNSTATEMENT: {
+        auto value = this->expression(scope, borrow_cast<ReturnStatement>(stmt)->value);
+        this->line(format("return {0};", value));
+        return make_pair(value, true);
+      }
+      case NodeType::LETSTATEMENT: {
+        auto let = borrow_cast<LetStatement>(stmt);
+        auto name = let->name->value;
+        string target;
+        if (scope->depth == 0 && this->known.count(name) > 0) {
+          auto func = this->known[name];
+          vector<string> args = {};
+          for (size_t i = 0; i < func->parameters.size(); i++) {
+            args.push_back(format("arg(args, {0})", i));
+          }
+          this->line(format("g_{0} = make_rc<CompiledFunction>({1}, {2}, [](const vector<Rc<Object>> &args) -> Rc<Object> {{ return f_{0}({3}); }});",
+                            name, func->parameters.size(), escape(function_source(func)), joined(args, ", ")));
+          target = "g_" + name;
+        } else {
+          auto value = this->expression(scope, let->value);
+          target = scope->depth == 0 ? "g_" + name : variable(scope, name);
+          this->line(format("{0} = {1};", target, value));
+        }
+        scope->bound.insert(name);
+        return make_pair(target, false);
+      }
+      default:
+        throw Unsupported(stmt->token_literal());
+      }
+    }
+
+    auto expression(Scope *scope, const Rc<Expression> &expr) -> string {
+      switch (expr->type()) {
+      case NodeType::INTEGERLITERAL:
+        return this->integer_constant(borrow_cast<IntegerLiteral>(expr)->value);
+      case NodeType::STRINGLITERAL:
+        return this->string_constant(borrow_cast<StringLiteral>(expr)->value);
+      case NodeType::BOOLEAN:
+        return borrow_cast<ast::Boolean>(expr)->value ? "TRUEOBJ" : "FALSEOBJ";
+      case NodeType::IDENTIFIER:
+        return this->identifier(scope, borrow_cast<Identifier>(expr)->value);
+      case NodeType::PREFIXEXPRESSION: {
+        auto prefix = borrow_cast<PrefixExpression>(expr);
+        auto right = this->expression(scope, prefix->right);
+        auto value = this->temp();
+        this->line(format("auto {0} = eval_prefix_expression({1}, {2});", value, operator_name(prefix->op), right));
+        if (prefix->op != Operator::BANG) {
+          this->check(value);
+        }
+        return value;
+      }
+      case NodeType::INFIXEXPRESSION: {
+        auto infix = borrow_cast<InfixExpression>(expr);
+        auto left = this->expression(scope, infix->left);
+        auto right = this->expression(scope, infix->right);
+        auto value = this->temp();
+        this->line(format("auto {0} = eval_infix_expression({1}, {2}, {3});", value, operator_name(infix->op), left, right));
+        this->check(value);
+        return value;
+      }
+      case NodeType::IFEXPRESSION:
+        return this->if_expression(scope, borrow_cast<IfExpression>(expr));
+      case NodeType::FUNCTIONLITERAL:
+        return this->function_literal(scope, borrow_cast<FunctionLiteral>(expr));
+      case NodeType::CALLEXPRESSION:
+        return this->call(scope, borrow_cast<CallExpression>(expr));
+      case NodeType::ARRAYLITERAL: {
+        vector<string> elements = {};
+        for (const auto &elem : borrow_cast<ArrayLiteral>(expr)->elements) {
+          elements.push_back(this->expression(scope, elem));
+        }
+        auto value = this->temp();
+        this->line(format("auto {0} = make_rc<Array>(vector<Rc<Object>>{{{1}}});", value, joined(elements, ", ")));
+        return value;
+      }
+      case NodeType::INDEXEXPRESSION: {
+        auto index_expr = borrow_cast<IndexExpression>(expr);
+        auto left = this->expression(scope, index_expr->left);
+        auto index = this->expression(scope, index_expr->index);
+        auto value = this->temp();
+        this->line(format("auto {0} = eval_index_expression({1}, {2});", value, left, index));
+        this->check(value);
+        return value;
+      }
+      case NodeType::HASHLITERAL: {
+        auto pairs = this->temp();
+        this->line(format("map<HashKey, HashPair> {0};", pairs));
+        for (const auto &pair : borrow_cast<HashLiteral>(expr)->pairs) {
+          auto key = this->expression(scope, pair.first);
+          this->line(format("if (!is_hashable({0})) {{ return unusable_hash_key({0}); }}", key));
+          auto value = this->expression(scope, pair.second);
+          this->line(format("hash_pair({0}, {1}, {2});", pairs, key, value));
+        }
+        auto value = this->temp();
+        this->line(format("auto {0} = make_rc<Hash>({1});", value, pairs));
+        return value;
+      }
+      default:
+        throw Unsupported(expr->token_literal());
+      }
+    }
+
+    // the int versions: an expression of the subset and its type
+
+    auto int_expression(const Rc<Expression> &expr) -> pair<string, Type> {
+      switch (expr->type()) {
+      case NodeType::INTEGERLITERAL:
+        return make_pair(std::to_string(borrow_cast<IntegerLiteral>(expr)->value), Type::INT);
+      case NodeType::BOOLEAN:
+        return make_pair(string(borrow_cast<ast::Boolean>(expr)->value ? "true" : "false"), Type::BOOL);
+      case NodeType::IDENTIFIER: {
+        auto local = this->int_locals.find(borrow_cast<Identifier>(expr)->value);
+        if (local == this->int_locals.end()) {
+          throw Unsupported("name");
+        }
+        return make_pair(local->second, Type::INT);
+      }
+      case NodeType::PREFIXEXPRESSION: {
+        auto prefix = borrow_cast<PrefixExpression>(expr);
+        auto right = this->int_expression(prefix->right);
+        if (prefix->op == Operator::MINUS && right.second == Type::INT) {
+          return make_pair("(-" + right.first + ")", Type::INT);
+        }
+        if (prefix->op == Operator::BANG && right.second == Type::BOOL) {
+          return make_pair("(!" + right.first + ")", Type::BOOL);
+        }
+        if (prefix->op == Operator::BANG && right.second == Type::INT) {
+          return make_pair(string("false"), Type::BOOL);
+        }
+        throw Unsupported("prefix");
+      }
+      case NodeType::INFIXEXPRESSION: {
+        auto infix = borrow_cast<InfixExpression>(expr);
+        auto left = this->int_expression(infix->left);
+        auto right = this->int_expression(infix->right);
+        auto ints = left.second == Type::INT && right.second == Type::INT;
+        auto bools = left.second == Type::BOOL && right.second == Type::BOOL;
+        auto op = operator_string(infix->op);
+        switch (infix->op) {
+        case Operator::PLUS:
+        case Operator::MINUS:
+        case Operator::ASTERISK:
+        case Operator::SLASH:
+          if (ints) {
+            return make_pair("(" + left.first + " " + op + " " + right.first + ")", Type::INT);
+          }
+          break;
+        case Operator::LT:
+        case Operator::GT:
+          if (ints) {
+            return make_pair("(" + left.first + " " + op + " " + right.first + ")", Type::BOOL);
+          }
+          break;
+        case Operator::EQ:
+        case Operator::NOT_EQ:
+          if (ints || bools) {
+            return make_pair("(" + left.first + " " + op + " " + right.first + ")", Type::BOOL);
+          }
+          break;
+        default:
+          break;
+        }
+        throw Unsupported("infix");
+      }
+      case NodeType::CALLEXPRESSION: {
+        auto call = borrow_cast<CallExpression>(expr);
+        if (call->function->type() != NodeType::IDENTIFIER) {
+          throw Unsupported("callee");
+        }
+        auto name = borrow_cast<Identifier>(call->function)->value;
+        if (this->int_locals.count(name) > 0 || this->integral.count(name) == 0 ||
+            this->known[name]->parameters.size() != call->arguments.size()) {
+          throw Unsupported("callee");
+        }
+        vector<string> args = {};
+        for (const auto &arg : call->arguments) {
+          auto a = this->int_expression(arg);
+          if (a.second != Type::INT) {
+            throw Unsupported("argument");
+          }
+          args.push_back(a.first);
+        }
+        this->int_callees->insert(name);
+        return make_pair("i_" + name + "(" + joined(args, ", ") + ")", Type::INT);
+      }
+      case NodeType::IFEXPRESSION:
+        return this->int_if(borrow_cast<IfExpression>(expr), true);
+      default:
+        throw Unsupported("expression");
+      }
+    }
+
+    auto int_if(IfExpression *if_expr, bool want) -> pair<string, Type> {
+      auto condition = this->int_expression(if_expr->condition);
+      if (condition.second != Type::BOOL) {
+        throw Unsupported("condition");
+      }
+      if (want && if_expr->alternative == nullptr) {
+        throw Unsupported("if without else");
+      }
+
+      // branches first, the declaration of the value depends on them
+      auto value = this->temp();
+      auto outer = this->out;
+      vector<string> consequence_lines = {};
+      vector<string> alternative_lines = {};
+      this->out = &consequence_lines;
+      this->indent++;
+      auto consequence = this->int_block(if_expr->consequence->statements, want, false, value);
+      auto alternative = Type::UNIT;
+      if (if_expr->alternative != nullptr) {
+        this->out = &alternative_lines;
+        alternative = this->int_block(if_expr->alternative->statements, want, false, value);
+      }
+      this->indent--;
+      this->out = outer;
+
+      auto type = Type::UNIT;
+      if (consequence == Type::NEVER || consequence == alternative) {
+        type = alternative;
+      } else if (alternative == Type::NEVER) {
+        type = consequence;
+      } else if (want) {
+        throw Unsupported("branches of different types");
+      }
+      if (want && type != Type::NEVER) {
+        this->line(format("{0} {1};", type == Type::INT ? "int" : "bool", value));
+      }
+      this->line(format("if ({0}) {{", condition.first));
+      this->out->insert(this->out->end(), consequence_lines.begin(), consequence_lines.end());
+      if (if_expr->alternative != nullptr) {
+        this->line("} else {");
+        this->out->insert(this->out->end(), alternative_lines.begin(), alternative_lines.end());
+      }
+      this->line("}");
+      return make_pair(value, type);
+    }
+
+    // the statements of a block, its value assigned to result when wanted
+    auto int_block(const vector<Rc<Statement>> &stmts, bool want, bool top, const string &result) -> Type {
+      if (stmts.empty() && want) {
+        throw Unsupported("empty block");
+      }
+      auto type = Type::UNIT;
+      for (size_t i = 0; i < stmts.size(); i++) {
+        auto last = want && i + 1 == stmts.size();
+        const auto &stmt = stmts[i];
+        switch (stmt->type()) {
+        case NodeType::RETURNSTATEMENT: {
+          auto value = this->int_expression(borrow_cast<ReturnStatement>(stmt)->value);
+          if (value.second != Type::INT) {
+            throw Unsupported("return value");
+          }
+          this->line(format("return {0};", value.first));
+          return Type::NEVER;
+        }
+        case NodeType::LETSTATEMENT: {
+          // only the body's own statements, each name once
+          auto let = borrow_cast<LetStatement>(stmt);
+          auto name = let->name->value;
+          if (!top || last || this->int_locals.count(name) > 0) {
+            throw Unsupported("let");
+          }
+          auto value = this->int_expression(let->value);
+          if (value.second != Type::INT) {
+            throw Unsupported("let value");
+          }
+          this->line(format("int v_{0} = {1};", name, value.first));
+          this->int_locals[name] = "v_" + name;
+          type = Type::UNIT;
+          break;
+        }
+        case NodeType::EXPRESSIONSTATEMENT: {
+          auto expr = borrow_cast<ExpressionStatement>(stmt)->expression;
+          pair<string, Type> value;
+          if (expr->type() == NodeType::IFEXPRESSION) {
+            value = this->int_if(borrow_cast<IfExpression>(expr), last);
+          } else {
+            value = this->int_expression(expr);
+            if (!last) {
+              this->line(format("(void){0};", value.first));
+            }
+          }
+          if (value.second == Type::NEVER) {
+            return Type::NEVER;
+          }
+          if (last) {
+            this->line(format("{0} = {1};", result, value.first));
+          }
+          type = value.second;
+          break;
+        }
+        default:
+          throw Unsupported("statement");
+        }
+      }
+      return type;
+    }
+
+    auto int_function(const string &name, FunctionLiteral *func, vector<string> &lines) -> void {
+      this->int_locals.clear();
+      this->int_callees = &this->integral_calls[name];
+      this->int_callees->clear();
+      vector<string> params = {};
+      for (const auto &param : func->parameters) {
+        if (this->int_locals.count(param->value) > 0) {
+          throw Unsupported("parameters");
+        }
+        this->int_locals[param->value] = "v_" + param->value;
+        params.push_back("int v_" + param->value);
+      }
+
+      vector<string> body = {};
+      this->out = &body;
+      this->indent++;
+      auto type = this->int_block(func->body->statements, true, true, "result");
+      if (type == Type::INT) {
+        body.insert(body.begin(), string(2 * this->indent, ' ') + "int result;");
+        this->line("return result;");
+      } else if (type != Type::NEVER) {
+        throw Unsupported("result");
+      }
+      this->indent--;
+
+      this->out = &lines;
+      this->line(format("int i_{0}({1}) {{", name, joined(params, ", ")));
+      lines.insert(lines.end(), body.begin(), body.end());
+      this->line("}");
+    }
+
+    // the int versions that call only int versions, the largest such set
+    auto find_integral() -> void {
+      for (const auto &k : this->known) {
+        this->integral.insert(k.first);
+      }
+      auto changed = true;
+      while (changed) {
+        changed = false;
+        for (const auto &k : this->known) {
+          if (this->integral.count(k.first) == 0) {
+            continue;
+          }
+          vector<string> lines = {};
+          try {
+            this->int_function(k.first, k.second, lines);
+          } catch (Unsupported &) {
+            this->integral.erase(k.first);
+            changed = true;
+          }
+        }
+      }
+    }
+
+    // the int versions an int version may end up calling
+    auto reachable(const string &name) -> set<string> {
+      set<string> seen = {};
+      vector<string> pending = { name };
+      while (!pending.empty()) {
+        auto next = pending.back();
+        pending.pop_back();
+        for (const auto &callee : this->integral_calls[next]) {
+          if (seen.insert(callee).second) {
+            pending.push_back(callee);
+          }
+        }
+      }
+      return seen;
+    }
+
+    auto known_function(const string &name, FunctionLiteral *func, vector<string> &lines) -> void {
+      this->out = &lines;
+      vector<string> params = {};
+      for (const auto &param : func->parameters) {
+        params.push_back("Rc<Object> a_" + param->value);
+      }
+      this->line(format("Rc<Object> f_{0}({1}) {{", name, joined(params, ", ")));
+      this->indent++;
+
+      if (this->integral.count(name) > 0) {
+        // the int version once every function it calls is defined
+        vector<string> guards = {};
+        vector<string> args = {};
+        for (const auto &param : func->parameters) {
+          guards.push_back("is_integer(a_" + param->value + ")");
+          args.push_back("borrow_cast<Integer>(a_" + param->value + ")->value");
+        }
+        for (const auto &callee : this->reachable(name)) {
+          if (callee != name) {
+            guards.push_back("g_" + callee + " != nullptr");
+          }
+        }
+        if (guards.empty()) {
+          this->line(format("return make_rc<Integer>(i_{0}());", name));
+          this->indent--;
+          this->line("}");
+          return;
+        }
+        this->line(format("if ({0}) {{", joined(guards, " && ")));
+        this->line(format("  return make_rc<Integer>(i_{0}({1}));", name, joined(args, ", ")));
+        this->line("}");
+      }
+
+      Scope program = { nullptr, 0, {}, {}, {}, {} };
+      Scope scope = { &program, 1, {}, {}, {}, {} };
+      vector<string> values = {};
+      for (const auto &param : func->parameters) {
+        values.push_back("a_" + param->value);
+      }
+      this->body(&scope, func, values);
+      this->indent--;
+      this->line("}");
+    }
+
+  public:
+    auto transpile(Program *program, const string &source) -> string {
+      for (const auto &b : builtins::builtins) {
+        this->builtin_names.insert(b.first);
+      }
+
+      // names bound by top level lets, anywhere outside literals
+      map<string, size_t> lets = {};
+      analysis::walk(Rc<Node>(program), [&](const Rc<Node> &n) {
+          if (n->type() == NodeType::FUNCTIONLITERAL || n->type() == NodeType::MACROLITERAL) {
+            return false;
+          }
+          if (n->type() == NodeType::LETSTATEMENT) {
+            lets[borrow_cast<LetStatement>(n)->name->value]++;
+          }
+          return true;
+        });
+      for (const auto &l : lets) {
+        this->globals.insert(l.first);
+      }
+      for (const auto &stmt : program->statements) {
+        if (stmt->type() != NodeType::LETSTATEMENT) {
+          continue;
+        }
+        auto let = borrow_cast<LetStatement>(stmt);
+        auto name = let->name->value;
+        if (let->value->type() == NodeType::FUNCTIONLITERAL && lets[name] == 1 && this->builtin_names.count(name) == 0) {
+          this->known[name] = borrow_cast<FunctionLiteral>(let->value);
+        }
+      }
+
+      this->find_integral();
+      vector<string> int_lines = {};
+      for (const auto &k : this->known) {
+        if (this->integral.count(k.first) > 0) {
+          this->int_function(k.first, k.second, int_lines);
+        }
+      }
+
+      vector<string> function_lines = {};
+      for (const auto &k : this->known) {
+        this->known_function(k.first, k.second, function_lines);
+      }
+
+      vector<string> program_lines = {};
+      this->out = &program_lines;
+      this->line("Rc<Object> program() {");
+      this->indent++;
+      Scope scope = { nullptr, 0, {}, {}, {}, {} };
+      auto result = this->block(&scope, program->statements);
+      if (!result.second) {
+        this->line(format("return {0};", result.first));
+      }
+      this->indent--;
+      this->line("}");
+
+      vector<string> lines = {
+        format("// compiled by lc3 from {0}", source),
+        "#include \"compiled.hpp\"",
+        "",
+        "using namespace compiled;",
+        "",
+        "namespace {"
+      };
+      auto section = [&](const vector<string> &ls) {
+        for (const auto &l : ls) {
+          lines.push_back(l.empty() ? l : "  " + l);
+        }
+        lines.push_back("");
+      };
+      vector<string> declarations = {};
+      for (const auto &name : this->builtins_used) {
+        declarations.push_back(format("Rc<Object> b_{0} = builtin({1});", name, escape(name)));
+      }
+      for (const auto &name : this->globals) {
+        declarations.push_back(format("Rc<Object> g_{0};", name));
+      }
+      declarations.insert(declarations.end(), this->constants.begin(), this->constants.end());
+      for (const auto &k : this->known) {
+        if (this->integral.count(k.first) > 0) {
+          vector<string> params(k.second->parameters.size(), "int");
+          declarations.push_back(format("int i_{0}({1});", k.first, joined(params, ", ")));
+        }
+      }
+      for (const auto &k : this->known) {
+        vector<string> params(k.second->parameters.size(), "Rc<Object>");
+        declarations.push_back(format("Rc<Object> f_{0}({1});", k.first, joined(params, ", ")));
+      }
+      section(declarations);
+      section(int_lines);
+      section(function_lines);
+      section(program_lines);
+      lines.back() = "}";
+      lines.push_back("");
+      lines.push_back("int main() {");
+      lines.push_back("  return compiled::run(program);");
+      lines.push_back("}");
+
+      string code = "";
+      for (const auto &l : lines) {
+        code += l + "\n";
+      }
+      return code;
+    }
+  };
+
+  auto transpile(Program *program, const string &source) -> string {
+    return Transpiler().transpile(program, source);
+  }
+}
@@ -0,0 +1,404 @@
+#pragma once
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "code.hpp"
+#include "compiler.hpp"
+#include "eval.hpp"
+#include "analysis.hpp"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace ast;
+using namespace object;
+using namespace code;
+
+// Each handler jumps straight to the next one through a table of label
+// addresses where the compiler has them (labels as values), and comes back
+// to a switch otherwise. LC3_SWITCH_DISPATCH forces the switch, for
+// comparing the two.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(LC3_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#define VM_CASE(op) op
+#define VM_NEXT in = pc++; goto *handlers[static_cast<size_t>(in->op)]
+#else
+#define VM_CASE(op) case Opcode::op
+#define VM_NEXT break
+#endif
+
+namespace vm {
+  // register code for the body of func, nullptr if it is left to eval
+  auto compiled(object::Function *func) -> Code * {
+    auto body = func->body.get();
+    if (body->code == nullptr && !body->uncompilable) {
+      auto c = compiler::Compiler::compile_function(func->parameters, body);
+      if (c == nullptr) {
+        body->uncompilable = true;
+      } else {
+        body->code = c;
+      }
+    }
+    return static_cast<Code *>(body->code.get());
+  }
+
+  struct Frame {
+    Code *code;
+    const Instruction *pc;
+    size_t base;
+    // where names are looked up, kept alive by the caller's register
+    // holding the function
+    Environment *env;
+    // the caller's register for the result
+    uint32_t result;
+  };
+
+  // Runs register code. Frames live on one register stack and calls
+  // between compiled functions don't recurse on the C++ stack; a call of
+  // a function the compiler left out goes through eval::apply_function.
+  class VM {
+  private:
+    vector<Rc<Object>> stack;
+    vector<Frame> frames = {};
+
+    auto top() -> size_t {
+      if (this->frames.empty()) {
+        return 0;
+      }
+      const auto &f = this->frames.back();
+      return f.base + f.code->registers;
+    }
+
+    auto reserve(size_t size) -> void {
+      if (size > this->stack.size()) {
+        this->stack.resize(std::max(size, this->stack.size() * 2));
+      }
+    }
+
+    auto clear(const Frame &f) -> void {
+      auto r = this->stack.data() + f.base;
+      for (size_t i = 0; i < f.code->registers; i++) {
+        r[i] = nullptr;
+      }
+    }
+
+    // copies only what the analysis captured, from the frame's registers
+    // or its environment, on top of the root environment
+    auto closure(const ClosureInfo &info, const Rc<Object> *r, Environment *env) -> Rc<Object> {
+      auto literal = info.literal;
+      if (info.whole_environment) {
+        return make_rc<object::Function>(literal->parameters, literal->body, Rc<Environment>(env));
+      }
+
+      auto root = env;
+      while (root->outer != nullptr) {
+        root = root->outer.get();
+      }
+      if (info.names.empty()) {
+        return make_rc<object::Function>(literal->parameters, literal->body, Rc<Environment>(root));
+      }
+
+      auto captured = new_enclosed_environment(Rc<Environment>(root));
+      for (size_t i = 0; i < info.names.size(); i++) {
+        captured->store[info.names[i]] = info.registers[i] >= 0 ? r[info.registers[i]] : env->get(info.names[i]);
+      }
+      return make_rc<object::Function>(literal->parameters, literal->body, captured);
+    }
+
+    auto arithmetic(Opcode op, const Rc<Object> &left, const Rc<Object> &right) -> Rc<Object> {
+      if (left->type() == INTEGER_OBJ && right->type() == INTEGER_OBJ) {
+        auto l = borrow_cast<Integer>(left)->value;
+        auto r = borrow_cast<Integer>(right)->value;
+        switch (op) {
+        case Opcode::ADD:
+        case Opcode::ADD_K:
+          return make_rc<Integer>(l + r);
+        case Opcode::SUB:
+        case Opcode::SUB_K:
+          return make_rc<Integer>(l - r);
+        case Opcode::MUL:
+        case Opcode::MUL_K:
+          return make_rc<Integer>(l * r);
+        case Opcode::DIV:
+        case Opcode::DIV_K:
+          return make_rc<Integer>(l / r);
+        case Opcode::LT:
+        case Opcode::LT_K:
+          return eval::trans_boolean_object(l < r);
+        case Opcode::GT:
+        case Opcode::GT_K:
+          return eval::trans_boolean_object(l > r);
+        case Opcode::EQ:
+        case Opcode::EQ_K:
+          return eval::trans_boolean_object(l == r);
+        default:
+          return eval::trans_boolean_object(l != r);
+        }
+      }
+      return eval::eval_infix_expression(infix_operator(op), left, right);
+    }
+
+    auto call_args(const Rc<Object> *r, uint32_t first, uint32_t n) -> vector<Rc<Object>> {
+      return vector<Rc<Object>>(r + first, r + first + n);
+    }
+
+  public:
+    VM(): stack(1024) {};
+
+    size_t calls = 0;
+    size_t fallbacks = 0;
+
+    // Runs code with names looked up in env. returned tells a return
+    // statement at the top level apart from the value of the statement.
+    auto execute(Code *code, Environment *env, bool &returned) -> Rc<Object> {
+      auto entry = this->frames.size();
+      auto base = this->top();
+      this->reserve(base + code->registers);
+      this->frames.push_back({ code, code->instructions.data(), base, env, 0 });
+
+      Frame *f = &this->frames.back();
+      Rc<Object> *r = this->stack.data() + f->base;
+      const Rc<Object> *k = f->code->constants.data();
+      const Instruction *pc = f->pc;
+      Rc<Object> error = nullptr;
+
+      const Instruction *in;
+#ifdef VM_THREADED_DISPATCH
+      // one entry per opcode, in declaration order
+      static const void *handlers[OPCODES] = {
+        &&LOAD_CONST, &&LOAD_NULL, &&LOAD_NIL, &&MOVE, &&GET_NAME, &&GET_LOCAL, &&SET_NAME,
+        &&ADD, &&SUB, &&MUL, &&DIV, &&LT, &&GT, &&EQ, &&NE,
+        &&ADD_K, &&SUB_K, &&MUL_K, &&DIV_K, &&LT_K, &&GT_K, &&EQ_K, &&NE_K,
+        &&NEG, &&NOT, &&JUMP, &&JUMP_IF_FALSE, &&CALL, &&RETURN, &&END,
+        &&ARRAY, &&HASH_KEY, &&HASH, &&INDEX, &&CLOSURE
+      };
+      VM_NEXT;
+      {
+#else
+      for (;;) {
+        in = pc++;
+        switch (in->op) {
+#endif
+        VM_CASE(LOAD_CONST):
+          r[in->a] = k[in->b];
+          VM_NEXT;
+        VM_CASE(LOAD_NULL):
+          r[in->a] = eval::NULLOBJ;
+          VM_NEXT;
+        VM_CASE(LOAD_NIL):
+          r[in->a] = nullptr;
+          VM_NEXT;
+        VM_CASE(MOVE):
+          r[in->a] = r[in->b];
+          VM_NEXT;
+        VM_CASE(GET_NAME): {
+          auto value = eval::lookup(f->code->names[in->b], f->env);
+          if (value->type() == ERROR_OBJ) {
+            error = value;
+            goto unwind;
+          }
+          r[in->a] = std::move(value);
+          VM_NEXT;
+        }
+        VM_CASE(GET_LOCAL):
+          if (r[in->b] != nullptr) {
+            r[in->a] = r[in->b];
+          } else {
+            auto value = eval::lookup(f->code->names[in->c], f->env);
+            if (value->type() == ERROR_OBJ) {
+              error = value;
+              goto unwind;
+            }
+            r[in->a] = std::move(value);
+          }
+          VM_NEXT;
+        VM_CASE(SET_NAME):
+          f->env->set(f->code->names[in->b], r[in->a]);
+          VM_NEXT;
+        VM_CASE(ADD):
+        VM_CASE(SUB):
+        VM_CASE(MUL):
+        VM_CASE(DIV):
+        VM_CASE(LT):
+        VM_CASE(GT):
+        VM_CASE(EQ):
+        VM_CASE(NE):
+        VM_CASE(ADD_K):
+        VM_CASE(SUB_K):
+        VM_CASE(MUL_K):
+        VM_CASE(DIV_K):
+        VM_CASE(LT_K):
+        VM_CASE(GT_K):
+        VM_CASE(EQ_K):
+        VM_CASE(NE_K): {
+          const auto &right = in->op >= Opcode::ADD_K ? k[in->c] : r[in->c];
+          auto value = this->arithmetic(in->op, r[in->b], right);
+          if (value->type() == ERROR_OBJ) {
+            error = value;
+            goto unwind;
+          }
+          r[in->a] = std::move(value);
+          VM_NEXT;
+        }
+        VM_CASE(NEG): {
+          auto value = eval::eval_prefix_expression(Operator::MINUS, r[in->b]);
+          if (value->type() == ERROR_OBJ) {
+            error = value;
+            goto unwind;
+          }
+          r[in->a] = std::move(value);
+          VM_NEXT;
+        }
+        VM_CASE(NOT):
+          r[in->a] = eval::eval_bang_operator_expression(r[in->b]);
+          VM_NEXT;
+        VM_CASE(JUMP):
+          pc = f->code->instructions.data() + in->a;
+          VM_NEXT;
+        VM_CASE(JUMP_IF_FALSE):
+          if (!eval::is_truthy(r[in->a])) {
+            pc = f->code->instructions.data() + in->b;
+          }
+          VM_NEXT;
+        VM_CASE(CALL): {
+          const auto &callee = r[in->b];
+          Rc<Object> value;
+          if (callee->type() == FUNCTION_OBJ) {
+            auto func = borrow_cast<object::Function>(callee);
+            auto callee_code = compiled(func);
+            if (callee_code != nullptr) {
+              f->pc = pc;
+              auto callee_base = f->base + f->code->registers;
+              this->reserve(callee_base + callee_code->registers);
+              r = this->stack.data() + f->base;
+              auto args = r + in->b + 1;
+              auto callee_r = this->stack.data() + callee_base;
+              auto n = std::min(static_cast<size_t>(in->c), callee_code->parameters);
+              for (size_t i = 0; i < n; i++) {
+                callee_r[i] = args[i];
+              }
+
+              this->frames.push_back({ callee_code, callee_code->instructions.data(), callee_base, func->env.get(), in->a });
+              this->calls++;
+              f = &this->frames.back();
+              r = callee_r;
+              k = f->code->constants.data();
+              pc = f->pc;
+              VM_NEXT;
+            }
+            this->fallbacks++;
+            value = eval::apply_function(callee, this->call_args(r, in->b + 1, in->c));
+          } else if (callee->type() == BUILTIN_OBJ) {
+            value = borrow_cast<Builtin>(callee)->func(this->call_args(r, in->b + 1, in->c));
+          } else {
+            value = make_rc<Error>(format("not a function: {0}", type_name(callee->type())));
+          }
+
+          if (eval::is_error(value)) {
+            error = value;
+            goto unwind;
+          }
+          r[in->a] = std::move(value);
+          VM_NEXT;
+        }
+        VM_CASE(RETURN):
+        VM_CASE(END): {
+          auto value = std::move(r[in->a]);
+          auto result = f->result;
+          this->clear(*f);
+          this->frames.pop_back();
+          if (this->frames.size() == entry) {
+            returned = in->op == Opcode::RETURN;
+            return value;
+          }
+
+          f = &this->frames.back();
+          r = this->stack.data() + f->base;
+          k = f->code->constants.data();
+          pc = f->pc;
+          r[result] = std::move(value);
+          VM_NEXT;
+        }
+        VM_CASE(ARRAY):
+          r[in->a] = make_rc<Array>(this->call_args(r, in->b, in->c));
+          VM_NEXT;
+        VM_CASE(HASH_KEY):
+          if (!is_hashable(r[in->a])) {
+            error = make_rc<Error>(format("unusable as hash key_obj: {0}", type_name(r[in->a]->type())));
+            goto unwind;
+          }
+          VM_NEXT;
+        VM_CASE(HASH): {
+          map<HashKey, HashPair> pairs = {};
+          for (uint32_t i = 0; i < in->c; i++) {
+            const auto &key = r[in->b + 2 * i];
+            pairs[dynamic_cast<Hashable *>(key.get())->hash_key()] = make_pair(key, r[in->b + 2 * i + 1]);
+          }
+          r[in->a] = make_rc<Hash>(pairs);
+          VM_NEXT;
+        }
+        VM_CASE(INDEX): {
+          auto value = eval::eval_index_expression(r[in->b], r[in->c]);
+          if (value->type() == ERROR_OBJ) {
+            error = value;
+            goto unwind;
+          }
+          r[in->a] = std::move(value);
+          VM_NEXT;
+        }
+        VM_CASE(CLOSURE):
+          r[in->a] = this->closure(f->code->closures[in->b], r, f->env);
+          VM_NEXT;
+#ifndef VM_THREADED_DISPATCH
+        }
+#endif
+      }
+
+    unwind:
+      while (this->frames.size() > entry) {
+        this->clear(this->frames.back());
+        this->frames.pop_back();
+      }
+      returned = false;
+      return error;
+    }
+  };
+
+  auto machine() -> VM & {
+    // leaked like the statement region, registers may still hold objects
+    // at exit
+    static auto m = new VM();
+    return *m;
+  }
+
+  // Same contract as eval::eval_program: statements the compiler doesn't
+  // cover are evaluated by eval in the same environment.
+  auto run(Program *program, const Rc<Environment> &env) -> Rc<Object> {
+    Rc<Object> result;
+
+    analysis::resolve_closures(program);
+
+    for (const auto &stmt : program->statements) {
+      auto code = compiler::Compiler::compile_statement(stmt);
+      bool returned = false;
+      if (code == nullptr) {
+        result = eval::eval(stmt, env);
+        if (result != nullptr && result->type() == RETURN_VALUE_OBJ) {
+          result = borrow_cast<ReturnValue>(result)->value;
+          returned = true;
+        }
+      } else {
+        result = machine().execute(code.get(), env.get(), returned);
+      }
+
+      if (returned || eval::is_error(result)) {
+        return result;
+      }
+    }
+
+    return result;
+  }
+}
+
+#undef VM_CASE
+#undef VM_NEXT
@@ -0,0 +1,136 @@
+#include "catch.hpp"
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+#include "../src/analysis.hpp"
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace lexer;
+using namespace parser;
+using namespace analysis;
+
+auto parse_function_body(string input) -> Rc<BlockStatement> {
+  auto program = Parser::new_parser(Lexer::new_lexer(input))->parse_program();
+  auto stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  return static_pointer_cast<FunctionLiteral>(stmt->expression)->body;
+}
+
+TEST_CASE("test walk visits every node") {
+  auto program = Parser::new_parser(Lexer::new_lexer("let a = [1, {2: 3}][0]; if (a) { -a } else { f(a, 4) }"))->parse_program();
+  vector<int> ints = {};
+  size_t identifiers = 0;
+  walk(program, [&](const Rc<Node> &node) {
+      if (node->type() == NodeType::INTEGERLITERAL) {
+        ints.push_back(static_pointer_cast<IntegerLiteral>(node)->value);
+      } else if (node->type() == NodeType::IDENTIFIER) {
+        identifiers++;
+      }
+      return true;
+    });
+
+  sort(ints.begin(), ints.end());
+  REQUIRE(ints == vector<int>({ 0, 1, 2, 3, 4 }));
+  REQUIRE(identifiers == 5);
+}
+
+TEST_CASE("test captures environment") {
+  struct TestCase {
+    string input;
+    bool expected;
+  };
+
+  vector<TestCase> tests = {
+    { "fn(n) { n * 2 }", false },
+    { "fn(n) { let m = n + 1; if (m > 2) { return f(m); } else { [m] } }", false },
+    { "fn(x) { fn(y) { x + y } }", true },
+    { "fn(x) { if (x) { map(fn(y) { y }, [x]) } }", true },
+    { "fn(x) { quote(x) }", true },
+    { "fn(x) { yield x; }", true }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      auto body = parse_function_body(c.input);
+      REQUIRE(body->capture == Capture::UNKNOWN);
+      REQUIRE(captures_environment(body) == c.expected);
+      REQUIRE(body->capture != Capture::UNKNOWN);
+    });
+}
+
+TEST_CASE("test is generator") {
+  REQUIRE(is_generator(parse_function_body("fn(n) { while (true) { yield n; } }")));
+  REQUIRE(!is_generator(parse_function_body("fn(n) { n }")));
+  // the yield belongs to the literal
+  REQUIRE(!is_generator(parse_function_body("fn(n) { fn() { yield n; } }")));
+}
+
+TEST_CASE("test resolve closures") {
+  struct TestCase {
+    string input;
+    Closure expected;
+    vector<string> captured;
+  };
+
+  // the literal checked is the innermost one of the first statement
+  vector<TestCase> tests = {
+    { "fn(x) { fn(y) { x + y } }", Closure::FREE_VARIABLES, { "x" } },
+    { "fn(a) { let big = [a, a]; let b = a; fn() { a + b + len(big) } }", Closure::FREE_VARIABLES, { "a", "b", "big" } },
+    { "fn(a) { let big = [a, a]; fn() { puts(a) } }", Closure::FREE_VARIABLES, { "a" } },
+    { "fn(x) { fn(y) { fn(z) { x + z } } }", Closure::FREE_VARIABLES, { "x" } },
+    { "fn(x) { let g = fn(n) { g(n - 1) }; g }", Closure::ENVIRONMENT, {} },
+    { "fn(x) { let h = fn() { y }; let y = 1; h }", Closure::ENVIRONMENT, {} },
+    { "fn(x) { let x = x + 1; fn() { x } }", Closure::ENVIRONMENT, {} },
+    { "fn(x) { if (x) { let y = 1 }; fn() { y } }", Closure::ENVIRONMENT, {} },
+    { "fn(x) { fn() { quote(x) } }", Closure::ENVIRONMENT, {} },
+    // read before the literal binds a name of its own
+    { "fn(v) { fn() { let v = v + 10; v } }", Closure::FREE_VARIABLES, { "v" } },
+    { "fn(x) { fn() { puts(x); let x = 3; x } }", Closure::FREE_VARIABLES, { "x" } },
+    { "fn(x) { fn(c) { if (c) { let x = 1 }; x } }", Closure::FREE_VARIABLES, { "x" } }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      auto program = Parser::new_parser(Lexer::new_lexer(c.input))->parse_program();
+      resolve_closures(program.get());
+
+      Rc<FunctionLiteral> innermost = nullptr;
+      walk(program->statements[0], [&](const Rc<Node> &node) {
+          if (node->type() == NodeType::FUNCTIONLITERAL) {
+            innermost = static_pointer_cast<FunctionLiteral>(node);
+          }
+          return true;
+        });
+
+      REQUIRE(innermost->closure == c.expected);
+      REQUIRE(innermost->captured == c.captured);
+    });
+}
+
+TEST_CASE("test shape profile and fusion") {
+  auto program = Parser::new_parser(Lexer::new_lexer("let f = fn(n) { if (n < 2) { n } else { f(n - 1) + xs[n] } }; f(3) - 1;"))->parse_program();
+
+  map<string, size_t> profile = {};
+  profile_shapes(program, profile);
+  REQUIRE(profile["if (infix <)"] == 1);
+  REQUIRE(profile["(name) < (int)"] == 1);
+  REQUIRE(profile["(name) - (int)"] == 1);
+  REQUIRE(profile["(call) - (int)"] == 1);
+  REQUIRE(profile["(name)[name]"] == 1);
+  REQUIRE(profile["(name)(...)"] == 2);
+
+  fuse(program.get());
+  vector<Fused> infixes = {};
+  vector<Fused> others = {};
+  walk(program, [&](const Rc<Node> &node) {
+      if (node->type() == NodeType::INFIXEXPRESSION) {
+        infixes.push_back(static_pointer_cast<InfixExpression>(node)->fused);
+      } else if (node->type() == NodeType::IFEXPRESSION) {
+        others.push_back(static_pointer_cast<IfExpression>(node)->fused);
+      } else if (node->type() == NodeType::INDEXEXPRESSION) {
+        others.push_back(static_pointer_cast<IndexExpression>(node)->fused);
+      }
+      return true;
+    });
+  // n < 2, f(n - 1) + xs[n], n - 1 and f(3) - 1
+  REQUIRE(infixes == vector<Fused>({ Fused::NAME_CONSTANT, Fused::NONE, Fused::NAME_CONSTANT, Fused::NONE }));
+  REQUIRE(others == vector<Fused>({ Fused::COMPARE_BRANCH, Fused::NAME_INDEX }));
+}
@@ -0,0 +1,29 @@
+#include "catch.hpp"
+#include "../src/object.hpp"
+#include "../src/closure_compiler.hpp"
+#include "./util.hpp"
+#include <string>
+
+using namespace std;
+using namespace object;
+using namespace testutil;
+
+auto function_body(const Rc<Object> &obj) -> Rc<BlockStatement> {
+  REQUIRE(obj->type() == FUNCTION_OBJ);
+  return static_pointer_cast<object::Function>(obj)->body;
+}
+
+TEST_CASE("test closure compiler caches function bodies") {
+  auto env = make_rc<Environment>();
+  auto program = parse_input("let f = fn(n) { n + 1 }; let q = fn(x) { quote(x) }; f(1); q(1); f;");
+  auto f = closurecompiler::run(program.get(), env);
+
+  auto body = function_body(f);
+  REQUIRE(body->callable != nullptr);
+  REQUIRE(!body->uncallable);
+
+  // quote needs the call's environment, calls of q are left to eval
+  auto q = function_body(env->get("q"));
+  REQUIRE(q->callable == nullptr);
+  REQUIRE(q->uncallable);
+}
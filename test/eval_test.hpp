@@ -5,6 +5,7 @@
 #include "../src/eval.hpp"
 #include "./util.hpp"
 #include <iostream>
+#include <set>
 #include <vector>
 #include <string>
 #include <functional>
@@ -16,17 +17,17 @@ using namespace object;
 using namespace eval;
 using namespace testutil;
 
-auto test_integer_object(shared_ptr<Object> obj, int expected) -> void {
+auto test_integer_object(Rc<Object> obj, int expected) -> void {
   REQUIRE(obj->type() == INTEGER_OBJ);
   REQUIRE(static_pointer_cast<Integer>(obj)->value == expected);
 }
 
-auto test_boolean_object(shared_ptr<Object> obj, int expected) -> void {
+auto test_boolean_object(Rc<Object> obj, int expected) -> void {
   REQUIRE(obj->type() == BOOLEAN_OBJ);
   REQUIRE(static_pointer_cast<object::Boolean>(obj)->value == expected);
 }
 
-auto test_null_object(shared_ptr<Object> obj) -> void {
+auto test_null_object(Rc<Object> obj) -> void {
   REQUIRE(obj->type() == NULL_OBJ);
 }
 
@@ -85,7 +86,14 @@ TEST_CASE("test eval boolean expression") {
     { "(1 < 2) == true", true },
     { "(1 < 2) == false", false },
     { "(1 > 2) == true", false },
-    { "(1 > 2) == false", true }
+    { "(1 > 2) == false", true },
+    { "1 == true", false },
+    { "1 != true", true },
+    { "let a = [1]; a == a", true },
+    { "[1] == [1]", true },
+    { "[1, [2]] != [1, [3]]", true },
+    { "{\"a\": [1]} == {\"a\": [1]}", true },
+    { "[1] == {}", false }
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
@@ -369,7 +377,9 @@ TEST_CASE("test builtin functions") {
     { "len([1, 2, 3])", 3 },
     { "len([])", 0 },
     { "first([1, 2, 3])", 1 },
-    { "last([1, 2, 3])", 3 }
+    { "last([1, 2, 3])", 3 },
+    { "reduce([1, 2, 3], 10, fn(acc, x) { acc + x })", 16 },
+    { "reduce([], 10, fn(acc, x) { acc + x })", 10 }
   };
 
   vector<StringTestCase> err_tests = {
@@ -377,19 +387,33 @@ TEST_CASE("test builtin functions") {
     { "len(\"one\", \"two\")", "wrong number of arguments. got=2, want=1" },
     { "first(1)", "argument to `first` must be ARRAY, got INTEGER" },
     { "last(1)", "argument to `last` must be ARRAY, got INTEGER" },
-    { "push(1, 1)", "argument to `push` must be ARRAY, got INTEGER" }
+    { "push(1, 1)", "argument to `push` must be ARRAY, got INTEGER" },
+    { "map(1, fn(x) { x })", "argument to `map` must be ARRAY, got INTEGER" },
+    { "filter([1], 1)", "argument to `filter` must be FUNCTION, got INTEGER" },
+    { "reduce([1], fn(acc, x) { x })", "wrong number of arguments. got=2, want=3" },
+    { "each([1, 2], fn(x) { x + true })", "type mismatch: INTEGER + BOOLEAN" },
+    { "sort(1)", "argument to `sort` must be ARRAY, got INTEGER" },
+    { "sort([true])", "can't sort BOOLEAN without a function to order it" },
+    { "sort([1, \"a\"])", "can't sort INTEGER and STRING without a function to order them" },
+    { "sort([2, 1], fn(a, b) { a + true })", "type mismatch: INTEGER + BOOLEAN" }
   };
 
   vector<ArrayTestCase> arr_tests = {
     { "rest([1, 2, 3])", vector<int>({ 2, 3 }) },
-    { "push([], 1)", vector<int>({ 1 }) }
+    { "push([], 1)", vector<int>({ 1 }) },
+    { "map([1, 2, 3], fn(x) { x * 2 })", vector<int>({ 2, 4, 6 }) },
+    { "map([[1], [], [1, 2]], len)", vector<int>({ 1, 0, 2 }) },
+    { "filter([1, 2, 3, 4], fn(x) { x > 2 })", vector<int>({ 3, 4 }) },
+    { "sort([3, -1, 2, 300, -70000, 0])", vector<int>({ -70000, -1, 0, 2, 3, 300 }) },
+    { "sort([1, 3, 2], fn(a, b) { a > b })", vector<int>({ 3, 2, 1 }) }
   };
 
   vector<string> null_tests = {
     "puts(\"hello\", \"world!\")",
     "first([])",
     "last([])",
-    "rest([])"
+    "rest([])",
+    "each([1, 2], fn(x) { x })"
   };
 
   std::for_each(int_tests.cbegin(), int_tests.cend(), [](IntTestCase c) {
@@ -401,7 +425,7 @@ TEST_CASE("test builtin functions") {
     });
 
   std::for_each(arr_tests.cbegin(), arr_tests.cend(), [](ArrayTestCase c) {
-      vector<int> int_arr = static_pointer_cast<Array>(test_eval(c.input))->elements | view::transform([](shared_ptr<Object> obj) {
+      vector<int> int_arr = static_pointer_cast<Array>(test_eval(c.input))->elements() | view::transform([](Rc<Object> obj) {
           return static_pointer_cast<Integer>(obj)->value;
         });
       REQUIRE(int_arr == c.expected);
@@ -419,10 +443,51 @@ TEST_CASE("test array literals") {
   REQUIRE(evaluated->type() == ARRAY_OBJ);
   auto arr = static_pointer_cast<Array>(evaluated);
 
-  REQUIRE(arr->elements.size() == 3);
-  vector<int> int_arr = arr->elements | view::transform([](shared_ptr<Object> o) { return static_pointer_cast<Integer>(o)->value; });
+  REQUIRE(arr->size() == 3);
+  REQUIRE(arr->is_unboxed());
   vector<int> expected = { 1, 4, 6 };
-  REQUIRE(int_arr == expected);
+  REQUIRE(arr->values() == expected);
+}
+
+TEST_CASE("test integer arrays stay unboxed") {
+  struct TestCase {
+    string input;
+    string expected;
+    bool unboxed;
+  };
+
+  vector<TestCase> tests = {
+    { "[];", "[]", true },
+    { "let a = [1, 2]; a[2] = 3; a[0] = -1; a;", "[-1, 2, 3]", true },
+    { "push(rest([1, 2, 3]), 4);", "[2, 3, 4]", true },
+    { "map(array(range(0, 4)), fn(x) { x * x });", "[0, 1, 4, 9]", true },
+    { "sort([3, 1, 2], fn(a, b) { a > b });", "[3, 2, 1]", true },
+    // the first element of another type boxes them all
+    { "push([1, 2], \"a\");", "[1, 2, a]", false },
+    { "let a = [1, 2]; a[1] = [3]; a;", "[1, [3]]", false },
+    { "[1, \"a\", 2];", "[1, a, 2]", false },
+    // and a boxed array of integers is still one
+    { "sort(rest([\"a\", 3, -1, 2]));", "[-1, 2, 3]", true }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      auto evaluated = test_eval(c.input);
+      REQUIRE(inspect(evaluated) == c.expected);
+      REQUIRE(static_pointer_cast<Array>(evaluated)->is_unboxed() == c.unboxed);
+    });
+
+  auto evaluated = test_eval("let a = [1, 2, 3]; [a[1], a[3], first(a), last(a), len(a)];");
+  REQUIRE(inspect(evaluated) == "[2, null, 1, 3, 3]");
+  REQUIRE(test_eval("[1, 2, 3];") == test_eval("push([1, 2], 3);"));
+  REQUIRE(!(test_eval("[1, 2, 3];") == test_eval("[1, 2];")));
+  // compared element by element across the two forms
+  auto ints = make_rc<Array>(vector<int>{ 1, 2 });
+  auto boxed = make_rc<Array>(vector<Rc<Object>>{ make_rc<Integer>(1), make_rc<String>("a") });
+  boxed->elements().pop_back();
+  boxed->push(make_rc<Integer>(2));
+  REQUIRE(!boxed->is_unboxed());
+  REQUIRE(static_pointer_cast<Object>(ints) == static_pointer_cast<Object>(boxed));
 }
 
 TEST_CASE("test array index expressions") {
@@ -497,12 +562,12 @@ TEST_CASE("test hash literals") {
   auto hash = static_pointer_cast<Hash>(evaluated);
 
   map<string, int> expected = {
-    { make_shared<String>("one")->hash_key(), 1 },
-    { make_shared<String>("two")->hash_key(), 2 },
-    { make_shared<String>("three")->hash_key(), 3 },
-    { make_shared<Integer>(4)->hash_key(), 4 },
-    { make_shared<object::Boolean>(true)->hash_key(), 5 },
-    { make_shared<object::Boolean>(false)->hash_key(), 6 }
+    { make_rc<String>("one")->hash_key(), 1 },
+    { make_rc<String>("two")->hash_key(), 2 },
+    { make_rc<String>("three")->hash_key(), 3 },
+    { make_rc<Integer>(4)->hash_key(), 4 },
+    { make_rc<object::Boolean>(true)->hash_key(), 5 },
+    { make_rc<object::Boolean>(false)->hash_key(), 6 }
   };
 
   std::for_each(expected.cbegin(), expected.cend(), [&](pair<string, int> p) {
@@ -552,3 +617,544 @@ TEST_CASE("test hash index expressions") {
       test_null_object(test_eval(input));
     });
 }
+
+TEST_CASE("test non-capturing calls run on the frame stack") {
+  auto calls = frames.calls;
+  auto escaped = frames.escaped;
+  test_integer_object(eval_input("let f = fn(n) { if (n > 0) { f(n - 1) + 1 } else { 0 } }; f(3) + f(3);"), 6);
+  REQUIRE(frames.calls - calls == 8);
+  REQUIRE(frames.depth == 0);
+
+  // the literal newAdder returns copies x, so its frame isn't captured
+  calls = frames.calls;
+  test_integer_object(eval_input("let newAdder = fn(x) { fn(y) { x + y }; }; let addTwo = newAdder(2); addTwo(2) + newAdder(1)(1);"), 6);
+  REQUIRE(frames.calls - calls == 4);
+
+  // a self-referencing inner function still needs the whole frame
+  calls = frames.calls;
+  test_integer_object(eval_input("let f = fn(n) { let g = fn(k) { if (k > 0) { g(k - 1) } else { n } }; g(2) }; f(7);"), 7);
+  REQUIRE(frames.calls - calls == 3);
+
+  test_integer_object(eval_input("let f = fn(a, b) { let c = a * b; c + a }; f(f(2, 3), f(1, 1));"), 24);
+  REQUIRE(frames.depth == 0);
+  REQUIRE(frames.escaped == escaped);
+}
+
+TEST_CASE("test closures copy only their free variables") {
+  auto evaluated = test_eval("let f = fn(a) { let big = [a, a, a]; fn() { a } }; f(5);");
+  REQUIRE(evaluated->type() == FUNCTION_OBJ);
+
+  auto closure = static_pointer_cast<object::Function>(evaluated)->env;
+  REQUIRE(closure->store.size() == 1);
+  test_integer_object(closure->store["a"], 5);
+  // the next one up is the global environment
+  REQUIRE(closure->outer->outer == nullptr);
+  REQUIRE(closure->outer->store.count("f") == 1);
+
+  test_integer_object(test_eval("let x = 1; let f = fn(a) { fn(b) { fn(c) { a + b + c + x } } }; f(10)(100)(1000);"), 1111);
+  test_integer_object(test_eval("let f = fn() { let g = fn() { h() }; g() }; let h = fn() { 3 }; f();"), 3);
+
+  // a name read before the literal binds its own is still the enclosing one
+  REQUIRE(inspect(test_eval("let v = 1; let u = fn(v) { let h = fn() { let v = v + 10; v }; [h(), v] }; u(5);")) == "[15, 5]");
+  REQUIRE(inspect(test_eval("let x = 1; let u = fn(x) { let h = fn() { let y = x; let x = 3; [y, x] }; h() }; u(2);")) == "[2, 3]");
+  REQUIRE(inspect(test_eval("let x = 1; let u = fn(x) { let h = fn(c) { if (c) { let x = 3; }; x }; [h(false), h(true)] }; u(2);")) == "[2, 3]");
+}
+
+TEST_CASE("test nodes quicken to the operand types they see") {
+  auto program = parse_input("let f = fn(a, b) { [a][0] + b }; f(1, 2); f(\"a\", \"b\"); f(3, 4);");
+  auto env = make_rc<Environment>();
+  auto body = static_pointer_cast<FunctionLiteral>(static_pointer_cast<LetStatement>(program->statements[0])->value)->body;
+  auto infix = static_pointer_cast<InfixExpression>(static_pointer_cast<ExpressionStatement>(body->statements[0])->expression);
+  auto index = static_pointer_cast<IndexExpression>(infix->left);
+  auto call = static_pointer_cast<CallExpression>(static_pointer_cast<ExpressionStatement>(program->statements[1])->expression);
+  REQUIRE(infix->quickened == Quickened::UNSEEN);
+
+  eval_program(program.get(), env);
+  test_integer_object(eval::eval(parse_input("f(5, 6)"), env), 11);
+  // strings failed the int + int guard, the array index still holds
+  REQUIRE(infix->quickened == Quickened::GENERIC);
+  REQUIRE(index->quickened == Quickened::ARRAY_INTEGER);
+  REQUIRE(call->quickened == Quickened::FUNCTION);
+
+  program = parse_input("let g = fn(n, k) { n - k }; len([1]); g(3, 1); g(true, 1);");
+  eval_program(program.get(), env);
+  body = static_pointer_cast<FunctionLiteral>(static_pointer_cast<LetStatement>(program->statements[0])->value)->body;
+  infix = static_pointer_cast<InfixExpression>(static_pointer_cast<ExpressionStatement>(body->statements[0])->expression);
+  REQUIRE(infix->quickened == Quickened::GENERIC);
+  call = static_pointer_cast<CallExpression>(static_pointer_cast<ExpressionStatement>(program->statements[1])->expression);
+  REQUIRE(call->quickened == Quickened::BUILTIN);
+
+  REQUIRE(inspect(test_eval("let g = fn(n) { n - 1 }; g(3) + g(4);")) == "5");
+  REQUIRE(inspect(test_eval("let g = fn(n) { n - 1 }; g(3); g(true);")) == "ERROR: type mismatch: BOOLEAN - INTEGER");
+}
+
+TEST_CASE("test call sites cache global callees") {
+  auto program = parse_input("let f = fn(n) { if (n > 0) { f(n - 1) } else { len(\"ab\") } }; f(3);");
+  auto env = make_rc<Environment>();
+  test_integer_object(eval::eval(program, env), 2);
+
+  auto body = static_pointer_cast<FunctionLiteral>(static_pointer_cast<LetStatement>(program->statements[0])->value)->body;
+  auto if_expr = static_pointer_cast<IfExpression>(static_pointer_cast<ExpressionStatement>(body->statements[0])->expression);
+  auto call = static_pointer_cast<CallExpression>(static_pointer_cast<ExpressionStatement>(if_expr->consequence->statements[0])->expression);
+  REQUIRE(call->global_callee);
+  REQUIRE(call->cached_root == env.get());
+  REQUIRE(call->cached_callee == env->get("f").get());
+
+  // a parameter or let of an enclosing function is never cached
+  program = parse_input("let g = fn(h) { let k = h; fn() { k() + h() } }; g(fn() { 1 })();");
+  test_integer_object(eval::eval(program, env), 2);
+  auto inner = static_pointer_cast<FunctionLiteral>(static_pointer_cast<ExpressionStatement>(static_pointer_cast<FunctionLiteral>(static_pointer_cast<LetStatement>(program->statements[0])->value)->body->statements[1])->expression);
+  auto sum = static_pointer_cast<InfixExpression>(static_pointer_cast<ExpressionStatement>(inner->body->statements[0])->expression);
+  REQUIRE_FALSE(static_pointer_cast<CallExpression>(sum->left)->global_callee);
+  REQUIRE_FALSE(static_pointer_cast<CallExpression>(sum->right)->global_callee);
+
+  // rebinding a global invalidates the caches
+  test_integer_object(test_eval("let g = fn() { h() }; let h = fn() { 1 }; let a = g(); let h = fn() { 2 }; a * 10 + g();"), 12);
+  test_integer_object(test_eval("let g = fn() { len(\"abc\") }; let a = g(); let len = fn(x) { 7 }; a * 10 + g();"), 37);
+}
+
+TEST_CASE("test fused shapes") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "let f = fn(x) { if (x > 1) { 1 } else { 2 } }; f(5) * 10 + f(0);", "12" },
+    { "let f = fn(x, y) { if (x == y) { 1 } else { 2 } }; f(3, 3) * 10 + f(3, 4);", "12" },
+    { "let f = fn(x) { if (x == 1) { 1 } else { 2 } }; f(true);", "2" },
+    { "let f = fn(x) { if (x > 1) { 1 } else { 2 } }; f(\"a\");", "ERROR: type mismatch: STRING > INTEGER" },
+    { "if (y < 1) { 1 }", "ERROR: identifier not found: y" },
+    { "let x = 7; x - 1;", "6" },
+    { "let x = \"a\"; x - 1;", "ERROR: type mismatch: STRING - INTEGER" },
+    { "let x = true; let y = x == 1; if (y) { 1 } else { 2 };", "2" },
+    { "let a = [1, 2]; let i = 1; a[i] + a[0];", "3" },
+    { "let h = {\"k\": 3}; h[\"k\"];", "3" },
+    { "let z = 1; z[0];", "ERROR: index operator not supported: INTEGER" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+}
+
+TEST_CASE("test loops") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "let i = 0; let sum = 0; while (i < 5) { let sum = sum + i; let i = i + 1; }; sum;", "10" },
+    { "let i = 0; while (i < 3) { let i = i + 1; }", "null" },
+    { "while (false) { 1 }; 2", "2" },
+    { "let sum = 0; for (x in [1, 2, 3]) { let sum = sum + x * x; }; sum;", "14" },
+    { "let keys = []; for (k in {\"b\": 1, \"a\": 2}) { let keys = push(keys, k); }; len(keys);", "2" },
+    { "for (x in []) { 1 }; 2", "2" },
+    { "let f = fn(n) { let i = 0; while (true) { if (i == n) { return i * 10; } let i = i + 1; } }; f(4);", "40" },
+    { "let f = fn(a) { for (x in a) { if (x > 2) { return x; } } 0 }; f([1, 5, 3]) + f([1]);", "5" },
+    { "let i = 0; while (i < 10) { if (i == 3) { return i; } let i = i + 1; }; 99;", "3" },
+    { "let f = fn(a, n) { while (n > 0) { let a = a + n; let n = n - 1; } a }; f(0, 4) + f(1, 0);", "11" },
+    { "let fs = []; for (x in [1, 2]) { let fs = push(fs, fn() { x }); }; fs[0]() + fs[1]();", "4" },
+    { "while (y < 1) { 1 }", "ERROR: identifier not found: y" },
+    { "let i = 0; while (i < 3) { let i = i + true; }", "ERROR: type mismatch: INTEGER + BOOLEAN" },
+    { "for (x in 5) { x }", "ERROR: not iterable: INTEGER" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // iterations run in the loop's environment, not in frames
+  auto calls = frames.calls;
+  auto env = make_rc<Environment>();
+  test_integer_object(eval::eval(parse_input("let i = 0; let n = 0; while (i < 100000) { let n = n + 2; let i = i + 1; }; n;"), env), 200000);
+  REQUIRE(frames.calls == calls);
+  REQUIRE(env->store.size() == 2);
+  test_integer_object(eval_input("let f = fn(n) { let i = 0; while (i < n) { let i = i + 1; } i }; f(100000);"), 100000);
+  REQUIRE(frames.calls - calls == 1);
+}
+
+TEST_CASE("test top level loops recycle the statement region") {
+  auto resets = statement_region().resets;
+  region::per_statement = true;
+  auto evaluated = eval_input("let i = 0; let a = [1, 2]; while (i < 1000) { let a = [i, a[0]]; let i = i + 1; }; a[1];");
+  region::per_statement = false;
+  test_integer_object(evaluated, 998);
+  // one per iteration and one per statement
+  REQUIRE(statement_region().resets - resets == 1004);
+}
+
+TEST_CASE("test assignment") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "let x = 1; x = x + 1; x;", "2" },
+    { "let x = 1; x = 5", "5" },
+    { "let f = fn() { x = 5; }; let x = 1; f(); x;", "5" },
+    { "let counter = fn() { let n = 0; fn() { n = n + 1; n } }; let c = counter(); c(); c(); c();", "3" },
+    { "let f = fn(n) { let g = fn() { n }; n = n + 1; g() }; f(1);", "2" },
+    { "let f = fn(n) { let g = fn() { n = n * 2; }; g(); n }; f(3);", "6" },
+    { "let a = [1, 2, 3]; a[1] = 5; a;", "[1, 5, 3]" },
+    { "let a = [1, 2]; let b = a; a[0] = 9; [a, b];", "[[9, 2], [1, 2]]" },
+    { "let f = fn(a) { a[0] = 9; a }; let a = [1]; [f(a), a];", "[[9], [1]]" },
+    { "let h = {\"a\": 1}; h[\"b\"] = 2; h[\"a\"] = 3; h[\"a\"] * 10 + h[\"b\"];", "32" },
+    { "let m = [[1, 2], [3, 4]]; m[1][0] = 7; m;", "[[1, 2], [7, 4]]" },
+    { "let m = [[1, 2]]; let row = m[0]; m[0][1] = 5; [m, row];", "[[[1, 5]], [1, 2]]" },
+    { "let m = {1: [0]}; m[1][0] = 4; m[1];", "[4]" },
+    { "let a = [0, 0, 0]; let i = 0; while (i < 3) { a[i] = i * i; i = i + 1; }; a;", "[0, 1, 4]" },
+    { "let a = [0, 0]; for (x in a) { a[0] = a[0] + 1; }; a;", "[2, 0]" },
+    { "y = 1", "ERROR: identifier not found: y" },
+    { "let a = []; let i = 0; while (i < 3) { a[len(a)] = i; i = i + 1; }; a;", "[0, 1, 2]" },
+    { "let a = [1]; a[2] = 2;", "ERROR: index out of range: 2" },
+    { "let a = [1]; a[-1] = 2;", "ERROR: index out of range: -1" },
+    { "let x = 1; x[0] = 2;", "ERROR: index operator not supported: INTEGER" },
+    { "let a = [1]; a[\"k\"] = 2;", "ERROR: index operator not supported: ARRAY" },
+    { "let h = {}; h[[1]] = 1;", "ERROR: unusable as hash key: ARRAY" },
+    { "let a = [1]; a[0] = b;", "ERROR: identifier not found: b" },
+    { "[1][0] = 2", "ERROR: cannot assign to ([1][0])" },
+    // only the last index may add an element
+    { "let h = {}; h[\"a\"][\"b\"] = 1;", "ERROR: key not found: a" },
+    { "let a = [[1]]; a[len(a)][0] = 1;", "ERROR: index out of range: 1" },
+    { "let a = [1]; a[0][0] = 2;", "ERROR: index operator not supported: INTEGER" },
+    { "let h = {\"a\": 1}; h[\"a\"][\"b\"] = 2;", "ERROR: index operator not supported: INTEGER" },
+    { "let a = [[1], {}]; a[0][1] = 2; a[1][\"k\"] = 3; a;", "[[1, 2], {k: 3}]" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // and a failed one leaves the containers as they were
+  auto env = make_rc<Environment>();
+  eval::eval(parse_input("let h = {\"x\": 1}; let a = [[1]]; h[\"a\"][\"b\"] = 1;"), env);
+  eval::eval(parse_input("a[1][0] = 1;"), env);
+  REQUIRE(inspect(env->store["h"]) == "{x: 1}");
+  REQUIRE(inspect(env->store["a"]) == "[[1]]");
+}
+
+TEST_CASE("test index assignment changes a unique value in place") {
+  auto env = make_rc<Environment>();
+  eval::eval(parse_input("let a = [1, 2, 3]; let h = {\"k\": 1};"), env);
+  auto a = env->store["a"].get();
+  auto h = env->store["h"].get();
+  eval::eval(parse_input("a[0] = 7; h[\"k\"] = 2; h[\"j\"] = 3;"), env);
+  REQUIRE(env->store["a"].get() == a);
+  REQUIRE(env->store["h"].get() == h);
+  REQUIRE(inspect(env->store["a"]) == "[7, 2, 3]");
+
+  // a shared value is copied once, after that the copy is unique
+  eval::eval(parse_input("let b = a; a[1] = 8;"), env);
+  auto copy = env->store["a"].get();
+  REQUIRE(copy != a);
+  eval::eval(parse_input("a[2] = 9;"), env);
+  REQUIRE(env->store["a"].get() == copy);
+  REQUIRE(inspect(env->store["b"]) == "[7, 2, 3]");
+
+  // what a heap environment's array is given is promoted out of the
+  // statement region
+  region::per_statement = true;
+  env = make_rc<Environment>();
+  eval::eval(parse_input("let a = [0, 0, 0]; let i = 0; while (i < 3) { a[i] = [i]; i = i + 1; }; a;"), env);
+  region::per_statement = false;
+  auto elements = static_pointer_cast<Array>(env->store["a"])->elements();
+  REQUIRE(inspect(env->store["a"]) == "[[0], [1], [2]]");
+  for (const auto &element : elements) {
+    REQUIRE(!region::owns(element.get()));
+  }
+}
+
+TEST_CASE("test in place updates leave shared values alone") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "let a = [1]; let b = a; let a = push(a, 2); [a, b];", "[[1, 2], [1]]" },
+    { "let a = [1]; let b = a; a = push(a, 2); [a, b];", "[[1, 2], [1]]" },
+    { "let a = [1, 2, 3]; let b = a; let a = rest(a); [a, b];", "[[2, 3], [1, 2, 3]]" },
+    { "let a = [1]; let a = push(a, a); a;", "[1, [1]]" },
+    { "let s = \"a\"; let t = s; let s = s + \"b\"; [s, t];", "[ab, a]" },
+    { "let s = \"a\"; s = s + s; s = s + s; s;", "aaaa" },
+    { "let f = fn(acc) { let acc = push(acc, 1); acc }; let x = [0]; let y = f(x); [x, y];", "[[0], [0, 1]]" },
+    { "let f = fn(acc) { push(acc, 9) }; let x = [1]; f(x); x;", "[1]" },
+    { "let f = fn(acc) { let g = fn() { acc }; [push(acc, 1), g()] }; f([0]);", "[[0, 1], [0]]" },
+    { "let f = fn(s) { s + \"!\" }; let s = \"hi\"; [f(s), s];", "[hi!, hi]" },
+    { "let build = fn(acc, n) { if (n == 0) { acc } else { build(push(acc, n), n - 1) } }; let a = [0]; [build(a, 3), a];", "[[0, 3, 2, 1], [0]]" },
+    { "let a = [[1]]; let inner = a[0]; let inner = push(inner, 2); [a, inner];", "[[[1]], [1, 2]]" },
+    { "let drain = fn(a, n) { if (len(a) == 0) { n } else { drain(rest(a), n + 1) } }; let a = [1, 2, 3]; [drain(a, 0), a];", "[3, [1, 2, 3]]" },
+    { "let a = [1]; let a = push(a);", "ERROR: wrong number of arguments. got=1, want=2" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // a failed update leaves the variable bound to its old value
+  auto env = make_rc<Environment>();
+  eval::eval(parse_input("let a = [1];"), env);
+  eval::eval(parse_input("let a = push(a);"), env);
+  REQUIRE(inspect(env->store["a"]) == "[1]");
+}
+
+TEST_CASE("test push, rest and + reuse a value nobody else holds") {
+  auto env = make_rc<Environment>();
+  eval::eval(parse_input("let a = [1]; let s = \"a\";"), env);
+  auto a = env->store["a"].get();
+  auto s = env->store["s"].get();
+  eval::eval(parse_input("let a = push(a, 2); a = push(a, 3); let a = rest(a); let s = s + \"b\"; s = s + \"c\";"), env);
+  REQUIRE(env->store["a"].get() == a);
+  REQUIRE(env->store["s"].get() == s);
+  REQUIRE(inspect(env->store["a"]) == "[2, 3]");
+  REQUIRE(inspect(env->store["s"]) == "abc");
+
+  // an accumulator handed on from call to call is appended to all along
+  set<const Object *> accumulators = {};
+  env->store["seen"] = make_rc<Builtin>([&](const vector<Rc<Object>> &args) -> Rc<Object> {
+      accumulators.insert(args[0].get());
+      return args[0];
+    });
+  auto evaluated = eval::eval(parse_input("let build = fn(acc, n) { if (n == 0) { acc } else { build(push(seen(acc), n), n - 1) } }; build([], 50);"), env);
+  REQUIRE(static_pointer_cast<Array>(evaluated)->size() == 50);
+  REQUIRE(accumulators.size() == 1);
+
+  accumulators.clear();
+  evaluated = eval::eval(parse_input("let build = fn(acc, n) { if (n == 0) { return acc; } let acc = seen(acc); let acc = push(acc, n); build(acc, n - 1) }; build([], 50);"), env);
+  REQUIRE(static_pointer_cast<Array>(evaluated)->size() == 50);
+  REQUIRE(accumulators.size() == 1);
+
+  // sort takes no variable over, but sorts a temporary in place, by key
+  // or through a function, unboxed or not
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> sorts = {
+    { "sort(seen(rest([\"a\", 3, 1, 2])));", "[1, 2, 3]" },
+    { "sort(seen([[2], [1]]), fn(x, y) { x[0] < y[0] });", "[[1], [2]]" },
+    { "sort(seen([2, 3, 1]), fn(x, y) { x > y });", "[3, 2, 1]" }
+  };
+  for (const auto &c : sorts) {
+    INFO(c.input);
+    accumulators.clear();
+    evaluated = eval::eval(parse_input(c.input), env);
+    REQUIRE(inspect(evaluated) == c.expected);
+    REQUIRE(accumulators.count(evaluated.get()) == 1);
+  }
+  REQUIRE(static_pointer_cast<Array>(evaluated)->is_unboxed());
+}
+
+TEST_CASE("test higher order builtins") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "let k = 10; map([1, 2], fn(x) { x + k });", "[11, 12]" },
+    { "map([1, 2], fn(x) { map([x, x], fn(y) { x * y }) });", "[[1, 1], [4, 4]]" },
+    { "map([1, 2], fn(x) { if (x > 1) { return \"big\"; } x });", "[1, big]" },
+    { "filter([1, false, first([]), \"\"], fn(x) { x });", "[1, ]" },
+    { "reduce([1, 2, 3], [], fn(acc, x) { push(acc, x * x) });", "[1, 4, 9]" },
+    { "let total = 0; each([1, 2, 3], fn(x) { total = total + x; }); total;", "6" },
+    { "let a = [1, 2]; map(a, fn(x) { a[0] = 9; x }); a;", "[9, 2]" },
+    { "map([1, 2], fn(x, y) { y });", "ERROR: identifier not found: y" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // every call of the function runs in the frame reserved for the first,
+  // however long the array
+  auto depth = frames.depth;
+  auto evaluated = test_eval("let xs = []; let i = 0; while (i < 100000) { xs = push(xs, i); i = i + 1; }; "
+                             "let doubled = map(xs, fn(x) { x + x }); "
+                             "reduce(filter(doubled, fn(x) { x < 100000 }), 0, fn(acc, x) { acc + 1 });");
+  test_integer_object(evaluated, 50000);
+  REQUIRE(frames.depth == depth);
+}
+
+TEST_CASE("test lazy sequences") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "range(0, 5);", "sequence" },
+    { "array(range(0, 5));", "[0, 1, 2, 3, 4]" },
+    { "array(range(10, 0, -3));", "[10, 7, 4, 1]" },
+    { "array(range(5, 0));", "[]" },
+    { "len(range(0, 10, 3));", "4" },
+    { "len(lfilter(range(0, 10), fn(x) { x > 6 }));", "3" },
+    { "array(take(lmap(range(1, 100), fn(x) { x * x }), 3));", "[1, 4, 9]" },
+    { "array(lmap([1, 2, 3], fn(x) { x + 1 }));", "[2, 3, 4]" },
+    { "reduce(lfilter(range(0, 10), fn(x) { x / 2 * 2 == x }), 0, fn(acc, x) { acc + x });", "20" },
+    { "map(take(range(0, 100), 2), fn(x) { -x });", "[0, -1]" },
+    { "array(take(range(0, 3), 0));", "[]" },
+    { "let s = range(0, 3); let t = lmap(s, fn(x) { x * 10 }); [array(s), array(t)];", "[[0, 1, 2], [0, 10, 20]]" },
+    { "let n = 0; for (x in range(0, 4)) { n = n + x; }; n;", "6" },
+    { "array(lmap(range(0, 3), fn(x) { x + true }));", "ERROR: type mismatch: INTEGER + BOOLEAN" },
+    { "range(0);", "ERROR: wrong number of arguments. got=1, want=2 or 3" },
+    { "range(0, \"a\");", "ERROR: argument to `range` must be INTEGER, got STRING" },
+    { "range(0, 5, 0);", "ERROR: range step must not be 0" },
+    { "lmap(1, fn(x) { x });", "ERROR: argument to `lmap` must be ARRAY, got INTEGER" },
+    { "lfilter(range(0, 1), 1);", "ERROR: argument to `lfilter` must be FUNCTION, got INTEGER" },
+    { "take(range(0, 1), \"a\");", "ERROR: argument to `take` must be INTEGER, got STRING" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // the stages run one element at a time and stop once take has enough
+  auto evaluated = test_eval("let calls = 0; let f = fn(x) { calls = calls + 1; x * 2 }; "
+                             "let firsts = array(take(lfilter(lmap(range(0, 1000000), f), fn(x) { x > 10 }), 2)); "
+                             "[firsts, calls];");
+  REQUIRE(inspect(evaluated) == "[[12, 14], 8]");
+
+  // no array of a million elements is ever made
+  test_integer_object(test_eval("reduce(lmap(range(0, 1000000), fn(x) { x / 1000 }), 0, fn(acc, x) { acc + x });"), 499500000);
+}
+
+TEST_CASE("test generators") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  string count = "let count = fn(n) { let i = 0; while (i < n) { yield i; i = i + 1; } }; ";
+  string naturals = "let naturals = fn() { let i = 0; while (true) { yield i; i = i + 1; } }; ";
+  vector<TestCase> tests = {
+    { count + "count(3);", "generator" },
+    { count + "array(count(3));", "[0, 1, 2]" },
+    { count + "len(count(4));", "4" },
+    { count + "map(count(3), fn(x) { x * 2 });", "[0, 2, 4]" },
+    { count + "let n = 0; for (x in count(4)) { n = n + x; }; n;", "6" },
+    { naturals + "array(take(lfilter(naturals(), fn(x) { x > 5 }), 2));", "[6, 7]" },
+    // consumed once, a take leaves it where it stopped
+    { naturals + "let g = naturals(); [array(take(g, 2)), array(take(g, 2))];", "[[0, 1], [2, 3]]" },
+    { count + "let g = count(2); [array(g), array(g)];", "[[0, 1], []]" },
+    { "let g = fn(xs) { for (x in xs) { yield x + 1; } }; array(g(g([1, 2])));", "[3, 4]" },
+    { "let f = fn(x) { [x] }; let g = fn() { yield f(yield 1); }; array(g());", "[1, [null]]" },
+    { "let g = fn() { yield 1; return 5; yield 2; }; array(g());", "[1]" },
+    { "let g = fn() { let k = 10; yield fn(x) { x + k }; }; first(array(g()))(1);", "11" },
+    { "let g = fn() { yield 1; 1 + true }; array(g());", "ERROR: type mismatch: INTEGER + BOOLEAN" },
+    { "let x = 0; let g = fn() { yield array(x); }; x = g(); array(x);", "ERROR: generator is already running" },
+    { "yield 1;", "ERROR: yield outside a generator" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // a generator dropped half way is unwound, its frames released
+  auto depth = frames.depth;
+  auto evaluated = test_eval(naturals + "let f = fn(x) { x }; let g = fn() { yield f(yield 1); }; "
+                             "let i = 0; let total = 0; "
+                             "while (i < 1000) { total = total + first(array(take(g(), 1))) + reduce(take(naturals(), 3), 0, fn(acc, x) { acc + x }); i = i + 1; }; "
+                             "total;");
+  test_integer_object(evaluated, 4000);
+  REQUIRE(frames.depth == depth);
+
+  // a million values stream through without an array of them
+  test_integer_object(test_eval(count + "reduce(count(1000000), 0, fn(acc, x) { acc + x / 1000 });"), 499500000);
+
+  // a body recurses hundreds of calls deep even in an unoptimized build,
+  // and fails past the end of its own stack instead of crashing
+  string down = "let down = fn(n) { if (n == 0) { [] } else { push(down(n - 1), n) } }; "
+    "let g = fn(n) { yield len(down(n)); }; ";
+  test_integer_object(test_eval(down + "first(array(g(400)));"), 400);
+  REQUIRE(inspect(test_eval(down + "array(g(1000000));")) == "ERROR: stack overflow in generator");
+  REQUIRE(frames.depth == depth);
+  test_integer_object(test_eval(down + "first(array(g(10)));"), 10);
+}
+
+TEST_CASE("test sort") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "sort([]);", "[]" },
+    { "sort([\"pear\", \"apple\", \"fig\"]);", "[apple, fig, pear]" },
+    // stable, pairs with equal keys keep their order
+    { "sort([[2, \"b\"], [1, \"c\"], [2, \"a\"]], fn(a, b) { a[0] < b[0] });", "[[1, c], [2, b], [2, a]]" },
+    { "let a = [2, 1]; let b = sort(a); [a, b];", "[[2, 1], [1, 2]]" },
+    { "sort([3, 1, 2], first);", "ERROR: wrong number of arguments. got=2, want=1" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+
+  // radix sorted, the same as std::sort
+  auto evaluated = test_eval("sort(array(lmap(range(0, 100000), fn(x) { x * 7919 - x * 7919 / 100003 * 100003 - 50000 })));");
+  auto values = static_pointer_cast<Array>(evaluated)->values();
+  auto expected = values;
+  std::sort(expected.begin(), expected.end());
+  REQUIRE(values == expected);
+
+  // strings merged from four threads
+  auto threads = builtins::sort_threads;
+  builtins::sort_threads = 4;
+  evaluated = test_eval("let l = [\"q\", \"w\", \"e\", \"r\", \"t\", \"y\", \"u\", \"i\", \"o\", \"p\"]; "
+                        "let d = fn(x, k) { let y = x / k; l[y - y / 10 * 10] }; "
+                        "sort(array(lmap(range(0, 150000), fn(x) { let z = x * 79; d(z, 1) + d(z, 10) + d(z, 1000) + d(z, 100000) })));");
+  builtins::sort_threads = threads;
+  vector<string> strings = static_pointer_cast<Array>(evaluated)->elements() | view::transform([](Rc<Object> obj) {
+      return static_pointer_cast<String>(obj)->value;
+    });
+  REQUIRE(strings.size() == 150000);
+  REQUIRE(std::is_sorted(strings.begin(), strings.end()));
+}
+
+TEST_CASE("test integer array builtins") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "sum([1, 2, 3, 4, 5, 6, 7, 8, 9, 10]);", "55" },
+    { "sum([]);", "0" },
+    { "sum([2147483647, 1]);", "-2147483648" },
+    { "[min([4, -2, 9]), max([4, -2, 9])];", "[-2, 9]" },
+    { "min([]);", "null" },
+    { "dot([1, 2, 3], [4, 5, 6]);", "32" },
+    { "count_eq([1, 2, 1, 1, 3], 1);", "3" },
+    { "prefix_sum([1, 2, 3, 4, 5]);", "[1, 3, 6, 10, 15]" },
+    { "add([1, 2, 3], [10, 20, 30]);", "[11, 22, 33]" },
+    { "mul([1, 2, 3], [10, 20, 30]);", "[10, 40, 90]" },
+    // an array once boxed takes part as long as it only holds integers
+    { "sum(rest([\"a\", 1, 2]));", "3" },
+    { "sum(array(range(0, 1000)));", "499500" },
+    { "max(prefix_sum(array(range(0, 100))));", "4950" },
+    { "sum([1, \"a\"]);", "ERROR: argument to `sum` must only hold INTEGER, got STRING" },
+    { "min(1);", "ERROR: argument to `min` must be ARRAY, got INTEGER" },
+    { "dot([1, 2], [1]);", "ERROR: arguments to `dot` must have the same length, got 2 and 1" },
+    { "add([1]);", "ERROR: wrong number of arguments. got=1, want=2" },
+    { "count_eq([1], \"a\");", "ERROR: argument to `count_eq` must be INTEGER, got STRING" },
+    { "prefix_sum([1], [2]);", "ERROR: wrong number of arguments. got=2, want=1" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      INFO(c.input);
+      REQUIRE(inspect(test_eval(c.input)) == c.expected);
+    });
+}
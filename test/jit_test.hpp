@@ -0,0 +1,89 @@
+#include "catch.hpp"
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+#include "../src/object.hpp"
+#include "../src/eval.hpp"
+#include "../src/jit.hpp"
+#include "../src/tier.hpp"
+#include "./util.hpp"
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace lexer;
+using namespace parser;
+using namespace object;
+using namespace testutil;
+
+// every function compiled on its first call
+auto test_jit(string input) -> Rc<Object> {
+  auto optimize_after = tier::optimize_after;
+  auto native_after = tier::native_after;
+  tier::optimize_after = 1;
+  tier::native_after = 1;
+  auto evaluated = test_eval(input);
+  tier::optimize_after = optimize_after;
+  tier::native_after = native_after;
+  return evaluated;
+}
+
+auto test_no_jit(string input) -> Rc<Object> {
+  jit::enabled = false;
+  auto evaluated = test_eval(input);
+  jit::enabled = true;
+  return evaluated;
+}
+
+TEST_CASE("test jit matches eval") {
+  vector<string> inputs = {
+    "let f = fn(a, b) { (a + b * 2 - 10 / 2) * -a }; f(3, 4);",
+    "let f = fn(a, b) { if (a < b) { a } else { b } }; f(3, 4) + f(7, 2);",
+    "let f = fn(a) { if (!(a > 1) == (a != 1)) { 1 } else { 0 } }; f(1) + f(2);",
+    "let f = fn(a) { let b = a * 2; let c = b + a; c }; f(3);",
+    "let f = fn(a) { if (a > 0) { return a; } -a }; f(-5) + f(5);",
+    "let f = fn(a) { if (a > 0) { return 1; } else { return 2; } }; f(1) + f(0);",
+    "let f = fn(a) { if (a > 0) { 5 }; a }; f(1);",
+    "let f = fn(a) { if (a > 0) { 5 } }; f(1); f(0);",
+    "let f = fn(a) { let b = 1; }; f(1);",
+    "let f = fn(a) { a < 1 }; f(0);",
+    "let f = fn(a) { !a }; f(0);",
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(15);",
+    "let factorial = fn(n) { if (n > 0) { return n * factorial(n - 1); } else { return 1; } }; factorial(10);",
+    "let add = fn(a, b, c) { a + b + c }; let f = fn(n) { add(n, add(1, n, 2), 3) * 2 }; f(4);",
+    "let f = fn(n) { n + 1 }; f(true);",
+    "let f = fn(n) { n + 1 }; f(1, 2);",
+    "let f = fn(n) { g(n) }; f(1);",
+    "let f = fn(n) { len(n) }; f(1);",
+    "let f = fn(n) { \"a\" }; f(1);",
+    "let n = 10; let f = fn(k) { n + k }; f(1);"
+  };
+
+  std::for_each(inputs.cbegin(), inputs.cend(), [](string input) {
+      INFO(input);
+      REQUIRE(inspect(test_jit(input)) == inspect(test_no_jit(input)));
+    });
+}
+
+TEST_CASE("test jit compiles hot functions") {
+  auto compiled = jit::compiled_functions;
+  test_integer_object(test_eval("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(20);"), 6765);
+  REQUIRE(jit::compiled_functions - compiled == 1);
+
+  // cold functions stay with eval
+  compiled = jit::compiled_functions;
+  test_integer_object(test_eval("let f = fn(n) { n * 2 }; f(1) + f(2);"), 6);
+  REQUIRE(jit::compiled_functions == compiled);
+
+  test_integer_object(test_no_jit("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(20);"), 6765);
+  REQUIRE(jit::compiled_functions == compiled);
+}
+
+TEST_CASE("test jit bails out to eval") {
+  auto bailouts = jit::bailouts;
+  // g no longer gives an integer once rebound, f gives up and is run by eval
+  auto evaluated = test_jit("let g = fn(n) { n * 2 }; let f = fn(n) { g(n) + 1 }; f(1); let g = fn(n) { true }; f(1);");
+  REQUIRE(inspect(evaluated) == "ERROR: type mismatch: BOOLEAN + INTEGER");
+  REQUIRE(jit::bailouts - bailouts == 1);
+
+  test_integer_object(test_jit("let g = fn(n) { n * 2 }; let f = fn(n) { g(n) + 1 }; f(1); let g = fn(n) { n * 3 }; f(1);"), 4);
+}
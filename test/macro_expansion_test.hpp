@@ -18,7 +18,7 @@ using namespace parser;
 using namespace eval;
 using namespace macroexpansion;
 
-auto test_parse_program(string input) -> shared_ptr<Program> {
+auto test_parse_program(string input) -> Rc<Program> {
   auto l = Lexer::new_lexer(input);
   auto p = Parser::new_parser(l);
   return p->parse_program();
@@ -32,7 +32,7 @@ TEST_CASE("test define macros") {
     let mymacroTwo = macro(x, y) { x + y; }; \
     ";
 
-  auto env = make_shared<Environment>();
+  auto env = make_rc<Environment>();
   auto program = test_parse_program(input);
 
   define_macros(program, env);
@@ -43,9 +43,9 @@ TEST_CASE("test define macros") {
   REQUIRE(env->get("mymacro") != nullptr);
   REQUIRE(env->get("mymacroTwo") != nullptr);
 
-  vector<shared_ptr<Object>> macros = { env->get("mymacro"), env->get("mymacroTwo") };
+  vector<Rc<Object>> macros = { env->get("mymacro"), env->get("mymacroTwo") };
 
-  std::for_each(macros.cbegin(), macros.cend(), [](shared_ptr<Object> obj) {
+  std::for_each(macros.cbegin(), macros.cend(), [](Rc<Object> obj) {
       REQUIRE(obj->type() == MACRO_OBJ);
       auto macro = static_pointer_cast<Macro>(obj);
       REQUIRE(macro->parameters.size() == 2);
@@ -91,13 +91,20 @@ TEST_CASE("test expand macros") {
       \
 			",
       "if (!(10 > 5)) { puts(\"not greater\") } else { puts(\"greater\") }"
+    },
+    { "\
+      let twice = macro(x) { quote(unquote(x) * 2); }; \
+      \
+      while (twice(i) < 10) { for (x in twice([1])) { twice(x); } } \
+      ",
+      "while ((i * 2) < 10) { for (x in ([1] * 2)) { (x * 2); } }"
     }
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
       auto expected = test_parse_program(c.expected);
       auto program = test_parse_program(c.input);
-      auto env = make_shared<Environment>();
+      auto env = make_rc<Environment>();
       define_macros(program, env);
       auto expanded = expand_macros(program, env);
       REQUIRE(expanded->to_string() == expected->to_string());
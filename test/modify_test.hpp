@@ -12,7 +12,7 @@ using namespace std;
 using namespace ast;
 using namespace modify;
 
-auto turn_one_into_two(shared_ptr<Node> node) -> shared_ptr<Node> {
+auto turn_one_into_two(Rc<Node> node) -> Rc<Node> {
   if (node->type() != NodeType::INTEGERLITERAL) {
     return node;
   }
@@ -28,16 +28,16 @@ auto turn_one_into_two(shared_ptr<Node> node) -> shared_ptr<Node> {
 }
 
 TEST_CASE("test modify") {
-  auto one = [=]() -> shared_ptr<Expression> {
-    return make_shared<IntegerLiteral>(Token({ INT, "1" }), 1);
+  auto one = [=]() -> Rc<Expression> {
+    return make_rc<IntegerLiteral>(Token({ INT, "1" }), 1);
   };
-  auto two = [=]() -> shared_ptr<Expression> {
-    return make_shared<IntegerLiteral>(Token({ INT, "2" }), 2);
+  auto two = [=]() -> Rc<Expression> {
+    return make_rc<IntegerLiteral>(Token({ INT, "2" }), 2);
   };
 
   struct TestCase {
-    shared_ptr<Node> input;
-    shared_ptr<Node> expected;
+    Rc<Node> input;
+    Rc<Node> expected;
   };
 
   Token t1 = { INT, "1" };
@@ -50,46 +50,54 @@ TEST_CASE("test modify") {
 
   vector<TestCase> tests = {
     { one(), two() },
-    { make_shared<Program>(vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t1, one()) })),
-      make_shared<Program>(vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t2, two()) }))
+    { make_rc<Program>(vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t1, one()) })),
+      make_rc<Program>(vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t2, two()) }))
     },
-    { make_shared<InfixExpression>(t1, one(), "+", two()),
-      make_shared<InfixExpression>(t2, two(), "+", two())
+    { make_rc<InfixExpression>(t1, one(), "+", two()),
+      make_rc<InfixExpression>(t2, two(), "+", two())
     },
-    { make_shared<InfixExpression>(t1, two(), "+", one()),
-      make_shared<InfixExpression>(t2, two(), "+", two())
+    { make_rc<InfixExpression>(t1, two(), "+", one()),
+      make_rc<InfixExpression>(t2, two(), "+", two())
     },
-    { make_shared<PrefixExpression>(t1, "-", one()),
-      make_shared<PrefixExpression>(t2, "-", two())
+    { make_rc<PrefixExpression>(t1, "-", one()),
+      make_rc<PrefixExpression>(t2, "-", two())
     },
-    { make_shared<IndexExpression>(t1, one(), one()),
-      make_shared<IndexExpression>(t2, two(), two())
+    { make_rc<IndexExpression>(t1, one(), one()),
+      make_rc<IndexExpression>(t2, two(), two())
     },
-    { make_shared<IfExpression>(t1,
+    { make_rc<IfExpression>(t1,
                                 one(),
-                                make_shared<BlockStatement>(t1, vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t1, one()) })),
-                                make_shared<BlockStatement>(t1, vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t1, one()) }))),
-      make_shared<IfExpression>(t1,
+                                make_rc<BlockStatement>(t1, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t1, one()) })),
+                                make_rc<BlockStatement>(t1, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t1, one()) }))),
+      make_rc<IfExpression>(t1,
                                 two(),
-                                make_shared<BlockStatement>(t2, vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t2, two()) })),
-                                make_shared<BlockStatement>(t2, vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t2, two()) })))
+                                make_rc<BlockStatement>(t2, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t2, two()) })),
+                                make_rc<BlockStatement>(t2, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t2, two()) })))
     },
-    { make_shared<ReturnStatement>(tr, one()),
-      make_shared<ReturnStatement>(tr, two())
+    { make_rc<ReturnStatement>(tr, one()),
+      make_rc<ReturnStatement>(tr, two())
     },
-    { make_shared<LetStatement>(tl, make_shared<Identifier>(t2, "two"), one()),
-      make_shared<LetStatement>(tl, make_shared<Identifier>(t2, "two"), two())
+    { make_rc<LetStatement>(tl, make_rc<Identifier>(t2, "two"), one()),
+      make_rc<LetStatement>(tl, make_rc<Identifier>(t2, "two"), two())
     },
-    { make_shared<FunctionLiteral>(tf, vector<shared_ptr<Identifier>>({}),
-                                   make_shared<BlockStatement>(t1, vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t1, one()) }))),
-      make_shared<FunctionLiteral>(tf, vector<shared_ptr<Identifier>>({}),
-                                   make_shared<BlockStatement>(t2, vector<shared_ptr<Statement>>({ make_shared<ExpressionStatement>(t2, two()) }))) 
+    { make_rc<FunctionLiteral>(tf, vector<Rc<Identifier>>({}),
+                                   make_rc<BlockStatement>(t1, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t1, one()) }))),
+      make_rc<FunctionLiteral>(tf, vector<Rc<Identifier>>({}),
+                                   make_rc<BlockStatement>(t2, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t2, two()) }))) 
     },
-    { make_shared<ArrayLiteral>(ta, vector<shared_ptr<Expression>>({ one(), one() })),
-      make_shared<ArrayLiteral>(ta, vector<shared_ptr<Expression>>({ two(), two() }))
+    { make_rc<WhileStatement>(t1, one(), make_rc<BlockStatement>(t1, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t1, one()) }))),
+      make_rc<WhileStatement>(t2, two(), make_rc<BlockStatement>(t2, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t2, two()) })))
     },
-    { make_shared<HashLiteral>(th, map<shared_ptr<Expression>, shared_ptr<Expression>>({ { one(), one() }, { one(), one() } })),
-      make_shared<HashLiteral>(th, map<shared_ptr<Expression>, shared_ptr<Expression>>({ { two(), two() }, { two(), two() } })),
+    { make_rc<ForStatement>(t1, make_rc<Identifier>(t2, "x"), one(),
+                                make_rc<BlockStatement>(t1, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t1, one()) }))),
+      make_rc<ForStatement>(t2, make_rc<Identifier>(t2, "x"), two(),
+                                make_rc<BlockStatement>(t2, vector<Rc<Statement>>({ make_rc<ExpressionStatement>(t2, two()) })))
+    },
+    { make_rc<ArrayLiteral>(ta, vector<Rc<Expression>>({ one(), one() })),
+      make_rc<ArrayLiteral>(ta, vector<Rc<Expression>>({ two(), two() }))
+    },
+    { make_rc<HashLiteral>(th, map<Rc<Expression>, Rc<Expression>>({ { one(), one() }, { one(), one() } })),
+      make_rc<HashLiteral>(th, map<Rc<Expression>, Rc<Expression>>({ { two(), two() }, { two(), two() } })),
     }
   };
 
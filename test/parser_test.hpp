@@ -29,7 +29,7 @@ auto check_parse_errors(shared_ptr<Parser> p) -> void {
   return;
 }
 
-auto generate_and_check_program(string input) -> shared_ptr<Program> {
+auto generate_and_check_program(string input) -> Rc<Program> {
   auto lexer = Lexer::new_lexer(input);
   auto parser = Parser::new_parser(lexer);
 
@@ -39,22 +39,22 @@ auto generate_and_check_program(string input) -> shared_ptr<Program> {
   return program;
 }
 
-auto test_integer_literal(shared_ptr<Expression> expr, TestVariant value) -> bool {
-  shared_ptr<IntegerLiteral> int_expr = static_pointer_cast<IntegerLiteral>(expr);
+auto test_integer_literal(Rc<Expression> expr, TestVariant value) -> bool {
+  Rc<IntegerLiteral> int_expr = static_pointer_cast<IntegerLiteral>(expr);
   return int_expr->value == value.as_int;
 }
 
-auto test_identifier(shared_ptr<Expression> expr, TestVariant value) -> bool {
-  shared_ptr<Identifier> str_expr = static_pointer_cast<Identifier>(expr);
+auto test_identifier(Rc<Expression> expr, TestVariant value) -> bool {
+  Rc<Identifier> str_expr = static_pointer_cast<Identifier>(expr);
   return str_expr->value == value.as_string;
 }
 
-auto test_boolean_literal(shared_ptr<Expression> expr, TestVariant value) -> bool {
-  shared_ptr<ast::Boolean> bool_expr = static_pointer_cast<ast::Boolean>(expr);
+auto test_boolean_literal(Rc<Expression> expr, TestVariant value) -> bool {
+  Rc<ast::Boolean> bool_expr = static_pointer_cast<ast::Boolean>(expr);
   return bool_expr->value == value.as_bool;
 }
 
-auto test_literal_expression(shared_ptr<Expression> expr, TestVariant expected) -> bool {
+auto test_literal_expression(Rc<Expression> expr, TestVariant expected) -> bool {
   switch (expected.type_id) {
   case TestVariant::t_int:
     return test_integer_literal(expr, expected);
@@ -70,12 +70,13 @@ auto test_literal_expression(shared_ptr<Expression> expr, TestVariant expected)
   }
 }
 
-auto test_infix_expression(shared_ptr<Expression> expression,
+auto test_infix_expression(Rc<Expression> expression,
                            const TestVariant &expected_left,
                            const string &expected_operator,
                            const TestVariant &expected_right) -> void {
-  shared_ptr<InfixExpression> expr = static_pointer_cast<InfixExpression>(expression);
+  Rc<InfixExpression> expr = static_pointer_cast<InfixExpression>(expression);
   REQUIRE(expr->infix_operator == expected_operator);
+  REQUIRE(operator_string(expr->op) == expected_operator);
   REQUIRE(test_literal_expression(expr->left, expected_left));
   REQUIRE(test_literal_expression(expr->right, expected_right));
 }
@@ -110,8 +111,8 @@ TEST_CASE("test parse let statements") {
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
-      shared_ptr<Program> program = generate_and_check_program(c.input);
-      shared_ptr<LetStatement> stmt = static_pointer_cast<LetStatement>(program->statements[0]);
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<LetStatement> stmt = static_pointer_cast<LetStatement>(program->statements[0]);
       REQUIRE(stmt->token_literal() == "let");
       REQUIRE(stmt->name->value == c.expected_identifier);
 
@@ -119,6 +120,31 @@ TEST_CASE("test parse let statements") {
     });
 }
 
+TEST_CASE("test parse assign statements") {
+  struct TestCase {
+    string input;
+    string expected;
+  };
+
+  vector<TestCase> tests = {
+    { "x = 5;", "x = 5;" },
+    { "a[i + 1] = y * 2", "(a[(i + 1)]) = (y * 2);" },
+    { "h[\"k\"][0] = fn(x) { x };", "((h[k])[0]) = fn(x) x;" }
+  };
+
+  std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<AssignStatement> stmt = static_pointer_cast<AssignStatement>(program->statements[0]);
+      REQUIRE(stmt->token_literal() == "=");
+      REQUIRE(stmt->to_string() == c.expected);
+    });
+
+  auto lexer = Lexer::new_lexer("f(x) = 1;");
+  auto parser = Parser::new_parser(lexer);
+  parser->parse_program();
+  REQUIRE(parser->get_errors()[0] == "cannot assign to f(x)");
+}
+
 TEST_CASE("test parse return statements") {
   struct TestCase {
     string input;
@@ -137,8 +163,8 @@ TEST_CASE("test parse return statements") {
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
-      shared_ptr<Program> program = generate_and_check_program(c.input);
-      shared_ptr<ReturnStatement> stmt = static_pointer_cast<ReturnStatement>(program->statements[0]);
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<ReturnStatement> stmt = static_pointer_cast<ReturnStatement>(program->statements[0]);
       REQUIRE(stmt->token_literal() == "return");
 
       REQUIRE(test_literal_expression(stmt->value, c.expected_value));
@@ -165,8 +191,8 @@ TEST_CASE("test parse identifier") {
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
-      shared_ptr<Program> program = generate_and_check_program(c.input);
-      shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
       REQUIRE(test_literal_expression(stmt->expression, c.expected_value));
     });
 }
@@ -195,10 +221,11 @@ TEST_CASE("test parse prefix expression") {
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
-      shared_ptr<Program> program = generate_and_check_program(c.input);
-      shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-      shared_ptr<PrefixExpression> expr = static_pointer_cast<PrefixExpression>(stmt->expression);
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+      Rc<PrefixExpression> expr = static_pointer_cast<PrefixExpression>(stmt->expression);
       REQUIRE(expr->prefix_operator == c.expected_operator);
+      REQUIRE(operator_string(expr->op) == c.expected_operator);
       REQUIRE(test_literal_expression(expr->right, c.expected_value));
     });
 }
@@ -242,8 +269,8 @@ TEST_CASE("test parse infix expression") {
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
-      shared_ptr<Program> program = generate_and_check_program(c.input);
-      shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
       test_infix_expression(stmt->expression, c.expected_left_value, c.expected_operator, c.expected_right_value);
     });
 }
@@ -376,9 +403,9 @@ TEST_CASE("test parse operator precedence") {
 
 TEST_CASE("test parse if expression") {
   auto input = "if (x < y) { x }";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<IfExpression> expr = static_pointer_cast<IfExpression>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<IfExpression> expr = static_pointer_cast<IfExpression>(stmt->expression);
 
   string s_left("x");
   TestVariant v_left = TestVariant(s_left);
@@ -387,7 +414,7 @@ TEST_CASE("test parse if expression") {
   test_infix_expression(expr->condition, v_left, "<", v_right);
 
   REQUIRE(expr->consequence->statements.size() == 1);
-  shared_ptr<ExpressionStatement> cons = static_pointer_cast<ExpressionStatement>(expr->consequence->statements[0]);
+  Rc<ExpressionStatement> cons = static_pointer_cast<ExpressionStatement>(expr->consequence->statements[0]);
   string c("x");
   TestVariant v_c = TestVariant(c);
   REQUIRE(test_identifier(cons->expression, v_c));
@@ -397,9 +424,9 @@ TEST_CASE("test parse if expression") {
 
 TEST_CASE("test parse if else expression") {
   auto input = "if (x < y) { x } else { y }";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<IfExpression> expr = static_pointer_cast<IfExpression>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<IfExpression> expr = static_pointer_cast<IfExpression>(stmt->expression);
 
   string s_left("x");
   TestVariant v_left = TestVariant(s_left);
@@ -408,23 +435,69 @@ TEST_CASE("test parse if else expression") {
   test_infix_expression(expr->condition, v_left, "<", v_right);
 
   REQUIRE(expr->consequence->statements.size() == 1);
-  shared_ptr<ExpressionStatement> cons = static_pointer_cast<ExpressionStatement>(expr->consequence->statements[0]);
+  Rc<ExpressionStatement> cons = static_pointer_cast<ExpressionStatement>(expr->consequence->statements[0]);
   string c("x");
   TestVariant v_c = TestVariant(c);
   REQUIRE(test_identifier(cons->expression, v_c));
 
   REQUIRE(expr->alternative->statements.size() == 1);
-  shared_ptr<ExpressionStatement> alt = static_pointer_cast<ExpressionStatement>(expr->alternative->statements[0]);
+  Rc<ExpressionStatement> alt = static_pointer_cast<ExpressionStatement>(expr->alternative->statements[0]);
   string a("y");
   TestVariant v_a = TestVariant(a);
   REQUIRE(test_identifier(alt->expression, v_a));
 }
 
+TEST_CASE("test parse while statement") {
+  auto input = "while (x < y) { x; };";
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<WhileStatement> stmt = static_pointer_cast<WhileStatement>(program->statements[0]);
+
+  string s_left("x");
+  TestVariant v_left = TestVariant(s_left);
+  string s_right("y");
+  TestVariant v_right = TestVariant(s_right);
+  test_infix_expression(stmt->condition, v_left, "<", v_right);
+
+  REQUIRE(stmt->body->statements.size() == 1);
+  Rc<ExpressionStatement> body = static_pointer_cast<ExpressionStatement>(stmt->body->statements[0]);
+  string b("x");
+  TestVariant v_b = TestVariant(b);
+  REQUIRE(test_identifier(body->expression, v_b));
+}
+
+TEST_CASE("test parse for statement") {
+  auto input = "for (x in [1, 2]) { x }";
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ForStatement> stmt = static_pointer_cast<ForStatement>(program->statements[0]);
+
+  string v("x");
+  TestVariant v_v = TestVariant(v);
+  REQUIRE(test_identifier(stmt->variable, v_v));
+  REQUIRE(stmt->iterable->to_string() == "[1, 2]");
+  REQUIRE(stmt->body->statements.size() == 1);
+  REQUIRE(stmt->to_string() == "for(x in [1, 2]) x");
+
+  auto lexer = Lexer::new_lexer("for (x [1, 2]) { x }");
+  auto parser = Parser::new_parser(lexer);
+  parser->parse_program();
+  REQUIRE(parser->get_errors()[0] == "expected next token to be IN, got [ instead");
+}
+
+TEST_CASE("test parse yield expression") {
+  auto input = "fn() { let x = yield a + 1; f(yield x, 2) }";
+  Rc<Program> program = generate_and_check_program(input);
+  auto func = static_pointer_cast<FunctionLiteral>(static_pointer_cast<ExpressionStatement>(program->statements[0])->expression);
+  auto let = static_pointer_cast<LetStatement>(func->body->statements[0]);
+  REQUIRE(let->value->type() == NodeType::YIELDEXPRESSION);
+  REQUIRE(let->value->to_string() == "(yield (a + 1))");
+  REQUIRE(func->body->statements[1]->to_string() == "f((yield x), 2)");
+}
+
 TEST_CASE("test parse function literal") {
   auto input = "fn(x, y) { x + y; }";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<FunctionLiteral> func = static_pointer_cast<FunctionLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<FunctionLiteral> func = static_pointer_cast<FunctionLiteral>(stmt->expression);
 
   REQUIRE(func->parameters.size() == 2);
 
@@ -436,7 +509,7 @@ TEST_CASE("test parse function literal") {
   REQUIRE(test_literal_expression(func->parameters[1], v_p2));
 
   REQUIRE(func->body->statements.size() == 1);
-  shared_ptr<ExpressionStatement> body_stmt = static_pointer_cast<ExpressionStatement>(func->body->statements[0]);
+  Rc<ExpressionStatement> body_stmt = static_pointer_cast<ExpressionStatement>(func->body->statements[0]);
 
   string s_left("x");
   TestVariant v_left = TestVariant(s_left);
@@ -458,9 +531,9 @@ TEST_CASE("test parse function parameters") {
   };
 
   std::for_each(tests.cbegin(), tests.cend(), [](TestCase c) {
-      shared_ptr<Program> program = generate_and_check_program(c.input);
-      shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-      shared_ptr<FunctionLiteral> func = static_pointer_cast<FunctionLiteral>(stmt->expression);
+      Rc<Program> program = generate_and_check_program(c.input);
+      Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+      Rc<FunctionLiteral> func = static_pointer_cast<FunctionLiteral>(stmt->expression);
       REQUIRE(func->parameters.size() == c.expected_params.size());
 
       for (size_t i = 0; i < c.expected_params.size(); i++) {
@@ -471,9 +544,9 @@ TEST_CASE("test parse function parameters") {
 
 TEST_CASE("test parse call expression") {
   auto input = "add(1, 2 * 3, 4 + 5);";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<CallExpression> expr = static_pointer_cast<CallExpression>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<CallExpression> expr = static_pointer_cast<CallExpression>(stmt->expression);
 
   string f("add");
   TestVariant f_var = TestVariant(f);
@@ -488,25 +561,25 @@ TEST_CASE("test parse call expression") {
 
 TEST_CASE("test parse string literal") {
   auto input = "\"hello world\"";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<StringLiteral> str = static_pointer_cast<StringLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<StringLiteral> str = static_pointer_cast<StringLiteral>(stmt->expression);
   REQUIRE(str->value == "hello world");
 }
 
 TEST_CASE("test parse empty array literal") {
   auto input= "[]";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<ArrayLiteral> array = static_pointer_cast<ArrayLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<ArrayLiteral> array = static_pointer_cast<ArrayLiteral>(stmt->expression);
   REQUIRE(array->elements.size() == 0);
 }
 
 TEST_CASE("test parse array literal") {
   auto input = "[1, 2 * 2, 3 + 3]";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<ArrayLiteral> array = static_pointer_cast<ArrayLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<ArrayLiteral> array = static_pointer_cast<ArrayLiteral>(stmt->expression);
   REQUIRE(array->elements.size() == 3);
   REQUIRE(test_integer_literal(array->elements[0], TestVariant(1)));
   test_infix_expression(array->elements[1], TestVariant(2), "*", TestVariant(2));
@@ -515,9 +588,9 @@ TEST_CASE("test parse array literal") {
 
 TEST_CASE("test parse index expression") {
   auto input = "myArray[1 + 1]";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<IndexExpression> idx = static_pointer_cast<IndexExpression>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<IndexExpression> idx = static_pointer_cast<IndexExpression>(stmt->expression);
   string left("myArray");
   TestVariant v_left(left);
   REQUIRE(test_identifier(idx->left, v_left));
@@ -526,17 +599,17 @@ TEST_CASE("test parse index expression") {
 
 TEST_CASE("test parse empty hash literal") {
   auto input = "{}";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
   REQUIRE(hash->pairs.size() == 0);
 }
 
 TEST_CASE("test parse hash literal string keys") {
   auto input = "{\"one\": 1, \"two\": 2, \"three\": 3}";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
   REQUIRE(hash->pairs.size() == 3);
   map<string, int> expected = {
     { "one", 1 },
@@ -544,8 +617,8 @@ TEST_CASE("test parse hash literal string keys") {
     { "three", 3 }
   };
 
-  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<shared_ptr<Expression>, shared_ptr<Expression>> const &p) {
-      shared_ptr<StringLiteral> key = static_pointer_cast<StringLiteral>(p.first);
+  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<Rc<Expression>, Rc<Expression>> const &p) {
+      Rc<StringLiteral> key = static_pointer_cast<StringLiteral>(p.first);
       int expected_value = expected[key->value];
       test_integer_literal(p.second, TestVariant(expected_value));
     });
@@ -553,17 +626,17 @@ TEST_CASE("test parse hash literal string keys") {
 
 TEST_CASE("test parse hash literal boolean keys") {
   auto input = "{true: 1, false: 2}";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
   REQUIRE(hash->pairs.size() == 2);
   map<string, int> expected = {
     { "true", 1 },
     { "false", 2 }
   };
 
-  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<shared_ptr<Expression>, shared_ptr<Expression>> const &p) {
-      shared_ptr<ast::Boolean> key = static_pointer_cast<ast::Boolean>(p.first);
+  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<Rc<Expression>, Rc<Expression>> const &p) {
+      Rc<ast::Boolean> key = static_pointer_cast<ast::Boolean>(p.first);
       int expected_value = expected[key->to_string()];
       test_integer_literal(p.second, TestVariant(expected_value));
     });
@@ -571,9 +644,9 @@ TEST_CASE("test parse hash literal boolean keys") {
 
 TEST_CASE("test parse hash literal integer keys") {
   auto input = "{1: 1, 2: 2, 3: 3}";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
   REQUIRE(hash->pairs.size() == 3);
   map<string, int> expected = {
     { "1", 1 },
@@ -581,8 +654,8 @@ TEST_CASE("test parse hash literal integer keys") {
     { "3", 3 }
   };
 
-  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<shared_ptr<Expression>, shared_ptr<Expression>> const &p) {
-      shared_ptr<IntegerLiteral> key = static_pointer_cast<IntegerLiteral>(p.first);
+  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<Rc<Expression>, Rc<Expression>> const &p) {
+      Rc<IntegerLiteral> key = static_pointer_cast<IntegerLiteral>(p.first);
       int expected_value = expected[key->to_string()];
       test_integer_literal(p.second, TestVariant(expected_value));
     });
@@ -590,25 +663,25 @@ TEST_CASE("test parse hash literal integer keys") {
 
 TEST_CASE("test parse hash literal with expression") {
   auto input = "{\"one\": 0 + 1, \"two\": 10 - 8, \"three\": 15 / 5}";
-  shared_ptr<Program> program = generate_and_check_program(input);
-  shared_ptr<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
-  shared_ptr<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
+  Rc<Program> program = generate_and_check_program(input);
+  Rc<ExpressionStatement> stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  Rc<HashLiteral> hash = static_pointer_cast<HashLiteral>(stmt->expression);
   REQUIRE(hash->pairs.size() == 3);
 
-  map<string, function<void(shared_ptr<Expression>)>> expected = {
-    { "one", [](shared_ptr<Expression> e) -> void {
+  map<string, function<void(Rc<Expression>)>> expected = {
+    { "one", [](Rc<Expression> e) -> void {
         test_infix_expression(e, TestVariant(0), "+", TestVariant(1));
       } },
-    { "two", [](shared_ptr<Expression> e) -> void {
+    { "two", [](Rc<Expression> e) -> void {
         test_infix_expression(e, TestVariant(10), "-", TestVariant(8));
       } },
-    { "three", [](shared_ptr<Expression> e) -> void {
+    { "three", [](Rc<Expression> e) -> void {
         test_infix_expression(e, TestVariant(15), "/", TestVariant(5));
       } }
   };
 
-  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<shared_ptr<Expression>, shared_ptr<Expression>> const &p) {
-      shared_ptr<StringLiteral> key = static_pointer_cast<StringLiteral>(p.first);
+  std::for_each(hash->pairs.cbegin(), hash->pairs.cend(), [&](pair<Rc<Expression>, Rc<Expression>> const &p) {
+      Rc<StringLiteral> key = static_pointer_cast<StringLiteral>(p.first);
       auto test_func = expected[key->value];
       test_func(p.second);
     });
@@ -616,7 +689,7 @@ TEST_CASE("test parse hash literal with expression") {
 
 TEST_CASE("test parse macro literal") {
   auto input = "macro(x, y) { x + y; }";
-  shared_ptr<Program> program = generate_and_check_program(input);
+  Rc<Program> program = generate_and_check_program(input);
 
   REQUIRE(program->statements.size() == 1);
   REQUIRE(program->statements[0]->type() == NodeType::EXPRESSIONSTATEMENT);
@@ -0,0 +1,47 @@
+#include "catch.hpp"
+#include "../src/pool.hpp"
+#include "../src/object.hpp"
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace object;
+
+auto find_pool_stats(const string &name) -> pool::PoolStats {
+  for (const auto &s : pool::stats()) {
+    if (s.name == name) {
+      return s;
+    }
+  }
+  return { name, 0, 0, 0, 0, 0 };
+}
+
+TEST_CASE("test pooled objects are counted") {
+  auto before = find_pool_stats(type_name(INTEGER_OBJ));
+  {
+    vector<Rc<Object>> ints = {};
+    for (int i = 0; i < 1000; i++) {
+      ints.push_back(make_rc<Integer>(i));
+    }
+
+    auto during = find_pool_stats(type_name(INTEGER_OBJ));
+    REQUIRE(during.allocations - before.allocations == 1000);
+    REQUIRE(during.live() - before.live() == 1000);
+    REQUIRE(during.capacity >= during.live());
+    REQUIRE(static_pointer_cast<Integer>(ints[999])->value == 999);
+  }
+  auto after = find_pool_stats(type_name(INTEGER_OBJ));
+  REQUIRE(after.live() == before.live());
+  REQUIRE(after.frees - before.frees == 1000);
+}
+
+TEST_CASE("test pool reuses freed blocks") {
+  void *first;
+  {
+    auto s = make_rc<String>("pooled");
+    first = s.get();
+  }
+  auto again = make_rc<String>("again");
+  REQUIRE(static_cast<void *>(again.get()) == first);
+  REQUIRE(find_pool_stats(type_name(STRING_OBJ)).object_size >= sizeof(String));
+}
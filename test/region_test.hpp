@@ -0,0 +1,65 @@
+#include "catch.hpp"
+#include "../src/region.hpp"
+#include "../src/object.hpp"
+#include "../src/eval.hpp"
+#include "./util.hpp"
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace object;
+using namespace eval;
+using namespace testutil;
+
+auto test_eval_in_regions(string input) -> Rc<Object> {
+  region::per_statement = true;
+  auto evaluated = test_eval(input);
+  region::per_statement = false;
+  return evaluated;
+}
+
+TEST_CASE("test region allocation") {
+  region::Region r;
+  {
+    region::Scope scope(&r);
+    auto i = make_rc<Integer>(1);
+    REQUIRE(region::owns(i.get()));
+    REQUIRE(r.live() == 1);
+  }
+  REQUIRE(r.live() == 0);
+
+  auto heap = make_rc<Integer>(2);
+  REQUIRE(!region::owns(heap.get()));
+  r.reset();
+}
+
+TEST_CASE("test region evaluation matches heap evaluation") {
+  vector<string> inputs = {
+    "let a = 5; let b = a * 2; b + a;",
+    "let newAdder = fn(x) { fn(y) { x + y }; }; let addTwo = newAdder(2); addTwo(3);",
+    "let arr = [1, 2 * 2, 3]; let more = push(arr, 4); more;",
+    "let h = {\"one\": 1, 2: [2]}; h[2];",
+    "let f = fn(n) { if (n > 0) { return n * f(n - 1); } else { return 1; } }; f(10);",
+    "let counter = fn(n) { let inc = fn(x) { x + 1 }; inc(n) }; counter(1) + counter(2);",
+    "let s = \"a\" + \"b\"; s + s;",
+    "if (true) { let x = [1, 2]; x }",
+    "return [3]; 4;",
+    "5 + true; 5;"
+  };
+
+  std::for_each(inputs.cbegin(), inputs.cend(), [](string input) {
+      auto expected = test_eval(input);
+      auto evaluated = test_eval_in_regions(input);
+      REQUIRE(!region::owns(evaluated.get()));
+      REQUIRE(evaluated == expected);
+    });
+}
+
+TEST_CASE("test region is reset after each statement") {
+  auto &r = statement_region();
+  auto resets = r.resets;
+  auto evaluated = test_eval_in_regions("let f = fn(x) { [x, x + 1] }; let y = f(1); f(2)[1] + y[0];");
+  test_integer_object(evaluated, 4);
+  REQUIRE(r.resets - resets == 3);
+  REQUIRE(r.live() == 0);
+}
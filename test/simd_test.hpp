@@ -0,0 +1,61 @@
+#include "catch.hpp"
+#include "../src/simd.hpp"
+#include <vector>
+#include <limits>
+
+using namespace std;
+
+// values around the edges of int, so sums and products wrap
+auto simd_values(size_t n, uint32_t seed) -> vector<int> {
+  vector<int> values = {};
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    values.push_back(i % 7 == 0 ? numeric_limits<int>::min() + static_cast<int>(i) : static_cast<int>(seed));
+  }
+  return values;
+}
+
+TEST_CASE("test simd kernels match the scalar ones at every level") {
+  auto detected = simd::level;
+  vector<simd::Level> levels = { simd::Level::SCALAR };
+  if (detected != simd::Level::SCALAR) {
+    levels.push_back(simd::Level::SSE4);
+  }
+  if (detected == simd::Level::AVX2) {
+    levels.push_back(simd::Level::AVX2);
+  }
+
+  // every length up to a few vectors, so every tail is covered
+  for (size_t n = 1; n < 40; n++) {
+    INFO(n);
+    auto a = simd_values(n, static_cast<uint32_t>(n));
+    auto b = simd_values(n, static_cast<uint32_t>(n) + 1);
+    a[n / 2] = b[n / 3];
+
+    vector<int> sums(n), expected_sums(n), sum(n), expected_sum(n), product(n), expected_product(n);
+    simd::prefix_sum_scalar(a.data(), expected_sums.data(), n, 0);
+    simd::add_scalar(a.data(), b.data(), expected_sum.data(), n);
+    simd::mul_scalar(a.data(), b.data(), expected_product.data(), n);
+    for (auto level : levels) {
+      simd::level = level;
+      REQUIRE(simd::sum(a.data(), n) == simd::sum_scalar(a.data(), n, 0));
+      REQUIRE(simd::min(a.data(), n) == simd::min_scalar(a.data() + 1, n - 1, a[0]));
+      REQUIRE(simd::max(a.data(), n) == simd::max_scalar(a.data() + 1, n - 1, a[0]));
+      REQUIRE(simd::dot(a.data(), b.data(), n) == simd::dot_scalar(a.data(), b.data(), n, 0));
+      REQUIRE(simd::count_eq(b.data(), n, b[n / 3]) == simd::count_eq_scalar(b.data(), n, b[n / 3]));
+      simd::prefix_sum(a.data(), sums.data(), n);
+      REQUIRE(sums == expected_sums);
+      simd::add(a.data(), b.data(), sum.data(), n);
+      REQUIRE(sum == expected_sum);
+      simd::mul(a.data(), b.data(), product.data(), n);
+      REQUIRE(product == expected_product);
+    }
+  }
+  simd::level = detected;
+
+  vector<int> values = { 3, -1, 4, 1, -5, 9, 2, -6, 5, 3, 5 };
+  REQUIRE(simd::sum(values.data(), values.size()) == 20);
+  REQUIRE(simd::min(values.data(), values.size()) == -6);
+  REQUIRE(simd::max(values.data(), values.size()) == 9);
+  REQUIRE(simd::count_eq(values.data(), values.size(), 5) == 2);
+}
@@ -2,10 +2,20 @@
 #include "catch.hpp"
 
 #include "token_test.hpp"
+#include "rc_test.hpp"
+#include "pool_test.hpp"
+#include "simd_test.hpp"
 #include "lexer_test.hpp"
 #include "ast_test.hpp"
 #include "parser_test.hpp"
 #include "eval_test.hpp"
+#include "region_test.hpp"
 #include "modify_test.hpp"
+#include "analysis_test.hpp"
+#include "vm_test.hpp"
+#include "closure_compiler_test.hpp"
+#include "jit_test.hpp"
+#include "transpiler_test.hpp"
+#include "tier_test.hpp"
 #include "quote_unquote_test.hpp"
 #include "macro_expansion_test.hpp"
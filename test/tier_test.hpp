@@ -0,0 +1,88 @@
+#include "catch.hpp"
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+#include "../src/object.hpp"
+#include "../src/eval.hpp"
+#include "../src/tier.hpp"
+#include "./util.hpp"
+#include <string>
+#include <sstream>
+
+using namespace std;
+using namespace lexer;
+using namespace parser;
+using namespace object;
+using namespace testutil;
+
+// evaluates input with the given tier thresholds, the trace goes to log
+auto eval_tiered(string input, uint32_t optimize_after, uint32_t native_after, ostream *log, Rc<Environment> env) -> Rc<Object> {
+  auto saved = make_pair(tier::optimize_after, tier::native_after);
+  tier::optimize_after = optimize_after;
+  tier::native_after = native_after;
+  tier::log = log;
+  auto evaluated = eval::eval(parse_input(input), env);
+  tier::optimize_after = saved.first;
+  tier::native_after = saved.second;
+  tier::log = nullptr;
+  return evaluated;
+}
+
+auto body_of(const Rc<Environment> &env, const string &name) -> BlockStatement * {
+  return borrow_cast<object::Function>(env->get(name))->body.get();
+}
+
+TEST_CASE("test functions move up the tiers as they get hot") {
+  stringstream log;
+  auto env = make_rc<Environment>();
+  auto evaluated = eval_tiered("let add = fn(a, b) { a + b * (2 * 3) }; let once = fn() { 1 }; once(); add(1, 1); add(1, 2); add(1, 3);", 3, 5, &log, env);
+  test_integer_object(evaluated, 19);
+  REQUIRE(body_of(env, "once")->tier == Tier::WALK);
+  REQUIRE(body_of(env, "add")->tier == Tier::OPTIMIZED);
+  REQUIRE(log.str() == "tier: add optimized after 3 calls\n");
+
+  log.str("");
+  evaluated = eval_tiered("add(1, 4); add(1, 5);", 3, 5, &log, env);
+  test_integer_object(evaluated, 31);
+#ifdef JIT_X86_64
+  REQUIRE(body_of(env, "add")->tier == Tier::NATIVE);
+  REQUIRE(log.str() == "tier: add compiled to native code after 5 calls\n");
+#else
+  REQUIRE(body_of(env, "add")->tier == Tier::OPTIMIZED);
+  REQUIRE(log.str() == "tier: add can't be compiled, stays optimized after 5 calls\n");
+#endif
+
+  // without the jit the optimized tier is the last one
+  log.str("");
+  jit::enabled = false;
+  evaluated = eval_tiered("let sub = fn(a) { a - 1 }; sub(1); sub(2); sub(3);", 1, 2, &log, env);
+  jit::enabled = true;
+  test_integer_object(evaluated, 2);
+  REQUIRE(body_of(env, "sub")->tier == Tier::OPTIMIZED);
+  REQUIRE(log.str() == "tier: sub optimized after 1 calls\n");
+}
+
+TEST_CASE("test optimized tier folds constants and resolves parameters") {
+  auto env = make_rc<Environment>();
+  string input = "let f = fn(x, y) { if (x) { y + -(2 * 3) } else { 1 / 0 + true } }; f(true, 10);";
+  test_integer_object(eval_tiered(input, 1, 1000, nullptr, env), 4);
+
+  auto body = body_of(env, "f");
+  REQUIRE(body->tier == Tier::OPTIMIZED);
+  auto if_expr = borrow_cast<IfExpression>(borrow_cast<ExpressionStatement>(body->statements[0])->expression);
+  auto sum = borrow_cast<InfixExpression>(borrow_cast<ExpressionStatement>(if_expr->consequence->statements[0])->expression);
+  REQUIRE(sum->constant == nullptr);
+  REQUIRE(borrow_cast<PrefixExpression>(sum->right)->constant != nullptr);
+  REQUIRE(borrow_cast<Identifier>(sum->left)->parameter != nullptr);
+  REQUIRE(borrow_cast<Identifier>(sum->left)->slot == 1);
+
+  // neither the division by zero nor the mismatch are folded away
+  auto failed = borrow_cast<InfixExpression>(borrow_cast<ExpressionStatement>(if_expr->alternative->statements[0])->expression);
+  REQUIRE(failed->constant == nullptr);
+  REQUIRE(borrow_cast<InfixExpression>(failed->left)->constant == nullptr);
+
+  test_integer_object(eval_tiered("f(true, 7);", 1, 1000, nullptr, env), 1);
+  // an assigned parameter is read back from its slot
+  test_integer_object(eval_tiered("let inc = fn(n) { n = n + 1; n * 10 }; inc(1) + inc(2);", 1, 1000, nullptr, env), 50);
+  // a closure over the same literal reads its own parameters
+  test_integer_object(eval_tiered("let g = fn(y) { fn(x) { x + y } }; let h = g(1); h(5) + h(6) + g(2)(7);", 1, 1000, nullptr, env), 22);
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Compiles each script with `lc3 compile` and the system compiler, the
+# binary has to print what the interpreter prints.
+#   test/transpile.sh path/to/lc3 c++ [compiler flags...]
+set -e
+
+cd "$(dirname "$0")/.."
+LC3=$1
+CXX=$2
+shift 2
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+status=0
+for script in test/transpile/*.lc3 bench/*.lc3; do
+  name=$(basename "$script" .lc3)
+  "$LC3" compile "$script" -o "$WORK/$name.cc"
+  "$CXX" -std=c++14 -O1 -pthread -Isrc "$@" "$WORK/$name.cc" -o "$WORK/$name"
+  if diff <("$LC3" "$script") <("$WORK/$name") > "$WORK/$name.diff"; then
+    echo "ok   $script"
+  else
+    echo "FAIL $script"
+    cat "$WORK/$name.diff"
+    status=1
+  fi
+done
+exit $status
@@ -0,0 +1,55 @@
+#include "catch.hpp"
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+#include "../src/transpiler.hpp"
+#include <string>
+
+using namespace std;
+using namespace lexer;
+using namespace parser;
+
+auto transpile_input(const string &input) -> string {
+  auto program = Parser::new_parser(Lexer::new_lexer(input))->parse_program();
+  return transpiler::transpile(program.get(), "test.lc3");
+}
+
+auto contains(const string &code, const string &part) -> bool {
+  return code.find(part) != string::npos;
+}
+
+TEST_CASE("test transpile known functions to direct calls") {
+  auto code = transpile_input("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(10);");
+  INFO(code);
+  REQUIRE(contains(code, "int i_fib(int v_n) {"));
+  REQUIRE(contains(code, " = (i_fib((v_n - 1)) + i_fib((v_n - 2)));"));
+  REQUIRE(contains(code, "Rc<Object> f_fib(Rc<Object> a_n) {"));
+  REQUIRE(contains(code, "return make_rc<Integer>(i_fib(borrow_cast<Integer>(a_n)->value));"));
+  REQUIRE(contains(code, "= f_fib(k"));
+
+  // strings aren't integers, len is called through its object
+  code = transpile_input("let f = fn(s) { len(s) + 1 }; f(\"a\");");
+  INFO(code);
+  REQUIRE(!contains(code, "i_f("));
+  REQUIRE(contains(code, "call(b_len, {v_s})"));
+
+  // rebound names are called through their objects
+  code = transpile_input("let f = fn(n) { n }; let f = fn(n) { n + 1 }; f(1);");
+  INFO(code);
+  REQUIRE(!contains(code, "f_f("));
+  REQUIRE(contains(code, "call("));
+}
+
+TEST_CASE("test transpile closures to cells") {
+  auto code = transpile_input("let adder = fn(x) { fn(y) { x + y } }; adder(1)(2);");
+  INFO(code);
+  REQUIRE(contains(code, "auto c1_x = make_rc<Cell>();"));
+  REQUIRE(contains(code, "[c1_x](const vector<Rc<Object>> &args) -> Rc<Object> {"));
+  REQUIRE(contains(code, "eval_infix_expression(Operator::PLUS, c1_x->value, v_y)"));
+}
+
+TEST_CASE("test transpile rejects quote, loops, assignment and yield") {
+  REQUIRE_THROWS_AS(transpile_input("quote(1 + 2)"), transpiler::Unsupported);
+  REQUIRE_THROWS_AS(transpile_input("let i = 0; while (i < 3) { let i = i + 1; }"), transpiler::Unsupported);
+  REQUIRE_THROWS_AS(transpile_input("let f = fn(a) { a[0] = 1; a }; f([0]);"), transpiler::Unsupported);
+  REQUIRE_THROWS_AS(transpile_input("let f = fn(a) { yield a; }; f(1);"), transpiler::Unsupported);
+}
@@ -3,6 +3,8 @@
 #include "../src/lexer.hpp"
 #include "../src/parser.hpp"
 #include "../src/eval.hpp"
+#include "../src/closure_compiler.hpp"
+#include "catch.hpp"
 #include <iostream>
 #include <memory>
 #include <map>
@@ -15,15 +17,35 @@ using namespace parser;
 using namespace eval;
 
 namespace testutil {
-  auto test_eval(string input) -> shared_ptr<Object> {
+  auto parse_input(string input) -> Rc<Program> {
     auto lexer = Lexer::new_lexer(input);
     auto parser = Parser::new_parser(lexer);
-    auto program = parser->parse_program();
-    auto env = make_shared<Environment>();
+    return parser->parse_program();
+  }
+
+  auto eval_input(string input) -> Rc<Object> {
+    auto program = parse_input(input);
+    auto env = make_rc<Environment>();
 
     return eval::eval(program, env);
   }
 
+  auto inspect(const Rc<Object> &obj) -> string {
+    return obj == nullptr ? "nothing" : obj->inspect();
+  }
+
+  // evaluates input with eval, the other engines have to agree on the
+  // result
+  auto test_eval(string input) -> Rc<Object> {
+    auto evaluated = eval_input(input);
+
+    auto closure_compiled = closurecompiler::run(parse_input(input).get(), make_rc<Environment>());
+    INFO(input);
+    REQUIRE(inspect(closure_compiled) == inspect(evaluated));
+
+    return evaluated;
+  }
+
   struct TestVariant {
     enum { t_string, t_int, t_bool } type_id;
     union {
@@ -0,0 +1,106 @@
+#include "catch.hpp"
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+#include "../src/object.hpp"
+#include "../src/eval.hpp"
+#include "../src/compiler.hpp"
+#include "../src/vm.hpp"
+#include "./util.hpp"
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace lexer;
+using namespace parser;
+using namespace object;
+using namespace testutil;
+
+auto test_vm(string input) -> Rc<Object> {
+  auto program = Parser::new_parser(Lexer::new_lexer(input))->parse_program();
+  auto env = make_rc<Environment>();
+
+  return vm::run(program.get(), env);
+}
+
+TEST_CASE("test vm matches eval") {
+  vector<string> inputs = {
+    "5; -5; 5 + 5 * 2 - 10 / 2; (5 + 10 * 2 + 15 / 3) * 2 + -10",
+    "1 < 2; 1 > 2; 1 == 1; 1 != 1; true == true; true != false; (1 < 2) == true",
+    "!true; !!5; !false",
+    "if (1 < 2) { 10 } else { 20 }",
+    "if (false) { 10 }",
+    "if (true) { }",
+    "if (10 > 1) { if (10 > 1) { return 10; } return 1; }",
+    "let a = 5; let b = a; let c = a + b + 5; c;",
+    "let identity = fn(x) { x; }; identity(5);",
+    "let double = fn(x) { x * 2; }; double(5);",
+    "let add = fn(x, y) { x + y; }; add(5 + 5, add(5, 5));",
+    "fn(x) { x; }(5)",
+    "let f = fn(a) { let b = a * 2; let c = b + a; c }; f(3);",
+    "let f = fn(a) { let a = a + 1; a }; f(3);",
+    "let x = 10; let f = fn() { let y = x; let x = 2; y + x }; f();",
+    "let f = fn(c) { if (c) { let v = 1; }; v }; f(true);",
+    "let f = fn(c) { if (c) { let v = 1; }; v }; f(false);",
+    "let f = fn(x) { x + if (true) { let x = 5; x } else { 0 } }; f(1);",
+    "let newAdder = fn(x) { fn(y) { x + y }; }; let addTwo = newAdder(2); addTwo(2);",
+    "let f = fn(a) { fn(b) { fn(c) { a + b + c } } }; f(1)(2)(3);",
+    "let f = fn(n) { let g = fn(k) { if (k > 0) { g(k - 1) } else { n } }; g(2) }; f(7);",
+    "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(15);",
+    "let factorial = fn(n) { if (n > 0) { return n * factorial(n - 1); } else { return 1; } }; factorial(10);",
+    "\"Hello\" + \" \" + \"World!\"",
+    "len(\"four\"); len([1, 2, 3]); first([1, 2]); last([1, 2]); rest([1, 2, 3]); push([1], 2)",
+    "let k = 3; map([1, 2], fn(x) { x * k }); reduce(filter([1, 2, 3], fn(x) { x > 1 }), 0, fn(acc, x) { acc + x })",
+    "let g = fn(n) { yield n; yield n * 2; }; array(lmap(g(3), fn(x) { x + 1 }))",
+    "[1, 2 * 2, 3 + 3][1]; [1, 2, 3][3]; [1, 2, 3][-1]",
+    "let two = \"two\"; {\"one\": 10 - 9, two: 1 + 1, \"thr\" + \"ee\": 6 / 2, 4: 4, true: 5, false: 6}",
+    "{\"foo\": 5}[\"foo\"]; {\"foo\": 5}[\"bar\"]; {5: 5}[5]; {true: 5}[true]",
+    "5 + true;",
+    "5 + true; 5;",
+    "-true",
+    "if (10 > 1) { true + false; }",
+    "let f = fn() { true + false; 1 }; f() + 1;",
+    "foobar",
+    "\"Hello\" - \"World\"",
+    "{\"name\": \"Monkey\"}[fn(x) { x }];",
+    "{fn(x) { x }: 1};",
+    "len(1)",
+    "5(1)",
+    "let q = fn(x) { quote(x + unquote(x)) }; q(8);",
+    "let x = 1; quote(unquote(x) + 2);",
+    "return 7; 8;"
+  };
+
+  std::for_each(inputs.cbegin(), inputs.cend(), [](string input) {
+      INFO(input);
+      REQUIRE(inspect(test_vm(input)) == inspect(test_eval(input)));
+    });
+}
+
+TEST_CASE("test compile infix to three address code") {
+  auto program = Parser::new_parser(Lexer::new_lexer("fn(n) { n * factorial(n - 1) }"))->parse_program();
+  analysis::resolve_closures(program.get());
+  auto stmt = static_pointer_cast<ExpressionStatement>(program->statements[0]);
+  auto func = static_pointer_cast<FunctionLiteral>(stmt->expression);
+  auto code = compiler::Compiler::compile_function(func->parameters, func->body.get());
+
+  REQUIRE(code != nullptr);
+  REQUIRE(code->to_string() ==
+          "0000 GET_NAME 2 0 0\n"
+          "0001 SUB_K 3 0 0\n"
+          "0002 CALL 1 2 1\n"
+          "0003 MUL 1 0 1\n"
+          "0004 RETURN 1 0 0\n");
+  REQUIRE(code->registers == 4);
+  REQUIRE(code->parameters == 1);
+}
+
+TEST_CASE("test vm falls back to eval") {
+  auto fallbacks = vm::machine().fallbacks;
+  // the inner literal closes over the whole environment, the body of f
+  // can't be compiled
+  test_integer_object(test_vm("let f = fn(n) { let g = fn(k) { if (k > 0) { g(k - 1) } else { n } }; g(2) }; f(7);"), 7);
+  REQUIRE(vm::machine().fallbacks - fallbacks == 1);
+
+  // calls don't grow the C++ stack
+  test_integer_object(test_vm("let count = fn(n) { if (n == 0) { 0 } else { 1 + count(n - 1) } }; count(20000);"), 20000);
+}